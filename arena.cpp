@@ -0,0 +1,21 @@
+#include "arena.hh"
+
+void *Arena::allocate(size_t size, size_t align) {
+  if (size > BLOCK_SIZE / 4) {
+    large_.push_back(std::make_unique<std::byte[]>(size));
+    return large_.back().get();
+  }
+  if (block_ < blocks_.size()) {
+    const size_t offset = (used_ + align - 1) / align * align;
+    if (offset + size <= BLOCK_SIZE) {
+      used_ = offset + size;
+      return blocks_[block_].get() + offset;
+    }
+    ++block_;
+  }
+  if (block_ == blocks_.size()) {
+    blocks_.push_back(std::make_unique<std::byte[]>(BLOCK_SIZE));
+  }
+  used_ = size;
+  return blocks_[block_].get();
+}
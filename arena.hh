@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator. Nothing is freed on its own, clear() frees it all at
+//   once and keeps the blocks for the next round. Destructors of what
+//   is allocated are not run.
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena &other) = delete;
+  Arena &operator=(const Arena &other) = delete;
+
+  void *allocate(size_t size, size_t align);
+
+  void clear() {
+    block_ = 0;
+    used_ = 0;
+    large_.clear();
+  }
+
+private:
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+  std::vector<std::unique_ptr<std::byte[]>> blocks_;
+  // Block being filled and bytes used in it.
+  size_t block_ = 0;
+  size_t used_ = 0;
+  // Allocations larger than a quarter of a block.
+  std::vector<std::unique_ptr<std::byte[]>> large_;
+};
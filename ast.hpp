@@ -3,6 +3,7 @@
 #include <const_expr.hpp>
 #include <decl.hpp>
 #include <expr.hpp>
+#include <ident.hpp>
 #include <stmt.hpp>
 
 #include <string>
@@ -17,11 +18,11 @@ public:
   ProgramModule &operator=(ProgramModule &&other) = default;
 
 public:
-  ProgramModule(std::string program_name, Block block)
+  ProgramModule(Ident program_name, Block block)
       : program_name_(program_name), block_(std::move(block)) {}
 
 public:
-  std::string program_name_;
+  Ident program_name_;
   Block block_;
 };
 
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <arena.hh>
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pas {
+namespace ast {
+
+// AST nodes live in the arena of their translation unit: the driver
+//   makes it current from scan_begin() to scan_end(), make() and List
+//   allocate from the current arena. The tree is dropped with the
+//   arena, no destructor runs over it, so freeing doesn't depend on its
+//   size or depth.
+// Outside of an arena a List falls back to the heap, nodes can't be
+//   made there.
+inline thread_local Arena *current_arena = nullptr;
+
+// Pointer to a node, it has the node to itself as unique_ptr would, but
+//   the node is freed with the arena, not by the pointer.
+template <typename T> class NodePtr {
+public:
+  NodePtr() = default;
+  explicit NodePtr(T *node) : node_(node) {}
+  NodePtr(NodePtr &&other) noexcept
+      : node_(std::exchange(other.node_, nullptr)) {}
+  NodePtr &operator=(NodePtr &&other) noexcept {
+    node_ = std::exchange(other.node_, nullptr);
+    return *this;
+  }
+
+  NodePtr(const NodePtr &other) = delete;
+  NodePtr &operator=(const NodePtr &other) = delete;
+
+public:
+  T *get() const { return node_; }
+  T &operator*() const { return *node_; }
+  T *operator->() const { return node_; }
+  explicit operator bool() const { return node_ != nullptr; }
+
+private:
+  T *node_ = nullptr;
+};
+
+template <typename T, typename... Args> NodePtr<T> make(Args &&...args) {
+  assert(current_arena != nullptr);
+  void *memory = current_arena->allocate(sizeof(T), alignof(T));
+  return NodePtr<T>(new (memory) T(std::forward<Args>(args)...));
+}
+
+// Allocator of the arena current when it was made. Moving a List takes
+//   its allocator along, so lists built anywhere during the parse stay
+//   in the arena.
+template <typename T> class ArenaAllocator {
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator() : arena_(current_arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}
+
+  T *allocate(size_t count) {
+    if (arena_ == nullptr) {
+      return std::allocator<T>().allocate(count);
+    }
+    return static_cast<T *>(arena_->allocate(count * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *items, size_t count) {
+    if (arena_ == nullptr) {
+      std::allocator<T>().deallocate(items, count);
+    }
+  }
+
+  Arena *arena() const { return arena_; }
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &other) const {
+    return arena_ == other.arena();
+  }
+
+private:
+  Arena *arena_;
+};
+
+template <typename T> using List = std::vector<T, ArenaAllocator<T>>;
+
+} // namespace ast
+} // namespace pas
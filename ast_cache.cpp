@@ -0,0 +1,588 @@
+#include "ast_cache.hh"
+
+#include "exceptions.hh"
+#include "source_file.hh"
+#include "symbol_table.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char MAGIC[8] = {'M', 'C', 'C', 'A', 'S', 'T', '\r', '\n'};
+constexpr uint32_t FORMAT_VERSION = 1;
+constexpr uint32_t SHARE_EXPRS = 1;
+
+enum Section : uint32_t {
+  Exprs,
+  ExprHashes,
+  Stmts,
+  Decls,
+  Types,
+  Blocks,
+  Children,
+  // Bytes of all spellings and literals, Spans cut them into strings.
+  Strings,
+  // Spelling of each symbol id of the saving process, from 0 up.
+  Symbols,
+  // Bytes of each literal, from id 0 up.
+  Literals,
+  SECTION_COUNT
+};
+
+struct SectionRef {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct EntryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t key;
+  uint32_t program_name;
+  uint32_t program_block;
+  SectionRef sections[SECTION_COUNT];
+};
+
+struct Span {
+  uint32_t offset;
+  uint32_t size;
+};
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+class EntryWriter {
+public:
+  Span string(std::string_view text) {
+    const Span span{static_cast<uint32_t>(strings_.size()),
+                    static_cast<uint32_t>(text.size())};
+    strings_.append(text);
+    return span;
+  }
+
+  template <typename T>
+  void section(Section section, std::span<const T> data) {
+    sections_[section].assign(reinterpret_cast<const char *>(data.data()),
+                              data.size_bytes());
+  }
+
+  // Header and sections, each section aligned to 8 bytes.
+  std::string finish(EntryHeader header) {
+    section(Strings, std::span<const char>(strings_));
+    std::string image(sizeof(header), '\0');
+    for (uint32_t i = 0; i < SECTION_COUNT; ++i) {
+      image.resize((image.size() + 7) / 8 * 8, '\0');
+      header.sections[i] = SectionRef{image.size(), sections_[i].size()};
+      image.append(sections_[i]);
+    }
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+  }
+
+private:
+  std::string strings_;
+  std::string sections_[SECTION_COUNT];
+};
+
+class EntryReader {
+public:
+  explicit EntryReader(const SourceFile &image) : image_(image) {}
+
+  // False unless the entry is of this format and key.
+  bool header(uint64_t key) {
+    if (image_.size() < sizeof(EntryHeader)) {
+      return false;
+    }
+    std::memcpy(&header_, image_.data(), sizeof(header_));
+    return std::memcmp(header_.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+           header_.version == FORMAT_VERSION && header_.key == key;
+  }
+  const EntryHeader &header() const { return header_; }
+
+  // False if the section is out of the file.
+  template <typename T>
+  bool section(Section section, std::span<const T> &data) const {
+    const SectionRef ref = header_.sections[section];
+    const uintptr_t address =
+        reinterpret_cast<uintptr_t>(image_.data()) + ref.offset;
+    if (address % alignof(T) != 0 || ref.size % sizeof(T) != 0 ||
+        ref.offset > image_.size() || ref.size > image_.size() - ref.offset) {
+      return false;
+    }
+    data = std::span<const T>(reinterpret_cast<const T *>(address),
+                              ref.size / sizeof(T));
+    return true;
+  }
+
+private:
+  const SourceFile &image_;
+  EntryHeader header_;
+};
+
+// Checks every index a mapped entry holds before the tree is used:
+//   child lists are in the side array, children are in their arrays and
+//   of the kinds their parents take, symbols and literals are in the
+//   entry's tables, operators are of their enums. A child expr, stmt or
+//   type comes before its parent and a subprogram's block before the
+//   block declaring it, as the tree is built, so a damaged entry can't
+//   make a walk go round in circles.
+class EntryChecker {
+public:
+  EntryChecker(std::span<const pas::flat::Expr> exprs,
+               std::span<const pas::flat::Stmt> stmts,
+               std::span<const pas::flat::Decl> decls,
+               std::span<const pas::flat::Type> types,
+               std::span<const pas::flat::Block> blocks,
+               std::span<const uint32_t> children, size_t symbol_count,
+               size_t literal_count)
+      : exprs_(exprs), stmts_(stmts), decls_(decls), types_(types),
+        blocks_(blocks), children_(children), symbol_count_(symbol_count),
+        literal_count_(literal_count) {}
+
+  bool valid() const {
+    for (size_t id = 0; id < exprs_.size(); ++id) {
+      if (!ValidExpr(id)) {
+        return false;
+      }
+    }
+    for (size_t id = 0; id < stmts_.size(); ++id) {
+      if (!ValidStmt(id)) {
+        return false;
+      }
+    }
+    for (size_t id = 0; id < types_.size(); ++id) {
+      if (!ValidType(id)) {
+        return false;
+      }
+    }
+    for (size_t id = 0; id < decls_.size(); ++id) {
+      if (!ValidDecl(id)) {
+        return false;
+      }
+    }
+    for (size_t id = 0; id < blocks_.size(); ++id) {
+      if (!ValidBlock(id)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  using ExprKind = pas::flat::ExprKind;
+  using StmtKind = pas::flat::StmtKind;
+  using DeclKind = pas::flat::DeclKind;
+  using TypeKind = pas::flat::TypeKind;
+  using List = std::span<const uint32_t>;
+
+  bool Symbol(uint32_t id) const { return id < symbol_count_; }
+  bool Symbols(List list) const {
+    return std::all_of(list.begin(), list.end(),
+                       [this](uint32_t id) { return Symbol(id); });
+  }
+
+  // The children of range, nullopt if it's out of the side array.
+  std::optional<List> Children(pas::flat::Range range) const {
+    if (range.first > children_.size() ||
+        range.size > children_.size() - range.first) {
+      return std::nullopt;
+    }
+    return children_.subspan(range.first, range.size);
+  }
+
+  // Ids below limit of nodes whose kind is, or is not, an item kind:
+  //   a Designator's Field, Deref or Index, a Case's CaseArm, a Record's
+  //   Field, a subprogram's Param.
+  template <typename Node>
+  static bool Kinds(std::span<const Node> nodes, List list, size_t limit,
+                    bool items) {
+    return std::all_of(list.begin(), list.end(), [&](uint32_t id) {
+      return id < limit && IsItem(nodes[id].kind) == items;
+    });
+  }
+  static bool IsItem(ExprKind kind) {
+    return kind == ExprKind::Field || kind == ExprKind::Deref ||
+           kind == ExprKind::Index;
+  }
+  static bool IsItem(StmtKind kind) { return kind == StmtKind::CaseArm; }
+  static bool IsItem(TypeKind kind) { return kind == TypeKind::Field; }
+  static bool IsItem(DeclKind kind) { return kind == DeclKind::Param; }
+
+  bool Exprs(List list, size_t limit) const {
+    return Kinds(exprs_, list, limit, false);
+  }
+  bool Exprs(List list) const { return Exprs(list, exprs_.size()); }
+  bool Stmts(List list, size_t limit) const {
+    return Kinds(stmts_, list, limit, false);
+  }
+  bool Type(uint32_t id, size_t limit) const {
+    return Kinds(types_, List(&id, 1), limit, false);
+  }
+
+  // Operands of a Sum or a Product: exprs before id at even positions,
+  //   operators up to max_op between them.
+  bool Operands(List list, size_t id, uint32_t max_op) const {
+    if (list.size() % 2 == 0) {
+      return false;
+    }
+    for (size_t i = 0; i < list.size(); ++i) {
+      if (i % 2 == 0 ? !Exprs(list.subspan(i, 1), id) : list[i] > max_op) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool ValidExpr(size_t id) const {
+    const pas::flat::Expr &expr = exprs_[id];
+    const std::optional<List> list = Children(expr.children);
+    if (!list.has_value()) {
+      return false;
+    }
+    switch (expr.kind) {
+    case ExprKind::Number:
+    case ExprKind::Bool:
+    case ExprKind::Nil:
+    case ExprKind::Deref:
+      return list->empty();
+    case ExprKind::String:
+      return expr.value < literal_count_ && list->empty();
+    case ExprKind::Designator:
+      return Symbol(expr.value) && Kinds(exprs_, *list, id, true);
+    case ExprKind::Field:
+      return Symbol(expr.value) && list->empty();
+    case ExprKind::Index:
+      return Exprs(*list, id);
+    case ExprKind::Relation:
+      return expr.op <= static_cast<uint8_t>(pas::ast::RelOp::In) &&
+             list->size() == 2 && Exprs(*list, id);
+    case ExprKind::Sum:
+      return expr.op <= static_cast<uint8_t>(pas::ast::UnaryOp::Minus) + 1 &&
+             Operands(*list, id, static_cast<uint32_t>(pas::ast::AddOp::Or));
+    case ExprKind::Product:
+      return Operands(*list, id, static_cast<uint32_t>(pas::ast::MultOp::And));
+    case ExprKind::Not:
+      return list->size() == 1 && Exprs(*list, id);
+    case ExprKind::Call:
+      return Symbol(expr.value) && Exprs(*list, id);
+    }
+    return false;
+  }
+
+  bool ValidStmt(size_t id) const {
+    const pas::flat::Stmt &stmt = stmts_[id];
+    const std::optional<List> list = Children(stmt.children);
+    if (!list.has_value()) {
+      return false;
+    }
+    // The first children are exprs, the rest stmts.
+    auto split = [&](size_t expr_count) {
+      return list->size() >= expr_count &&
+             Exprs(list->first(expr_count)) &&
+             Stmts(list->subspan(expr_count), id);
+    };
+    switch (stmt.kind) {
+    case StmtKind::Assignment:
+      return list->size() == 2 && split(2) &&
+             exprs_[(*list)[0]].kind == ExprKind::Designator;
+    case StmtKind::ProcCall:
+      return Symbol(stmt.value) && split(list->size());
+    case StmtKind::If:
+      return (list->size() == 2 || list->size() == 3) && split(1);
+    case StmtKind::Case:
+      return !list->empty() && Exprs(list->first(1)) &&
+             Kinds(stmts_, list->subspan(1), id, true);
+    case StmtKind::CaseArm:
+      return !list->empty() && Stmts(list->first(1), id) &&
+             Exprs(list->subspan(1));
+    case StmtKind::While:
+      return list->size() == 2 && split(1);
+    case StmtKind::Repeat:
+      return split(1);
+    case StmtKind::For:
+      return stmt.op <= static_cast<uint8_t>(pas::ast::WhichWay::DownTo) &&
+             Symbol(stmt.value) && list->size() == 3 && split(2);
+    case StmtKind::Memory:
+      return stmt.op <= static_cast<uint8_t>(pas::ast::MemoryStmt::Kind::New) &&
+             Symbol(stmt.value) && list->empty();
+    case StmtKind::Seq:
+      return split(0);
+    case StmtKind::Empty:
+      return list->empty();
+    }
+    return false;
+  }
+
+  bool ValidType(size_t id) const {
+    const pas::flat::Type &type = types_[id];
+    const std::optional<List> list = Children(type.children);
+    if (!list.has_value()) {
+      return false;
+    }
+    switch (type.kind) {
+    case TypeKind::Named:
+    case TypeKind::Pointer:
+      return Symbol(type.value) && list->empty();
+    case TypeKind::Set:
+      return list->size() == 2 && Exprs(*list);
+    case TypeKind::Array:
+      return Type(type.value, id) && list->size() % 2 == 0 && Exprs(*list);
+    case TypeKind::Record:
+      return Kinds(types_, *list, id, true);
+    case TypeKind::Field:
+      return Type(type.value, id) && Symbols(*list);
+    }
+    return false;
+  }
+
+  bool ValidDecl(size_t id) const {
+    const pas::flat::Decl &decl = decls_[id];
+    const std::optional<List> list = Children(decl.children);
+    if (!list.has_value()) {
+      return false;
+    }
+    // The block, the return type name for a function, then parameters.
+    auto subprogram = [&](size_t first) {
+      return list->size() >= first && (*list)[0] < blocks_.size() &&
+             Kinds(decls_, list->subspan(first), id, true);
+    };
+    switch (decl.kind) {
+    case DeclKind::Const:
+      return Symbol(decl.value) && list->size() == 1 && Exprs(*list);
+    case DeclKind::Type:
+      return Symbol(decl.value) && list->size() == 1 &&
+             Type((*list)[0], types_.size());
+    case DeclKind::Var:
+      return Type(decl.value, types_.size()) && Symbols(*list);
+    case DeclKind::Proc:
+      return Symbol(decl.value) && subprogram(1);
+    case DeclKind::Func:
+      return Symbol(decl.value) && subprogram(2) && Symbol((*list)[1]);
+    case DeclKind::Param:
+      return Symbol(decl.value) && Symbols(*list);
+    }
+    return false;
+  }
+
+  bool ValidBlock(size_t id) const {
+    const pas::flat::Block &block = blocks_[id];
+    const std::optional<List> decls = Children(block.decls);
+    const std::optional<List> stmts = Children(block.stmts);
+    if (!decls.has_value() || !stmts.has_value() ||
+        !Kinds(decls_, *decls, decls_.size(), false) ||
+        !Stmts(*stmts, stmts_.size())) {
+      return false;
+    }
+    return std::all_of(decls->begin(), decls->end(), [&](uint32_t decl) {
+      const pas::flat::Decl &node = decls_[decl];
+      const bool subprogram =
+          node.kind == DeclKind::Proc || node.kind == DeclKind::Func;
+      return !subprogram || children_[node.children.first] < id;
+    });
+  }
+
+private:
+  std::span<const pas::flat::Expr> exprs_;
+  std::span<const pas::flat::Stmt> stmts_;
+  std::span<const pas::flat::Decl> decls_;
+  std::span<const pas::flat::Type> types_;
+  std::span<const pas::flat::Block> blocks_;
+  std::span<const uint32_t> children_;
+  size_t symbol_count_;
+  size_t literal_count_;
+};
+
+} // namespace
+
+AstCache::AstCache(std::string dir) : dir_(std::move(dir)) {
+  std::error_code error;
+  std::filesystem::create_directories(dir_, error);
+  if (error) {
+    throw IOProblemException("can't create " + dir_ + ": " + error.message());
+  }
+  struct stat compiler;
+  if (::stat("/proc/self/exe", &compiler) == 0) {
+    const int64_t stamp[2] = {
+        static_cast<int64_t>(compiler.st_size),
+        static_cast<int64_t>(compiler.st_mtim.tv_sec) * 1000000000 +
+            compiler.st_mtim.tv_nsec};
+    compiler_stamp_ = fnv1a(14695981039346656037ull, stamp, sizeof(stamp));
+  }
+}
+
+uint64_t AstCache::key(std::string_view text, bool share_exprs) const {
+  const uint32_t options[2] = {FORMAT_VERSION, share_exprs ? SHARE_EXPRS : 0};
+  uint64_t hash = fnv1a(compiler_stamp_, options, sizeof(options));
+  return fnv1a(hash, text.data(), text.size());
+}
+
+std::string AstCache::path(uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.ast",
+                static_cast<unsigned long long>(key));
+  return dir_ + "/" + name;
+}
+
+bool AstCache::load(uint64_t key, pas::flat::Tree &tree,
+                    pas::LiteralPool &literals) const {
+  const std::string entry_path = path(key);
+  if (::access(entry_path.c_str(), R_OK) != 0) {
+    return false;
+  }
+  std::shared_ptr<SourceFile> image;
+  try {
+    image = std::make_shared<SourceFile>(SourceFile::open(entry_path));
+  } catch (const IOProblemException &) {
+    return false;
+  }
+  EntryReader reader(*image);
+  if (!reader.header(key)) {
+    return false;
+  }
+
+  pas::flat::Tree::View view;
+  std::span<const char> strings;
+  std::span<const Span> symbol_spans;
+  std::span<const Span> literal_spans;
+  if (!reader.section(Exprs, view.exprs) ||
+      !reader.section(ExprHashes, view.expr_hashes) ||
+      !reader.section(Stmts, view.stmts) ||
+      !reader.section(Decls, view.decls) ||
+      !reader.section(Types, view.types) ||
+      !reader.section(Blocks, view.blocks) ||
+      !reader.section(Children, view.children) ||
+      !reader.section(Strings, strings) ||
+      !reader.section(Symbols, symbol_spans) ||
+      !reader.section(Literals, literal_spans) ||
+      reader.header().program_block >= view.blocks.size() ||
+      literal_spans.empty()) {
+    return false;
+  }
+  const bool share_exprs = (reader.header().flags & SHARE_EXPRS) != 0;
+  if (view.expr_hashes.size() != (share_exprs ? view.exprs.size() : 0) ||
+      reader.header().program_name >= symbol_spans.size() ||
+      !EntryChecker(view.exprs, view.stmts, view.decls, view.types,
+                    view.blocks, view.children, symbol_spans.size(),
+                    literal_spans.size())
+           .valid()) {
+    return false;
+  }
+  auto string = [&](Span span) {
+    return std::string_view(strings.data() + span.offset, span.size);
+  };
+  for (std::span<const Span> spans : {symbol_spans, literal_spans}) {
+    for (Span span : spans) {
+      if (span.offset > strings.size() ||
+          span.size > strings.size() - span.offset) {
+        return false;
+      }
+    }
+  }
+
+  // Ids are most often the same, the ones the source interned in the
+  //   same order, then they are not mapped.
+  std::vector<pas::Symbol> symbols;
+  symbols.reserve(symbol_spans.size());
+  bool same_ids = true;
+  for (Span span : symbol_spans) {
+    const pas::Symbol symbol =
+        pas::SymbolTable::global().intern(string(span));
+    same_ids = same_ids && symbol.id() == symbols.size();
+    symbols.push_back(symbol);
+  }
+  if (same_ids) {
+    symbols.clear();
+  }
+
+  // Id 0 is the empty literal of a cleared pool. Literals of an entry
+  //   are all different, two equal ones get one id and it's damaged.
+  literals.clear();
+  for (size_t i = 1; i < literal_spans.size(); ++i) {
+    if (literals.intern(string(literal_spans[i])).id() != i) {
+      literals.clear();
+      return false;
+    }
+  }
+
+  tree.share_exprs_ = share_exprs;
+  tree.program_name_ = reader.header().program_name;
+  tree.program_block_ = reader.header().program_block;
+  tree.exprs_.clear();
+  tree.expr_hashes_.clear();
+  tree.stmts_.clear();
+  tree.decls_.clear();
+  tree.types_.clear();
+  tree.blocks_.clear();
+  tree.children_.clear();
+  tree.view_ = view;
+  tree.symbols_ = std::move(symbols);
+  tree.mapping_ = std::move(image);
+  return true;
+}
+
+void AstCache::store(uint64_t key, const pas::flat::Tree &tree,
+                     const pas::LiteralPool &literals) const {
+  // Only a tree built here is saved, its ids are of this process.
+  assert(tree.symbols_.empty());
+  EntryWriter writer;
+  const pas::flat::Tree::View &view = tree.view_;
+  writer.section(Exprs, view.exprs);
+  writer.section(ExprHashes, view.expr_hashes);
+  writer.section(Stmts, view.stmts);
+  writer.section(Decls, view.decls);
+  writer.section(Types, view.types);
+  writer.section(Blocks, view.blocks);
+  writer.section(Children, view.children);
+
+  std::vector<Span> symbols;
+  const pas::SymbolTable &table = pas::SymbolTable::global();
+  const size_t symbol_count = table.size();
+  for (uint32_t id = 0; id < symbol_count; ++id) {
+    symbols.push_back(writer.string(table.spelling(pas::Symbol(id))));
+  }
+  writer.section(Symbols, std::span<const Span>(symbols));
+  std::vector<Span> literal_spans;
+  for (uint32_t id = 0; id < literals.size(); ++id) {
+    literal_spans.push_back(
+        writer.string(literals.bytes(pas::StringLiteral(id))));
+  }
+  writer.section(Literals, std::span<const Span>(literal_spans));
+
+  EntryHeader header{};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = FORMAT_VERSION;
+  header.flags = tree.shares_exprs() ? SHARE_EXPRS : 0;
+  header.key = key;
+  header.program_name = tree.program_name_;
+  header.program_block = tree.program_block_;
+  const std::string image = writer.finish(header);
+
+  const std::string entry_path = path(key);
+  const std::string temp_path =
+      entry_path + "." + std::to_string(::getpid()) + ".tmp";
+  std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+  out.write(image.data(), static_cast<std::streamsize>(image.size()));
+  out.close();
+  if (!out || std::rename(temp_path.c_str(), entry_path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "flat_ast.hh"
+#include "literal_pool.hh"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Flat ASTs of sources parsed before (-ast-cache=DIR), so a source that
+//   hasn't changed since is neither lexed nor parsed again.
+// An entry is a file named by its key: a hash of the source's text after
+//   the preprocessor, of the options the tree depends on and of the
+//   compiler binary. It holds the tree's arrays as they are in memory at
+//   offsets from the start of the file. Loading maps the file and points
+//   the tree's spans right at them, nodes are not read one by one. Only
+//   what holds ids of the process that saved it is fixed up: spellings
+//   are interned into a table the tree maps its symbol ids through, and
+//   string literals go to the pool in the order of their ids.
+// Entries are written to a temporary file and renamed, a reader sees
+//   an entry whole or not at all. An entry that can't be written is
+//   skipped, the cache only saves time.
+class AstCache {
+public:
+  // Creates dir if there is none.
+  explicit AstCache(std::string dir);
+
+  AstCache(const AstCache &other) = delete;
+  AstCache &operator=(const AstCache &other) = delete;
+
+public:
+  uint64_t key(std::string_view text, bool share_exprs) const;
+
+  // False if there is no entry for key or it is damaged, every index
+  //   in it is checked. On a hit the literal pool holds the tree's
+  //   literals and nothing else, on a miss it may have been cleared.
+  bool load(uint64_t key, pas::flat::Tree &tree,
+            pas::LiteralPool &literals) const;
+  void store(uint64_t key, const pas::flat::Tree &tree,
+             const pas::LiteralPool &literals) const;
+
+private:
+  std::string path(uint64_t key) const;
+
+private:
+  std::string dir_;
+  // Size and modification time of the running compiler, a rebuilt one
+  //   doesn't read entries of the one before.
+  uint64_t compiler_stamp_ = 0;
+};
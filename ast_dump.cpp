@@ -0,0 +1,597 @@
+#include "ast_dump.hh"
+
+#include "exceptions.hh"
+#include "flat_walk.hh"
+#include "symbol_table.hh"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string_view>
+
+namespace pas {
+namespace flat {
+
+namespace {
+
+constexpr size_t DUMP_BUFFER_SIZE = 1 << 20;
+constexpr char BINARY_MAGIC[8] = {'M', 'C', 'C', 'D', 'U', 'M', 'P', '\n'};
+
+// Bytes of the dump not written yet. Writers put small pieces in place
+//   with Reserve and Commit, the stream only sees whole buffers.
+class DumpBuffer {
+public:
+  explicit DumpBuffer(std::ostream &out)
+      : out_(out), data_(std::make_unique<char[]>(DUMP_BUFFER_SIZE)) {}
+
+  DumpBuffer(const DumpBuffer &other) = delete;
+  DumpBuffer &operator=(const DumpBuffer &other) = delete;
+
+  // Room for size bytes, the ones up to end are kept by Commit.
+  char *Reserve(size_t size) {
+    assert(size <= DUMP_BUFFER_SIZE);
+    if (DUMP_BUFFER_SIZE - size_ < size) {
+      Flush();
+    }
+    return data_.get() + size_;
+  }
+  void Commit(const char *end) { size_ = end - data_.get(); }
+
+  void Put(char c) {
+    if (size_ == DUMP_BUFFER_SIZE) {
+      Flush();
+    }
+    data_[size_++] = c;
+  }
+  void Append(std::string_view bytes) {
+    if (DUMP_BUFFER_SIZE - size_ < bytes.size()) {
+      Flush();
+      // A string longer than the buffer goes out right away.
+      if (bytes.size() > DUMP_BUFFER_SIZE) {
+        Write(bytes.data(), bytes.size());
+        return;
+      }
+    }
+    std::memcpy(data_.get() + size_, bytes.data(), bytes.size());
+    size_ += bytes.size();
+  }
+  void Fill(char c, size_t count) {
+    while (count > 0) {
+      const size_t chunk = std::min(count, DUMP_BUFFER_SIZE);
+      std::memset(Reserve(chunk), c, chunk);
+      size_ += chunk;
+      count -= chunk;
+    }
+  }
+
+  void Flush() {
+    Write(data_.get(), size_);
+    size_ = 0;
+  }
+
+private:
+  void Write(const char *data, size_t size) {
+    out_.write(data, static_cast<std::streamsize>(size));
+    if (!out_) {
+      throw IOProblemException("can't write the AST dump");
+    }
+  }
+
+private:
+  std::ostream &out_;
+  std::unique_ptr<char[]> data_;
+  size_t size_ = 0;
+};
+
+void AppendDecimal(DumpBuffer &buffer, int value) {
+  char *begin = buffer.Reserve(16);
+  buffer.Commit(std::to_chars(begin, begin + 16, value).ptr);
+}
+
+// Writers get a record as Node, its fields and EndNode. The formats
+//   are in ast_dump.hh.
+class TextWriter {
+public:
+  explicit TextWriter(DumpBuffer &buffer) : buffer_(buffer) {}
+
+  void Begin() {}
+  void Node(uint32_t depth, std::string_view kind) {
+    buffer_.Fill(' ', depth);
+    buffer_.Append(kind);
+  }
+  void IntField(std::string_view key, int value) {
+    Key(key);
+    AppendDecimal(buffer_, value);
+  }
+  void BoolField(std::string_view key, bool value) {
+    Key(key);
+    buffer_.Append(value ? "true" : "false");
+  }
+  void StringField(std::string_view key, std::string_view value) {
+    Key(key);
+    String(value);
+  }
+  void ListBegin(std::string_view key) {
+    Key(key);
+    first_item_ = true;
+  }
+  void ListItem(std::string_view item) {
+    if (!first_item_) {
+      buffer_.Put(',');
+    }
+    String(item);
+    first_item_ = false;
+  }
+  void ListEnd() {}
+  void EndNode() { buffer_.Put('\n'); }
+  void Finish() {}
+
+private:
+  void Key(std::string_view key) {
+    buffer_.Put(' ');
+    buffer_.Append(key);
+    buffer_.Put('=');
+  }
+
+  void String(std::string_view value) {
+    const bool plain =
+        !value.empty() && std::all_of(value.begin(), value.end(), [](char c) {
+          return static_cast<unsigned char>(c) > ' ' && c != '"' &&
+                 c != '\\' && c != ',' && c != 0x7f;
+        });
+    if (plain) {
+      buffer_.Append(value);
+      return;
+    }
+    buffer_.Put('"');
+    for (char c : value) {
+      switch (c) {
+      case '"':
+      case '\\':
+        buffer_.Put('\\');
+        buffer_.Put(c);
+        break;
+      case '\n':
+        buffer_.Append("\\n");
+        break;
+      case '\t':
+        buffer_.Append("\\t");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < ' ' || c == 0x7f) {
+          static constexpr char HEX[] = "0123456789abcdef";
+          buffer_.Append("\\x");
+          buffer_.Put(HEX[static_cast<unsigned char>(c) >> 4]);
+          buffer_.Put(HEX[c & 0xf]);
+        } else {
+          buffer_.Put(c);
+        }
+      }
+    }
+    buffer_.Put('"');
+  }
+
+private:
+  DumpBuffer &buffer_;
+  bool first_item_ = true;
+};
+
+class JsonLinesWriter {
+public:
+  explicit JsonLinesWriter(DumpBuffer &buffer) : buffer_(buffer) {}
+
+  void Begin() {}
+  void Node(uint32_t depth, std::string_view kind) {
+    buffer_.Append("{\"depth\":");
+    AppendDecimal(buffer_, static_cast<int>(depth));
+    buffer_.Append(",\"kind\":\"");
+    buffer_.Append(kind);
+    buffer_.Put('"');
+  }
+  void IntField(std::string_view key, int value) {
+    Key(key);
+    AppendDecimal(buffer_, value);
+  }
+  void BoolField(std::string_view key, bool value) {
+    Key(key);
+    buffer_.Append(value ? "true" : "false");
+  }
+  void StringField(std::string_view key, std::string_view value) {
+    Key(key);
+    String(value);
+  }
+  void ListBegin(std::string_view key) {
+    Key(key);
+    buffer_.Put('[');
+    first_item_ = true;
+  }
+  void ListItem(std::string_view item) {
+    if (!first_item_) {
+      buffer_.Put(',');
+    }
+    String(item);
+    first_item_ = false;
+  }
+  void ListEnd() { buffer_.Put(']'); }
+  void EndNode() { buffer_.Append("}\n"); }
+  void Finish() {}
+
+private:
+  // Keys are identifiers, they need no escapes.
+  void Key(std::string_view key) {
+    buffer_.Append(",\"");
+    buffer_.Append(key);
+    buffer_.Append("\":");
+  }
+
+  // Bytes that need no escape go in runs.
+  void String(std::string_view value) {
+    buffer_.Put('"');
+    size_t run = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+      const unsigned char c = static_cast<unsigned char>(value[i]);
+      if (c >= ' ' && c != '"' && c != '\\') {
+        continue;
+      }
+      buffer_.Append(value.substr(run, i - run));
+      run = i + 1;
+      switch (c) {
+      case '"':
+        buffer_.Append("\\\"");
+        break;
+      case '\\':
+        buffer_.Append("\\\\");
+        break;
+      case '\n':
+        buffer_.Append("\\n");
+        break;
+      case '\t':
+        buffer_.Append("\\t");
+        break;
+      default: {
+        static constexpr char HEX[] = "0123456789abcdef";
+        buffer_.Append("\\u00");
+        buffer_.Put(HEX[c >> 4]);
+        buffer_.Put(HEX[c & 0xf]);
+      }
+      }
+    }
+    buffer_.Append(value.substr(run));
+    buffer_.Put('"');
+  }
+
+private:
+  DumpBuffer &buffer_;
+  bool first_item_ = true;
+};
+
+class BinaryWriter {
+public:
+  explicit BinaryWriter(DumpBuffer &buffer) : buffer_(buffer) {}
+
+  void Begin() { buffer_.Append(std::string_view(BINARY_MAGIC, 8)); }
+  void Node(uint32_t depth, std::string_view kind) {
+    Varint(depth);
+    Name(kind);
+  }
+  void IntField(std::string_view key, int value) {
+    Name(key);
+    buffer_.Put('i');
+    // Zigzag: small negative numbers are short too.
+    const uint32_t bits = static_cast<uint32_t>(value);
+    Varint((bits << 1) ^ (value < 0 ? UINT32_MAX : 0));
+  }
+  void BoolField(std::string_view key, bool value) {
+    Name(key);
+    buffer_.Put('b');
+    buffer_.Put(value ? 1 : 0);
+  }
+  void StringField(std::string_view key, std::string_view value) {
+    Name(key);
+    buffer_.Put('s');
+    String(value, 0);
+  }
+  void ListBegin(std::string_view key) {
+    Name(key);
+    buffer_.Put('l');
+  }
+  void ListItem(std::string_view item) { String(item, 1); }
+  void ListEnd() { buffer_.Put(0); }
+  void EndNode() { buffer_.Put(0); }
+  void Finish() {}
+
+private:
+  void Varint(uint64_t value) {
+    char *end = buffer_.Reserve(10);
+    while (value >= 0x80) {
+      *end++ = static_cast<char>(value | 0x80);
+      value >>= 7;
+    }
+    *end++ = static_cast<char>(value);
+    buffer_.Commit(end);
+  }
+
+  void String(std::string_view value, uint64_t bias) {
+    Varint(value.size() + bias);
+    buffer_.Append(value);
+  }
+
+  // Kind and key names are literals of the dumper, there are a few
+  //   dozen of them whatever the tree. They are told apart by address in
+  //   an open addressed table, a name at two addresses is only defined
+  //   twice.
+  void Name(std::string_view name) {
+    size_t slot = (reinterpret_cast<uintptr_t>(name.data()) >> 3) %
+                  NAME_SLOTS;
+    while (names_[slot].name != nullptr && names_[slot].name != name.data()) {
+      slot = (slot + 1) % NAME_SLOTS;
+    }
+    if (names_[slot].name != nullptr) {
+      Varint(names_[slot].id + 2);
+      return;
+    }
+    assert(name_count_ < NAME_SLOTS / 2);
+    names_[slot] = NameSlot{name.data(), name_count_++};
+    Varint(1);
+    String(name, 0);
+  }
+
+private:
+  DumpBuffer &buffer_;
+  static constexpr size_t NAME_SLOTS = 256;
+  struct NameSlot {
+    const char *name = nullptr;
+    uint32_t id = 0;
+  };
+  std::array<NameSlot, NAME_SLOTS> names_{};
+  uint32_t name_count_ = 0;
+};
+
+// Kind names of the records.
+#define FOR_EACH_FLAT_EXPR(kind)                                               \
+  constexpr std::string_view KindName(Tag<ExprKind::kind>) {                   \
+    return #kind "Expr";                                                       \
+  }
+#define FOR_EACH_FLAT_STMT(kind)                                               \
+  constexpr std::string_view KindName(Tag<StmtKind::kind>) {                   \
+    return #kind "Stmt";                                                       \
+  }
+#define FOR_EACH_FLAT_DECL(kind)                                               \
+  constexpr std::string_view KindName(Tag<DeclKind::kind>) {                   \
+    return #kind "Decl";                                                       \
+  }
+#define FOR_EACH_FLAT_TYPE(kind)                                               \
+  constexpr std::string_view KindName(Tag<TypeKind::kind>) {                   \
+    return #kind "Type";                                                       \
+  }
+#include <enum_flat_node.hpp>
+#undef FOR_EACH_FLAT_EXPR
+#undef FOR_EACH_FLAT_STMT
+#undef FOR_EACH_FLAT_DECL
+#undef FOR_EACH_FLAT_TYPE
+constexpr std::string_view KindName(Tag<NodeClass::Block>) { return "Block"; }
+constexpr std::string_view KindName(Tag<NodeClass::Declarations>) {
+  return "Declarations";
+}
+
+std::string_view OpName(pas::ast::UnaryOp op) {
+  switch (op) {
+  case pas::ast::UnaryOp::Plus:
+    return "plus";
+  case pas::ast::UnaryOp::Minus:
+    return "minus";
+  }
+  assert(false);
+  __builtin_unreachable();
+}
+
+std::string_view OpName(pas::ast::AddOp op) {
+  switch (op) {
+  case pas::ast::AddOp::Plus:
+    return "plus";
+  case pas::ast::AddOp::Minus:
+    return "minus";
+  case pas::ast::AddOp::Or:
+    return "or";
+  }
+  assert(false);
+  __builtin_unreachable();
+}
+
+std::string_view OpName(pas::ast::MultOp op) {
+  switch (op) {
+  case pas::ast::MultOp::Multiply:
+    return "multiply";
+  case pas::ast::MultOp::RealDiv:
+    return "real_div";
+  case pas::ast::MultOp::IntDiv:
+    return "int_div";
+  case pas::ast::MultOp::Modulo:
+    return "modulo";
+  case pas::ast::MultOp::And:
+    return "and";
+  }
+  assert(false);
+  __builtin_unreachable();
+}
+
+std::string_view OpName(pas::ast::RelOp op) {
+  switch (op) {
+  case pas::ast::RelOp::Equal:
+    return "equal";
+  case pas::ast::RelOp::NotEqual:
+    return "not_equal";
+  case pas::ast::RelOp::Less:
+    return "less";
+  case pas::ast::RelOp::LessEqual:
+    return "less_equal";
+  case pas::ast::RelOp::Greater:
+    return "greater";
+  case pas::ast::RelOp::GreaterEqual:
+    return "greater_equal";
+  case pas::ast::RelOp::In:
+    return "in";
+  }
+  assert(false);
+  __builtin_unreachable();
+}
+
+// Walk hooks: a record as a node is entered, children are one deeper.
+//   Fields of each kind are by the layouts in flat_ast.hh.
+template <typename Writer> class Dumper {
+public:
+  Dumper(const Tree &tree, const pas::LiteralPool &literals, Writer &writer)
+      : tree_(tree), literals_(literals), writer_(writer),
+        walker_(tree, *this) {}
+
+  void Dump() {
+    writer_.Begin();
+    writer_.Node(0, "Program");
+    writer_.StringField("name", tree_.program_name().spelling());
+    writer_.EndNode();
+    depth_ = 1;
+    walker_.walk(NodeClass::Block, tree_.program_block());
+    writer_.Finish();
+  }
+
+private:
+  friend class Walker<Dumper>;
+
+  template <auto Kind, typename Node>
+  bool enter(Tag<Kind> tag, NodeId, const Node &node) {
+    writer_.Node(depth_, KindName(tag));
+    Fields(tag, node);
+    writer_.EndNode();
+    ++depth_;
+    return true;
+  }
+  template <auto Kind, typename Node>
+  void leave(Tag<Kind>, NodeId, const Node &) {
+    --depth_;
+  }
+  void item(Tag<ExprKind::Sum>, NodeId, const Expr &, uint32_t op) {
+    Op(OpName(static_cast<pas::ast::AddOp>(op)));
+  }
+  void item(Tag<ExprKind::Product>, NodeId, const Expr &, uint32_t op) {
+    Op(OpName(static_cast<pas::ast::MultOp>(op)));
+  }
+
+  void Op(std::string_view name) {
+    writer_.Node(depth_, "Op");
+    writer_.StringField("op", name);
+    writer_.EndNode();
+  }
+
+  // Kinds without fields.
+  template <auto Kind, typename Node> void Fields(Tag<Kind>, const Node &) {}
+
+  void Fields(Tag<ExprKind::Number>, const Expr &expr) {
+    writer_.IntField("value", expr.number());
+  }
+  void Fields(Tag<ExprKind::Bool>, const Expr &expr) {
+    writer_.BoolField("value", expr.value != 0);
+  }
+  void Fields(Tag<ExprKind::String>, const Expr &expr) {
+    writer_.StringField("value",
+                        literals_.bytes(pas::StringLiteral(expr.value)));
+  }
+  void Fields(Tag<ExprKind::Designator>, const Expr &expr) { Name(expr); }
+  void Fields(Tag<ExprKind::Field>, const Expr &expr) { Name(expr); }
+  void Fields(Tag<ExprKind::Relation>, const Expr &expr) {
+    writer_.StringField("op", OpName(static_cast<pas::ast::RelOp>(expr.op)));
+  }
+  void Fields(Tag<ExprKind::Sum>, const Expr &expr) {
+    if (expr.op != 0) {
+      writer_.StringField(
+          "unary_op", OpName(static_cast<pas::ast::UnaryOp>(expr.op - 1)));
+    }
+  }
+  void Fields(Tag<ExprKind::Call>, const Expr &expr) { Name(expr); }
+
+  void Fields(Tag<StmtKind::ProcCall>, const Stmt &stmt) { Name(stmt); }
+  void Fields(Tag<StmtKind::For>, const Stmt &stmt) {
+    const auto dir = static_cast<pas::ast::WhichWay>(stmt.op);
+    writer_.StringField("counter", tree_.name(stmt).spelling());
+    writer_.StringField("dir",
+                        dir == pas::ast::WhichWay::To ? "to" : "down_to");
+  }
+  void Fields(Tag<StmtKind::Memory>, const Stmt &stmt) {
+    const auto kind = static_cast<pas::ast::MemoryStmt::Kind>(stmt.op);
+    writer_.StringField(
+        "op", kind == pas::ast::MemoryStmt::Kind::New ? "new" : "dispose");
+    Name(stmt);
+  }
+
+  void Fields(Tag<DeclKind::Const>, const Decl &decl) { Name(decl); }
+  void Fields(Tag<DeclKind::Type>, const Decl &decl) { Name(decl); }
+  void Fields(Tag<DeclKind::Var>, const Decl &decl) { Names(decl); }
+  void Fields(Tag<DeclKind::Proc>, const Decl &decl) { Name(decl); }
+  void Fields(Tag<DeclKind::Func>, const Decl &decl) {
+    Name(decl);
+    writer_.StringField(
+        "returns", tree_.symbol(tree_.list(decl.children)[1]).spelling());
+  }
+  void Fields(Tag<DeclKind::Param>, const Decl &decl) {
+    writer_.StringField("type", tree_.name(decl).spelling());
+    Names(decl);
+  }
+
+  void Fields(Tag<TypeKind::Named>, const Type &type) { Name(type); }
+  void Fields(Tag<TypeKind::Pointer>, const Type &type) {
+    writer_.StringField("to", tree_.name(type).spelling());
+  }
+  void Fields(Tag<TypeKind::Field>, const Type &type) { Names(type); }
+
+  template <typename Kind> void Name(const pas::flat::Node<Kind> &node) {
+    writer_.StringField("name", tree_.name(node).spelling());
+  }
+  // Names a Var, a Param or a Field declares, its children.
+  template <typename Kind> void Names(const pas::flat::Node<Kind> &node) {
+    writer_.ListBegin("names");
+    for (uint32_t name : tree_.list(node.children)) {
+      writer_.ListItem(tree_.symbol(name).spelling());
+    }
+    writer_.ListEnd();
+  }
+
+private:
+  const Tree &tree_;
+  const pas::LiteralPool &literals_;
+  Writer &writer_;
+  uint32_t depth_ = 0;
+  Walker<Dumper> walker_;
+};
+
+template <typename Writer>
+void DumpWith(const Tree &tree, const pas::LiteralPool &literals,
+              DumpBuffer &buffer) {
+  Writer writer(buffer);
+  Dumper<Writer>(tree, literals, writer).Dump();
+}
+
+} // namespace
+
+void dump(const Tree &tree, const pas::LiteralPool &literals,
+          DumpFormat format, std::ostream &out) {
+  DumpBuffer buffer(out);
+  switch (format) {
+  case DumpFormat::Text:
+    DumpWith<TextWriter>(tree, literals, buffer);
+    break;
+  case DumpFormat::JsonLines:
+    DumpWith<JsonLinesWriter>(tree, literals, buffer);
+    break;
+  case DumpFormat::Binary:
+    DumpWith<BinaryWriter>(tree, literals, buffer);
+    break;
+  }
+  buffer.Flush();
+  out.flush();
+}
+
+} // namespace flat
+} // namespace pas
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "flat_ast.hh"
+#include "literal_pool.hh"
+
+#include <ostream>
+
+namespace pas {
+namespace flat {
+
+// -ast-dump=FORMAT. Every node of the tree is a record, in pre-order,
+//   with its depth, its kind and the fields it holds besides children:
+//   names, operators, literals. Kinds are named after the node and its
+//   class (IfStmt, SumExpr, FieldType, ...), plus Program, Block,
+//   Declarations and Op for an operator between the operands of a Sum or
+//   a Product.
+enum class DumpFormat {
+  // A line a record, indented by depth: "  IfStmt",
+  //   "   DesignatorExpr name=x". A string that is empty or has spaces,
+  //   quotes or control characters in it is quoted.
+  Text,
+  // A JSON object a line: {"depth":2,"kind":"DesignatorExpr","name":"x"}.
+  //   Names of variables and parameters are an array.
+  JsonLines,
+  // "MCCDUMP\n", then a record a node: the depth, the kind, each field
+  //   (key, type byte, value) and a 0. Numbers are LEB128 varints, ints
+  //   zigzag encoded. Kinds and keys are names: a varint 1 and the name
+  //   (varint size and bytes) the first time, its id + 2 after that, ids
+  //   go from 0 in the order names come. Type bytes: 'i' an int, 'b' a
+  //   bool byte, 's' a string (varint size and bytes), 'l' strings each
+  //   as its size + 1 and bytes, then a 0.
+  Binary,
+};
+
+// Writes the tree node by node through a buffer of its own flushed to
+//   out in large writes, the dump takes no memory that grows with the
+//   tree but the walk's stack. Throws IOProblemException if out fails.
+void dump(const Tree &tree, const pas::LiteralPool &literals,
+          DumpFormat format, std::ostream &out);
+
+} // namespace flat
+} // namespace pas
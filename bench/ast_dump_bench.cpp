@@ -0,0 +1,87 @@
+// AST dump throughput of each format (ast_dump.hh) over a block of a
+//   million statements, written to a file in the temporary directory.
+//   The dump is expected to keep up with the disk: MB/s close to what
+//   a plain copy of the file gets.
+
+#include <ast_dump.hh>
+
+#include <ast.hpp>
+#include <symbol_table.hh>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace {
+
+using namespace pas::ast;
+using pas::flat::DumpFormat;
+
+constexpr size_t STATEMENTS = 1'000'000;
+constexpr int RUNS = 3;
+
+pas::Symbol symbol(const char *spelling) {
+  return pas::SymbolTable::global().intern(spelling);
+}
+
+// "x := x * 2 + 1", 7 records each.
+pas::AST program(size_t count) {
+  List<Stmt> stmts;
+  for (size_t i = 0; i < count; ++i) {
+    List<Term::Op> mult_ops;
+    mult_ops.push_back({MultOp::Multiply, 2});
+    List<SimpleExpr::Op> add_ops;
+    add_ops.push_back({AddOp::Plus, Term(1, {})});
+    stmts.push_back(make<Assignment>(
+        Designator(symbol("x"), {}),
+        Expr(SimpleExpr(std::nullopt,
+                        Term(Designator(symbol("x"), {}), std::move(mult_ops)),
+                        std::move(add_ops)))));
+  }
+  auto decls = make<Declarations>(List<ConstDef>{}, List<TypeDef>{},
+                                  List<VarDecl>{}, List<SubprogDecl>{});
+  return pas::AST(ProgramModule(symbol("bench"),
+                                Block(std::move(decls), std::move(stmts))));
+}
+
+void bench(const char *name, DumpFormat format, const pas::flat::Tree &tree,
+           const pas::LiteralPool &literals, const std::string &path) {
+  double best = 0;
+  for (int i = 0; i < RUNS; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      pas::flat::dump(tree, literals, format, out);
+    }
+    double time =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count();
+    if (i == 0 || time < best) {
+      best = time;
+    }
+  }
+  const double size = static_cast<double>(std::filesystem::file_size(path));
+  std::printf("%-6s %7.1f MB  %6.1f ms  %7.1f MB/s  %5.1f ns/statement\n",
+              name, size / 1e6, best * 1e3, size / 1e6 / best,
+              best * 1e9 / STATEMENTS);
+}
+
+} // namespace
+
+int main() {
+  Arena arena;
+  current_arena = &arena;
+  pas::LiteralPool literals;
+  pas::flat::Tree tree;
+  tree.build(program(STATEMENTS));
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "mcc_ast_dump_bench").string();
+  bench("text", DumpFormat::Text, tree, literals, path);
+  bench("json", DumpFormat::JsonLines, tree, literals, path);
+  bench("binary", DumpFormat::Binary, tree, literals, path);
+  std::remove(path.c_str());
+  current_arena = nullptr;
+  return 0;
+}
@@ -0,0 +1,210 @@
+// Traversal throughput of the flat AST: a recursive walk against the
+//   Walker with its work stack on the heap (flat_walk.hh). Both count
+//   the nodes they go through, over a long block of statements, a long
+//   "if ... else if" chain and a deeply parenthesized expression. Deep
+//   trees are where recursion runs out of stack, the walker is expected
+//   to keep its time per node there.
+
+#include <flat_walk.hh>
+
+#include <ast.hpp>
+#include <get_idx.hpp>
+#include <symbol_table.hh>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+namespace {
+
+using namespace pas::ast;
+using pas::flat::NodeClass;
+using pas::flat::NodeId;
+
+constexpr int RUNS = 20;
+
+pas::Symbol symbol(const char *spelling) {
+  return pas::SymbolTable::global().intern(spelling);
+}
+
+Term term(Factor factor) { return Term(std::move(factor), {}); }
+
+// x + 1
+Expr increment(Factor factor) {
+  List<SimpleExpr::Op> ops;
+  ops.push_back({AddOp::Plus, term(1)});
+  return Expr(SimpleExpr(std::nullopt, term(std::move(factor)), std::move(ops)));
+}
+
+Stmt assignment(Expr value) {
+  return make<Assignment>(Designator(symbol("x"), {}), std::move(value));
+}
+
+pas::AST program(List<Stmt> stmts) {
+  auto decls = make<Declarations>(List<ConstDef>{}, List<TypeDef>{},
+                                  List<VarDecl>{}, List<SubprogDecl>{});
+  return pas::AST(ProgramModule(symbol("bench"),
+                           Block(std::move(decls), std::move(stmts))));
+}
+
+// count statements "x := x + 1".
+pas::AST wide(size_t count) {
+  List<Stmt> stmts;
+  for (size_t i = 0; i < count; ++i) {
+    stmts.push_back(assignment(increment(Designator(symbol("x"), {}))));
+  }
+  return program(std::move(stmts));
+}
+
+// "if x > 0 then x := 0 else if x > 1 then x := 1 else ...", depth deep.
+pas::AST if_chain(size_t depth) {
+  std::optional<Stmt> rest;
+  for (size_t i = depth; i-- > 0;) {
+    Expr cond(SimpleExpr(std::nullopt, term(Designator(symbol("x"), {})), {}),
+              Expr::Op{RelOp::Greater,
+                       SimpleExpr(std::nullopt, term(int(i)), {})});
+    Expr value(SimpleExpr(std::nullopt, term(int(i)), {}));
+    rest = make<IfStmt>(std::move(cond), assignment(std::move(value)),
+                        std::move(rest));
+  }
+  List<Stmt> stmts;
+  stmts.push_back(std::move(*rest));
+  return program(std::move(stmts));
+}
+
+// "x := ((x + 1) + 1) + ...", depth deep.
+pas::AST parens(size_t depth) {
+  Expr expr = increment(Designator(symbol("x"), {}));
+  for (size_t i = 1; i < depth; ++i) {
+    expr = increment(make<Expr>(std::move(expr)));
+  }
+  List<Stmt> stmts;
+  stmts.push_back(assignment(std::move(expr)));
+  return program(std::move(stmts));
+}
+
+// Recursion over the same layouts, the way the visitors were written.
+class RecursiveCounter {
+public:
+  explicit RecursiveCounter(const pas::flat::Tree &tree) : tree_(tree) {}
+
+  size_t count() {
+    count_ = 0;
+    CountBlock(tree_.block(tree_.program_block()));
+    return count_;
+  }
+
+private:
+  void CountBlock(const pas::flat::Block &block) {
+    count_ += 2;
+    for (NodeId stmt : tree_.list(block.stmts)) {
+      CountStmt(stmt);
+    }
+  }
+  void CountStmt(NodeId id) {
+    const pas::flat::Stmt &stmt = tree_.stmt(id);
+    ++count_;
+    std::span<const uint32_t> children = tree_.list(stmt.children);
+    switch (stmt.kind) {
+    case pas::flat::StmtKind::Assignment:
+      CountExpr(children[0]);
+      CountExpr(children[1]);
+      break;
+    case pas::flat::StmtKind::If:
+      CountExpr(children[0]);
+      for (NodeId branch : children.subspan(1)) {
+        CountStmt(branch);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  void CountExpr(NodeId id) {
+    const pas::flat::Expr &expr = tree_.expr(id);
+    ++count_;
+    std::span<const uint32_t> children = tree_.list(expr.children);
+    const bool operators = expr.kind == pas::flat::ExprKind::Sum ||
+                           expr.kind == pas::flat::ExprKind::Product;
+    for (size_t i = 0; i < children.size(); i += operators ? 2 : 1) {
+      CountExpr(children[i]);
+    }
+  }
+
+  const pas::flat::Tree &tree_;
+  size_t count_ = 0;
+};
+
+class WalkCounter {
+public:
+  explicit WalkCounter(const pas::flat::Tree &tree)
+      : tree_(tree), walker_(tree, *this) {}
+
+  size_t count() {
+    count_ = 0;
+    walker_.walk(NodeClass::Block, tree_.program_block());
+    return count_;
+  }
+
+private:
+  friend class pas::flat::Walker<WalkCounter>;
+
+  template <auto Kind, typename Node>
+  bool enter(pas::flat::Tag<Kind>, NodeId, const Node &) {
+    ++count_;
+    return true;
+  }
+
+  const pas::flat::Tree &tree_;
+  size_t count_ = 0;
+  pas::flat::Walker<WalkCounter> walker_;
+};
+
+// Best of RUNS in ns per node.
+double time_count(const std::function<size_t()> &count, size_t &nodes) {
+  double best = 0;
+  for (int i = 0; i < RUNS; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    nodes = count();
+    double time = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    if (i == 0 || time < best) {
+      best = time;
+    }
+  }
+  return best * 1e9 / nodes;
+}
+
+void bench(const char *name, size_t size, const pas::AST &ast) {
+  pas::flat::Tree tree;
+  tree.build(ast);
+  RecursiveCounter recursive(tree);
+  WalkCounter walk(tree);
+  size_t recursive_nodes = 0;
+  size_t walk_nodes = 0;
+  const double recursive_time =
+      time_count([&] { return recursive.count(); }, recursive_nodes);
+  const double walk_time = time_count([&] { return walk.count(); }, walk_nodes);
+  std::printf("%-8s size=%8zu  recursive %5.2f ns/node (%zu)  walker %5.2f "
+              "ns/node (%zu)\n",
+              name, size, recursive_time, recursive_nodes, walk_time,
+              walk_nodes);
+}
+
+} // namespace
+
+int main() {
+  Arena arena;
+  current_arena = &arena;
+  for (size_t count : {10'000, 100'000, 1'000'000}) {
+    bench("wide", count, wide(count));
+  }
+  for (size_t depth : {1'000, 10'000}) {
+    bench("if-chain", depth, if_chain(depth));
+    bench("parens", depth, parens(depth));
+  }
+  current_arena = nullptr;
+  return 0;
+}
@@ -0,0 +1,116 @@
+// Interpreter time of a tight integer loop, with the operands' types
+//   tested by each operation and with the types the checks found
+//   (sema.hpp), which take the tests away.
+
+#include <visitor.hpp>
+
+#include <ast.hpp>
+#include <sema.hpp>
+#include <symbol_table.hh>
+
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+using namespace pas::ast;
+
+constexpr int ITERATIONS = 2'000'000;
+constexpr int RUNS = 3;
+
+pas::Symbol symbol(const char *spelling) {
+  return pas::SymbolTable::global().intern(spelling);
+}
+
+Term designator(const char *name) {
+  return Term(Designator(symbol(name), {}), {});
+}
+
+// var x, y: Integer;
+// for i := 1 to ITERATIONS do begin
+//   x := x + i * 3 mod 7;
+//   if x > y then y := x - 1
+// end
+pas::AST program() {
+  List<Stmt> body;
+  {
+    List<Term::Op> mult_ops;
+    mult_ops.push_back({MultOp::Multiply, 3});
+    mult_ops.push_back({MultOp::Modulo, 7});
+    List<SimpleExpr::Op> add_ops;
+    add_ops.push_back(
+        {AddOp::Plus, Term(Designator(symbol("i"), {}), std::move(mult_ops))});
+    body.push_back(make<Assignment>(
+        Designator(symbol("x"), {}),
+        Expr(SimpleExpr(std::nullopt, designator("x"), std::move(add_ops)))));
+  }
+  {
+    List<SimpleExpr::Op> add_ops;
+    add_ops.push_back({AddOp::Minus, Term(1, {})});
+    Expr condition(SimpleExpr(std::nullopt, designator("x"), {}),
+                   Expr::Op{RelOp::Greater,
+                            SimpleExpr(std::nullopt, designator("y"), {})});
+    body.push_back(make<IfStmt>(
+        std::move(condition),
+        make<Assignment>(Designator(symbol("y"), {}),
+                         Expr(SimpleExpr(std::nullopt, designator("x"),
+                                         std::move(add_ops)))),
+        std::nullopt));
+  }
+  List<Stmt> stmts;
+  stmts.push_back(make<ForStmt>(
+      symbol("i"), Expr(SimpleExpr(std::nullopt, Term(1, {}), {})),
+      WhichWay::To,
+      Expr(SimpleExpr(std::nullopt, Term(ITERATIONS, {}), {})),
+      make<StmtSeq>(std::move(body))));
+
+  List<Ident> names;
+  names.push_back(symbol("x"));
+  names.push_back(symbol("y"));
+  List<VarDecl> vars;
+  vars.push_back(
+      VarDecl(std::move(names), make<NamedType>(symbol("Integer"))));
+  auto decls = make<Declarations>(List<ConstDef>{}, List<TypeDef>{},
+                                  std::move(vars), List<SubprogDecl>{});
+  return pas::AST(ProgramModule(symbol("bench"),
+                                Block(std::move(decls), std::move(stmts))));
+}
+
+double bench(const pas::flat::Tree &tree, const pas::LiteralPool &literals,
+             std::span<const pas::sema::ExprType> types) {
+  double best = 0;
+  for (int i = 0; i < RUNS; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    pas::visitor::Interpreter(tree, literals, types).interpret();
+    double time =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count();
+    if (i == 0 || time < best) {
+      best = time;
+    }
+  }
+  return best;
+}
+
+} // namespace
+
+int main() {
+  Arena arena;
+  current_arena = &arena;
+  pas::LiteralPool literals;
+  pas::flat::Tree tree;
+  tree.build(program());
+  const pas::sema::Analysis analysis = pas::sema::check(tree, 1);
+  if (!analysis.diagnostics.empty()) {
+    std::printf("unexpected: %s\n", analysis.diagnostics.front().c_str());
+    return 1;
+  }
+  const double tested = bench(tree, literals, {});
+  const double typed = bench(tree, literals, analysis.types);
+  std::printf("tested  %7.1f ms  %5.1f ns/iteration\n", tested * 1e3,
+              tested * 1e9 / ITERATIONS);
+  std::printf("typed   %7.1f ms  %5.1f ns/iteration  %4.2fx\n", typed * 1e3,
+              typed * 1e9 / ITERATIONS, tested / typed);
+  current_arena = nullptr;
+  return 0;
+}
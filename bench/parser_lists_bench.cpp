@@ -0,0 +1,88 @@
+// Parse time of long lists: a block of many statements and calls with
+//   many arguments. Lists are built by appending as items are reduced,
+//   so time per item should stay flat as the lists grow; prepending made
+//   it grow linearly with the length (quadratic in total).
+// Only the parser run is timed, the source is written to a temporary
+//   file and lexed by the default lexer.
+
+#include <driver.hh>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Parses the program in text, returns the parser's time in seconds.
+double time_parse(const std::string &text) {
+  const std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "mcc_parser_lists_bench.pas";
+  std::ofstream(path) << text;
+
+  Driver driver;
+  driver.file = path.string();
+  driver.scan_begin();
+  auto start = std::chrono::steady_clock::now();
+  const int status = driver.parser();
+  double time = seconds_since(start);
+  driver.scan_end();
+  std::filesystem::remove(path);
+  if (status != 0) {
+    std::printf("parse failed\n");
+  }
+  return time;
+}
+
+// One block of `count` assignments.
+void bench_statements(size_t count) {
+  std::string text = "program bench;\nbegin\n";
+  for (size_t i = 0; i < count; ++i) {
+    text += "  x := x + 1;\n";
+  }
+  text += "  x := 0\nend.\n";
+
+  double time = time_parse(text);
+  std::printf("statements  count=%8zu  %8.1f ms  %6.1f ns/statement\n", count,
+              time * 1e3, time * 1e9 / count);
+}
+
+constexpr size_t CALLS = 16;
+
+// CALLS procedure calls with `count` arguments each.
+void bench_arguments(size_t count) {
+  std::string call = "  p(";
+  for (size_t i = 0; i < count; ++i) {
+    call += i == 0 ? "1" : ", 1";
+  }
+  call += ")";
+
+  std::string text = "program bench;\nbegin\n";
+  for (size_t i = 0; i < CALLS; ++i) {
+    text += call + (i + 1 == CALLS ? "\n" : ";\n");
+  }
+  text += "end.\n";
+
+  double time = time_parse(text);
+  std::printf("arguments   count=%8zu  %8.1f ms  %6.1f ns/argument\n", count,
+              time * 1e3, time * 1e9 / (count * CALLS));
+}
+
+} // namespace
+
+int main() {
+  for (size_t count : {12'500, 25'000, 50'000, 100'000}) {
+    bench_statements(count);
+  }
+  for (size_t count : {1'250, 2'500, 5'000, 10'000}) {
+    bench_arguments(count);
+  }
+  return 0;
+}
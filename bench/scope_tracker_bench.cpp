@@ -0,0 +1,122 @@
+// Lookup cost of ScopeTracker as the number of declared names grows.
+//   Per-lookup time should stay flat for both a huge file scope (headers
+//   with thousands of typedefs) and deep nesting with shadowed names.
+// A fresh tracker sizes its head table to the largest symbol id on the
+//   first declaration, which shows up in "enter" for small depths, as
+//   all names of earlier runs are already interned by then.
+
+#include <scope_tracker.hh>
+#include <symbol_table.hh>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum class ItemKind { VarName, TypeName };
+
+std::vector<pas::Symbol> make_names(size_t count, const std::string &prefix) {
+  std::vector<pas::Symbol> names;
+  names.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    names.push_back(
+        pas::SymbolTable::global().intern(prefix + std::to_string(i)));
+  }
+  return names;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+constexpr size_t LOOKUPS = 2'000'000;
+
+// One scope with `count` typedefs, then lookups of random declared
+//   names and of undeclared ones, like the scanner does.
+void bench_file_scope(size_t count) {
+  std::vector<pas::Symbol> names = make_names(count, "type_");
+  std::vector<pas::Symbol> unknown = make_names(1024, "unknown_");
+
+  ScopeTracker<ItemKind> tracker;
+  tracker.start_scope();
+
+  auto start = std::chrono::steady_clock::now();
+  for (pas::Symbol name : names) {
+    tracker.add_item(name, ItemKind::TypeName);
+  }
+  double declare_time = seconds_since(start);
+
+  std::mt19937 rng(42);
+  size_t found = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    pas::Symbol name = (i % 4 == 0) ? unknown[rng() % unknown.size()]
+                                    : names[rng() % names.size()];
+    found += tracker.find_item(name) != nullptr;
+  }
+  double lookup_time = seconds_since(start);
+
+  tracker.end_scope();
+  std::printf("file scope  names=%8zu  declare %7.1f ns/name  lookup %6.1f "
+              "ns/op  (found %zu)\n",
+              count, declare_time * 1e9 / count, lookup_time * 1e9 / LOOKUPS,
+              found);
+}
+
+// `depth` nested scopes, each declaring a few fresh names and shadowing
+//   one common name. Lookups at the innermost level, then unwind.
+void bench_nesting(size_t depth) {
+  constexpr size_t NAMES_PER_SCOPE = 4;
+  std::vector<pas::Symbol> names =
+      make_names(depth * NAMES_PER_SCOPE, "local_");
+  pas::Symbol shadowed = pas::SymbolTable::global().intern("i");
+
+  ScopeTracker<ItemKind> tracker;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t level = 0; level < depth; ++level) {
+    tracker.start_scope();
+    tracker.add_item(shadowed, ItemKind::VarName);
+    for (size_t i = 0; i < NAMES_PER_SCOPE; ++i) {
+      tracker.add_item(names[level * NAMES_PER_SCOPE + i], ItemKind::VarName);
+    }
+  }
+  double enter_time = seconds_since(start);
+
+  std::mt19937 rng(42);
+  size_t found = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < LOOKUPS; ++i) {
+    pas::Symbol name = (i % 2 == 0) ? shadowed : names[rng() % names.size()];
+    found += tracker.find_item(name) != nullptr;
+  }
+  double lookup_time = seconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  for (size_t level = 0; level < depth; ++level) {
+    tracker.end_scope();
+  }
+  double leave_time = seconds_since(start);
+
+  std::printf("nesting     depth=%8zu  enter %9.1f ns/scope  lookup %6.1f "
+              "ns/op  leave %6.1f ns/scope  (found %zu)\n",
+              depth, enter_time * 1e9 / depth, lookup_time * 1e9 / LOOKUPS,
+              leave_time * 1e9 / depth, found);
+}
+
+} // namespace
+
+int main() {
+  for (size_t count : {1'000, 10'000, 100'000, 1'000'000}) {
+    bench_file_scope(count);
+  }
+  for (size_t depth : {10, 1'000, 100'000}) {
+    bench_nesting(depth);
+  }
+  return 0;
+}
@@ -0,0 +1,115 @@
+// Time of the checks before -run (sema.hpp) over a program of many
+//   subprograms, by the number of threads. The subprograms are checked
+//   apart from each other, the time is expected to go down close to
+//   linearly up to the number of cores.
+
+#include <sema.hpp>
+
+#include <ast.hpp>
+#include <symbol_table.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+namespace {
+
+using namespace pas::ast;
+
+constexpr size_t SUBPROGRAMS = 20'000;
+constexpr size_t STATEMENTS = 50;
+constexpr int RUNS = 3;
+
+pas::Symbol symbol(const std::string &spelling) {
+  return pas::SymbolTable::global().intern(spelling);
+}
+
+Expr designator(pas::Symbol name) {
+  return Expr(SimpleExpr(std::nullopt, Term(Designator(name, {}), {}), {}));
+}
+
+// procedure pN(a, b: Integer); var x: Integer;
+//   begin x := a * 2 + b; ...; write_int(x) end
+SubprogDecl subprogram(size_t index) {
+  List<Ident> param_names;
+  param_names.push_back(symbol("a"));
+  param_names.push_back(symbol("b"));
+  List<FormalParam> params;
+  params.push_back(FormalParam(std::move(param_names), symbol("Integer")));
+
+  List<Ident> var_names;
+  var_names.push_back(symbol("x"));
+  List<VarDecl> vars;
+  vars.push_back(
+      VarDecl(std::move(var_names), make<NamedType>(symbol("Integer"))));
+  auto decls = make<Declarations>(List<ConstDef>{}, List<TypeDef>{},
+                                  std::move(vars), List<SubprogDecl>{});
+
+  List<Stmt> stmts;
+  for (size_t i = 0; i < STATEMENTS; ++i) {
+    List<Term::Op> mult_ops;
+    mult_ops.push_back({MultOp::Multiply, 2});
+    List<SimpleExpr::Op> add_ops;
+    add_ops.push_back({AddOp::Plus, Term(Designator(symbol("b"), {}), {})});
+    stmts.push_back(make<Assignment>(
+        Designator(symbol("x"), {}),
+        Expr(SimpleExpr(std::nullopt,
+                        Term(Designator(symbol("a"), {}), std::move(mult_ops)),
+                        std::move(add_ops)))));
+  }
+  List<Expr> args;
+  args.push_back(designator(symbol("x")));
+  stmts.push_back(make<ProcCall>(symbol("write_int"), std::move(args)));
+  return ProcDecl(ProcHeading(symbol("p" + std::to_string(index)),
+                              std::move(params)),
+                  Block(std::move(decls), std::move(stmts)));
+}
+
+pas::AST program() {
+  List<SubprogDecl> subprograms;
+  for (size_t i = 0; i < SUBPROGRAMS; ++i) {
+    subprograms.push_back(subprogram(i));
+  }
+  auto decls = make<Declarations>(List<ConstDef>{}, List<TypeDef>{},
+                                  List<VarDecl>{}, std::move(subprograms));
+  return pas::AST(
+      ProgramModule(symbol("bench"), Block(std::move(decls), List<Stmt>{})));
+}
+
+double bench(const pas::flat::Tree &tree, unsigned threads) {
+  double best = 0;
+  for (int i = 0; i < RUNS; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    const pas::sema::Analysis analysis = pas::sema::check(tree, threads);
+    double time =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count();
+    if (!analysis.diagnostics.empty()) {
+      std::printf("unexpected: %s\n", analysis.diagnostics.front().c_str());
+    }
+    if (i == 0 || time < best) {
+      best = time;
+    }
+  }
+  return best;
+}
+
+} // namespace
+
+int main() {
+  Arena arena;
+  current_arena = &arena;
+  pas::flat::Tree tree;
+  tree.build(program());
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  const double single = bench(tree, 1);
+  for (unsigned threads = 1; threads <= cores; threads *= 2) {
+    const double time = threads == 1 ? single : bench(tree, threads);
+    std::printf("%3u threads  %7.1f ms  %5.2fx\n", threads, time * 1e3,
+                single / time);
+  }
+  current_arena = nullptr;
+  return 0;
+}
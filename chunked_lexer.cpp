@@ -0,0 +1,127 @@
+#include "chunked_lexer.hh"
+#include "driver.hh"
+#include "fast_scanner.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+ChunkedLexer::ChunkedLexer(Driver &driver)
+    : driver(driver), reader_(driver, driver.tokens) {}
+
+ChunkedLexer::ChunkRun ChunkedLexer::LexChunk(size_t from, size_t to,
+                                              bool starts_in_comment) {
+  ChunkRun run;
+  FastScanner scanner(driver);
+  scanner.SetRawIdentifiers(true);
+  scanner.RestartChunk(from, to);
+
+  try {
+    if (starts_in_comment) {
+      scanner.ContinueComment();
+    }
+    while (true) {
+      yy::parser::symbol_type token = scanner.ScanToken();
+      const TokenBuffer::Kind kind = scanner.TokenKind();
+      if (kind == yy::parser::token::TOK_EOF) {
+        break;
+      }
+      run.tokens.push_back(kind, static_cast<uint32_t>(scanner.TokenOffset()),
+                           static_cast<uint32_t>(scanner.TokenLength()),
+                           TokenBuffer::payload_of(kind, token));
+    }
+    run.ends_in_comment = scanner.EndedInComment();
+  } catch (const yy::parser::syntax_error &exc) {
+    run.error = LexError{exc.what(), exc.location};
+  }
+
+  return run;
+}
+
+void ChunkedLexer::Lex(unsigned thread_count) {
+  const size_t size = driver.source_.size();
+  const char *data = driver.source_.data();
+
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const size_t chunk_count = std::clamp<size_t>(
+      size / MIN_CHUNK_SIZE, 1, thread_count * CHUNKS_PER_THREAD);
+
+  // Chunk i is [bounds[i], bounds[i + 1]), each but the last ends
+  //   right after a newline. Chunks without a newline merge with the next.
+  std::vector<size_t> bounds{driver.lex_start_};
+  for (size_t i = 1; i < chunk_count; ++i) {
+    const size_t target = std::max(size * i / chunk_count, bounds.back());
+    const void *newline = std::memchr(data + target, '\n', size - target);
+    if (newline == nullptr) {
+      break;
+    }
+    const size_t bound = static_cast<const char *>(newline) - data + 1;
+    if (bound != bounds.back() && bound != size) {
+      bounds.push_back(bound);
+    }
+  }
+  bounds.push_back(size);
+  const size_t chunks = bounds.size() - 1;
+
+  // runs[2 * i] starts chunk i normally, runs[2 * i + 1] inside of a
+  //   comment. The first chunk can only start normally.
+  std::vector<ChunkRun> runs(2 * chunks);
+  std::atomic<size_t> next_run = 0;
+  auto worker = [&]() {
+    for (size_t run = next_run++; run < runs.size(); run = next_run++) {
+      if (run == 1) {
+        continue;
+      }
+      runs[run] = LexChunk(bounds[run / 2], bounds[run / 2 + 1], run % 2 == 1);
+    }
+  };
+
+  const size_t worker_count = std::min<size_t>(thread_count, runs.size()) - 1;
+  std::vector<std::thread> workers;
+  workers.reserve(worker_count);
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : workers) {
+    thread.join();
+  }
+
+  driver.tokens.clear();
+  reader_.Reset();
+  error_.reset();
+
+  bool in_comment = false;
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    ChunkRun &run = runs[2 * chunk + (in_comment ? 1 : 0)];
+    driver.tokens.append(run.tokens);
+    if (run.error.has_value()) {
+      error_ = std::move(run.error);
+      return;
+    }
+    in_comment = run.ends_in_comment;
+  }
+
+  // Only the last chunk knows it ends at the end of file, so an
+  //   unterminated comment is reported there.
+  assert(!in_comment);
+  driver.tokens.push_back(yy::parser::token::TOK_EOF,
+                          static_cast<uint32_t>(size), 0, 0);
+}
+
+yy::parser::symbol_type ChunkedLexer::NextToken() {
+  if (reader_.AtEnd()) {
+    if (error_.has_value()) {
+      throw yy::parser::syntax_error(error_->location, error_->message);
+    }
+    // The parser asked again after the end of file.
+    return yy::parser::make_EOF(reader_.EndLocation());
+  }
+  return reader_.Next();
+}
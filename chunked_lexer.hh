@@ -0,0 +1,59 @@
+#pragma once
+
+#include "parser.hh"
+#include "token_buffer.hh"
+#include "token_reader.hh"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+class Driver;
+
+// Lexes a large source on several threads before parsing starts.
+// The source is split into chunks at newlines. A token never spans a
+//   newline, the only thing that does is a block comment (string
+//   literals can't contain one, there are no line continuations). So a
+//   chunk starts either in the normal state or inside of a comment.
+//   Every chunk but the first is lexed speculatively from both states
+//   at once; then the runs are stitched together from the first chunk
+//   on, each chunk taking the run that starts in the state the
+//   previous one ended in. The result is exactly the single-threaded
+//   token stream, errors included.
+class ChunkedLexer {
+public:
+  ChunkedLexer(Driver &driver);
+
+  // Fills the driver's TokenBuffer. thread_count of 0 means one per core.
+  void Lex(unsigned thread_count);
+
+  // Next token for the parser. A lexing error is thrown after all
+  //   tokens before it are handed out.
+  yy::parser::symbol_type NextToken();
+
+  Driver &driver;
+
+private:
+  struct LexError {
+    std::string message;
+    SourceLoc location;
+  };
+
+  // One speculative run over a chunk.
+  struct ChunkRun {
+    TokenBuffer tokens;
+    bool ends_in_comment = false;
+    std::optional<LexError> error;
+  };
+
+  ChunkRun LexChunk(size_t from, size_t to, bool starts_in_comment);
+
+private:
+  // Smaller sources are not worth the threads.
+  static constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+  // More chunks than threads, so that a slow chunk is not the tail.
+  static constexpr size_t CHUNKS_PER_THREAD = 4;
+
+  TokenReader reader_;
+  std::optional<LexError> error_;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <ident.hpp>
 #include <ops.hpp>
 
 #include <optional>
@@ -16,7 +17,7 @@ enum class ConstFactorKind : size_t {
   Nil = 3
 };
 
-using ConstFactor = std::variant<std::string, int, bool, std::monostate>;
+using ConstFactor = std::variant<Ident, int, bool, std::monostate>;
 
 class ConstExpr {
 public:
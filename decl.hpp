@@ -1,12 +1,11 @@
 #pragma once
 
+#include <ast_arena.hpp>
 #include <const_expr.hpp>
+#include <ident.hpp>
 #include <stmt.hpp>
 #include <type.hpp>
 
-#include <string>
-#include <vector>
-
 namespace pas {
 namespace ast {
 
@@ -17,11 +16,11 @@ public:
   VarDecl &operator=(VarDecl &&other) = default;
 
 public:
-  VarDecl(std::vector<std::string> ident_list, Type type)
+  VarDecl(List<Ident> ident_list, Type type)
       : ident_list_(std::move(ident_list)), type_(std::move(type)) {}
 
 public:
-  std::vector<std::string> ident_list_;
+  List<Ident> ident_list_;
   Type type_;
 };
 
@@ -32,11 +31,11 @@ public:
   ConstDef &operator=(ConstDef &&other) = default;
 
 public:
-  ConstDef(std::string ident, ConstExpr const_expr)
+  ConstDef(Ident ident, ConstExpr const_expr)
       : ident_(std::move(ident)), const_expr_(std::move(const_expr)) {}
 
 public:
-  std::string ident_;
+  Ident ident_;
   ConstExpr const_expr_;
 };
 
@@ -47,11 +46,11 @@ public:
   TypeDef &operator=(TypeDef &&other) = default;
 
 public:
-  TypeDef(std::string ident, Type type)
+  TypeDef(Ident ident, Type type)
       : ident_(std::move(ident)), type_(std::move(type)) {}
 
 public:
-  std::string ident_;
+  Ident ident_;
   Type type_;
 };
 
@@ -62,12 +61,12 @@ public:
   FormalParam &operator=(FormalParam &&other) = default;
 
 public:
-  FormalParam(std::vector<std::string> proc_name, std::string type_ident)
+  FormalParam(List<Ident> proc_name, Ident type_ident)
       : proc_name_(std::move(proc_name)), type_ident_(std::move(type_ident)) {}
 
 public:
-  std::vector<std::string> proc_name_;
-  std::string type_ident_;
+  List<Ident> proc_name_;
+  Ident type_ident_;
 };
 
 class ProcHeading {
@@ -77,12 +76,12 @@ public:
   ProcHeading &operator=(ProcHeading &&other) = default;
 
 public:
-  ProcHeading(std::string proc_name, std::vector<FormalParam> params)
+  ProcHeading(Ident proc_name, List<FormalParam> params)
       : proc_name_(std::move(proc_name)), params_(std::move(params)) {}
 
 public:
-  std::string proc_name_;
-  std::vector<FormalParam> params_;
+  Ident proc_name_;
+  List<FormalParam> params_;
 };
 
 class Declarations;
@@ -98,16 +97,16 @@ public:
   //   then we'll move them to our fields.
   // If we copy construct, these are just copies,
   //   it's fine to take them over.
-  Block(std::unique_ptr<Declarations> decls, std::vector<Stmt> stmt_seq)
+  Block(NodePtr<Declarations> decls, List<Stmt> stmt_seq)
       : decls_(std::move(decls)), stmt_seq_(std::move(stmt_seq)) {}
 
 public:
   // Block is needed for FuncDecl and ProcDecl, but it needs Declarations,
   //   which in turn requires FuncDecl and ProcDecl as subprog decls.
   //   We can't store this object in each other as hierarchy requires as there's
-  //   a cycle. Have to store a pointer. We can use unique_ptr.
-  std::unique_ptr<Declarations> decls_;
-  std::vector<Stmt> stmt_seq_;
+  //   a cycle. Have to store a pointer, to a node in the arena.
+  NodePtr<Declarations> decls_;
+  List<Stmt> stmt_seq_;
 };
 
 class ProcDecl {
@@ -132,13 +131,13 @@ public:
   FuncDecl &operator=(FuncDecl &&other) = default;
 
 public:
-  FuncDecl(ProcDecl proc_decl, std::string ret_type_ident)
+  FuncDecl(ProcDecl proc_decl, Ident ret_type_ident)
       : proc_decl_(std::move(proc_decl)),
         ret_type_ident_(std::move(ret_type_ident)) {}
 
 public:
   ProcDecl proc_decl_;
-  std::string ret_type_ident_;
+  Ident ret_type_ident_;
 };
 
 enum class SubprogKind { Proc = 0, Func = 1 };
@@ -157,18 +156,18 @@ public:
   //   then we'll move them to our fields.
   // If we copy construct, these are just copies,
   //   it's fine to take them over.
-  Declarations(std::vector<ConstDef> const_defs, std::vector<TypeDef> type_defs,
-               std::vector<VarDecl> var_decls,
-               std::vector<SubprogDecl> subprog_decls)
+  Declarations(List<ConstDef> const_defs, List<TypeDef> type_defs,
+               List<VarDecl> var_decls,
+               List<SubprogDecl> subprog_decls)
       : const_defs_(std::move(const_defs)), type_defs_(std::move(type_defs)),
         var_decls_(std::move(var_decls)),
         subprog_decls_(std::move(subprog_decls)) {}
 
 public:
-  std::vector<ConstDef> const_defs_;
-  std::vector<TypeDef> type_defs_;
-  std::vector<VarDecl> var_decls_;
-  std::vector<SubprogDecl> subprog_decls_;
+  List<ConstDef> const_defs_;
+  List<TypeDef> type_defs_;
+  List<VarDecl> var_decls_;
+  List<SubprogDecl> subprog_decls_;
 };
 
 } // namespace ast
@@ -1,56 +1,460 @@
 #include "driver.hh"
+#include "exceptions.hh"
 #include "parser.hh"
-// #include "sema.hpp"
+#include "sema.hpp"
 #include "visitor.hpp"
 
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <utility>
+
 Driver::Driver()
     : trace_parsing(false), trace_scanning(false), location_debug(false),
-      scanner(*this), parser(scanner, *this) {
+      scanner(*this), fast_scanner(*this), token_pipeline(*this),
+      chunked_lexer(*this), expression_parser(*this), parser(scanner, *this),
+      preprocessor(files) {
   variables["one"] = 1;
   variables["two"] = 2;
 }
 
-void Driver::set_ast(pas::AST &&ast) { ast_.emplace(std::move(ast)); }
+// The lexer thread reads the source, stop it before the source is gone.
+Driver::~Driver() {
+  token_pipeline.Stop();
+  if (pas::ast::current_arena == &ast_arena_) {
+    pas::ast::current_arena = nullptr;
+  }
+}
+
+void Driver::set_ast(pas::AST &&ast) {
+  ast_ = pas::ast::make<pas::AST>(std::move(ast)).get();
+}
+
+void Driver::set_fragment(pas::ast::List<pas::ast::SubprogDecl> &&decls) {
+  fragment_ =
+      pas::ast::make<pas::ast::List<pas::ast::SubprogDecl>>(std::move(decls));
+}
+
+void Driver::subprogram_begin(SourceLoc loc) {
+  if (subprogram_depth_++ == 0) {
+    subprograms_.push_back(SubprogramStart{loc.offset, scope_tracker.size()});
+  }
+}
+
+void Driver::subprogram_end() { --subprogram_depth_; }
+
+void Driver::block_statements(SourceLoc loc) {
+  // Blocks of subprograms are reduced before their declarations.
+  if (subprogram_depth_ == 0) {
+    statements_ = SubprogramStart{loc.offset, scope_tracker.size()};
+  }
+}
 
 bool Driver::parse(const std::string &f) {
   file = f;
 
-  // initialize location positions
-  location.initialize(&file);
-  scan_begin();
+  if (stage == Stage::Preprocess) {
+    open_source();
+    std::cout.write(source_.data() + lex_start_,
+                    static_cast<std::streamsize>(source_.size() - lex_start_));
+    return true;
+  }
+
+  bool opened = false;
+  if (ast_cache_ != nullptr && pch_ == nullptr &&
+      (stage == Stage::DumpAst || stage == Stage::Run)) {
+    open_source();
+    opened = true;
+    const uint64_t key = ast_cache_->key(
+        std::string_view(source_.data(), source_.size()), share_exprs);
+    if (ast_cache_->load(key, flat_ast_, literal_pool)) {
+      return run_passes();
+    }
+    cache_key_ = key;
+  }
+
+  if (!parse_source(opened)) {
+    cache_key_.reset();
+    return false;
+  }
+  return run_stage();
+}
+
+void Driver::use_ast_cache(const std::string &dir) {
+  ast_cache_ = std::make_unique<AstCache>(dir);
+}
+
+void Driver::dump_to(const std::string &path) {
+  dump_file_ = std::make_unique<std::ofstream>(
+      path, std::ios::binary | std::ios::trunc);
+  if (!*dump_file_) {
+    throw IOProblemException("can't open " + path);
+  }
+}
+
+bool Driver::parse_source(bool opened) {
+  location = SourceLoc();
+  if (opened) {
+    scan_opened();
+  } else {
+    scan_begin();
+  }
   parser.set_debug_level(trace_parsing);
   if (parser() != 0) {
     std::cout << "Parsing error!";
+    scan_end();
     return false;
   }
   scan_end();
+  assert(ast_ != nullptr);
+  return true;
+}
 
-  assert(ast_.has_value());
+bool Driver::parse_fragment() {
+  lex_start_ = 0;
+  pch_reader_.reset();
+  line_table_.reset();
+  expecting_ = Expecting::Token;
+  pending_token_.emplace(yy::parser::make_subprogram_fragment(SourceLoc()));
+  subprograms_.clear();
+  subprogram_depth_ = 0;
+  fragment_ = {};
+  // The fragment's nodes are added to the arena of the AST it goes into.
+  pas::ast::current_arena = &ast_arena_;
+  lex_begin();
 
-  pas::visitor::Printer printer(std::cout);
-  printer.visit(ast_.value());
+  parsing_fragment_ = true;
+  const bool parsed = parser() == 0;
+  parsing_fragment_ = false;
+  scan_end();
+  return parsed;
+}
 
-  pas::visitor::Interpreter interpreter;
-  interpreter.interpret(ast_.value());
+bool Driver::run_stage() {
+  if (stage == Stage::DumpAst || stage == Stage::Run) {
+    flat_ast_.build(*ast_, share_exprs);
+    if (std::optional<uint64_t> key = std::exchange(cache_key_, {})) {
+      ast_cache_->store(*key, flat_ast_, literal_pool);
+    }
+  }
+  return run_passes();
+}
 
+bool Driver::run_passes() {
+  switch (stage) {
+  case Stage::SyntaxOnly:
+    break;
+  case Stage::DumpAst: {
+    pas::flat::dump(flat_ast_, literal_pool, dump_format,
+                    dump_file_ != nullptr ? *dump_file_ : std::cout);
+    break;
+  }
+  case Stage::Run: {
+    const pas::sema::Analysis analysis =
+        pas::sema::check(flat_ast_, sema_threads);
+    for (const std::string &diagnostic : analysis.diagnostics) {
+      std::cerr << file << ": " << diagnostic << '\n';
+    }
+    if (!analysis.diagnostics.empty()) {
+      return false;
+    }
+    pas::visitor::Interpreter interpreter(flat_ast_, literal_pool,
+                                          analysis.types);
+    interpreter.interpret();
+    break;
+  }
+  default:
+    assert(false);
+    __builtin_unreachable();
+  }
   return true;
 }
 
-// bool Driver::typecheck() {
-//   assert(ast_.has_value());
-//   return pas::sema::typecheck(ast_.value());
-// }
-
 void Driver::scan_begin() {
-  scanner.set_debug(trace_scanning);
-  if (file.empty() || file == "-") {
+  open_source();
+  scan_opened();
+}
+
+void Driver::scan_opened() {
+  if (pch_ != nullptr) {
+    pch_reader_.emplace(*this, pch_->tokens());
   } else {
-    stream.open(file);
+    pch_reader_.reset();
+  }
+  literal_pool.clear();
+  ast_ = nullptr;
+  fragment_ = {};
+  ast_arena_.clear();
+  pas::ast::current_arena = &ast_arena_;
+  expecting_ = Expecting::Token;
+  pending_token_.reset();
+  // The file scope, ParseSession replays it.
+  scope_tracker.clear();
+  scope_tracker.start_scope();
+  subprograms_.clear();
+  subprogram_depth_ = 0;
+  lex_begin();
+}
+
+void Driver::lex_begin() {
+  scanner.set_debug(trace_scanning);
+  // Restart scanner resetting buffer!
+  scanner.Restart();
+  fast_scanner.Restart();
+  fast_scanner.SetRawIdentifiers(lexer_kind == LexerKind::Pipeline);
+  if (lexer_kind == LexerKind::Pipeline) {
+    token_pipeline.Start();
+  } else if (lexer_kind == LexerKind::Chunked) {
+    chunked_lexer.Lex(lexer_threads);
+  }
+}
+
+void Driver::open_source() {
+  // Still may be reading the previous source.
+  token_pipeline.Stop();
+  // Empty name or "-" is stdin.
+  source_ = SourceFile::open(file);
+  if (trace_scanning) {
     std::cerr << "File name is " << file << std::endl;
+  }
+  // Without a '#' there are no directives, the file is lexed as it is,
+  //   unless a precompiled header goes first.
+  preprocessed_ = pch_ != nullptr ||
+                  std::memchr(source_.data(), '#', source_.size()) != nullptr;
+  if (preprocessed_) {
+    source_ = SourceFile::from_text(
+        preprocessor.Run(file.empty() ? "-" : file, std::move(source_)));
+  }
+  lex_start_ = pch_ != nullptr ? pch_->text().size() : 0;
+  // Locations and token offsets are 32-bit.
+  if (source_.size() > std::numeric_limits<uint32_t>::max()) {
+    throw IOProblemException("source is too large, the limit is 4 GiB");
+  }
+  line_table_.reset();
+}
+
+void Driver::emit_pch(const std::string &header, const std::string &path) {
+  if (pch_ != nullptr) {
+    throw PrecompiledHeaderException(
+        "a precompiled header can't start with another one");
+  }
+  token_pipeline.Stop();
+  file = header;
+  source_ = SourceFile::from_text(
+      preprocessor.Run(header.empty() ? "-" : header, SourceFile::open(header)));
+  if (source_.size() > std::numeric_limits<uint32_t>::max()) {
+    throw IOProblemException("source is too large, the limit is 4 GiB");
+  }
+  preprocessed_ = true;
+  lex_start_ = 0;
+  line_table_.reset();
+
+  TokenBuffer header_tokens;
+  FastScanner header_scanner(*this);
+  header_scanner.SetRawIdentifiers(true);
+  header_scanner.Restart();
+  try {
+    while (true) {
+      yy::parser::symbol_type token = header_scanner.ScanToken();
+      const TokenBuffer::Kind kind = header_scanner.TokenKind();
+      if (kind == yy::parser::token::TOK_EOF) {
+        break;
+      }
+      header_tokens.push_back(
+          kind, static_cast<uint32_t>(header_scanner.TokenOffset()),
+          static_cast<uint32_t>(header_scanner.TokenLength()),
+          TokenBuffer::payload_of(kind, token));
+    }
+  } catch (const yy::parser::syntax_error &exc) {
+    throw PrecompiledHeaderException(describe_location(exc.location) + ": " +
+                                     exc.what());
+  }
+
+  PrecompiledHeader::write(path, std::string_view(source_.data(), source_.size()),
+                           header_tokens, preprocessor);
+}
+
+void Driver::include_pch(const std::string &path) {
+  preprocessor.SetPrelude(nullptr);
+  pch_ = PrecompiledHeader::load(path, files);
+  preprocessor.SetPrelude(pch_.get());
+}
 
-    // Restart scanner resetting buffer!
-    scanner.yyrestart(&stream);
+std::string Driver::describe_location(SourceLoc loc) {
+  LineTable::Position position = line_table_.find(
+      std::string_view(source_.data(), source_.size()), loc);
+  std::ostringstream description;
+  if (preprocessed_) {
+    LineMap::Origin origin = preprocessor.line_map().find(position.line);
+    description << *origin.path << ':' << origin.line << '.'
+                << position.column;
+  } else {
+    description << file << ':' << position.line << '.' << position.column;
   }
+  return description.str();
+}
+
+// Source is kept until the next parse: tokens and the AST view
+//   identifiers and literals right in its text.
+void Driver::scan_end() {
+  token_pipeline.Stop();
+  pas::ast::current_arena = nullptr;
 }
 
-void Driver::scan_end() { stream.close(); }
+yy::parser::symbol_type
+Driver::make_identifier_or_name(std::string_view str,
+                                const yy::parser::location_type &loc) {
+  // The only place an identifier is hashed as a string,
+  //   everything after works with the symbol.
+  return classify_identifier(pas::SymbolTable::global().intern(str), loc);
+}
+
+yy::parser::symbol_type
+Driver::classify_identifier(pas::Symbol symbol,
+                            const yy::parser::location_type &loc) {
+  DeclaredIdentType *identifier_type = scope_tracker.find_item(symbol);
+
+  if (identifier_type == nullptr) {
+    return yy::parser::make_identifier(symbol, loc);
+  }
+
+  switch (*identifier_type) {
+  case DeclaredIdentType::VarName:
+    return yy::parser::make_var_name(symbol, loc);
+  case DeclaredIdentType::TypeName:
+    return yy::parser::make_type_name(symbol, loc);
+  case DeclaredIdentType::FuncName:
+    return yy::parser::make_func_name(symbol, loc);
+  case DeclaredIdentType::StructName:
+    return yy::parser::make_struct_name(symbol, loc);
+  default:
+    assert(false);
+    __builtin_unreachable();
+  }
+}
+
+namespace {
+// Kind, location and payload of a token, for the differential mode.
+//   Two lexers agree on a token when its descriptions are equal.
+std::string describe_token(Driver &driver,
+                           const yy::parser::symbol_type &token) {
+  using Kind = yy::parser::symbol_kind;
+
+  std::ostringstream description;
+  description << token.name() << " at "
+              << driver.describe_location(token.location);
+
+  switch (token.kind()) {
+  case Kind::S_identifier:
+  case Kind::S_var_name:
+  case Kind::S_type_name:
+  case Kind::S_func_name:
+  case Kind::S_struct_name:
+    description << " '" << token.value.as<pas::Symbol>() << "'";
+    break;
+  case Kind::S_string:
+  case Kind::S_long_string:
+    description << " '" << token.value.as<std::string_view>() << "'";
+    break;
+  case Kind::S_number:
+  case Kind::S_char_const:
+  case Kind::S_long_char_const:
+    description << ' ' << token.value.as<int>();
+    break;
+  default:
+    break;
+  }
+
+  return description.str();
+}
+
+// Scans a token with the lexer, keeping either the token or the error.
+template <typename Lexer>
+std::string scan_described(Driver &driver, Lexer &lexer,
+                           std::optional<yy::parser::symbol_type> &token,
+                           std::optional<yy::parser::syntax_error> &error) {
+  try {
+    token.emplace(lexer.ScanToken());
+    return describe_token(driver, token.value());
+  } catch (const yy::parser::syntax_error &exc) {
+    error.emplace(exc);
+    std::ostringstream description;
+    description << "error '" << exc.what() << "' at "
+                << driver.describe_location(exc.location);
+    return description.str();
+  }
+}
+} // namespace
+
+void Driver::expect_expression() { expecting_ = Expecting::Expression; }
+
+void Driver::expect_expression_list(bool allow_empty) {
+  expecting_ = allow_empty ? Expecting::List : Expecting::NonEmptyList;
+}
+
+yy::parser::symbol_type Driver::next_token() {
+  const Expecting expecting = expecting_;
+  expecting_ = Expecting::Token;
+  std::optional<yy::parser::symbol_type> token;
+  switch (expecting) {
+  case Expecting::Token:
+    return lex_token();
+  case Expecting::Expression:
+    token.emplace(expression_parser.ParseExpression());
+    break;
+  case Expecting::List:
+  case Expecting::NonEmptyList:
+    token.emplace(
+        expression_parser.ParseList(expecting == Expecting::List));
+    break;
+  }
+  pending_token_.emplace(expression_parser.TakeLookahead());
+  return std::move(token.value());
+}
+
+yy::parser::symbol_type Driver::lex_token() {
+  if (pending_token_.has_value()) {
+    yy::parser::symbol_type token = std::move(pending_token_.value());
+    pending_token_.reset();
+    return token;
+  }
+  // Tokens of the precompiled header go first, they are lexed already.
+  if (pch_reader_.has_value() && !pch_reader_->AtEnd()) {
+    return pch_reader_->Next();
+  }
+
+  switch (lexer_kind) {
+  case LexerKind::Flex:
+    return scanner.ScanToken();
+  case LexerKind::Hand:
+    return fast_scanner.ScanToken();
+  case LexerKind::Pipeline:
+    return token_pipeline.NextToken();
+  case LexerKind::Chunked:
+    return chunked_lexer.NextToken();
+  case LexerKind::Differential: {
+    // Errors are compared too: both lexers must reject the same
+    //   character at the same place.
+    std::optional<yy::parser::symbol_type> token;
+    std::optional<yy::parser::syntax_error> error;
+    std::string expected = scan_described(*this, scanner, token, error);
+    std::optional<yy::parser::symbol_type> fast_token;
+    std::optional<yy::parser::syntax_error> fast_error;
+    std::string actual =
+        scan_described(*this, fast_scanner, fast_token, fast_error);
+    if (expected != actual) {
+      throw LexerMismatchException("lexers disagree: flex gives " + expected +
+                                   ", hand-written gives " + actual);
+    }
+    if (error.has_value()) {
+      throw error.value();
+    }
+    return std::move(token.value());
+  }
+  default:
+    assert(false);
+    __builtin_unreachable();
+  }
+}
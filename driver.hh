@@ -1,20 +1,69 @@
 #pragma once
 
+#include "arena.hh"
+#include "ast_cache.hh"
+#include "ast_dump.hh"
 #include "ast.hpp"
+#include "chunked_lexer.hh"
+#include "expression_parser.hh"
+#include "fast_scanner.hh"
+#include "file_cache.hh"
+#include "flat_ast.hh"
+#include "literal_pool.hh"
 #include "parser.hh"
+#include "precompiled_header.hh"
+#include "preprocessor.hh"
 #include "scanner.h"
 #include "scope_tracker.hh"
+#include "source_file.hh"
+#include "source_location.hh"
+#include "token_buffer.hh"
+#include "token_pipeline.hh"
+#include "token_reader.hh"
 
 #include <fstream>
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 class Driver {
 public:
   Driver();
+  ~Driver();
   std::map<std::string, int> variables;
   int result;
+
+  // Where parse() stops. Each stage does only the work it needs.
+  enum class Stage {
+    // -E: prints the preprocessed source, nothing is lexed.
+    Preprocess,
+    // -fsyntax-only: parses and drops the AST.
+    SyntaxOnly,
+    // -ast-dump[=FORMAT]: dumps the AST instead of running it.
+    DumpAst,
+    Run,
+  };
+  Stage stage = Stage::Run;
+  // -fshare-exprs: the dump and the interpreter get equal expressions
+  //   as one node, see flat_ast.hh.
+  bool share_exprs = false;
+  pas::flat::DumpFormat dump_format = pas::flat::DumpFormat::Text;
+  // -sema-threads=N: threads the checks before -run take, see sema.hpp
+  //   (0 is one per core).
+  unsigned sema_threads = 0;
+
+  // -ast-dump-file=PATH: dumps of all translation units go to path, not
+  //   to stdout.
+  void dump_to(const std::string &path);
+
+  // -ast-cache=DIR: -ast-dump and -run take the flat AST of a source
+  //   parsed before from dir and skip lexing and parsing, see
+  //   ast_cache.hh. Sources after a precompiled header are parsed.
+  void use_ast_cache(const std::string &dir);
+
   bool parse(const std::string &f);
   std::string file;
 
@@ -23,14 +72,64 @@ public:
 
   bool trace_parsing;
   bool trace_scanning;
-  yy::location location;
+  // Location of the last token matched by the flex scanner.
+  SourceLoc location;
+
+  // "file:line.column" of a location in the current source, for
+  //   diagnostics. The first call builds the source's line table.
+  std::string describe_location(SourceLoc loc);
 
   friend class Scanner;
   Scanner scanner;
+  friend class FastScanner;
+  FastScanner fast_scanner;
+  friend class TokenPipeline;
+  TokenPipeline token_pipeline;
+  friend class ChunkedLexer;
+  friend class TokenReader;
+  ChunkedLexer chunked_lexer;
+  friend class ExpressionParser;
+  ExpressionParser expression_parser;
   yy::parser parser;
   bool location_debug;
 
-  bool typecheck();
+  // Lexer that feeds the parser. Differential runs the hand-written
+  //   lexer alongside flex and fails on the first token they disagree on.
+  //   Pipeline runs the hand-written lexer on its own thread, Chunked
+  //   lexes the whole source up front on lexer_threads threads (0 is
+  //   one per core).
+  enum class LexerKind { Flex, Hand, Differential, Pipeline, Chunked };
+  LexerKind lexer_kind = LexerKind::Flex;
+  unsigned lexer_threads = 0;
+
+  // Called by the parser for every token.
+  yy::parser::symbol_type next_token();
+
+  // Called by the parser where an expression or a list of them starts:
+  //   the next token it gets is the whole of it, parsed by
+  //   expression_parser.
+  void expect_expression();
+  void expect_expression_list(bool allow_empty);
+
+  // Tokens of the last source lexed by the pipeline.
+  TokenBuffer tokens;
+
+  // Sources opened so far, shared by all translation units the
+  //   driver parses. A source with a '#' in it goes through the
+  //   preprocessor before the scanners see it.
+  FileCache files;
+  Preprocessor preprocessor;
+
+  // Preprocesses and lexes header into a precompiled header at path.
+  void emit_pch(const std::string &header, const std::string &path);
+  // Every translation unit parsed after this starts with the header
+  //   precompiled at path: its tokens go to the parser first, then the
+  //   lexer starts right after its text.
+  void include_pch(const std::string &path);
+
+  // String literals of the current translation unit, the AST refers
+  //   to them by handle.
+  pas::LiteralPool literal_pool;
 
   enum class DeclaredIdentType {
     VarName,
@@ -42,11 +141,87 @@ public:
 
   ScopeTracker<DeclaredIdentType> scope_tracker;
 
+  // Interns an identifier and classifies it by the declaration visible
+  //   in the current scope. Used by both lexers.
+  yy::parser::symbol_type
+  make_identifier_or_name(std::string_view str,
+                          const yy::parser::location_type &loc);
+  yy::parser::symbol_type
+  classify_identifier(pas::Symbol symbol,
+                      const yy::parser::location_type &loc);
+
 private:
   friend yy::parser; // Allow parser to call set_ast.
   void set_ast(pas::AST &&ast);
+  void set_fragment(pas::ast::List<pas::ast::SubprogDecl> &&decls);
+  // Where top-level subprograms and the program's statements start,
+  //   for ParseSession.
+  void subprogram_begin(SourceLoc loc);
+  void subprogram_end();
+  void block_statements(SourceLoc loc);
+  bool parsing_fragment() const { return parsing_fragment_; }
+
+  friend class ParseSession;
+
+  // Reads file into source_, through the preprocessor if it needs it.
+  void open_source();
+  // Starts the lexers on source_.
+  void lex_begin();
+  // Lexes and parses file. False on a syntax error, after reporting it.
+  //   With opened the source is in source_ already.
+  bool parse_source(bool opened = false);
+  // Parses source_ as a run of subprograms into fragment_, replaying
+  //   nothing: the caller sets up scope_tracker. Errors are not
+  //   reported.
+  bool parse_fragment();
+  // Does the work of stage with the parsed AST. False if the program
+  //   failed the checks, after reporting them.
+  bool run_stage();
+  // Does the work of stage with flat_ast_.
+  bool run_passes();
+  // Starts the lexers and the parser on source_.
+  void scan_opened();
 
 private:
-  std::optional<pas::AST> ast_;
-  std::ifstream stream;
+  // Nodes of the current translation unit's AST, see ast_arena.hpp.
+  //   The tree is never destroyed, the arena is cleared by the next
+  //   scan_begin().
+  Arena ast_arena_;
+  pas::AST *ast_ = nullptr;
+  // ast_ flattened for the dump and the interpreter, rebuilt by
+  //   run_stage() keeping its arrays' memory.
+  pas::flat::Tree flat_ast_;
+  std::unique_ptr<AstCache> ast_cache_;
+  std::unique_ptr<std::ofstream> dump_file_;
+  // Key of the source being parsed, its tree isn't in the cache yet.
+  std::optional<uint64_t> cache_key_;
+  SourceFile source_;
+  LineTable line_table_;
+  // source_ is the preprocessor's output, lines map through its LineMap.
+  bool preprocessed_ = false;
+  std::unique_ptr<PrecompiledHeader> pch_;
+  std::optional<TokenReader> pch_reader_;
+  // Offset the lexers start at, the precompiled header's text is before it.
+  size_t lex_start_ = 0;
+
+  enum class Expecting { Token, Expression, List, NonEmptyList };
+  Expecting expecting_ = Expecting::Token;
+  // The token the expression parser read past the expression.
+  std::optional<yy::parser::symbol_type> pending_token_;
+
+  // Top-level subprograms of the last parse: where each starts and the
+  //   scope_tracker's size there.
+  struct SubprogramStart {
+    uint32_t offset;
+    size_t scope_mark;
+  };
+  std::vector<SubprogramStart> subprograms_;
+  // Where the program's statements start.
+  SubprogramStart statements_{};
+  size_t subprogram_depth_ = 0;
+  bool parsing_fragment_ = false;
+  pas::ast::NodePtr<pas::ast::List<pas::ast::SubprogDecl>> fragment_;
+
+  // Next token of the lexer, for both parsers.
+  yy::parser::symbol_type lex_token();
 };
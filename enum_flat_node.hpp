@@ -0,0 +1,36 @@
+FOR_EACH_FLAT_EXPR(Number)
+FOR_EACH_FLAT_EXPR(Bool)
+FOR_EACH_FLAT_EXPR(Nil)
+FOR_EACH_FLAT_EXPR(String)
+FOR_EACH_FLAT_EXPR(Designator)
+FOR_EACH_FLAT_EXPR(Field)
+FOR_EACH_FLAT_EXPR(Deref)
+FOR_EACH_FLAT_EXPR(Index)
+FOR_EACH_FLAT_EXPR(Relation)
+FOR_EACH_FLAT_EXPR(Sum)
+FOR_EACH_FLAT_EXPR(Product)
+FOR_EACH_FLAT_EXPR(Not)
+FOR_EACH_FLAT_EXPR(Call)
+FOR_EACH_FLAT_STMT(Assignment)
+FOR_EACH_FLAT_STMT(ProcCall)
+FOR_EACH_FLAT_STMT(If)
+FOR_EACH_FLAT_STMT(Case)
+FOR_EACH_FLAT_STMT(CaseArm)
+FOR_EACH_FLAT_STMT(While)
+FOR_EACH_FLAT_STMT(Repeat)
+FOR_EACH_FLAT_STMT(For)
+FOR_EACH_FLAT_STMT(Memory)
+FOR_EACH_FLAT_STMT(Seq)
+FOR_EACH_FLAT_STMT(Empty)
+FOR_EACH_FLAT_DECL(Const)
+FOR_EACH_FLAT_DECL(Type)
+FOR_EACH_FLAT_DECL(Var)
+FOR_EACH_FLAT_DECL(Proc)
+FOR_EACH_FLAT_DECL(Func)
+FOR_EACH_FLAT_DECL(Param)
+FOR_EACH_FLAT_TYPE(Named)
+FOR_EACH_FLAT_TYPE(Pointer)
+FOR_EACH_FLAT_TYPE(Set)
+FOR_EACH_FLAT_TYPE(Array)
+FOR_EACH_FLAT_TYPE(Record)
+FOR_EACH_FLAT_TYPE(Field)
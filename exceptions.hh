@@ -39,3 +39,23 @@ class NoScopesException : public DescribedException {
 public:
   using DescribedException::DescribedException;
 };
+
+class IOProblemException : public DescribedException {
+public:
+  using DescribedException::DescribedException;
+};
+
+class LexerMismatchException : public DescribedException {
+public:
+  using DescribedException::DescribedException;
+};
+
+class PreprocessorException : public DescribedException {
+public:
+  using DescribedException::DescribedException;
+};
+
+class PrecompiledHeaderException : public DescribedException {
+public:
+  using DescribedException::DescribedException;
+};
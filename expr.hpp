@@ -2,13 +2,14 @@
 
 #include <fwd_stmt.hpp>
 
+#include <ast_arena.hpp>
 #include <const_expr.hpp>
+#include <ident.hpp>
+#include <literal_pool.hh>
 #include <ops.hpp>
 
-#include <memory>
 #include <utility> // std::move
 #include <variant>
-#include <vector>
 
 namespace pas {
 namespace ast {
@@ -19,7 +20,7 @@ namespace ast {
 //   Like the problem is that we need expr inside expr
 //   subvariants.
 class Expr;
-using ExprUP = std::unique_ptr<Expr>;
+using ExprUP = NodePtr<Expr>;
 
 class DesignatorFieldAccess {
 public:
@@ -28,10 +29,10 @@ public:
   DesignatorFieldAccess &operator=(DesignatorFieldAccess &&other) = default;
 
 public:
-  DesignatorFieldAccess(std::string ident) : ident_(std::move(ident)) {}
+  DesignatorFieldAccess(Ident ident) : ident_(ident) {}
 
 public:
-  std::string ident_;
+  Ident ident_;
 };
 class DesignatorArrayAccess {
 public:
@@ -40,11 +41,11 @@ public:
   DesignatorArrayAccess &operator=(DesignatorArrayAccess &&other) = default;
 
 public:
-  DesignatorArrayAccess(std::vector<ExprUP> expr_list)
+  DesignatorArrayAccess(List<ExprUP> expr_list)
       : expr_list_(std::move(expr_list)) {}
 
 public:
-  std::vector<ExprUP> expr_list_;
+  List<ExprUP> expr_list_;
 };
 class DesignatorPointerAccess {
 public:
@@ -70,12 +71,12 @@ public:
   Designator &operator=(Designator &&other) = default;
 
 public:
-  Designator(std::string ident, std::vector<DesignatorItem> items)
-      : ident_(std::move(ident)), items_(std::move(items)) {}
+  Designator(Ident ident, List<DesignatorItem> items)
+      : ident_(ident), items_(std::move(items)) {}
 
 public:
-  std::string ident_;
-  std::vector<DesignatorItem> items_;
+  Ident ident_;
+  List<DesignatorItem> items_;
 };
 
 enum class FactorKind {
@@ -92,10 +93,12 @@ enum class FactorKind {
 class Negation;
 class FuncCall;
 
-using NegationUP = std::unique_ptr<Negation>;
-using FuncCallUP = std::unique_ptr<FuncCall>;
+using NegationUP = NodePtr<Negation>;
+using FuncCallUP = NodePtr<FuncCall>;
 
-using Factor = std::variant<std::string, int, bool, std::monostate, Designator,
+// String literal is a handle in the driver's LiteralPool, decoded and
+//   concatenated with the adjacent ones.
+using Factor = std::variant<pas::StringLiteral, int, bool, std::monostate, Designator,
                             ExprUP, NegationUP, FuncCallUP>;
 
 class Negation {
@@ -122,12 +125,12 @@ public:
     MultOp op;
     Factor factor;
   };
-  Term(Factor start_factor, std::vector<Op> ops)
+  Term(Factor start_factor, List<Op> ops)
       : start_factor_(std::move(start_factor)), ops_(std::move(ops)) {}
 
 public:
   Factor start_factor_;
-  std::vector<Op> ops_;
+  List<Op> ops_;
 };
 
 class SimpleExpr {
@@ -142,14 +145,14 @@ public:
     Term term;
   };
   SimpleExpr(std::optional<UnaryOp> unary_op, Term start_term,
-             std::vector<Op> ops)
+             List<Op> ops)
       : unary_op_(std::move(unary_op)), start_term_(std::move(start_term)),
         ops_(std::move(ops)) {}
 
 public:
   std::optional<UnaryOp> unary_op_;
   Term start_term_;
-  std::vector<Op> ops_;
+  List<Op> ops_;
 };
 
 class Expr {
@@ -188,12 +191,12 @@ public:
   FuncCall &operator=(FuncCall &&other) = default;
 
 public:
-  FuncCall(std::string func_ident, std::vector<Expr> params)
-      : func_ident_(std::move(func_ident)), params_(std::move(params)) {}
+  FuncCall(Ident func_ident, List<Expr> params)
+      : func_ident_(func_ident), params_(std::move(params)) {}
 
 public:
-  std::string func_ident_;
-  std::vector<Expr> params_;
+  Ident func_ident_;
+  List<Expr> params_;
 };
 
 } // namespace ast
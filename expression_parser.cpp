@@ -0,0 +1,256 @@
+#include "expression_parser.hh"
+#include "driver.hh"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace {
+
+using Kind = yy::parser::symbol_kind;
+
+// As clang's default -fbracket-depth. A level takes about 2 KiB of
+//   stack unoptimized, 3 KiB through an index or an argument list.
+constexpr unsigned MAX_NESTING = 256;
+
+// Tokens that name a variable or a function, classified or not.
+bool is_name(yy::parser::symbol_kind_type kind) {
+  return kind == Kind::S_identifier || kind == Kind::S_var_name ||
+         kind == Kind::S_func_name;
+}
+
+} // namespace
+
+const ExpressionParser::OperatorTable &ExpressionParser::Operators() {
+  static const OperatorTable table = [] {
+    OperatorTable table{};
+    auto set = [&table](yy::parser::symbol_kind_type kind, Level level,
+                        auto op) {
+      table[kind] = Operator{level, static_cast<uint8_t>(op)};
+    };
+    using pas::ast::AddOp;
+    using pas::ast::MultOp;
+    using pas::ast::RelOp;
+    set(Kind::S_EQ, Level::Relation, RelOp::Equal);
+    set(Kind::S_NEQ, Level::Relation, RelOp::NotEqual);
+    set(Kind::S_LT, Level::Relation, RelOp::Less);
+    set(Kind::S_GT, Level::Relation, RelOp::Greater);
+    set(Kind::S_LEQ, Level::Relation, RelOp::LessEqual);
+    set(Kind::S_GEQ, Level::Relation, RelOp::GreaterEqual);
+    set(Kind::S_IN, Level::Relation, RelOp::In);
+    set(Kind::S_PLUS, Level::Additive, AddOp::Plus);
+    set(Kind::S_MINUS, Level::Additive, AddOp::Minus);
+    set(Kind::S_OR, Level::Additive, AddOp::Or);
+    set(Kind::S_STAR, Level::Multiplicative, MultOp::Multiply);
+    set(Kind::S_SLASH, Level::Multiplicative, MultOp::RealDiv);
+    set(Kind::S_PERCENT, Level::Multiplicative, MultOp::Modulo);
+    set(Kind::S_DIV, Level::Multiplicative, MultOp::IntDiv);
+    set(Kind::S_MOD, Level::Multiplicative, MultOp::Modulo);
+    set(Kind::S_AND, Level::Multiplicative, MultOp::And);
+    return table;
+  }();
+  return table;
+}
+
+yy::parser::symbol_type ExpressionParser::ParseExpression() {
+  nesting_ = 0;
+  Advance();
+  const SourceLoc loc = token_.location;
+  return yy::parser::make_expression(Expression(), loc);
+}
+
+yy::parser::symbol_type ExpressionParser::ParseList(bool allow_empty) {
+  nesting_ = 0;
+  Advance();
+  const SourceLoc loc = token_.location;
+  return yy::parser::make_expression_list(
+      ExpressionList(Kind::S_RPAREN, allow_empty), loc);
+}
+
+pas::ast::Expr ExpressionParser::Expression() {
+  pas::ast::SimpleExpr lhs = SimpleExpression();
+  const Operator &relation = OperatorOf();
+  if (relation.level != Level::Relation) {
+    return pas::ast::Expr(std::move(lhs));
+  }
+  Advance();
+  // A relation is not associative, a second one ends the expression.
+  return pas::ast::Expr(
+      std::move(lhs),
+      pas::ast::Expr::Op{static_cast<pas::ast::RelOp>(relation.op),
+                         SimpleExpression()});
+}
+
+pas::ast::SimpleExpr ExpressionParser::SimpleExpression() {
+  std::optional<pas::ast::UnaryOp> unary_op;
+  if (At(Kind::S_PLUS) || At(Kind::S_MINUS)) {
+    unary_op = At(Kind::S_PLUS) ? pas::ast::UnaryOp::Plus
+                                : pas::ast::UnaryOp::Minus;
+    Advance();
+  }
+  pas::ast::Term start = Term();
+  pas::ast::List<pas::ast::SimpleExpr::Op> ops;
+  while (OperatorOf().level == Level::Additive) {
+    const auto op = static_cast<pas::ast::AddOp>(OperatorOf().op);
+    Advance();
+    ops.push_back(pas::ast::SimpleExpr::Op{op, Term()});
+  }
+  return pas::ast::SimpleExpr(unary_op, std::move(start), std::move(ops));
+}
+
+pas::ast::Term ExpressionParser::Term() {
+  pas::ast::Factor start = Factor();
+  pas::ast::List<pas::ast::Term::Op> ops;
+  while (OperatorOf().level == Level::Multiplicative) {
+    const auto op = static_cast<pas::ast::MultOp>(OperatorOf().op);
+    Advance();
+    ops.push_back(pas::ast::Term::Op{op, Factor()});
+  }
+  return pas::ast::Term(std::move(start), std::move(ops));
+}
+
+pas::ast::Factor ExpressionParser::Factor() {
+  // Left as it is on a throw, the next expression starts from 0.
+  if (nesting_ == MAX_NESTING) {
+    throw yy::parser::syntax_error(
+        token_.location, "expression is nested more than " +
+                             std::to_string(MAX_NESTING) + " levels deep");
+  }
+  ++nesting_;
+  pas::ast::Factor factor = NestedFactor();
+  --nesting_;
+  return factor;
+}
+
+pas::ast::Factor ExpressionParser::NestedFactor() {
+  const yy::parser::symbol_kind_type kind = token_.kind();
+  if (kind == Kind::S_number || kind == Kind::S_char_const) {
+    const int value = token_.value.as<int>();
+    Advance();
+    return value;
+  }
+  if (kind == Kind::S_string) {
+    return StringConst();
+  }
+  if (kind == Kind::S_TRUE || kind == Kind::S_FALSE) {
+    Advance();
+    return kind == Kind::S_TRUE;
+  }
+  if (kind == Kind::S_NIL) {
+    Advance();
+    return std::monostate();
+  }
+  if (is_name(kind)) {
+    return Name(Identifier());
+  }
+  if (kind == Kind::S_LPAREN) {
+    Advance();
+    auto expr = pas::ast::make<pas::ast::Expr>(Expression());
+    Expect(Kind::S_RPAREN);
+    return expr;
+  }
+  if (kind == Kind::S_EXCLMARK || kind == Kind::S_NOT) {
+    Advance();
+    return pas::ast::make<pas::ast::Negation>(Factor());
+  }
+  Fail("expression");
+}
+
+pas::ast::Factor ExpressionParser::Name(pas::Symbol name) {
+  if (At(Kind::S_LPAREN)) {
+    Advance();
+    pas::ast::List<pas::ast::Expr> args =
+        ExpressionList(Kind::S_RPAREN, true);
+    Expect(Kind::S_RPAREN);
+    return pas::ast::make<pas::ast::FuncCall>(name, std::move(args));
+  }
+
+  pas::ast::List<pas::ast::DesignatorItem> items;
+  while (true) {
+    if (At(Kind::S_DOT)) {
+      Advance();
+      items.emplace_back(pas::ast::DesignatorFieldAccess(Identifier()));
+    } else if (At(Kind::S_ARROW)) {
+      // p->f is (*p).f.
+      Advance();
+      items.emplace_back(pas::ast::DesignatorPointerAccess());
+      items.emplace_back(pas::ast::DesignatorFieldAccess(Identifier()));
+    } else if (At(Kind::S_CARET)) {
+      Advance();
+      items.emplace_back(pas::ast::DesignatorPointerAccess());
+    } else if (At(Kind::S_LBRACKET)) {
+      Advance();
+      pas::ast::List<pas::ast::Expr> indices =
+          ExpressionList(Kind::S_RBRACKET, false);
+      Expect(Kind::S_RBRACKET);
+      pas::ast::List<pas::ast::ExprUP> exprs;
+      exprs.reserve(indices.size());
+      for (pas::ast::Expr &index : indices) {
+        exprs.push_back(pas::ast::make<pas::ast::Expr>(std::move(index)));
+      }
+      items.emplace_back(pas::ast::DesignatorArrayAccess(std::move(exprs)));
+    } else {
+      return pas::ast::Designator(name, std::move(items));
+    }
+  }
+}
+
+pas::Symbol ExpressionParser::Identifier() {
+  if (!is_name(token_.kind())) {
+    Fail("identifier");
+  }
+  const pas::Symbol name = token_.value.as<pas::Symbol>();
+  Advance();
+  return name;
+}
+
+pas::StringLiteral ExpressionParser::StringConst() {
+  // Adjacent literals are one, concatenated in the pool.
+  bool first = true;
+  while (At(Kind::S_string)) {
+    const std::string_view body = token_.value.as<std::string_view>();
+    if (!(first ? driver_.literal_pool.start_pending(body)
+                : driver_.literal_pool.append_pending(body))) {
+      throw yy::parser::syntax_error(token_.location,
+                                     "escape sequence out of range");
+    }
+    first = false;
+    Advance();
+  }
+  return driver_.literal_pool.intern_pending();
+}
+
+pas::ast::List<pas::ast::Expr>
+ExpressionParser::ExpressionList(yy::parser::symbol_kind_type close,
+                                 bool allow_empty) {
+  pas::ast::List<pas::ast::Expr> exprs;
+  if (allow_empty && At(close)) {
+    return exprs;
+  }
+  exprs.push_back(Expression());
+  while (At(Kind::S_COMMA)) {
+    Advance();
+    exprs.push_back(Expression());
+  }
+  return exprs;
+}
+
+void ExpressionParser::Advance() {
+  yy::parser::symbol_type next = driver_.lex_token();
+  token_.clear();
+  token_.move(next);
+}
+
+void ExpressionParser::Expect(yy::parser::symbol_kind_type kind) {
+  if (!At(kind)) {
+    Fail(yy::parser::symbol_name(kind));
+  }
+  Advance();
+}
+
+void ExpressionParser::Fail(const std::string &expected) const {
+  throw yy::parser::syntax_error(token_.location,
+                                 "syntax error, unexpected " + token_.name() +
+                                     ", expecting " + expected);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "ast.hpp"
+#include "parser.hh"
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+class Driver;
+
+// Hand-written parser of full expressions. The grammar asks the driver
+//   for an expression where one starts (see ExpressionStart in
+//   parser.y), the driver runs this parser over the tokens and hands
+//   the tree to bison as a single expression token, so the chain of
+//   precedence nonterminals is never reduced.
+// Precedence climbing over a table of binary operators indexed by token
+//   kind: one lookup and one append per operator. The levels are the
+//   ones the AST has: a relation over simple expressions, additive
+//   operators over terms, multiplicative operators over factors. The
+//   trees are the same the grammar built.
+// Syntax errors are thrown as yy::parser::syntax_error, bison reports
+//   them as its own. Each parenthesis, negation, index or argument list
+//   nests a few C++ calls, so factors nest at most MAX_NESTING deep: a
+//   generated expression deeper than that is a syntax error, not a
+//   stack overflow.
+class ExpressionParser {
+public:
+  explicit ExpressionParser(Driver &driver) : driver_(driver) {}
+
+  ExpressionParser(const ExpressionParser &other) = delete;
+  ExpressionParser &operator=(const ExpressionParser &other) = delete;
+
+public:
+  // An expression token, from the next token of the lexer on.
+  yy::parser::symbol_type ParseExpression();
+  // An expression_list token: expressions separated by commas, up to
+  //   the closing bracket which is left to the parser.
+  yy::parser::symbol_type ParseList(bool allow_empty);
+
+  // The token that ended the expression, read ahead. It goes to the
+  //   parser next.
+  yy::parser::symbol_type TakeLookahead() { return std::move(token_); }
+
+private:
+  enum class Level : uint8_t { None, Relation, Additive, Multiplicative };
+
+  // Binary operator of a token kind, op is the value of the AST's enum
+  //   of the level.
+  struct Operator {
+    Level level = Level::None;
+    uint8_t op = 0;
+  };
+
+  using OperatorTable = std::array<Operator, yy::parser::YYNTOKENS>;
+  static const OperatorTable &Operators();
+
+  pas::ast::Expr Expression();
+  pas::ast::SimpleExpr SimpleExpression();
+  pas::ast::Term Term();
+  pas::ast::Factor Factor();
+  pas::ast::Factor NestedFactor();
+  // A designator or a function call, after its name.
+  pas::ast::Factor Name(pas::Symbol name);
+  pas::Symbol Identifier();
+  pas::StringLiteral StringConst();
+  pas::ast::List<pas::ast::Expr>
+  ExpressionList(yy::parser::symbol_kind_type close, bool allow_empty);
+
+  const Operator &OperatorOf() const { return Operators()[token_.kind()]; }
+  bool At(yy::parser::symbol_kind_type kind) const {
+    return token_.kind() == kind;
+  }
+  void Advance();
+  void Expect(yy::parser::symbol_kind_type kind);
+  // A syntax error at the current token, expected is what should be
+  //   there instead.
+  [[noreturn]] void Fail(const std::string &expected) const;
+
+private:
+  Driver &driver_;
+  yy::parser::symbol_type token_;
+  // Factors being parsed, each inside the one before.
+  unsigned nesting_ = 0;
+};
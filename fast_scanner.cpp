@@ -0,0 +1,582 @@
+#include "fast_scanner.hh"
+#include "driver.hh"
+#include "symbol_table.hh"
+#include "token_makers.hh"
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+using TokenKind = yy::parser::token::token_kind_type;
+using Token = yy::parser::token;
+
+// Character classes. Bytes above 0x7f are in none of them, as in
+//   scanner.l.
+bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+bool is_octal_digit(char c) { return c >= '0' && c <= '7'; }
+bool is_hex_digit(char c) {
+  return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+bool is_nondigit(char c) {
+  return c == '_' || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+bool is_ident_char(char c) { return is_nondigit(c) || is_digit(c); }
+
+// Block classification. Each function returns a mask with bit i set
+//   when byte i of the block is in the class. A block is 32 bytes with
+//   AVX2, 16 with SSE2 (always there on x86-64). Other targets only
+//   have the scalar loops.
+#if defined(__AVX2__)
+#define MCC_LEXER_SIMD 1
+using Vec = __m256i;
+constexpr size_t BLOCK_SIZE = 32;
+
+Vec load(const char *pos) {
+  return _mm256_loadu_si256(reinterpret_cast<const Vec *>(pos));
+}
+Vec splat(char c) { return _mm256_set1_epi8(c); }
+Vec eq(Vec lhs, Vec rhs) { return _mm256_cmpeq_epi8(lhs, rhs); }
+Vec gt(Vec lhs, Vec rhs) { return _mm256_cmpgt_epi8(lhs, rhs); }
+Vec vor(Vec lhs, Vec rhs) { return _mm256_or_si256(lhs, rhs); }
+Vec vand(Vec lhs, Vec rhs) { return _mm256_and_si256(lhs, rhs); }
+uint32_t to_mask(Vec v) {
+  return static_cast<uint32_t>(_mm256_movemask_epi8(v));
+}
+#elif defined(__SSE2__)
+#define MCC_LEXER_SIMD 1
+using Vec = __m128i;
+constexpr size_t BLOCK_SIZE = 16;
+
+Vec load(const char *pos) {
+  return _mm_loadu_si128(reinterpret_cast<const Vec *>(pos));
+}
+Vec splat(char c) { return _mm_set1_epi8(c); }
+Vec eq(Vec lhs, Vec rhs) { return _mm_cmpeq_epi8(lhs, rhs); }
+Vec gt(Vec lhs, Vec rhs) { return _mm_cmpgt_epi8(lhs, rhs); }
+Vec vor(Vec lhs, Vec rhs) { return _mm_or_si128(lhs, rhs); }
+Vec vand(Vec lhs, Vec rhs) { return _mm_and_si128(lhs, rhs); }
+uint32_t to_mask(Vec v) { return static_cast<uint32_t>(_mm_movemask_epi8(v)); }
+#endif
+
+#if defined(MCC_LEXER_SIMD)
+constexpr uint32_t FULL_MASK =
+    static_cast<uint32_t>((uint64_t(1) << BLOCK_SIZE) - 1);
+
+// Comparisons are signed, so bytes above 0x7f (negative) never fall
+//   into a range of ASCII characters.
+Vec in_range(Vec v, char low, char high) {
+  return vand(gt(v, splat(low - 1)), gt(splat(high + 1), v));
+}
+
+uint32_t blank_mask(Vec v) {
+  return to_mask(vor(vor(eq(v, splat(' ')), eq(v, splat('\t'))),
+                     eq(v, splat('\r'))));
+}
+
+uint32_t ident_mask(Vec v) {
+  Vec lower = vor(v, splat(0x20));
+  return to_mask(vor(vor(in_range(lower, 'a', 'z'), in_range(v, '0', '9')),
+                     eq(v, splat('_'))));
+}
+
+// Bytes that can be skipped inside of a literal quoted with quote.
+uint32_t quoted_mask(Vec v, char quote) {
+  Vec stop = vor(vor(eq(v, splat(quote)), eq(v, splat('\\'))),
+                 eq(v, splat('\n')));
+  return ~to_mask(stop) & FULL_MASK;
+}
+
+// Bytes that can be skipped inside of a block comment.
+uint32_t comment_mask(Vec v) {
+  return ~to_mask(vor(eq(v, splat('*')), eq(v, splat('\n')))) & FULL_MASK;
+}
+#endif
+
+// Skips bytes of a class: whole blocks while they are full of it,
+//   then byte by byte. Blocks never cross end, the source is not
+//   padded and may end right at a page boundary.
+template <typename BlockMask, typename ByteTest>
+const char *skip_class([[maybe_unused]] BlockMask block_mask,
+                       ByteTest byte_test, const char *pos,
+                       const char *end) {
+#if defined(MCC_LEXER_SIMD)
+  while (static_cast<size_t>(end - pos) >= BLOCK_SIZE) {
+    uint32_t stop = ~block_mask(load(pos)) & FULL_MASK;
+    if (stop != 0) {
+      return pos + std::countr_zero(stop);
+    }
+    pos += BLOCK_SIZE;
+  }
+#endif
+  while (pos != end && byte_test(*pos)) {
+    ++pos;
+  }
+  return pos;
+}
+
+const char *skip_blanks(const char *pos, const char *end) {
+#if defined(MCC_LEXER_SIMD)
+  return skip_class(blank_mask, is_blank, pos, end);
+#else
+  return skip_class(nullptr, is_blank, pos, end);
+#endif
+}
+
+const char *skip_ident_chars(const char *pos, const char *end) {
+#if defined(MCC_LEXER_SIMD)
+  return skip_class(ident_mask, is_ident_char, pos, end);
+#else
+  return skip_class(nullptr, is_ident_char, pos, end);
+#endif
+}
+
+const char *skip_quoted_text(const char *pos, const char *end, char quote) {
+  auto byte_test = [quote](char c) {
+    return c != quote && c != '\\' && c != '\n';
+  };
+#if defined(MCC_LEXER_SIMD)
+  return skip_class([quote](Vec v) { return quoted_mask(v, quote); },
+                    byte_test, pos, end);
+#else
+  return skip_class(nullptr, byte_test, pos, end);
+#endif
+}
+
+const char *skip_comment_text(const char *pos, const char *end) {
+  auto byte_test = [](char c) { return c != '*' && c != '\n'; };
+#if defined(MCC_LEXER_SIMD)
+  return skip_class(comment_mask, byte_test, pos, end);
+#else
+  return skip_class(nullptr, byte_test, pos, end);
+#endif
+}
+
+// Escape sequence starting with the backslash at pos, see
+//   escape_sequence in scanner.l. Returns its end or nullptr if
+//   there is no valid escape sequence.
+const char *match_escape(const char *pos, const char *end) {
+  if (end - pos < 2) {
+    return nullptr;
+  }
+
+  switch (pos[1]) {
+  case '\'': case '"': case '?': case '\\':
+  case 'a': case 'b': case 'f': case 'n': case 'r': case 't': case 'v':
+    return pos + 2;
+
+  case 'x': {
+    const char *digits_end = pos + 2;
+    while (digits_end != end && is_hex_digit(*digits_end)) {
+      ++digits_end;
+    }
+    return digits_end == pos + 2 ? nullptr : digits_end;
+  }
+
+  default: {
+    // Up to three octal digits. Whatever digits follow are just
+    //   characters of the literal, so being greedy here is fine.
+    const char *digits_end = pos + 1;
+    while (digits_end != end && digits_end - pos <= 3 &&
+           is_octal_digit(*digits_end)) {
+      ++digits_end;
+    }
+    return digits_end == pos + 1 ? nullptr : digits_end;
+  }
+  }
+}
+
+// Integer suffix starting at pos, see integer_suffix in scanner.l.
+//   Returns its end, pos if there is none. Longest match, like flex:
+//   "1lul" is "1lu" followed by the identifier "l".
+const char *skip_integer_suffix(const char *pos, const char *end) {
+  auto at = [pos, end](size_t i) { return pos + i < end ? pos[i] : '\0'; };
+  auto is_u = [](char c) { return c == 'u' || c == 'U'; };
+  auto is_l = [](char c) { return c == 'l' || c == 'L'; };
+  // ll or LL, but not lL.
+  auto long_length = [&](size_t i) -> size_t {
+    if (!is_l(at(i))) {
+      return 0;
+    }
+    return at(i + 1) == at(i) ? 2 : 1;
+  };
+
+  if (is_u(at(0))) {
+    return pos + 1 + long_length(1);
+  }
+  size_t length = long_length(0);
+  if (length != 0 && is_u(at(length))) {
+    length += 1;
+  }
+  return pos + length;
+}
+
+// Keywords, found with a perfect hash of the first two characters,
+//   the last one and the length. Parameters are picked so that C99
+//   keywords don't collide, the constructor checks that at compile time.
+struct Keyword {
+  std::string_view text;
+  TokenKind kind;
+};
+
+constexpr Keyword KEYWORDS[] = {
+    {"auto", Token::TOK_AUTO},         {"break", Token::TOK_BREAK},
+    {"case", Token::TOK_CASE},         {"char", Token::TOK_CHAR},
+    {"const", Token::TOK_CONST},       {"continue", Token::TOK_CONTINUE},
+    {"default", Token::TOK_DEFAULT},   {"do", Token::TOK_DO},
+    {"double", Token::TOK_DOUBLE},     {"else", Token::TOK_ELSE},
+    {"enum", Token::TOK_ENUM},         {"extern", Token::TOK_EXTERN},
+    {"float", Token::TOK_FLOAT},       {"for", Token::TOK_FOR},
+    {"goto", Token::TOK_GOTO},         {"if", Token::TOK_IF},
+    {"inline", Token::TOK_INLINE},     {"int", Token::TOK_INT},
+    {"long", Token::TOK_LONG},         {"register", Token::TOK_REGISTER},
+    {"restrict", Token::TOK_RESTRICT}, {"return", Token::TOK_RETURN},
+    {"short", Token::TOK_SHORT},       {"signed", Token::TOK_SIGNED},
+    {"sizeof", Token::TOK_SIZEOF},     {"static", Token::TOK_STATIC},
+    {"struct", Token::TOK_STRUCT},     {"switch", Token::TOK_SWITCH},
+    {"typedef", Token::TOK_TYPEDEF},   {"union", Token::TOK_UNION},
+    {"unsigned", Token::TOK_UNSIGNED}, {"void", Token::TOK_VOID},
+    {"volatile", Token::TOK_VOLATILE}, {"while", Token::TOK_WHILE},
+    {"_Bool", Token::TOK_BOOL},        {"_Complex", Token::TOK_COMPLEX},
+    {"_Imaginary", Token::TOK_IMAGINARY},
+};
+
+class KeywordTable {
+public:
+  static constexpr size_t MIN_LENGTH = 2;
+  static constexpr size_t MAX_LENGTH = 10;
+
+  consteval KeywordTable() {
+    for (const Keyword &keyword : KEYWORDS) {
+      size_t slot = hash(keyword.text);
+      if (!slots_[slot].text.empty()) {
+        throw "keyword hash collision, pick other multipliers";
+      }
+      slots_[slot] = keyword;
+    }
+  }
+
+  // Length is checked by the caller, text has at least two characters.
+  constexpr const Keyword *find(std::string_view text) const {
+    const Keyword &slot = slots_[hash(text)];
+    return slot.text == text ? &slot : nullptr;
+  }
+
+private:
+  static constexpr size_t SIZE = 128;
+  static constexpr uint32_t FIRST_MULTIPLIER = 1;
+  static constexpr uint32_t SECOND_MULTIPLIER = 35;
+
+  static constexpr size_t hash(std::string_view text) {
+    uint32_t key = static_cast<uint8_t>(text[0]) * FIRST_MULTIPLIER +
+                   static_cast<uint8_t>(text[1]) * SECOND_MULTIPLIER +
+                   static_cast<uint8_t>(text.back()) +
+                   static_cast<uint32_t>(text.size());
+    return ((key * 2654435761u) >> 8) % SIZE;
+  }
+
+private:
+  std::array<Keyword, SIZE> slots_{};
+};
+
+constexpr KeywordTable KEYWORD_TABLE;
+
+} // namespace
+
+void FastScanner::Restart() {
+  begin_ = driver.source_.data();
+  cur_ = begin_ + driver.lex_start_;
+  end_ = begin_ + driver.source_.size();
+  source_end_ = end_;
+  token_start_ = cur_;
+  ended_in_comment_ = false;
+}
+
+SourceLoc FastScanner::LocationOf(const char *pos) const {
+  return SourceLoc{static_cast<uint32_t>(pos - begin_)};
+}
+
+void FastScanner::SkipLineComment() {
+  // The newline itself is left for the main loop, as in scanner.l.
+  const void *newline = std::memchr(cur_, '\n', end_ - cur_);
+  cur_ = newline != nullptr ? static_cast<const char *>(newline) : end_;
+}
+
+void FastScanner::RestartChunk(size_t from, size_t to) {
+  Restart();
+  cur_ = begin_ + from;
+  end_ = begin_ + to;
+  token_start_ = cur_;
+}
+
+void FastScanner::SkipBlockComment() {
+  cur_ += 2;
+  ContinueComment();
+}
+
+void FastScanner::ContinueComment() {
+  while (true) {
+    cur_ = skip_comment_text(cur_, end_);
+    if (cur_ == end_) {
+      if (end_ != source_end_) {
+        // The comment goes on in the next chunk.
+        ended_in_comment_ = true;
+        return;
+      }
+      throw yy::parser::syntax_error(LocationOf(cur_), "unterminated comment");
+    }
+    if (end_ - cur_ >= 2 && cur_[0] == '*' && cur_[1] == '/') {
+      cur_ += 2;
+      return;
+    }
+    // A newline or a star not followed by a slash.
+    cur_ += 1;
+  }
+}
+
+yy::parser::symbol_type FastScanner::MakeToken(Token::token_kind_type kind,
+                                               size_t length) {
+  cur_ += length;
+  token_kind_ = kind;
+  return yy::parser::symbol_type(kind, LocationOf(token_start_));
+}
+
+void FastScanner::InvalidCharacter() {
+  std::string character(1, *cur_);
+  throw yy::parser::syntax_error(LocationOf(cur_),
+                                 "invalid character: " + character);
+}
+
+const char *FastScanner::MatchQuoted(const char *pos, bool allow_empty) const {
+  const char quote = *pos;
+  const char *body = pos + 1;
+  const char *cur = body;
+  while (true) {
+    cur = skip_quoted_text(cur, end_, quote);
+    if (cur == end_ || *cur == '\n') {
+      return nullptr;
+    }
+    if (*cur == quote) {
+      break;
+    }
+    cur = match_escape(cur, end_);
+    if (cur == nullptr) {
+      return nullptr;
+    }
+  }
+  if (!allow_empty && cur == body) {
+    return nullptr;
+  }
+  return cur + 1;
+}
+
+yy::parser::symbol_type FastScanner::ScanIdentifier() {
+  const char *start = cur_;
+
+  // L'...' and L"..." are wide literals. If the literal is not valid,
+  //   flex would match L as an identifier, so do we.
+  if (*start == 'L' && end_ - start >= 2 &&
+      (start[1] == '\'' || start[1] == '"')) {
+    bool is_char = start[1] == '\'';
+    if (const char *literal_end = MatchQuoted(start + 1, !is_char)) {
+      cur_ = literal_end;
+      std::string_view text(start, literal_end - start);
+      token_kind_ =
+          is_char ? Token::TOK_long_char_const : Token::TOK_long_string;
+      return is_char ? make_long_char_const(text, LocationOf(start))
+                     : make_long_str_literal(text, LocationOf(start));
+    }
+  }
+
+  cur_ = skip_ident_chars(start + 1, end_);
+  std::string_view text(start, cur_ - start);
+  const SourceLoc loc = LocationOf(start);
+
+  if (text.size() >= KeywordTable::MIN_LENGTH &&
+      text.size() <= KeywordTable::MAX_LENGTH) {
+    if (const Keyword *keyword = KEYWORD_TABLE.find(text)) {
+      token_kind_ = keyword->kind;
+      return yy::parser::symbol_type(keyword->kind, loc);
+    }
+  }
+  token_kind_ = Token::TOK_identifier;
+  if (raw_identifiers_) {
+    return yy::parser::make_identifier(pas::SymbolTable::global().intern(text),
+                                       loc);
+  }
+  return driver.make_identifier_or_name(text, loc);
+}
+
+yy::parser::symbol_type FastScanner::ScanNumber() {
+  const char *start = cur_;
+  const char *digits_end = start + 1;
+  int base = 10;
+
+  if (*start != '0') {
+    while (digits_end != end_ && is_digit(*digits_end)) {
+      ++digits_end;
+    }
+  } else if (end_ - start >= 3 && (start[1] | 0x20) == 'x' &&
+             is_hex_digit(start[2])) {
+    base = 16;
+    digits_end = start + 3;
+    while (digits_end != end_ && is_hex_digit(*digits_end)) {
+      ++digits_end;
+    }
+  } else {
+    // "0" alone is octal too. "09" is "0" followed by "9".
+    base = 8;
+    while (digits_end != end_ && is_octal_digit(*digits_end)) {
+      ++digits_end;
+    }
+  }
+
+  cur_ = skip_integer_suffix(digits_end, end_);
+  token_kind_ = Token::TOK_number;
+  return make_number(std::string_view(start, cur_ - start), base,
+                     LocationOf(start));
+}
+
+yy::parser::symbol_type FastScanner::ScanToken() {
+  while (true) {
+    token_start_ = cur_;
+    if (cur_ == end_) {
+      token_kind_ = Token::TOK_EOF;
+      return yy::parser::make_EOF(LocationOf(cur_));
+    }
+
+    auto next_is = [this](size_t i, char c) {
+      return end_ - cur_ > static_cast<ptrdiff_t>(i) && cur_[i] == c;
+    };
+
+    switch (const char c = *cur_) {
+    case ' ': case '\t': case '\r':
+      cur_ = skip_blanks(cur_ + 1, end_);
+      continue;
+
+    case '\n':
+      cur_ += 1;
+      continue;
+
+    case '/':
+      if (next_is(1, '/')) {
+        SkipLineComment();
+        continue;
+      }
+      if (next_is(1, '*')) {
+        SkipBlockComment();
+        continue;
+      }
+      return next_is(1, '=') ? MakeToken(Token::TOK_SLASH_EQ, 2)
+                             : MakeToken(Token::TOK_SLASH, 1);
+
+    case '[': return MakeToken(Token::TOK_LBRACKET, 1);
+    case ']': return MakeToken(Token::TOK_RBRACKET, 1);
+    case '(': return MakeToken(Token::TOK_LPAREN, 1);
+    case ')': return MakeToken(Token::TOK_RPAREN, 1);
+    case '{': return MakeToken(Token::TOK_LBRACE, 1);
+    case '}': return MakeToken(Token::TOK_RBRACE, 1);
+    case '~': return MakeToken(Token::TOK_TILDE, 1);
+    case '?': return MakeToken(Token::TOK_QSTN_MARK, 1);
+    case ':': return MakeToken(Token::TOK_COLON, 1);
+    case ';': return MakeToken(Token::TOK_SEMICOLON, 1);
+    case ',': return MakeToken(Token::TOK_COMMA, 1);
+    case '#': return MakeToken(Token::TOK_NUMSIGN, 1);
+
+    case '.':
+      return next_is(1, '.') && next_is(2, '.')
+                 ? MakeToken(Token::TOK_ELLIPSIS, 3)
+                 : MakeToken(Token::TOK_DOT, 1);
+
+    case '-':
+      if (next_is(1, '>')) {
+        return MakeToken(Token::TOK_ARROW, 2);
+      }
+      return next_is(1, '=') ? MakeToken(Token::TOK_MINUS_EQ, 2)
+                             : MakeToken(Token::TOK_MINUS, 1);
+
+    case '&':
+      if (next_is(1, '&')) {
+        return MakeToken(Token::TOK_AND, 2);
+      }
+      return next_is(1, '=') ? MakeToken(Token::TOK_AND_EQ, 2)
+                             : MakeToken(Token::TOK_BIN_AND, 1);
+
+    case '|':
+      if (next_is(1, '|')) {
+        return MakeToken(Token::TOK_OR, 2);
+      }
+      return next_is(1, '=') ? MakeToken(Token::TOK_OR_EQ, 2)
+                             : MakeToken(Token::TOK_BIN_OR, 1);
+
+    case '*':
+      return next_is(1, '=') ? MakeToken(Token::TOK_STAR_EQ, 2)
+                             : MakeToken(Token::TOK_STAR, 1);
+    case '+':
+      return next_is(1, '=') ? MakeToken(Token::TOK_PLUS_EQ, 2)
+                             : MakeToken(Token::TOK_PLUS, 1);
+    case '!':
+      return next_is(1, '=') ? MakeToken(Token::TOK_NEQ, 2)
+                             : MakeToken(Token::TOK_EXCLMARK, 1);
+    case '%':
+      return next_is(1, '=') ? MakeToken(Token::TOK_PERC_EQ, 2)
+                             : MakeToken(Token::TOK_PERCENT, 1);
+    case '^':
+      return next_is(1, '=') ? MakeToken(Token::TOK_CARET_EQ, 2)
+                             : MakeToken(Token::TOK_CARET, 1);
+    case '=':
+      return next_is(1, '=') ? MakeToken(Token::TOK_EQ, 2)
+                             : MakeToken(Token::TOK_EQ_SIGN, 1);
+
+    case '<':
+      if (next_is(1, '<')) {
+        return next_is(2, '=') ? MakeToken(Token::TOK_SHL_EQ, 3)
+                               : MakeToken(Token::TOK_SHL, 2);
+      }
+      return next_is(1, '=') ? MakeToken(Token::TOK_LEQ, 2)
+                             : MakeToken(Token::TOK_LT, 1);
+
+    case '>':
+      if (next_is(1, '>')) {
+        return next_is(2, '=') ? MakeToken(Token::TOK_SHR_EQ, 3)
+                               : MakeToken(Token::TOK_SHR, 2);
+      }
+      return next_is(1, '=') ? MakeToken(Token::TOK_GEQ, 2)
+                             : MakeToken(Token::TOK_GT, 1);
+
+    case '\'':
+    case '"': {
+      const char *start = cur_;
+      const char *literal_end = MatchQuoted(start, c == '"');
+      if (literal_end == nullptr) {
+        InvalidCharacter();
+      }
+      cur_ = literal_end;
+      std::string_view text(start, literal_end - start);
+      token_kind_ = c == '"' ? Token::TOK_string : Token::TOK_char_const;
+      return c == '"' ? make_str_literal(text, LocationOf(start))
+                      : make_char_const(text, LocationOf(start));
+    }
+
+    default:
+      if (is_digit(c)) {
+        return ScanNumber();
+      }
+      if (is_nondigit(c)) {
+        return ScanIdentifier();
+      }
+      InvalidCharacter();
+    }
+  }
+}
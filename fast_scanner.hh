@@ -0,0 +1,80 @@
+#pragma once
+
+#include "parser.hh"
+
+#include <cstddef>
+
+class Driver;
+
+// Hand-written lexer for the same language as the flex Scanner,
+//   producing exactly the same tokens with the same locations.
+// It scans the driver's SourceFile in place: no buffer refill, no
+//   per-match action. Runs of blanks, identifier characters and
+//   literal bodies are classified 16 or 32 bytes at a time with SSE2
+//   or AVX2 (whichever the build targets), keywords are found with a
+//   perfect hash built at compile time.
+class FastScanner {
+public:
+  FastScanner(Driver &driver) : driver(driver) {}
+
+  // Starts scanning the driver's source from the beginning.
+  void Restart();
+
+  // Scans only [from, to) of the source, see ChunkedLexer. The end of
+  //   the chunk is reported as the end of file. Offsets and locations
+  //   of tokens are still from the beginning of the source.
+  void RestartChunk(size_t from, size_t to);
+
+  // Skips the rest of a block comment the cursor is in. A chunk may
+  //   start inside of a comment.
+  void ContinueComment();
+
+  // The chunk ended inside of a block comment.
+  bool EndedInComment() const { return ended_in_comment_; }
+
+  yy::parser::symbol_type ScanToken();
+
+  // Raw mode leaves identifiers unclassified: every one comes out as
+  //   "identifier", the consumer asks the scope tracker later. Needed
+  //   when scanning ahead of the parser, declarations are not known yet.
+  void SetRawIdentifiers(bool raw) { raw_identifiers_ = raw; }
+
+  // The token just scanned: its kind (meaningful in raw mode, where it
+  //   is not refined by the scope tracker), offset in the source and length.
+  yy::parser::token::token_kind_type TokenKind() const { return token_kind_; }
+  size_t TokenOffset() const { return token_start_ - begin_; }
+  size_t TokenLength() const { return cur_ - token_start_; }
+
+  Driver &driver;
+
+private:
+  // A location is just the offset, no line or column is tracked.
+  SourceLoc LocationOf(const char *pos) const;
+
+  // Skips a comment starting at the cursor, throws if it's unterminated.
+  void SkipLineComment();
+  void SkipBlockComment();
+
+  yy::parser::symbol_type MakeToken(yy::parser::token::token_kind_type kind,
+                                    size_t length);
+
+  yy::parser::symbol_type ScanIdentifier();
+  yy::parser::symbol_type ScanNumber();
+
+  // Literal starting with the quote at pos. Returns the end of the
+  //   literal or nullptr if there is no valid literal there.
+  const char *MatchQuoted(const char *pos, bool allow_empty) const;
+
+  [[noreturn]] void InvalidCharacter();
+
+private:
+  const char *begin_ = nullptr;
+  const char *cur_ = nullptr;
+  const char *end_ = nullptr;
+  const char *source_end_ = nullptr;
+  const char *token_start_ = nullptr;
+  yy::parser::token::token_kind_type token_kind_ =
+      yy::parser::token::TOK_EOF;
+  bool raw_identifiers_ = false;
+  bool ended_in_comment_ = false;
+};
@@ -0,0 +1,144 @@
+#include "file_cache.hh"
+
+#include "exceptions.hh"
+
+#include <climits>
+#include <cstdlib>
+#include <utility>
+
+#include <sys/stat.h>
+
+namespace {
+
+// As precompiled_header.cpp stamps the files of a header.
+bool stamp_file(const std::string &path, uint64_t &size, int64_t &mtime_ns) {
+  struct stat file_stat;
+  if (::stat(path.c_str(), &file_stat) != 0) {
+    return false;
+  }
+  size = static_cast<uint64_t>(file_stat.st_size);
+  mtime_ns = static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 +
+             file_stat.st_mtim.tv_nsec;
+  return true;
+}
+
+} // namespace
+
+std::optional<std::string> FileCache::canonical(const std::string &path) {
+  struct stat file_stat;
+  if (stat(path.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+    return std::nullopt;
+  }
+  char resolved[PATH_MAX];
+  if (realpath(path.c_str(), resolved) == nullptr) {
+    return std::nullopt;
+  }
+  return std::string(resolved);
+}
+
+FileCache::Entry &FileCache::insert(const std::string &key,
+                                    const std::string &path,
+                                    SourceFile source) {
+  auto entry = std::make_unique<Entry>();
+  entry->path = path;
+  entry->source = std::move(source);
+  if (key != "-") {
+    stamp_file(key, entry->size, entry->mtime_ns);
+  }
+  Entry &result = *entry;
+  entries_.emplace(key, std::move(entry));
+  return result;
+}
+
+FileCache::Entry &FileCache::open(const std::string &path) {
+  // Stdin can only be read once, it's cached under its name.
+  std::optional<std::string> key =
+      path.empty() || path == "-" ? std::optional<std::string>("-")
+                                  : canonical(path);
+  if (!key.has_value()) {
+    throw IOProblemException("can't open " + path);
+  }
+  auto it = entries_.find(key.value());
+  if (it != entries_.end()) {
+    return *it->second;
+  }
+  return insert(key.value(), path, SourceFile::open(path));
+}
+
+FileCache::Entry &FileCache::adopt(const std::string &path,
+                                   SourceFile source) {
+  std::string key = path.empty() || path == "-"
+                        ? std::string("-")
+                        : canonical(path).value_or(path);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    // Opened again by the driver, keep the new contents and learn
+    //   about them again.
+    it->second->source = std::move(source);
+    it->second->pragma_once = false;
+    it->second->guard.reset();
+    if (key != "-") {
+      stamp_file(key, it->second->size, it->second->mtime_ns);
+    }
+    return *it->second;
+  }
+  return insert(key, path, std::move(source));
+}
+
+void FileCache::refresh() {
+  for (auto &[key, entry] : entries_) {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    // Stdin can't be read again. A file that is gone keeps its last
+    //   contents until an include of it fails to resolve.
+    if (key == "-" || !stamp_file(key, size, mtime_ns) ||
+        (size == entry->size && mtime_ns == entry->mtime_ns)) {
+      continue;
+    }
+    entry->source = SourceFile::open(key);
+    entry->pragma_once = false;
+    entry->guard.reset();
+    entry->size = size;
+    entry->mtime_ns = mtime_ns;
+  }
+  lookups_.clear();
+}
+
+FileCache::Entry *FileCache::find_include(const std::string &includer_dir,
+                                          const std::string &name,
+                                          bool angled) {
+  std::string lookup_key = angled ? std::string("<>") : includer_dir;
+  lookup_key.push_back('\0');
+  lookup_key += name;
+  auto cached = lookups_.find(lookup_key);
+  if (cached != lookups_.end()) {
+    return cached->second;
+  }
+
+  Entry *found = nullptr;
+  auto try_path = [&](const std::string &path) {
+    std::optional<std::string> key = canonical(path);
+    if (!key.has_value()) {
+      return false;
+    }
+    auto it = entries_.find(key.value());
+    found = it != entries_.end()
+                ? it->second.get()
+                : &insert(key.value(), path, SourceFile::open(path));
+    return true;
+  };
+
+  const bool absolute = !name.empty() && name.front() == '/';
+  if (absolute) {
+    try_path(name);
+  } else if (angled || !try_path(includer_dir + name)) {
+    for (const std::string &dir : include_dirs_) {
+      if (try_path(dir + '/' + name)) {
+        break;
+      }
+    }
+  }
+
+  lookups_.emplace(std::move(lookup_key), found);
+  return found;
+}
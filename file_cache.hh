@@ -0,0 +1,71 @@
+#pragma once
+
+#include "source_file.hh"
+#include "symbol_table.hh"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Sources opened during a run, each mapped once however many times and
+//   from however many translation units it's included. The cache also
+//   remembers how include names resolved, so a repeated #include costs
+//   a hash lookup, not a round of stat calls.
+class FileCache {
+public:
+  struct Entry {
+    // As it was found, for diagnostics and relative includes.
+    std::string path;
+    SourceFile source;
+
+    // Learnt the first time the file is preprocessed, they don't depend
+    //   on the translation unit. A file with "#pragma once" or an
+    //   include guard (the guard macro is defined) is not entered again.
+    bool pragma_once = false;
+    std::optional<pas::Symbol> guard;
+
+    // Size and modification time when the source was read, for refresh.
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+  };
+
+  // The file at path, opened on the first call. Throws if it can't be opened.
+  Entry &open(const std::string &path);
+
+  // Makes an already opened source the entry for path, used for the
+  //   main file: the driver reads it before knowing if it needs the
+  //   preprocessor at all.
+  Entry &adopt(const std::string &path, SourceFile source);
+
+  // Resolves an include name: relative to the includer's directory
+  //   first unless it's a <name>, then in the include directories.
+  //   includer_dir is empty or ends with a slash. Returns nullptr if
+  //   there is no such file.
+  Entry *find_include(const std::string &includer_dir, const std::string &name,
+                      bool angled);
+
+  // For a run that goes on while files are edited (-session): reads
+  //   again every source whose size or modification time changed since
+  //   it was read, entries stay where they are. Include names are
+  //   resolved again, a new file may shadow an old one.
+  void refresh();
+
+  void add_include_dir(std::string dir) { include_dirs_.push_back(std::move(dir)); }
+
+private:
+  // Canonical path of an existing regular file, nullopt if there is none.
+  static std::optional<std::string> canonical(const std::string &path);
+
+  Entry &insert(const std::string &key, const std::string &path,
+                SourceFile source);
+
+private:
+  std::vector<std::string> include_dirs_;
+  // Canonical path -> entry.
+  std::unordered_map<std::string, std::unique_ptr<Entry>> entries_;
+  // Includer directory and include name -> entry, nullptr if not found.
+  std::unordered_map<std::string, Entry *> lookups_;
+};
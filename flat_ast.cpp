@@ -0,0 +1,742 @@
+#include "flat_ast.hh"
+
+#include <get_idx.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <unordered_set>
+
+namespace pas {
+namespace flat {
+
+// Builds the tree bottom-up. A node's children are flattened first and
+//   their ids are pushed to pending_, then moved to the side array as
+//   one range. Children of children are done with by then, so each
+//   list is contiguous.
+// The pointer AST is walked from a work stack on the heap, as Walker
+//   walks the flat one, so deep statements and expressions don't
+//   overflow the C++ stack. Visiting a node adds it right away if it
+//   has no children. Otherwise it queues its children and an End task,
+//   which adds the node over the ids its children pushed. Nodes get the
+//   ids a recursive walk would give them.
+// Shared exprs are looked up as they are added: children are shared
+//   already, so a node is compared to others by its own fields and its
+//   children's ids, never deeper.
+class Flattener {
+public:
+  explicit Flattener(Tree &tree)
+      : tree_(tree), shared_(0, ExprHash{tree}, SameExpr{tree}) {}
+
+  void Program(const pas::ast::ProgramModule &pm) {
+    tree_.program_name_ = pm.program_name_.id();
+    tasks_.push_back(Visit(Step::Block, &pm.block_));
+    Run();
+    tree_.program_block_ = pending_.back();
+    pending_.pop_back();
+    assert(pending_.empty());
+  }
+
+private:
+  enum class Step : uint8_t {
+    // Visits the node of the pointer AST of its name.
+    Block,
+    ConstDef,
+    TypeDef,
+    VarDecl,
+    Subprogram,
+    Param,
+    Type,
+    Field,
+    Stmt,
+    CaseArm,
+    Label,
+    Expr,
+    SimpleExpr,
+    Term,
+    Factor,
+    Designator,
+    Item,
+    // Pushes the ids of a list of names, the bound exprs of a list of
+    //   subranges or a value.
+    Names,
+    Bounds,
+    Value,
+    // Commits a block's declarations, then its statements.
+    Decls,
+    BlockEnd,
+    // Adds a node of the class with the children pushed since mark.
+    ExprEnd,
+    StmtEnd,
+    DeclEnd,
+    TypeEnd,
+  };
+
+  struct Task {
+    Step step;
+    // Of the node an End task adds. With value_first the first child
+    //   is its value: the type of a Var, an Array or a Field.
+    uint8_t kind = 0;
+    uint8_t op = 0;
+    bool value_first = false;
+    uint32_t value = 0;
+    uint32_t mark = 0;
+    const void *node = nullptr;
+  };
+
+  static Task Visit(Step step, const void *node) {
+    return Task{step, 0, 0, false, 0, 0, node};
+  }
+  static Task Value(uint32_t value) {
+    return Task{Step::Value, 0, 0, false, value, 0, nullptr};
+  }
+  template <typename Kind>
+  Task End(Step step, Kind kind, uint32_t value = 0, uint8_t op = 0) const {
+    assert(Mark() <= std::numeric_limits<uint32_t>::max());
+    return Task{step,  static_cast<uint8_t>(kind), op, false, value,
+                static_cast<uint32_t>(Mark()), nullptr};
+  }
+  template <typename Kind> Task EndWithValue(Step step, Kind kind) const {
+    Task task = End(step, kind);
+    task.value_first = true;
+    return task;
+  }
+
+  // Tasks a visit queues are added in the order they are to run, Queue
+  //   puts them on the stack so that the first one runs next. An End
+  //   task takes the mark when it's made, before its children run.
+  void Then(Task task) { batch_.push_back(task); }
+  void Queue() {
+    tasks_.insert(tasks_.end(), batch_.rbegin(), batch_.rend());
+    batch_.clear();
+  }
+
+  void Run() {
+    while (!tasks_.empty()) {
+      const Task task = tasks_.back();
+      tasks_.pop_back();
+      Do(task);
+    }
+  }
+
+  void Do(const Task &task) {
+    switch (task.step) {
+    case Step::Block:
+      return Block(*static_cast<const pas::ast::Block *>(task.node));
+    case Step::ConstDef: {
+      const auto &def = *static_cast<const pas::ast::ConstDef *>(task.node);
+      size_t mark = Mark();
+      pending_.push_back(ConstExpr(def.const_expr_));
+      pending_.push_back(
+          AddDecl(DeclKind::Const, def.ident_.id(), Commit(mark)));
+      return;
+    }
+    case Step::TypeDef: {
+      const auto &def = *static_cast<const pas::ast::TypeDef *>(task.node);
+      Then(Visit(Step::Type, &def.type_));
+      Then(End(Step::DeclEnd, DeclKind::Type, def.ident_.id()));
+      return Queue();
+    }
+    case Step::VarDecl: {
+      const auto &decl = *static_cast<const pas::ast::VarDecl *>(task.node);
+      Then(Visit(Step::Type, &decl.type_));
+      Then(Visit(Step::Names, &decl.ident_list_));
+      Then(EndWithValue(Step::DeclEnd, DeclKind::Var));
+      return Queue();
+    }
+    case Step::Subprogram:
+      return Subprogram(*static_cast<const pas::ast::SubprogDecl *>(task.node));
+    case Step::Param: {
+      const auto &param =
+          *static_cast<const pas::ast::FormalParam *>(task.node);
+      pending_.push_back(AddDecl(DeclKind::Param, param.type_ident_.id(),
+                                 Names(param.proc_name_)));
+      return;
+    }
+    case Step::Type:
+      return Type(*static_cast<const pas::ast::Type *>(task.node));
+    case Step::Field: {
+      const auto &field = *static_cast<const pas::ast::FieldList *>(task.node);
+      Then(Visit(Step::Type, &field.type_));
+      Then(Visit(Step::Names, &field.idents_));
+      Then(EndWithValue(Step::TypeEnd, TypeKind::Field));
+      return Queue();
+    }
+    case Step::Stmt:
+      return Stmt(*static_cast<const pas::ast::Stmt *>(task.node));
+    case Step::CaseArm: {
+      const auto &arm = *static_cast<const pas::ast::Case *>(task.node);
+      Then(Visit(Step::Stmt, &arm.then_stmt_));
+      for (const pas::ast::ConstExpr &label : arm.labels_) {
+        Then(Visit(Step::Label, &label));
+      }
+      Then(End(Step::StmtEnd, StmtKind::CaseArm));
+      return Queue();
+    }
+    case Step::Label:
+      pending_.push_back(
+          ConstExpr(*static_cast<const pas::ast::ConstExpr *>(task.node)));
+      return;
+    case Step::Expr:
+      return Expr(*static_cast<const pas::ast::Expr *>(task.node));
+    case Step::SimpleExpr:
+      return SimpleExpr(*static_cast<const pas::ast::SimpleExpr *>(task.node));
+    case Step::Term:
+      return Term(*static_cast<const pas::ast::Term *>(task.node));
+    case Step::Factor:
+      return Factor(*static_cast<const pas::ast::Factor *>(task.node));
+    case Step::Designator:
+      return Designator(*static_cast<const pas::ast::Designator *>(task.node));
+    case Step::Item:
+      return Item(*static_cast<const pas::ast::DesignatorItem *>(task.node));
+    case Step::Names:
+      for (pas::ast::Ident name :
+           *static_cast<const pas::ast::List<pas::ast::Ident> *>(task.node)) {
+        pending_.push_back(name.id());
+      }
+      return;
+    case Step::Bounds:
+      for (const pas::ast::Subrange &subrange :
+           *static_cast<const pas::ast::List<pas::ast::Subrange> *>(
+               task.node)) {
+        Subrange(subrange);
+      }
+      return;
+    case Step::Value:
+      pending_.push_back(task.value);
+      return;
+    case Step::Decls:
+      block_decls_.push_back(Commit(task.mark));
+      return;
+    case Step::BlockEnd: {
+      const Range stmt_range = Commit(task.mark);
+      tree_.blocks_.push_back(flat::Block{block_decls_.back(), stmt_range});
+      block_decls_.pop_back();
+      pending_.push_back(static_cast<NodeId>(tree_.blocks_.size() - 1));
+      return;
+    }
+    case Step::ExprEnd:
+    case Step::StmtEnd:
+    case Step::DeclEnd:
+    case Step::TypeEnd:
+      return Finish(task);
+    }
+  }
+
+  void Finish(const Task &task) {
+    uint32_t value = task.value;
+    Range children;
+    if (task.value_first) {
+      children = Commit(task.mark + 1);
+      value = pending_.back();
+      pending_.pop_back();
+    } else {
+      children = Commit(task.mark);
+    }
+    switch (task.step) {
+    case Step::ExprEnd:
+      pending_.push_back(AddExpr(static_cast<ExprKind>(task.kind), value,
+                                 children, task.op));
+      break;
+    case Step::StmtEnd:
+      pending_.push_back(AddStmt(static_cast<StmtKind>(task.kind), value,
+                                 children, task.op));
+      break;
+    case Step::DeclEnd:
+      pending_.push_back(
+          AddDecl(static_cast<DeclKind>(task.kind), value, children));
+      break;
+    case Step::TypeEnd:
+      pending_.push_back(
+          AddType(static_cast<TypeKind>(task.kind), value, children));
+      break;
+    default:
+      assert(false);
+      __builtin_unreachable();
+    }
+  }
+
+  size_t Mark() const { return pending_.size(); }
+
+  Range Commit(size_t mark) {
+    assert(tree_.children_.size() + (pending_.size() - mark) <=
+           std::numeric_limits<uint32_t>::max());
+    Range range{static_cast<uint32_t>(tree_.children_.size()),
+                static_cast<uint32_t>(pending_.size() - mark)};
+    tree_.children_.insert(tree_.children_.end(), pending_.begin() + mark,
+                           pending_.end());
+    pending_.resize(mark);
+    return range;
+  }
+
+  template <typename Kind>
+  static NodeId Add(std::vector<Node<Kind>> &nodes, Kind kind, uint8_t op,
+                    uint32_t value, Range children = {}) {
+    assert(nodes.size() < std::numeric_limits<NodeId>::max());
+    nodes.push_back(Node<Kind>{kind, op, 0, value, children});
+    return static_cast<NodeId>(nodes.size() - 1);
+  }
+  NodeId AddExpr(ExprKind kind, uint32_t value = 0, Range children = {},
+                 uint8_t op = 0) {
+    const NodeId id = Add(tree_.exprs_, kind, op, value, children);
+    if (Constant(kind, children)) {
+      tree_.exprs_[id].flags |= FLAG_CONSTANT;
+    }
+    if (!tree_.share_exprs_) {
+      return id;
+    }
+    tree_.expr_hashes_.push_back(Hash(tree_.exprs_[id]));
+    if (kind == ExprKind::Call) {
+      return id;
+    }
+    auto [it, inserted] = shared_.insert(id);
+    if (inserted) {
+      return id;
+    }
+    // A copy: drop it and the child list committed for it just before.
+    if (children.size != 0) {
+      assert(children.first + children.size == tree_.children_.size());
+      tree_.children_.resize(children.first);
+    }
+    tree_.exprs_.pop_back();
+    tree_.expr_hashes_.pop_back();
+    return *it;
+  }
+  NodeId AddStmt(StmtKind kind, uint32_t value = 0, Range children = {},
+                 uint8_t op = 0) {
+    return Add(tree_.stmts_, kind, op, value, children);
+  }
+  NodeId AddDecl(DeclKind kind, uint32_t value, Range children) {
+    return Add(tree_.decls_, kind, 0, value, children);
+  }
+  NodeId AddType(TypeKind kind, uint32_t value, Range children = {}) {
+    return Add(tree_.types_, kind, 0, value, children);
+  }
+
+  void Block(const pas::ast::Block &block) {
+    assert(block.decls_);
+    const pas::ast::Declarations &decls = *block.decls_;
+    const uint32_t mark = static_cast<uint32_t>(Mark());
+    for (const pas::ast::ConstDef &def : decls.const_defs_) {
+      Then(Visit(Step::ConstDef, &def));
+    }
+    for (const pas::ast::TypeDef &def : decls.type_defs_) {
+      Then(Visit(Step::TypeDef, &def));
+    }
+    for (const pas::ast::VarDecl &decl : decls.var_decls_) {
+      Then(Visit(Step::VarDecl, &decl));
+    }
+    for (const pas::ast::SubprogDecl &decl : decls.subprog_decls_) {
+      Then(Visit(Step::Subprogram, &decl));
+    }
+    Then(Task{Step::Decls, 0, 0, false, 0, mark, nullptr});
+    for (const pas::ast::Stmt &stmt : block.stmt_seq_) {
+      Then(Visit(Step::Stmt, &stmt));
+    }
+    Then(Task{Step::BlockEnd, 0, 0, false, 0, mark, nullptr});
+    Queue();
+  }
+
+  void Subprogram(const pas::ast::SubprogDecl &decl) {
+    const bool is_func = decl.index() == get_idx(pas::ast::SubprogKind::Func);
+    const pas::ast::ProcDecl &proc =
+        is_func ? std::get<pas::ast::FuncDecl>(decl).proc_decl_
+                : std::get<pas::ast::ProcDecl>(decl);
+    Then(Visit(Step::Block, &proc.block_));
+    if (is_func) {
+      Then(Value(std::get<pas::ast::FuncDecl>(decl).ret_type_ident_.id()));
+    }
+    for (const pas::ast::FormalParam &param : proc.proc_heading_.params_) {
+      Then(Visit(Step::Param, &param));
+    }
+    Then(End(Step::DeclEnd, is_func ? DeclKind::Func : DeclKind::Proc,
+             proc.proc_heading_.proc_name_.id()));
+    Queue();
+  }
+
+  Range Names(const pas::ast::List<pas::ast::Ident> &names) {
+    size_t mark = Mark();
+    for (pas::ast::Ident name : names) {
+      pending_.push_back(name.id());
+    }
+    return Commit(mark);
+  }
+
+  void Type(const pas::ast::Type &type) {
+    switch (type.index()) {
+    case get_idx(pas::ast::TypeKind::Named):
+      pending_.push_back(AddType(
+          TypeKind::Named,
+          std::get<pas::ast::NamedTypeUP>(type)->type_name_.id()));
+      return;
+    case get_idx(pas::ast::TypeKind::Pointer):
+      pending_.push_back(AddType(
+          TypeKind::Pointer,
+          std::get<pas::ast::PointerTypeUP>(type)->ref_type_name_.id()));
+      return;
+    case get_idx(pas::ast::TypeKind::Set): {
+      size_t mark = Mark();
+      Subrange(std::get<pas::ast::SetTypeUP>(type)->subrange_);
+      pending_.push_back(AddType(TypeKind::Set, 0, Commit(mark)));
+      return;
+    }
+    case get_idx(pas::ast::TypeKind::Array): {
+      const pas::ast::ArrayType &array = *std::get<pas::ast::ArrayTypeUP>(type);
+      Then(Visit(Step::Type, &array.item_type_));
+      Then(Visit(Step::Bounds, &array.subrange_list_));
+      Then(EndWithValue(Step::TypeEnd, TypeKind::Array));
+      return Queue();
+    }
+    case get_idx(pas::ast::TypeKind::Record): {
+      for (const pas::ast::FieldList &field :
+           std::get<pas::ast::RecordTypeUP>(type)->fields_) {
+        Then(Visit(Step::Field, &field));
+      }
+      Then(End(Step::TypeEnd, TypeKind::Record));
+      return Queue();
+    }
+    default:
+      assert(false);
+      __builtin_unreachable();
+    }
+  }
+
+  void Subrange(const pas::ast::Subrange &subrange) {
+    pending_.push_back(ConstFactor(subrange.start_));
+    pending_.push_back(ConstFactor(subrange.finish_));
+  }
+
+  NodeId ConstExpr(const pas::ast::ConstExpr &const_expr) {
+    const NodeId factor = ConstFactor(const_expr.factor_);
+    if (!const_expr.unary_op_.has_value()) {
+      return factor;
+    }
+    size_t mark = Mark();
+    pending_.push_back(factor);
+    return AddExpr(ExprKind::Sum, 0, Commit(mark),
+                   static_cast<uint8_t>(*const_expr.unary_op_) + 1);
+  }
+
+  NodeId ConstFactor(const pas::ast::ConstFactor &factor) {
+    switch (factor.index()) {
+    case get_idx(pas::ast::ConstFactorKind::Identifier):
+      return AddExpr(ExprKind::Designator,
+                     std::get<pas::ast::Ident>(factor).id());
+    case get_idx(pas::ast::ConstFactorKind::Number):
+      return AddExpr(ExprKind::Number,
+                     static_cast<uint32_t>(std::get<int>(factor)));
+    case get_idx(pas::ast::ConstFactorKind::Bool):
+      return AddExpr(ExprKind::Bool, std::get<bool>(factor));
+    case get_idx(pas::ast::ConstFactorKind::Nil):
+      return AddExpr(ExprKind::Nil);
+    default:
+      assert(false);
+      __builtin_unreachable();
+    }
+  }
+
+  void Stmt(const pas::ast::Stmt &stmt) {
+    switch (stmt.index()) {
+    case get_idx(pas::ast::StmtKind::Assignment): {
+      const pas::ast::Assignment &assignment =
+          *std::get<pas::ast::AssignmentUP>(stmt);
+      Then(Visit(Step::Designator, &assignment.designator_));
+      Then(Visit(Step::Expr, &assignment.expr_));
+      Then(End(Step::StmtEnd, StmtKind::Assignment));
+      return Queue();
+    }
+    case get_idx(pas::ast::StmtKind::ProcCall): {
+      const pas::ast::ProcCall &call = *std::get<pas::ast::ProcCallUP>(stmt);
+      for (const pas::ast::Expr &param : call.params_) {
+        Then(Visit(Step::Expr, &param));
+      }
+      Then(End(Step::StmtEnd, StmtKind::ProcCall, call.proc_ident_.id()));
+      return Queue();
+    }
+    case get_idx(pas::ast::StmtKind::If): {
+      const pas::ast::IfStmt &if_stmt = *std::get<pas::ast::IfStmtUP>(stmt);
+      Then(Visit(Step::Expr, &if_stmt.cond_expr_));
+      Then(Visit(Step::Stmt, &if_stmt.then_stmt_));
+      if (if_stmt.else_stmt_.has_value()) {
+        Then(Visit(Step::Stmt, &*if_stmt.else_stmt_));
+      }
+      Then(End(Step::StmtEnd, StmtKind::If));
+      return Queue();
+    }
+    case get_idx(pas::ast::StmtKind::Case): {
+      const pas::ast::CaseStmt &case_stmt =
+          *std::get<pas::ast::CaseStmtUP>(stmt);
+      Then(Visit(Step::Expr, &case_stmt.cond_expr_));
+      for (const pas::ast::Case &arm : case_stmt.cases_) {
+        Then(Visit(Step::CaseArm, &arm));
+      }
+      Then(End(Step::StmtEnd, StmtKind::Case));
+      return Queue();
+    }
+    case get_idx(pas::ast::StmtKind::While): {
+      const pas::ast::WhileStmt &while_stmt =
+          *std::get<pas::ast::WhileStmtUP>(stmt);
+      Then(Visit(Step::Expr, &while_stmt.cond_expr_));
+      Then(Visit(Step::Stmt, &while_stmt.inner_stmt_));
+      Then(End(Step::StmtEnd, StmtKind::While));
+      return Queue();
+    }
+    case get_idx(pas::ast::StmtKind::Repeat): {
+      const pas::ast::RepeatStmt &repeat =
+          *std::get<pas::ast::RepeatStmtUP>(stmt);
+      Then(Visit(Step::Expr, &repeat.cond_expr_));
+      for (const pas::ast::Stmt &inner : repeat.inner_stmts_) {
+        Then(Visit(Step::Stmt, &inner));
+      }
+      Then(End(Step::StmtEnd, StmtKind::Repeat));
+      return Queue();
+    }
+    case get_idx(pas::ast::StmtKind::For): {
+      const pas::ast::ForStmt &for_stmt = *std::get<pas::ast::ForStmtUP>(stmt);
+      Then(Visit(Step::Expr, &for_stmt.start_val_expr_));
+      Then(Visit(Step::Expr, &for_stmt.finish_val_expr_));
+      Then(Visit(Step::Stmt, &for_stmt.inner_stmt_));
+      Then(End(Step::StmtEnd, StmtKind::For, for_stmt.ident_.id(),
+               static_cast<uint8_t>(for_stmt.dir_)));
+      return Queue();
+    }
+    case get_idx(pas::ast::StmtKind::Memory): {
+      const pas::ast::MemoryStmt &memory =
+          *std::get<pas::ast::MemoryStmtUP>(stmt);
+      pending_.push_back(AddStmt(StmtKind::Memory, memory.ident_.id(), {},
+                                 static_cast<uint8_t>(memory.kind_)));
+      return;
+    }
+    case get_idx(pas::ast::StmtKind::StmtSeq): {
+      for (const pas::ast::Stmt &inner :
+           std::get<pas::ast::StmtSeqUP>(stmt)->stmts_) {
+        Then(Visit(Step::Stmt, &inner));
+      }
+      Then(End(Step::StmtEnd, StmtKind::Seq));
+      return Queue();
+    }
+    case get_idx(pas::ast::StmtKind::Empty):
+      pending_.push_back(AddStmt(StmtKind::Empty));
+      return;
+    default:
+      assert(false);
+      __builtin_unreachable();
+    }
+  }
+
+  // A chain without operators is its one child, no node: the child's
+  //   visit is queued in its place.
+  void Expr(const pas::ast::Expr &expr) {
+    if (!expr.op_.has_value()) {
+      Then(Visit(Step::SimpleExpr, &expr.start_expr_));
+      return Queue();
+    }
+    Then(Visit(Step::SimpleExpr, &expr.start_expr_));
+    Then(Visit(Step::SimpleExpr, &expr.op_->expr));
+    Then(End(Step::ExprEnd, ExprKind::Relation, 0,
+             static_cast<uint8_t>(expr.op_->rel)));
+    Queue();
+  }
+
+  void SimpleExpr(const pas::ast::SimpleExpr &expr) {
+    Then(Visit(Step::Term, &expr.start_term_));
+    if (expr.ops_.empty() && !expr.unary_op_.has_value()) {
+      return Queue();
+    }
+    for (const pas::ast::SimpleExpr::Op &op : expr.ops_) {
+      Then(Value(static_cast<uint32_t>(op.op)));
+      Then(Visit(Step::Term, &op.term));
+    }
+    const uint8_t unary_op =
+        expr.unary_op_.has_value() ? static_cast<uint8_t>(*expr.unary_op_) + 1
+                                   : 0;
+    Then(End(Step::ExprEnd, ExprKind::Sum, 0, unary_op));
+    Queue();
+  }
+
+  void Term(const pas::ast::Term &term) {
+    Then(Visit(Step::Factor, &term.start_factor_));
+    if (term.ops_.empty()) {
+      return Queue();
+    }
+    for (const pas::ast::Term::Op &op : term.ops_) {
+      Then(Value(static_cast<uint32_t>(op.op)));
+      Then(Visit(Step::Factor, &op.factor));
+    }
+    Then(End(Step::ExprEnd, ExprKind::Product));
+    Queue();
+  }
+
+  void Factor(const pas::ast::Factor &factor) {
+    switch (factor.index()) {
+    case get_idx(pas::ast::FactorKind::String):
+      pending_.push_back(AddExpr(ExprKind::String,
+                                 std::get<pas::StringLiteral>(factor).id()));
+      return;
+    case get_idx(pas::ast::FactorKind::Number):
+      pending_.push_back(AddExpr(
+          ExprKind::Number, static_cast<uint32_t>(std::get<int>(factor))));
+      return;
+    case get_idx(pas::ast::FactorKind::Bool):
+      pending_.push_back(AddExpr(ExprKind::Bool, std::get<bool>(factor)));
+      return;
+    case get_idx(pas::ast::FactorKind::Nil):
+      pending_.push_back(AddExpr(ExprKind::Nil));
+      return;
+    case get_idx(pas::ast::FactorKind::Designator):
+      return Designator(std::get<pas::ast::Designator>(factor));
+    case get_idx(pas::ast::FactorKind::Expr):
+      Then(Visit(Step::Expr, std::get<pas::ast::ExprUP>(factor).get()));
+      return Queue();
+    case get_idx(pas::ast::FactorKind::Negation):
+      Then(Visit(Step::Factor,
+                 &std::get<pas::ast::NegationUP>(factor)->factor_));
+      Then(End(Step::ExprEnd, ExprKind::Not));
+      return Queue();
+    case get_idx(pas::ast::FactorKind::FuncCall): {
+      const pas::ast::FuncCall &call = *std::get<pas::ast::FuncCallUP>(factor);
+      for (const pas::ast::Expr &param : call.params_) {
+        Then(Visit(Step::Expr, &param));
+      }
+      Then(End(Step::ExprEnd, ExprKind::Call, call.func_ident_.id()));
+      return Queue();
+    }
+    default:
+      assert(false);
+      __builtin_unreachable();
+    }
+  }
+
+  void Designator(const pas::ast::Designator &designator) {
+    for (const pas::ast::DesignatorItem &item : designator.items_) {
+      Then(Visit(Step::Item, &item));
+    }
+    Then(End(Step::ExprEnd, ExprKind::Designator, designator.ident_.id()));
+    Queue();
+  }
+
+  void Item(const pas::ast::DesignatorItem &item) {
+    switch (item.index()) {
+    case get_idx(pas::ast::DesignatorItemKind::FieldAccess):
+      pending_.push_back(AddExpr(
+          ExprKind::Field,
+          std::get<pas::ast::DesignatorFieldAccess>(item).ident_.id()));
+      return;
+    case get_idx(pas::ast::DesignatorItemKind::PointerAccess):
+      pending_.push_back(AddExpr(ExprKind::Deref));
+      return;
+    case get_idx(pas::ast::DesignatorItemKind::ArrayAccess):
+      for (const pas::ast::ExprUP &index :
+           std::get<pas::ast::DesignatorArrayAccess>(item).expr_list_) {
+        Then(Visit(Step::Expr, index.get()));
+      }
+      Then(End(Step::ExprEnd, ExprKind::Index));
+      return Queue();
+    }
+  }
+
+  // Literals, and operators over constants.
+  bool Constant(ExprKind kind, Range children) const {
+    std::span<const uint32_t> list = List(tree_, children);
+    switch (kind) {
+    case ExprKind::Number:
+    case ExprKind::Bool:
+    case ExprKind::Nil:
+    case ExprKind::String:
+      return true;
+    case ExprKind::Relation:
+    case ExprKind::Not:
+      return std::all_of(list.begin(), list.end(), [this](uint32_t child) {
+        return tree_.exprs_[child].constant();
+      });
+    case ExprKind::Sum:
+    case ExprKind::Product:
+      // Operators are between the operands.
+      for (size_t i = 0; i < list.size(); i += 2) {
+        if (!tree_.exprs_[list[i]].constant()) {
+          return false;
+        }
+      }
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // FNV-1a over the node's fields and its children's ids.
+  size_t Hash(const flat::Expr &expr) const {
+    size_t hash = 14695981039346656037ull;
+    auto mix = [&hash](size_t word) { hash = (hash ^ word) * 1099511628211ull; };
+    mix(static_cast<size_t>(expr.kind));
+    mix(expr.op);
+    mix(expr.value);
+    for (uint32_t child : List(tree_, expr.children)) {
+      mix(child);
+    }
+    return hash;
+  }
+
+  // The tree's spans are set once it's built, until then its vectors
+  //   are read.
+  static std::span<const uint32_t> List(const Tree &tree, Range range) {
+    return {tree.children_.data() + range.first, range.size};
+  }
+
+  struct ExprHash {
+    const Tree &tree;
+    size_t operator()(NodeId id) const { return tree.expr_hashes_[id]; }
+  };
+  struct SameExpr {
+    const Tree &tree;
+    bool operator()(NodeId lhs, NodeId rhs) const {
+      const flat::Expr &a = tree.exprs_[lhs];
+      const flat::Expr &b = tree.exprs_[rhs];
+      if (a.kind != b.kind || a.op != b.op || a.value != b.value) {
+        return false;
+      }
+      std::span<const uint32_t> a_children = List(tree, a.children);
+      std::span<const uint32_t> b_children = List(tree, b.children);
+      return std::equal(a_children.begin(), a_children.end(),
+                        b_children.begin(), b_children.end());
+    }
+  };
+
+private:
+  Tree &tree_;
+  std::vector<uint32_t> pending_;
+  std::vector<Task> tasks_;
+  std::vector<Task> batch_;
+  // Declarations of the blocks whose statements are being flattened.
+  std::vector<Range> block_decls_;
+  std::unordered_set<NodeId, ExprHash, SameExpr> shared_;
+};
+
+void Tree::build(const pas::AST &ast, bool share_exprs) {
+  share_exprs_ = share_exprs;
+  symbols_.clear();
+  mapping_.reset();
+  exprs_.clear();
+  expr_hashes_.clear();
+  stmts_.clear();
+  decls_.clear();
+  types_.clear();
+  blocks_.clear();
+  children_.clear();
+  Flattener(*this).Program(ast.pm_);
+  publish();
+}
+
+void Tree::publish() {
+  view_ = View{exprs_, expr_hashes_, stmts_,   decls_,
+               types_, blocks_,      children_};
+}
+
+size_t Tree::size_bytes() const {
+  return view_.exprs.size_bytes() + view_.expr_hashes.size_bytes() +
+         view_.stmts.size_bytes() + view_.decls.size_bytes() +
+         view_.types.size_bytes() + view_.blocks.size_bytes() +
+         view_.children.size_bytes();
+}
+
+} // namespace flat
+} // namespace pas
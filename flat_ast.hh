@@ -0,0 +1,207 @@
+#pragma once
+
+#include <ast.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+class AstCache;
+
+namespace pas {
+namespace flat {
+
+// The AST flattened for passes over the whole tree. Nodes of each kind
+//   are in their own contiguous array and refer to each other by 32-bit
+//   indices into those arrays. Child lists are ranges of one shared side
+//   array, so a node is 16 bytes whatever it holds.
+// Chains of the pointer AST that hold one child only (an Expr without a
+//   relation, a SimpleExpr without operators, a Term without operators,
+//   a parenthesized Factor) are not kept: a literal is a single node.
+// Nodes are added after their children, the tree doesn't change once
+//   built. Its arrays are read through spans, so a tree can be used
+//   right in a mapping of a file it was saved to, see ast_cache.hh.
+// Built with share_exprs, the exprs are a DAG: structurally equal
+//   expressions are one node, found by hash as the node is added. So an
+//   expression's id names it, and what a pass works out about one (its
+//   type, its value when it's constant) can be kept in a vector indexed
+//   by id and reused by every copy. Calls are never shared, each one is
+//   done on its own.
+
+// Index of a node in its array, the field holding it tells which one.
+using NodeId = uint32_t;
+
+// Child list, size items from first in the side array.
+struct Range {
+  uint32_t first = 0;
+  uint32_t size = 0;
+};
+
+// Layout of each kind is next to it: what op and value are and what
+//   children are, in order.
+enum class ExprKind : uint8_t {
+  Number,     // value: the number as int
+  Bool,       // value: 0 or 1
+  Nil,        //
+  String,     // value: StringLiteral id
+  Designator, // value: name; children: items, Field, Deref or Index exprs
+  Field,      // value: field name, only a Designator's item
+  Deref,      // only a Designator's item
+  Index,      // children: index exprs, only a Designator's item
+  Relation,   // op: RelOp; children: lhs, rhs
+  Sum,        // op: 0 or UnaryOp + 1; children: term, [AddOp, term]...
+  Product,    // children: factor, [MultOp, factor]...
+  Not,        // children: operand
+  Call,       // value: function name; children: arguments
+};
+
+enum class StmtKind : uint8_t {
+  Assignment, // children: Designator expr, value expr
+  ProcCall,   // value: procedure name; children: argument exprs
+  If,         // children: condition expr, then stmt, [else stmt]
+  Case,       // children: expr, CaseArm stmts
+  CaseArm,    // children: stmt, label exprs; only a Case's child
+  While,      // children: condition expr, stmt
+  Repeat,     // children: condition expr, stmts
+  For,        // op: WhichWay; value: counter; children: start, finish, stmt
+  Memory,     // op: MemoryStmt::Kind; value: pointer name
+  Seq,        // children: stmts
+  Empty,      //
+};
+
+enum class DeclKind : uint8_t {
+  Const, // value: name; children: constant expr
+  Type,  // value: name; children: type
+  Var,   // value: type; children: names
+  Proc,  // value: name; children: block, Param decls
+  Func,  // value: name; children: block, return type name, Param decls
+  Param, // value: type name; children: names
+};
+
+// Constants and subrange bounds are exprs: a Number, Bool, Nil or a
+//   Designator without items, in a one term Sum for a unary operator.
+enum class TypeKind : uint8_t {
+  Named,   // value: name
+  Pointer, // value: name of the type pointed to
+  Set,     // children: lower and upper bound exprs
+  Array,   // value: item type; children: [lower, upper bound expr]...
+  Record,  // children: Field types
+  Field,   // value: type; children: names; only a Record's child
+};
+
+// Node flags.
+// An expr without designators or calls in it, its value never changes.
+inline constexpr uint8_t FLAG_CONSTANT = 1;
+
+template <typename Kind> struct Node {
+  Kind kind{};
+  uint8_t op = 0;
+  uint8_t flags = 0;
+  uint32_t value = 0;
+  Range children;
+
+  int number() const { return static_cast<int>(value); }
+  bool constant() const { return (flags & FLAG_CONSTANT) != 0; }
+};
+
+using Expr = Node<ExprKind>;
+using Stmt = Node<StmtKind>;
+using Decl = Node<DeclKind>;
+using Type = Node<TypeKind>;
+
+// Declarations in source order of kinds: constants, types, variables,
+//   subprograms.
+struct Block {
+  Range decls;
+  Range stmts;
+};
+
+static_assert(sizeof(Expr) == 16 && sizeof(Block) == 16);
+
+class Tree {
+public:
+  Tree() = default;
+  Tree(const Tree &other) = delete;
+  Tree &operator=(const Tree &other) = delete;
+  Tree(Tree &&other) = default;
+  Tree &operator=(Tree &&other) = default;
+
+public:
+  // Flattens ast in place of the tree there was, keeping the memory.
+  void build(const pas::AST &ast, bool share_exprs = false);
+  bool shares_exprs() const { return share_exprs_; }
+
+  Symbol program_name() const { return symbol(program_name_); }
+  NodeId program_block() const { return program_block_; }
+
+  const Expr &expr(NodeId id) const { return view_.exprs[id]; }
+  const Stmt &stmt(NodeId id) const { return view_.stmts[id]; }
+  const Decl &decl(NodeId id) const { return view_.decls[id]; }
+  const Type &type(NodeId id) const { return view_.types[id]; }
+  const Block &block(NodeId id) const { return view_.blocks[id]; }
+  size_t expr_count() const { return view_.exprs.size(); }
+
+  // Symbol the tree holds as a number: a node's name in its value, a
+  //   function's return type name in its children. A loaded tree has
+  //   the ids of the process that saved it, they are mapped to ours.
+  Symbol symbol(uint32_t id) const {
+    return symbols_.empty() ? Symbol(id) : symbols_[id];
+  }
+  template <typename Kind> Symbol name(const Node<Kind> &node) const {
+    return symbol(node.value);
+  }
+
+  // Hash of the expr's structure, kept since the tree was built. Only a
+  //   tree with shared exprs has them.
+  size_t expr_hash(NodeId id) const {
+    assert(share_exprs_);
+    return view_.expr_hashes[id];
+  }
+
+  std::span<const uint32_t> list(Range range) const {
+    return view_.children.subspan(range.first, range.size);
+  }
+
+  // Bytes taken by the nodes, capacity not counted.
+  size_t size_bytes() const;
+
+private:
+  friend class Flattener;
+  friend class ::AstCache;
+
+  // Points the spans at the vectors once they are built.
+  void publish();
+
+  struct View {
+    std::span<const Expr> exprs;
+    std::span<const size_t> expr_hashes;
+    std::span<const Stmt> stmts;
+    std::span<const Decl> decls;
+    std::span<const Type> types;
+    std::span<const Block> blocks;
+    std::span<const uint32_t> children;
+  };
+
+  bool share_exprs_ = false;
+  uint32_t program_name_ = 0;
+  NodeId program_block_ = 0;
+  View view_;
+  // Symbols of the ids in a loaded tree, empty if the ids are ours.
+  std::vector<Symbol> symbols_;
+  // Keeps the file a loaded tree is in mapped.
+  std::shared_ptr<const void> mapping_;
+  // Nodes of a tree built here, the view is on them.
+  std::vector<Expr> exprs_;
+  std::vector<size_t> expr_hashes_;
+  std::vector<Stmt> stmts_;
+  std::vector<Decl> decls_;
+  std::vector<Type> types_;
+  std::vector<Block> blocks_;
+  std::vector<uint32_t> children_;
+};
+
+} // namespace flat
+} // namespace pas
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <flat_ast.hh>
+
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace pas {
+namespace flat {
+
+// What a walk goes through. A block's declarations are a node of their
+//   own, Declarations, with the block's id. An Item is a child that is
+//   not a node: an operator of a Sum or a Product, or a name.
+enum class NodeClass : uint8_t {
+  Block,
+  Declarations,
+  Decl,
+  Type,
+  Stmt,
+  Expr,
+  Item,
+};
+
+// Hooks are picked by overloading on the tag of a node's kind:
+//   Tag<ExprKind::Sum>, Tag<StmtKind::If>, ..., Tag<NodeClass::Block>
+//   and Tag<NodeClass::Declarations>.
+template <auto Kind> struct Tag {};
+
+// For the next hook: no child was walked yet, or there are no more.
+inline constexpr uint32_t NO_CHILD = UINT32_MAX;
+
+// Walks a Tree in pre- and post-order from a work stack on the heap, so
+//   a deep tree doesn't overflow the C++ stack. Children of a node are
+//   its child list in order, a type held in the value (of a Var, an
+//   Array or a Field) goes first.
+// Hooks is a class with any of these, for the kinds it cares about;
+//   node is the Expr, Stmt, Decl, Type or Block:
+//     bool enter(Tag<kind>, NodeId id, const Node &node);
+//       Before the children. False skips the children and leave.
+//     void leave(Tag<kind>, NodeId id, const Node &node);
+//       After the children.
+//     uint32_t next(Tag<kind>, NodeId id, const Node &node, uint32_t done);
+//       Index of the child to walk after child done, NO_CHILD to stop.
+//       By default children go in order; returning a child walked
+//       before walks it again, so a loop is walked.
+//     void item(Tag<kind>, NodeId id, const Node &node, uint32_t value);
+//       An Item child.
+// Whether there is a hook is found at compile time, a missing one costs
+//   nothing. The switch over kinds is made from enum_flat_node.hpp.
+// A hook may start another walk with the same walker, it runs to the
+//   end on top of the one that called the hook.
+template <typename Hooks> class Walker {
+public:
+  Walker(const Tree &tree, Hooks &hooks) : tree_(tree), hooks_(hooks) {}
+
+  Walker(const Walker &other) = delete;
+  Walker &operator=(const Walker &other) = delete;
+
+  void walk(NodeClass cls, NodeId id) {
+    assert(cls != NodeClass::Item);
+    const size_t base = stack_.size();
+    Enter(cls, id);
+    // Hooks may walk on top of the stack and move it, the frame is
+    //   found again after a hook. It is not copied out whole: it was
+    //   just written, reading it back in one piece stalls.
+    while (stack_.size() > base) {
+      const size_t top = stack_.size() - 1;
+      uint32_t next;
+      if ((stack_[top].hooks & NEXT) != 0) {
+        next = Next(stack_[top].cls, stack_[top].id, stack_[top].done);
+      } else {
+        next = stack_[top].done == NO_CHILD ? 0 : stack_[top].done + 1;
+      }
+      Frame &frame = stack_[top];
+      // NO_CHILD is past any child.
+      if (next >= frame.count) {
+        const NodeClass frame_cls = frame.cls;
+        const NodeId frame_id = frame.id;
+        const bool leave = (frame.hooks & LEAVE) != 0;
+        stack_.pop_back();
+        if (leave) {
+          Leave(frame_cls, frame_id);
+        }
+        continue;
+      }
+      frame.done = next;
+      const Child child = ChildAt(frame, next);
+      if (child.cls != NodeClass::Item) {
+        Enter(child.cls, child.id);
+      } else if ((frame.hooks & ITEM) != 0) {
+        Item(frame.cls, frame.id, child.id);
+      }
+    }
+  }
+
+private:
+  // Which of a node's hooks there are, besides enter.
+  static constexpr uint8_t NEXT = 1;
+  static constexpr uint8_t LEAVE = 2;
+  static constexpr uint8_t ITEM = 4;
+
+  // What of a node the loop needs, so children are found without
+  //   reading the node again.
+  struct Frame {
+    NodeClass cls;
+    uint8_t hooks;
+    uint8_t kind;
+    NodeId id;
+    // Child walked last.
+    uint32_t done;
+    uint32_t count;
+    // Start of the node's child list.
+    uint32_t first;
+  };
+
+  struct Child {
+    NodeClass cls;
+    uint32_t id;
+  };
+
+  template <typename KindTag, typename Node>
+  static constexpr uint8_t HOOKS =
+      (requires(Hooks &hooks, const Node &node) {
+        hooks.next(KindTag{}, NodeId{}, node, uint32_t{});
+      } ? NEXT : 0) |
+      (requires(Hooks &hooks, const Node &node) {
+        hooks.leave(KindTag{}, NodeId{}, node);
+      } ? LEAVE : 0) |
+      (requires(Hooks &hooks, const Node &node) {
+        hooks.item(KindTag{}, NodeId{}, node, uint32_t{});
+      } ? ITEM : 0);
+
+  // Calls f(Tag<kind>{}, node) for the node's kind.
+  template <typename F>
+  decltype(auto) Dispatch(NodeClass cls, NodeId id, F &&f) {
+    switch (cls) {
+    case NodeClass::Block:
+      return f(Tag<NodeClass::Block>{}, tree_.block(id));
+    case NodeClass::Declarations:
+      return f(Tag<NodeClass::Declarations>{}, tree_.block(id));
+    case NodeClass::Decl: {
+      const Decl &decl = tree_.decl(id);
+      switch (decl.kind) {
+#define FOR_EACH_FLAT_DECL(kind)                                               \
+  case DeclKind::kind:                                                         \
+    return f(Tag<DeclKind::kind>{}, decl);
+#define FOR_EACH_FLAT_EXPR(kind)
+#define FOR_EACH_FLAT_STMT(kind)
+#define FOR_EACH_FLAT_TYPE(kind)
+#include <enum_flat_node.hpp>
+#undef FOR_EACH_FLAT_DECL
+#undef FOR_EACH_FLAT_EXPR
+#undef FOR_EACH_FLAT_STMT
+#undef FOR_EACH_FLAT_TYPE
+      }
+      break;
+    }
+    case NodeClass::Type: {
+      const Type &type = tree_.type(id);
+      switch (type.kind) {
+#define FOR_EACH_FLAT_TYPE(kind)                                               \
+  case TypeKind::kind:                                                         \
+    return f(Tag<TypeKind::kind>{}, type);
+#define FOR_EACH_FLAT_EXPR(kind)
+#define FOR_EACH_FLAT_STMT(kind)
+#define FOR_EACH_FLAT_DECL(kind)
+#include <enum_flat_node.hpp>
+#undef FOR_EACH_FLAT_DECL
+#undef FOR_EACH_FLAT_EXPR
+#undef FOR_EACH_FLAT_STMT
+#undef FOR_EACH_FLAT_TYPE
+      }
+      break;
+    }
+    case NodeClass::Stmt: {
+      const Stmt &stmt = tree_.stmt(id);
+      switch (stmt.kind) {
+#define FOR_EACH_FLAT_STMT(kind)                                               \
+  case StmtKind::kind:                                                         \
+    return f(Tag<StmtKind::kind>{}, stmt);
+#define FOR_EACH_FLAT_EXPR(kind)
+#define FOR_EACH_FLAT_DECL(kind)
+#define FOR_EACH_FLAT_TYPE(kind)
+#include <enum_flat_node.hpp>
+#undef FOR_EACH_FLAT_DECL
+#undef FOR_EACH_FLAT_EXPR
+#undef FOR_EACH_FLAT_STMT
+#undef FOR_EACH_FLAT_TYPE
+      }
+      break;
+    }
+    case NodeClass::Expr: {
+      const Expr &expr = tree_.expr(id);
+      switch (expr.kind) {
+#define FOR_EACH_FLAT_EXPR(kind)                                               \
+  case ExprKind::kind:                                                         \
+    return f(Tag<ExprKind::kind>{}, expr);
+#define FOR_EACH_FLAT_STMT(kind)
+#define FOR_EACH_FLAT_DECL(kind)
+#define FOR_EACH_FLAT_TYPE(kind)
+#include <enum_flat_node.hpp>
+#undef FOR_EACH_FLAT_DECL
+#undef FOR_EACH_FLAT_EXPR
+#undef FOR_EACH_FLAT_STMT
+#undef FOR_EACH_FLAT_TYPE
+      }
+      break;
+    }
+    case NodeClass::Item:
+      break;
+    }
+    assert(false);
+    __builtin_unreachable();
+  }
+
+  // Calls the enter hook and pushes the node's frame unless it says no.
+  void Enter(NodeClass cls, NodeId id) {
+    Dispatch(cls, id, [&](auto tag, const auto &node) {
+      using KindTag = decltype(tag);
+      using Node = std::remove_cvref_t<decltype(node)>;
+      if constexpr (requires { hooks_.enter(tag, id, node); }) {
+        if (!hooks_.enter(tag, id, node)) {
+          return;
+        }
+      }
+      stack_.push_back(Frame{cls, HOOKS<KindTag, Node>, KindOf(tag), id,
+                             NO_CHILD, ChildCount(tag, node),
+                             FirstChild(tag, node)});
+    });
+  }
+
+  void Leave(NodeClass cls, NodeId id) {
+    Dispatch(cls, id, [&](auto tag, const auto &node) {
+      if constexpr (requires { hooks_.leave(tag, id, node); }) {
+        hooks_.leave(tag, id, node);
+      }
+    });
+  }
+
+  uint32_t Next(NodeClass cls, NodeId id, uint32_t done) {
+    return Dispatch(cls, id, [&](auto tag, const auto &node) {
+      if constexpr (requires { hooks_.next(tag, id, node, done); }) {
+        return static_cast<uint32_t>(hooks_.next(tag, id, node, done));
+      } else {
+        return done == NO_CHILD ? 0 : done + 1;
+      }
+    });
+  }
+
+  void Item(NodeClass cls, NodeId id, uint32_t value) {
+    Dispatch(cls, id, [&](auto tag, const auto &node) {
+      if constexpr (requires { hooks_.item(tag, id, node, value); }) {
+        hooks_.item(tag, id, node, value);
+      }
+    });
+  }
+
+  // A type in the value of these comes before the child list.
+  static bool TypeInValue(const Decl &decl) {
+    return decl.kind == DeclKind::Var;
+  }
+  static bool TypeInValue(const Type &type) {
+    return type.kind == TypeKind::Array || type.kind == TypeKind::Field;
+  }
+
+  template <auto Kind> static uint8_t KindOf(Tag<Kind>) {
+    return static_cast<uint8_t>(Kind);
+  }
+
+  static uint32_t ChildCount(Tag<NodeClass::Block>, const Block &block) {
+    return 1 + block.stmts.size;
+  }
+  static uint32_t ChildCount(Tag<NodeClass::Declarations>,
+                             const Block &block) {
+    return block.decls.size;
+  }
+  template <auto Kind, typename Node>
+  static uint32_t ChildCount(Tag<Kind>, const Node &node) {
+    if constexpr (requires { TypeInValue(node); }) {
+      return node.children.size + (TypeInValue(node) ? 1 : 0);
+    } else {
+      return node.children.size;
+    }
+  }
+
+  static uint32_t FirstChild(Tag<NodeClass::Block>, const Block &block) {
+    return block.stmts.first;
+  }
+  static uint32_t FirstChild(Tag<NodeClass::Declarations>,
+                             const Block &block) {
+    return block.decls.first;
+  }
+  template <auto Kind, typename Node>
+  static uint32_t FirstChild(Tag<Kind>, const Node &node) {
+    return node.children.first;
+  }
+
+  // Layouts are in flat_ast.hh.
+  Child ChildAt(const Frame &frame, uint32_t index) const {
+    std::span<const uint32_t> children =
+        tree_.list(Range{frame.first, index + 1});
+    switch (frame.cls) {
+    case NodeClass::Block:
+      if (index == 0) {
+        return Child{NodeClass::Declarations, frame.id};
+      }
+      return Child{NodeClass::Stmt, children[index - 1]};
+    case NodeClass::Declarations:
+      return Child{NodeClass::Decl, children[index]};
+    case NodeClass::Decl: {
+      const DeclKind kind = static_cast<DeclKind>(frame.kind);
+      if (kind == DeclKind::Var) {
+        if (index == 0) {
+          return Child{NodeClass::Type, tree_.decl(frame.id).value};
+        }
+        --index;
+      }
+      const uint32_t child = children[index];
+      switch (kind) {
+      case DeclKind::Const:
+        return Child{NodeClass::Expr, child};
+      case DeclKind::Type:
+        return Child{NodeClass::Type, child};
+      case DeclKind::Proc:
+        return Child{index == 0 ? NodeClass::Block : NodeClass::Decl, child};
+      case DeclKind::Func:
+        return Child{index == 0   ? NodeClass::Block
+                     : index == 1 ? NodeClass::Item
+                                  : NodeClass::Decl,
+                     child};
+      case DeclKind::Var:
+      case DeclKind::Param:
+        return Child{NodeClass::Item, child};
+      }
+      break;
+    }
+    case NodeClass::Type: {
+      const TypeKind kind = static_cast<TypeKind>(frame.kind);
+      if (kind == TypeKind::Array || kind == TypeKind::Field) {
+        if (index == 0) {
+          return Child{NodeClass::Type, tree_.type(frame.id).value};
+        }
+        --index;
+      }
+      const uint32_t child = children[index];
+      switch (kind) {
+      case TypeKind::Set:
+      case TypeKind::Array:
+        return Child{NodeClass::Expr, child};
+      case TypeKind::Record:
+        return Child{NodeClass::Type, child};
+      case TypeKind::Field:
+        return Child{NodeClass::Item, child};
+      case TypeKind::Named:
+      case TypeKind::Pointer:
+        break;
+      }
+      break;
+    }
+    case NodeClass::Stmt: {
+      const uint32_t child = children[index];
+      switch (static_cast<StmtKind>(frame.kind)) {
+      case StmtKind::Assignment:
+      case StmtKind::ProcCall:
+        return Child{NodeClass::Expr, child};
+      case StmtKind::If:
+      case StmtKind::Case:
+      case StmtKind::While:
+      case StmtKind::Repeat:
+        return Child{index == 0 ? NodeClass::Expr : NodeClass::Stmt, child};
+      case StmtKind::CaseArm:
+        return Child{index == 0 ? NodeClass::Stmt : NodeClass::Expr, child};
+      case StmtKind::For:
+        return Child{index < 2 ? NodeClass::Expr : NodeClass::Stmt, child};
+      case StmtKind::Seq:
+        return Child{NodeClass::Stmt, child};
+      case StmtKind::Memory:
+      case StmtKind::Empty:
+        break;
+      }
+      break;
+    }
+    case NodeClass::Expr: {
+      const ExprKind kind = static_cast<ExprKind>(frame.kind);
+      // Operators are between the operands.
+      if ((kind == ExprKind::Sum || kind == ExprKind::Product) &&
+          index % 2 == 1) {
+        return Child{NodeClass::Item, children[index]};
+      }
+      return Child{NodeClass::Expr, children[index]};
+    }
+    case NodeClass::Item:
+      break;
+    }
+    assert(false);
+    __builtin_unreachable();
+  }
+
+private:
+  const Tree &tree_;
+  Hooks &hooks_;
+  // Kept between walks with its capacity.
+  std::vector<Frame> stack_;
+};
+
+} // namespace flat
+} // namespace pas
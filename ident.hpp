@@ -0,0 +1,13 @@
+#pragma once
+
+#include <symbol_table.hh>
+
+namespace pas {
+namespace ast {
+
+// Identifier, interned in the global SymbolTable. Comparing and
+//   hashing names anywhere past the scanner is an integer operation.
+using Ident = pas::Symbol;
+
+} // namespace ast
+} // namespace pas
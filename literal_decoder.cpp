@@ -0,0 +1,204 @@
+#include "literal_decoder.hh"
+
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// Types an integer constant may have, by rank.
+enum class IntegerType {
+  Int,
+  UnsignedInt,
+  Long,
+  UnsignedLong,
+  LongLong,
+  UnsignedLongLong
+};
+
+bool is_unsigned(IntegerType type) {
+  return type == IntegerType::UnsignedInt ||
+         type == IntegerType::UnsignedLong ||
+         type == IntegerType::UnsignedLongLong;
+}
+
+// Host types are the target types for now, see make_number.
+uint64_t max_value(IntegerType type) {
+  switch (type) {
+  case IntegerType::Int:
+    return std::numeric_limits<int>::max();
+  case IntegerType::UnsignedInt:
+    return std::numeric_limits<unsigned int>::max();
+  case IntegerType::Long:
+    return std::numeric_limits<long>::max();
+  case IntegerType::UnsignedLong:
+    return std::numeric_limits<unsigned long>::max();
+  case IntegerType::LongLong:
+    return std::numeric_limits<long long>::max();
+  case IntegerType::UnsignedLongLong:
+    return std::numeric_limits<unsigned long long>::max();
+  }
+  assert(false);
+  __builtin_unreachable();
+}
+
+// Value of a digit, the scanner has checked it's valid for the base.
+uint32_t digit_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return static_cast<uint32_t>(c - '0');
+  }
+  return static_cast<uint32_t>((c | 0x20) - 'a' + 10);
+}
+
+bool is_digit_of(char c, int base) {
+  switch (base) {
+  case 8:
+    return c >= '0' && c <= '7';
+  case 10:
+    return c >= '0' && c <= '9';
+  default:
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+  }
+}
+
+} // namespace
+
+std::optional<uint64_t> decode_integer(std::string_view text, int base) {
+  size_t pos = base == 16 ? 2 : 0; // 0x
+  uint64_t value = 0;
+  for (; pos < text.size() && is_digit_of(text[pos], base); ++pos) {
+    if (__builtin_mul_overflow(value, static_cast<uint64_t>(base), &value) ||
+        __builtin_add_overflow(value, digit_value(text[pos]), &value)) {
+      return std::nullopt;
+    }
+  }
+
+  // The rest is a valid suffix: u, l, ll in either order.
+  bool unsigned_suffix = false;
+  size_t long_level = 0;
+  for (; pos < text.size(); ++pos) {
+    if ((text[pos] | 0x20) == 'u') {
+      unsigned_suffix = true;
+    } else {
+      long_level += 1;
+    }
+  }
+  assert(long_level <= 2);
+
+  // Types are listed by rank. A decimal constant without "u" stays signed.
+  const IntegerType first = long_level == 0   ? IntegerType::Int
+                            : long_level == 1 ? IntegerType::Long
+                                              : IntegerType::LongLong;
+  for (int type = static_cast<int>(first);
+       type <= static_cast<int>(IntegerType::UnsignedLongLong); ++type) {
+    const IntegerType candidate = static_cast<IntegerType>(type);
+    if (unsigned_suffix && !is_unsigned(candidate)) {
+      continue;
+    }
+    if (base == 10 && !unsigned_suffix && is_unsigned(candidate)) {
+      continue;
+    }
+    if (value <= max_value(candidate)) {
+      return value;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<uint32_t> decode_escape(std::string_view &text, uint32_t max) {
+  assert(text.size() >= 2 && text[0] == '\\');
+
+  char simple = '\0';
+  switch (text[1]) {
+  case '\'': case '"': case '?': case '\\':
+    simple = text[1];
+    break;
+  case 'a': simple = '\a'; break;
+  case 'b': simple = '\b'; break;
+  case 'f': simple = '\f'; break;
+  case 'n': simple = '\n'; break;
+  case 'r': simple = '\r'; break;
+  case 't': simple = '\t'; break;
+  case 'v': simple = '\v'; break;
+  default:
+    break;
+  }
+  if (simple != '\0') {
+    text.remove_prefix(2);
+    return static_cast<uint32_t>(static_cast<unsigned char>(simple));
+  }
+
+  // Hexadecimal takes all the digits, octal up to three.
+  const bool hex = text[1] == 'x';
+  const int base = hex ? 16 : 8;
+  const size_t max_digits = hex ? text.size() : 3;
+  size_t pos = hex ? 2 : 1;
+  uint64_t value = 0;
+  bool overflow = false;
+  for (size_t digits = 0; pos < text.size() && digits < max_digits &&
+                          is_digit_of(text[pos], base);
+       ++pos, ++digits) {
+    value = value * base + digit_value(text[pos]);
+    // Keep on consuming digits, the escape is out of range anyway.
+    overflow = overflow || value > max;
+    value = overflow ? 0 : value;
+  }
+  text.remove_prefix(pos);
+  if (overflow) {
+    return std::nullopt;
+  }
+  return static_cast<uint32_t>(value);
+}
+
+std::optional<int> decode_char_const(std::string_view body, bool wide) {
+  const uint32_t max = wide ? std::numeric_limits<int32_t>::max() : UCHAR_MAX;
+
+  uint32_t packed = 0;
+  uint32_t last = 0;
+  size_t count = 0;
+  while (!body.empty()) {
+    if (body[0] == '\\') {
+      std::optional<uint32_t> code = decode_escape(body, max);
+      if (!code.has_value()) {
+        return std::nullopt;
+      }
+      last = code.value();
+    } else {
+      last = static_cast<unsigned char>(body[0]);
+      body.remove_prefix(1);
+    }
+    packed = (packed << CHAR_BIT) | last;
+    count += 1;
+  }
+  assert(count != 0);
+
+  if (wide) {
+    return static_cast<int>(last);
+  }
+  if (count == 1) {
+    // A single char is converted to int, char is signed on the host.
+    return static_cast<int>(static_cast<char>(last));
+  }
+  return static_cast<int>(packed);
+}
+
+bool append_decoded(std::string_view body, std::string &out) {
+  while (!body.empty()) {
+    const char *backslash =
+        static_cast<const char *>(std::memchr(body.data(), '\\', body.size()));
+    if (backslash == nullptr) {
+      out.append(body);
+      break;
+    }
+    out.append(body.data(), backslash);
+    body.remove_prefix(backslash - body.data());
+
+    std::optional<uint32_t> code = decode_escape(body, UCHAR_MAX);
+    if (!code.has_value()) {
+      return false;
+    }
+    out.push_back(static_cast<char>(code.value()));
+  }
+  return true;
+}
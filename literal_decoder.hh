@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Values of literals, decoded right from the source text. Both scanners
+//   have already matched the literal, so its syntax is not checked again:
+//   these only compute values and catch the ones out of range.
+//   Nothing is allocated but the bytes append_decoded appends.
+
+// Value of an integer constant, TEXT is the whole constant: prefix,
+//   digits and suffix. Returns nullopt if the value fits none of the
+//   types C99 6.4.4.1 allows for the suffix and the base. Which of them
+//   it is isn't kept: numbers are ints for now, see make_number.
+std::optional<uint64_t> decode_integer(std::string_view text, int base);
+
+// Decodes the escape sequence TEXT starts with (at the backslash) and
+//   moves TEXT past it. Returns nullopt if the value is above MAX.
+std::optional<uint32_t> decode_escape(std::string_view &text, uint32_t max);
+
+// Value of a character constant, BODY is the text between the quotes.
+//   A narrow constant of several characters packs them into an int
+//   byte by byte, a wide one takes the last character, as gcc does.
+//   Returns nullopt on an escape out of range.
+std::optional<int> decode_char_const(std::string_view body, bool wide);
+
+// Appends the bytes of a narrow string literal, BODY is the text
+//   between the quotes. Returns false on an escape out of range.
+bool append_decoded(std::string_view body, std::string &out);
@@ -0,0 +1,80 @@
+#include "literal_pool.hh"
+
+#include "exceptions.hh"
+#include "literal_decoder.hh"
+
+#include <cstring>
+
+namespace pas {
+
+LiteralPool::LiteralPool() { clear(); }
+
+void LiteralPool::clear() {
+  literals_.clear();
+  ids_.clear();
+  arena_.clear();
+  arena_free_ = 0;
+  pending_.clear();
+
+  // Id 0 is the empty literal, that's what StringLiteral() refers to.
+  intern(std::string_view());
+}
+
+const char *LiteralPool::store(std::string_view bytes) {
+  // Large literals get a block of their own, the current block keeps
+  //   being filled.
+  if (bytes.size() > ARENA_BLOCK_SIZE / 4) {
+    auto block = std::make_unique<char[]>(bytes.size());
+    char *data = block.get();
+    std::memcpy(data, bytes.data(), bytes.size());
+    arena_.insert(arena_.empty() ? arena_.end() : arena_.end() - 1,
+                  std::move(block));
+    return data;
+  }
+
+  if (bytes.empty()) {
+    return "";
+  }
+  if (arena_.empty() || arena_free_ < bytes.size()) {
+    arena_.push_back(std::make_unique<char[]>(ARENA_BLOCK_SIZE));
+    arena_free_ = ARENA_BLOCK_SIZE;
+  }
+  char *data = arena_.back().get() + (ARENA_BLOCK_SIZE - arena_free_);
+  std::memcpy(data, bytes.data(), bytes.size());
+  arena_free_ -= bytes.size();
+  return data;
+}
+
+StringLiteral LiteralPool::intern(std::string_view bytes) {
+  auto it = ids_.find(bytes);
+  if (it != ids_.end()) {
+    return StringLiteral(it->second);
+  }
+
+  if (literals_.size() == UINT32_MAX) {
+    throw RuntimeProblemException("too many distinct string literals");
+  }
+  const uint32_t id = static_cast<uint32_t>(literals_.size());
+  const std::string_view stored(store(bytes), bytes.size());
+  literals_.push_back(stored);
+  ids_.emplace(stored, id);
+  return StringLiteral(id);
+}
+
+bool LiteralPool::start_pending(std::string_view body) {
+  // Whatever was left by a parse error is dropped.
+  pending_.clear();
+  return append_pending(body);
+}
+
+bool LiteralPool::append_pending(std::string_view body) {
+  return append_decoded(body, pending_);
+}
+
+StringLiteral LiteralPool::intern_pending() {
+  StringLiteral literal = intern(pending_);
+  pending_.clear();
+  return literal;
+}
+
+} // namespace pas
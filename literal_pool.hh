@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace pas {
+
+// Handle of a string literal in the translation unit's LiteralPool.
+//   Equal handles are equal bytes, so a backend emits each one once.
+class StringLiteral {
+public:
+  StringLiteral() = default;
+  explicit StringLiteral(uint32_t id) : id_(id) {}
+
+  uint32_t id() const { return id_; }
+
+  bool operator==(const StringLiteral &other) const = default;
+
+private:
+  uint32_t id_ = 0;
+};
+
+// Decoded bytes of all narrow string literals of a translation unit,
+//   each distinct literal stored once in an arena. Adjacent literals
+//   are concatenated here (C99 5.1.1.2, phase 6): the parser decodes
+//   every piece into a pending literal and interns it when the run
+//   ends. Unlike the SymbolTable the pool is per driver and is used by
+//   the parser's thread only.
+class LiteralPool {
+public:
+  LiteralPool();
+
+  LiteralPool(const LiteralPool &other) = delete;
+  LiteralPool &operator=(const LiteralPool &other) = delete;
+
+public:
+  // Drops all literals, for the next translation unit.
+  void clear();
+
+  StringLiteral intern(std::string_view bytes);
+
+  // Start a pending literal with the text between the quotes of the
+  //   first of adjacent literals, or add the next one to it. Return
+  //   false on an escape out of range.
+  bool start_pending(std::string_view body);
+  bool append_pending(std::string_view body);
+  // Interns the pending literal and starts a new one.
+  StringLiteral intern_pending();
+
+  std::string_view bytes(StringLiteral literal) const {
+    return literals_[literal.id()];
+  }
+
+  // Number of distinct literals.
+  size_t size() const { return literals_.size(); }
+
+private:
+  const char *store(std::string_view bytes);
+
+private:
+  static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+  std::vector<std::string_view> literals_;
+  // Keys view bytes in the arena.
+  std::unordered_map<std::string_view, uint32_t> ids_;
+  std::vector<std::unique_ptr<char[]>> arena_;
+  size_t arena_free_ = 0;
+  // Reused for every literal, keeps its capacity.
+  std::string pending_;
+};
+
+} // namespace pas
+
+template <> struct std::hash<pas::StringLiteral> {
+  size_t operator()(pas::StringLiteral literal) const noexcept {
+    return std::hash<uint32_t>()(literal.id());
+  }
+};
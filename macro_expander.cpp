@@ -0,0 +1,959 @@
+#include "macro_expander.hh"
+
+#include "exceptions.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+bool is_nondigit(char c) {
+  return c == '_' || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+bool is_ident_char(char c) { return is_nondigit(c) || is_digit(c); }
+
+size_t filter_hash(std::string_view name) {
+  return (name.size() * 31 + static_cast<uint8_t>(name.front()) * 7 +
+          static_cast<uint8_t>(name.back()) * 131);
+}
+
+// Whether two tokens written next to each other would be lexed as
+//   something else, the output needs a space between them then.
+bool would_paste(char last, char first) {
+  if (is_ident_char(last) &&
+      (is_ident_char(first) || first == '\'' || first == '"')) {
+    return true;
+  }
+  // Parts of a pp-number: "1" ".", "." "1", "1e" "+".
+  if ((is_digit(last) && first == '.') || (last == '.' && is_digit(first)) ||
+      (((last | 0x20) == 'e' || (last | 0x20) == 'p') &&
+       (first == '+' || first == '-'))) {
+    return true;
+  }
+  static constexpr std::string_view PUNCTUATION = "+-*/%<>=!&|^#:.";
+  return PUNCTUATION.find(last) != std::string_view::npos &&
+         PUNCTUATION.find(first) != std::string_view::npos;
+}
+
+} // namespace
+
+// Preprocessing tokens of text, a line at a time. Comments are white
+//   space, a block comment may take several lines.
+class PPLexer {
+public:
+  PPLexer(const char *pos, const char *end, bool in_comment)
+      : pos_(pos), end_(end), in_comment_(in_comment) {}
+
+  // Next token of the current line. False at its end, the newline is
+  //   consumed; the next line is only lexed after StartNextLine.
+  bool Next(PPToken &token) {
+    if (at_line_start_) {
+      return false;
+    }
+    const bool space = SkipSpace();
+    if (pos_ == end_) {
+      return false;
+    }
+    if (*pos_ == '\n') {
+      ++pos_;
+      ++lines_;
+      at_line_start_ = true;
+      return false;
+    }
+
+    token = PPToken();
+    token.space_before = space || space_pending_;
+    space_pending_ = false;
+    const char *start = pos_;
+    token.kind = Lex();
+    token.text = start;
+    token.size = static_cast<uint32_t>(pos_ - start);
+    return true;
+  }
+
+  void StartNextLine() {
+    at_line_start_ = false;
+    space_pending_ = true;
+  }
+
+  bool AtEnd() const { return pos_ == end_; }
+  bool AtLineStart() const { return at_line_start_; }
+
+  // The next line is a directive.
+  bool AtDirective() const {
+    const char *pos = pos_;
+    while (pos != end_ && is_blank(*pos)) {
+      ++pos;
+    }
+    return pos != end_ && *pos == '#';
+  }
+
+  const char *pos() const { return pos_; }
+  uint32_t lines() const { return lines_; }
+
+private:
+  bool SkipSpace() {
+    bool skipped = false;
+    if (in_comment_) {
+      SkipCommentBody();
+      skipped = true;
+    }
+    while (pos_ != end_) {
+      const char c = *pos_;
+      if (is_blank(c)) {
+        ++pos_;
+      } else if (c == '\\' && end_ - pos_ >= 2 && pos_[1] == '\n') {
+        pos_ += 2;
+        ++lines_;
+      } else if (c == '/' && end_ - pos_ >= 2 && pos_[1] == '*') {
+        pos_ += 2;
+        SkipCommentBody();
+      } else if (c == '/' && end_ - pos_ >= 2 && pos_[1] == '/') {
+        const void *newline = std::memchr(pos_, '\n', end_ - pos_);
+        pos_ = newline != nullptr ? static_cast<const char *>(newline) : end_;
+      } else {
+        break;
+      }
+      skipped = true;
+    }
+    return skipped;
+  }
+
+  void SkipCommentBody() {
+    while (pos_ != end_) {
+      if (*pos_ == '*' && end_ - pos_ >= 2 && pos_[1] == '/') {
+        pos_ += 2;
+        in_comment_ = false;
+        return;
+      }
+      lines_ += *pos_ == '\n' ? 1 : 0;
+      ++pos_;
+    }
+    throw PreprocessorException("unterminated comment");
+  }
+
+  PPToken::Kind Lex() {
+    const char c = *pos_;
+    if (c == 'L' && end_ - pos_ >= 2 && (pos_[1] == '\'' || pos_[1] == '"')) {
+      ++pos_;
+      return Literal();
+    }
+    if (is_nondigit(c)) {
+      while (pos_ != end_ && is_ident_char(*pos_)) {
+        ++pos_;
+      }
+      return PPToken::Kind::Identifier;
+    }
+    if (is_digit(c) || (c == '.' && end_ - pos_ >= 2 && is_digit(pos_[1]))) {
+      ++pos_;
+      while (pos_ != end_) {
+        const char d = *pos_;
+        if ((d == '+' || d == '-') && ((pos_[-1] | 0x20) == 'e' ||
+                                       (pos_[-1] | 0x20) == 'p')) {
+          ++pos_;
+        } else if (is_ident_char(d) || d == '.') {
+          ++pos_;
+        } else {
+          break;
+        }
+      }
+      return PPToken::Kind::Number;
+    }
+    if (c == '"' || c == '\'') {
+      return Literal();
+    }
+
+    static constexpr std::string_view PUNCTUATORS[] = {
+        "%:%:", "...", "<<=", ">>=", "->", "++", "--", "<<", ">>", "<=",
+        ">=",   "==",  "!=",  "&&",  "||", "*=", "/=", "%=", "+=", "-=",
+        "&=",   "^=",  "|=",  "##",  "<:", ":>", "<%", "%>", "%:"};
+    const std::string_view rest(pos_, std::min<size_t>(end_ - pos_, 4));
+    for (std::string_view punctuator : PUNCTUATORS) {
+      if (rest.starts_with(punctuator)) {
+        pos_ += punctuator.size();
+        return PPToken::Kind::Punctuator;
+      }
+    }
+    static constexpr std::string_view SINGLE = "[](){}.&*+-~!/%<>^|?:;=,#";
+    ++pos_;
+    return SINGLE.find(c) != std::string_view::npos
+               ? PPToken::Kind::Punctuator
+               : PPToken::Kind::Other;
+  }
+
+  // A character constant or a string literal from its quote. An
+  //   unterminated one ends with the line and is not a literal.
+  PPToken::Kind Literal() {
+    const char quote = *pos_++;
+    while (pos_ != end_ && *pos_ != quote && *pos_ != '\n') {
+      pos_ += *pos_ == '\\' && end_ - pos_ >= 2 && pos_[1] != '\n' ? 2 : 1;
+    }
+    if (pos_ == end_ || *pos_ != quote) {
+      return PPToken::Kind::Other;
+    }
+    ++pos_;
+    return quote == '"' ? PPToken::Kind::String : PPToken::Kind::CharConst;
+  }
+
+private:
+  const char *pos_;
+  const char *end_;
+  bool in_comment_;
+  bool at_line_start_ = false;
+  bool space_pending_ = false;
+  uint32_t lines_ = 0;
+};
+
+void HideSets::clear() {
+  words_.clear();
+  starts_.assign({0, 0});
+  ids_.clear();
+  ids_.emplace(std::string(), 0);
+  add_cache_.clear();
+  unite_cache_.clear();
+  intersect_cache_.clear();
+}
+
+bool HideSets::contains(HideSet set, uint32_t bit) const {
+  const uint32_t index = bit / 64;
+  for (uint32_t i = starts_[set]; i != starts_[set + 1]; ++i) {
+    if (words_[i].index >= index) {
+      return words_[i].index == index &&
+             (words_[i].bits & (uint64_t(1) << (bit % 64))) != 0;
+    }
+  }
+  return false;
+}
+
+HideSet HideSets::intern(const std::vector<Word> &words) {
+  std::string key;
+  key.reserve(words.size() * (sizeof(uint32_t) + sizeof(uint64_t)));
+  for (const Word &word : words) {
+    key.append(reinterpret_cast<const char *>(&word.index), sizeof(word.index));
+    key.append(reinterpret_cast<const char *>(&word.bits), sizeof(word.bits));
+  }
+  auto [it, inserted] =
+      ids_.emplace(std::move(key), static_cast<HideSet>(starts_.size() - 1));
+  if (inserted) {
+    words_.insert(words_.end(), words.begin(), words.end());
+    starts_.push_back(static_cast<uint32_t>(words_.size()));
+  }
+  return it->second;
+}
+
+HideSet HideSets::add(HideSet set, uint32_t bit) {
+  if (contains(set, bit)) {
+    return set;
+  }
+  const uint64_t key = (uint64_t(set) << 32) | bit;
+  auto it = add_cache_.find(key);
+  if (it != add_cache_.end()) {
+    return it->second;
+  }
+
+  const uint32_t index = bit / 64;
+  scratch_.assign(words_.begin() + starts_[set],
+                  words_.begin() + starts_[set + 1]);
+  auto word = std::lower_bound(
+      scratch_.begin(), scratch_.end(), index,
+      [](const Word &word, uint32_t index) { return word.index < index; });
+  if (word == scratch_.end() || word->index != index) {
+    word = scratch_.insert(word, Word{index, 0});
+  }
+  word->bits |= uint64_t(1) << (bit % 64);
+
+  const HideSet result = intern(scratch_);
+  add_cache_.emplace(key, result);
+  return result;
+}
+
+HideSet HideSets::unite(HideSet a, HideSet b) {
+  if (a == b || b == 0) {
+    return a;
+  }
+  if (a == 0) {
+    return b;
+  }
+  const uint64_t key = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+  auto it = unite_cache_.find(key);
+  if (it != unite_cache_.end()) {
+    return it->second;
+  }
+
+  scratch_.clear();
+  uint32_t i = starts_[a];
+  uint32_t j = starts_[b];
+  while (i != starts_[a + 1] || j != starts_[b + 1]) {
+    if (j == starts_[b + 1] ||
+        (i != starts_[a + 1] && words_[i].index < words_[j].index)) {
+      scratch_.push_back(words_[i++]);
+    } else if (i == starts_[a + 1] || words_[j].index < words_[i].index) {
+      scratch_.push_back(words_[j++]);
+    } else {
+      scratch_.push_back(Word{words_[i].index, words_[i].bits | words_[j].bits});
+      ++i;
+      ++j;
+    }
+  }
+
+  const HideSet result = intern(scratch_);
+  unite_cache_.emplace(key, result);
+  return result;
+}
+
+HideSet HideSets::intersect(HideSet a, HideSet b) {
+  if (a == b) {
+    return a;
+  }
+  if (a == 0 || b == 0) {
+    return 0;
+  }
+  const uint64_t key = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+  auto it = intersect_cache_.find(key);
+  if (it != intersect_cache_.end()) {
+    return it->second;
+  }
+
+  scratch_.clear();
+  uint32_t i = starts_[a];
+  uint32_t j = starts_[b];
+  while (i != starts_[a + 1] && j != starts_[b + 1]) {
+    if (words_[i].index < words_[j].index) {
+      ++i;
+    } else if (words_[j].index < words_[i].index) {
+      ++j;
+    } else {
+      const uint64_t bits = words_[i].bits & words_[j].bits;
+      if (bits != 0) {
+        scratch_.push_back(Word{words_[i].index, bits});
+      }
+      ++i;
+      ++j;
+    }
+  }
+
+  const HideSet result = intern(scratch_);
+  intersect_cache_.emplace(key, result);
+  return result;
+}
+
+// State of an expansion in progress, set aside while an argument or a
+//   memoized macro is expanded on its own.
+struct MacroExpander::Isolation {
+  Isolation(MacroExpander &expander, const PPToken *tokens, uint32_t count)
+      : expander(expander), floor(expander.floor_), base(expander.base_),
+        pushback(expander.pushback_), has_pushback(expander.has_pushback_) {
+    if (expander.depth_ == MAX_DEPTH) {
+      throw PreprocessorException("macro arguments nested too deeply");
+    }
+    ++expander.depth_;
+    expander.contexts_.push_back(Context{tokens, tokens + count});
+    expander.floor_ = expander.contexts_.size() - 1;
+    expander.base_ = nullptr;
+    expander.has_pushback_ = false;
+  }
+
+  ~Isolation() {
+    expander.contexts_.resize(expander.floor_);
+    expander.floor_ = floor;
+    expander.base_ = base;
+    expander.pushback_ = pushback;
+    expander.has_pushback_ = has_pushback;
+    --expander.depth_;
+  }
+
+  MacroExpander &expander;
+  size_t floor;
+  PPLexer *base;
+  PPToken pushback;
+  bool has_pushback;
+};
+
+MacroExpander::MacroExpander(MacroTable &macros)
+    : macros_(macros),
+      va_args_(pas::SymbolTable::global().intern("__VA_ARGS__")) {}
+
+MacroExpander::~MacroExpander() = default;
+
+void MacroExpander::Reset() {
+  arena_.clear();
+  scratch_.clear();
+  hide_sets_.clear();
+  hide_bits_.clear();
+  memo_.clear();
+  generation_ += 1;
+  filter_.reset();
+  contexts_.clear();
+  floor_ = 0;
+  base_ = nullptr;
+  has_pushback_ = false;
+  memoizing_ = false;
+  depth_ = 0;
+  expansions_ = 0;
+  memo_hits_ = 0;
+
+  for (auto &[name, macro] : macros_) {
+    // Bodies were in the arena.
+    macro.tokenized = false;
+    filter_.set(filter_hash(name.spelling()) % FILTER_BITS);
+  }
+}
+
+void MacroExpander::Defined(pas::Symbol name) {
+  generation_ += 1;
+  filter_.set(filter_hash(name.spelling()) % FILTER_BITS);
+  Tokenize(macros_.at(name));
+}
+
+void MacroExpander::Undefined(pas::Symbol) { generation_ += 1; }
+
+bool MacroExpander::MayExpand(std::string_view line) const {
+  size_t pos = 0;
+  while (pos < line.size()) {
+    const char c = line[pos];
+    if (is_nondigit(c)) {
+      const size_t start = pos;
+      while (pos < line.size() && is_ident_char(line[pos])) {
+        ++pos;
+      }
+      if (filter_[filter_hash(line.substr(start, pos - start)) % FILTER_BITS]) {
+        return true;
+      }
+      if (pos < line.size() && (line[pos] == '\'' || line[pos] == '"')) {
+        // A wide literal, skipped below.
+        continue;
+      }
+    } else if (is_digit(c)) {
+      // Suffixes and hex digits of a number are not identifiers.
+      while (pos < line.size() && (is_ident_char(line[pos]) || line[pos] == '.')) {
+        ++pos;
+      }
+    } else if (c == '"' || c == '\'') {
+      ++pos;
+      while (pos < line.size() && line[pos] != c) {
+        pos += line[pos] == '\\' ? 2 : 1;
+      }
+      ++pos;
+    } else {
+      ++pos;
+    }
+  }
+  return false;
+}
+
+MacroDefinition *MacroExpander::Lookup(PPToken &token) {
+  if (token.kind != PPToken::Kind::Identifier) {
+    return nullptr;
+  }
+  if (token.symbol == pas::Symbol()) {
+    if (!filter_[filter_hash(token.spelling()) % FILTER_BITS]) {
+      return nullptr;
+    }
+    token.symbol = pas::SymbolTable::global().intern(token.spelling());
+  }
+  auto it = macros_.find(token.symbol);
+  return it != macros_.end() ? &it->second : nullptr;
+}
+
+void MacroExpander::Tokenize(MacroDefinition &macro) {
+  if (macro.tokenized) {
+    return;
+  }
+  // Once per definition, Level(0) may be in use.
+  std::vector<PPToken> tokens;
+  PPLexer lexer(macro.body.data(), macro.body.data() + macro.body.size(),
+                false);
+  PPToken token;
+  while (lexer.Next(token)) {
+    if (token.kind == PPToken::Kind::Identifier) {
+      token.symbol = pas::SymbolTable::global().intern(token.spelling());
+      auto param =
+          std::find(macro.params.begin(), macro.params.end(), token.symbol);
+      if (param != macro.params.end()) {
+        token.param = static_cast<uint16_t>(param - macro.params.begin());
+      } else if (macro.variadic && token.symbol == va_args_) {
+        token.param = static_cast<uint16_t>(macro.params.size());
+      }
+    }
+    tokens.push_back(token);
+  }
+
+  if (!tokens.empty() && (tokens.front().Is("##") || tokens.back().Is("##"))) {
+    throw PreprocessorException(
+        "'##' cannot appear at either end of a macro expansion");
+  }
+  if (macro.function_like) {
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      if (tokens[i].Is("#") &&
+          (i + 1 == tokens.size() || tokens[i + 1].param == PPToken::NO_PARAM)) {
+        throw PreprocessorException("'#' is not followed by a macro parameter");
+      }
+    }
+  }
+
+  macro.tokens = Copy(tokens.data(), tokens.size(), arena_);
+  macro.token_count = static_cast<uint32_t>(tokens.size());
+  macro.tokenized = true;
+}
+
+uint32_t MacroExpander::HideBit(pas::Symbol name) {
+  return hide_bits_.emplace(name, static_cast<uint32_t>(hide_bits_.size()))
+      .first->second;
+}
+
+MacroExpander::Buffers &MacroExpander::Level(size_t depth) {
+  while (levels_.size() <= depth) {
+    levels_.push_back(std::make_unique<Buffers>());
+  }
+  return *levels_[depth];
+}
+
+bool MacroExpander::Next(PPToken &token) {
+  if (has_pushback_) {
+    token = pushback_;
+    has_pushback_ = false;
+    return true;
+  }
+  while (contexts_.size() > floor_) {
+    Context &context = contexts_.back();
+    if (context.next != context.end) {
+      token = *context.next++;
+      return true;
+    }
+    contexts_.pop_back();
+  }
+  return base_ != nullptr && base_->Next(token);
+}
+
+bool MacroExpander::NextAcrossLines(PPToken &token) {
+  if (Next(token)) {
+    return true;
+  }
+  if (base_ == nullptr) {
+    return false;
+  }
+  // A directive is not an argument, C99 6.10.3p11.
+  while (!base_->AtEnd() && !base_->AtDirective()) {
+    base_->StartNextLine();
+    if (base_->Next(token)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void MacroExpander::ExpandLoop(Sink sink, bool condition) {
+  PPToken token;
+  while (true) {
+    if (sink.text != nullptr && contexts_.empty() && !has_pushback_ &&
+        depth_ == 0) {
+      // Whatever the last expansion made is written out already.
+      scratch_.clear();
+    }
+    if (!Next(token)) {
+      return;
+    }
+
+    if (condition && token.kind == PPToken::Kind::Identifier &&
+        token.spelling() == "defined") {
+      // The operand of defined is a name, not something to replace.
+      Emit(token, sink);
+      PPToken operand;
+      if (Next(operand)) {
+        Emit(operand, sink);
+        for (int i = 0; i < 2 && operand.Is("(") && Next(token); ++i) {
+          Emit(token, sink);
+        }
+      }
+      continue;
+    }
+
+    MacroDefinition *macro = Lookup(token);
+    if (macro == nullptr || !Invoke(token, *macro, sink)) {
+      Emit(token, sink);
+    }
+  }
+}
+
+bool MacroExpander::Invoke(const PPToken &token, MacroDefinition &macro,
+                           Sink sink) {
+  const uint32_t bit = HideBit(token.symbol);
+  if (hide_sets_.contains(token.hide_set, bit)) {
+    return false;
+  }
+  Tokenize(macro);
+
+  if (!macro.function_like) {
+    if (token.hide_set == 0 && !memoizing_ && EmitMemoized(token, sink)) {
+      return true;
+    }
+    expansions_ += 1;
+    PushContext(Substitute(token, macro, {},
+                           hide_sets_.add(token.hide_set, bit)));
+    return true;
+  }
+
+  PPToken paren;
+  if (!NextAcrossLines(paren)) {
+    return false;
+  }
+  if (!paren.Is("(")) {
+    pushback_ = paren;
+    has_pushback_ = true;
+    return false;
+  }
+  expansions_ += 1;
+
+  // Arguments, split at the commas outside of parentheses. The ones
+  //   of ... are one argument, commas included.
+  Buffers &buffers = Level(depth_);
+  std::vector<PPToken> &collected = buffers.collected;
+  std::vector<uint32_t> &bounds = buffers.bounds;
+  collected.clear();
+  bounds.assign(1, 0);
+  const size_t named = macro.params.size();
+  int parens = 0;
+  HideSet paren_hide_set = 0;
+  while (true) {
+    PPToken arg_token;
+    if (!NextAcrossLines(arg_token)) {
+      if (memoizing_) {
+        throw Incomplete();
+      }
+      throw PreprocessorException("unterminated argument list invoking macro '" +
+                                  std::string(token.spelling()) + "'");
+    }
+    if (arg_token.Is("(")) {
+      parens += 1;
+    } else if (arg_token.Is(")")) {
+      if (parens == 0) {
+        paren_hide_set = arg_token.hide_set;
+        break;
+      }
+      parens -= 1;
+    } else if (arg_token.Is(",") && parens == 0 &&
+               !(macro.variadic && bounds.size() - 1 >= named)) {
+      bounds.push_back(static_cast<uint32_t>(collected.size()));
+      continue;
+    }
+    collected.push_back(arg_token);
+  }
+  bounds.push_back(static_cast<uint32_t>(collected.size()));
+
+  size_t count = bounds.size() - 1;
+  if (count == 1 && collected.empty() && named == 0) {
+    // F() passes no arguments, or an empty one to ....
+    count = macro.variadic ? 1 : 0;
+  } else if (macro.variadic && count == named) {
+    // The variable arguments may be left out altogether.
+    bounds.push_back(bounds.back());
+    count += 1;
+  }
+  const size_t expected = named + (macro.variadic ? 1 : 0);
+  if (count != expected) {
+    throw PreprocessorException(
+        "macro '" + std::string(token.spelling()) + "' passed " +
+        std::to_string(count) + " arguments, but takes " +
+        std::to_string(expected));
+  }
+
+  std::vector<Argument> &args = buffers.args;
+  args.clear();
+  for (size_t i = 0; i < count; ++i) {
+    args.push_back(Argument{collected.data() + bounds[i],
+                            bounds[i + 1] - bounds[i]});
+  }
+
+  const HideSet hide_set = hide_sets_.add(
+      hide_sets_.intersect(token.hide_set, paren_hide_set), bit);
+  PushContext(Substitute(token, macro, args, hide_set));
+  return true;
+}
+
+bool MacroExpander::EmitMemoized(const PPToken &token, Sink sink) {
+  Memo &memo = memo_[token.symbol];
+  if (memo.generation == generation_) {
+    memo_hits_ += memo.open ? 0 : 1;
+  } else {
+    memo = Memo();
+    memo.generation = generation_;
+    Argument result{nullptr, 0};
+    memoizing_ = true;
+    try {
+      result = ExpandIsolated(&token, 1);
+    } catch (const Incomplete &) {
+      memo.open = true;
+    }
+    memoizing_ = false;
+
+    if (!memo.open && result.count != 0) {
+      // A function-like name at the end could take its arguments from
+      //   what follows the invocation.
+      PPToken last = result.tokens[result.count - 1];
+      const MacroDefinition *last_macro = Lookup(last);
+      memo.open = last_macro != nullptr && last_macro->function_like &&
+                  !hide_sets_.contains(last.hide_set, HideBit(last.symbol));
+    }
+    if (!memo.open && result.count != 0) {
+      PPToken *tokens = arena_.tokens(result.count);
+      std::copy(result.tokens, result.tokens + result.count, tokens);
+      for (uint32_t i = 0; i < result.count; ++i) {
+        if (tokens[i].scratch_text) {
+          char *text = arena_.text(tokens[i].size);
+          std::memcpy(text, tokens[i].text, tokens[i].size);
+          tokens[i].text = text;
+          tokens[i].scratch_text = false;
+        }
+      }
+      memo.tokens = tokens;
+      memo.count = result.count;
+    }
+    expansions_ += memo.open ? 0 : 1;
+  }
+
+  if (memo.open) {
+    return false;
+  }
+  for (uint32_t i = 0; i < memo.count; ++i) {
+    PPToken memo_token = memo.tokens[i];
+    if (i == 0) {
+      memo_token.space_before = token.space_before;
+    }
+    Emit(memo_token, sink);
+  }
+  return true;
+}
+
+std::vector<PPToken> &
+MacroExpander::Substitute(const PPToken &name, MacroDefinition &macro,
+                          const std::vector<Argument> &args,
+                          HideSet hide_set) {
+  Buffers &buffers = Level(depth_);
+  std::vector<PPToken> &out = buffers.substituted;
+  std::vector<Argument> &expanded = buffers.expanded;
+  out.clear();
+  expanded.assign(args.size(), Argument{nullptr, UINT32_MAX});
+
+  const PPToken *body = macro.tokens;
+  const size_t size = macro.token_count;
+  auto stringizes = [&](size_t i) {
+    return macro.function_like && body[i].Is("#") && i + 1 < size;
+  };
+  // Appends the operand at i, returns the index after it. Next to ##
+  //   an argument is taken as written, an empty one is a placemarker.
+  auto append_operand = [&](size_t i, bool raw) {
+    const PPToken &token = body[i];
+    if (stringizes(i)) {
+      out.push_back(Stringize(args[body[i + 1].param], token.space_before));
+      return i + 2;
+    }
+    if (token.param == PPToken::NO_PARAM) {
+      out.push_back(token);
+      return i + 1;
+    }
+
+    Argument arg = args[token.param];
+    if (!raw) {
+      Argument &full = expanded[token.param];
+      if (full.count == UINT32_MAX) {
+        full = ExpandIsolated(arg.tokens, arg.count);
+      }
+      arg = full;
+    }
+    const size_t start = out.size();
+    if (arg.count == 0 && raw) {
+      PPToken placemarker;
+      placemarker.kind = PPToken::Kind::Placemarker;
+      out.push_back(placemarker);
+    } else {
+      out.insert(out.end(), arg.tokens, arg.tokens + arg.count);
+    }
+    if (start != out.size()) {
+      out[start].space_before = token.space_before;
+    }
+    return i + 1;
+  };
+
+  size_t i = 0;
+  while (i < size) {
+    const size_t operand_end = stringizes(i) ? i + 2 : i + 1;
+    const bool pasted = operand_end < size && body[operand_end].Is("##");
+    i = append_operand(i, pasted);
+    while (i < size && body[i].Is("##")) {
+      const size_t lhs = out.size() - 1;
+      i = append_operand(i + 1, true);
+      out[lhs] = Paste(out[lhs], out[lhs + 1]);
+      out.erase(out.begin() + lhs + 1);
+    }
+  }
+
+  out.erase(std::remove_if(out.begin(), out.end(),
+                           [](const PPToken &token) {
+                             return token.kind == PPToken::Kind::Placemarker;
+                           }),
+            out.end());
+  for (PPToken &token : out) {
+    token.hide_set = hide_sets_.unite(token.hide_set, hide_set);
+    token.param = PPToken::NO_PARAM;
+  }
+  if (!out.empty()) {
+    out.front().space_before = name.space_before;
+  }
+  return out;
+}
+
+MacroExpander::Argument MacroExpander::ExpandIsolated(const PPToken *tokens,
+                                                      uint32_t count) {
+  if (count == 0) {
+    return Argument{nullptr, 0};
+  }
+  Isolation isolation(*this, tokens, count);
+  std::vector<PPToken> &out = Level(depth_).isolated;
+  out.clear();
+  ExpandLoop(Sink{nullptr, &out}, false);
+  return Argument{Copy(out.data(), out.size(), scratch_),
+                  static_cast<uint32_t>(out.size())};
+}
+
+PPToken MacroExpander::Stringize(const Argument &arg, bool space_before) {
+  std::string &text = stringized_;
+  text.assign(1, '"');
+  for (uint32_t i = 0; i < arg.count; ++i) {
+    const PPToken &token = arg.tokens[i];
+    if (i != 0 && token.space_before) {
+      text.push_back(' ');
+    }
+    if (token.kind == PPToken::Kind::String ||
+        token.kind == PPToken::Kind::CharConst) {
+      for (char c : token.spelling()) {
+        if (c == '"' || c == '\\') {
+          text.push_back('\\');
+        }
+        text.push_back(c);
+      }
+    } else {
+      text.append(token.spelling());
+    }
+  }
+  text.push_back('"');
+
+  PPToken result;
+  result.kind = PPToken::Kind::String;
+  char *stored = scratch_.text(text.size());
+  std::memcpy(stored, text.data(), text.size());
+  result.text = stored;
+  result.size = static_cast<uint32_t>(text.size());
+  result.space_before = space_before;
+  result.scratch_text = true;
+  return result;
+}
+
+PPToken MacroExpander::Paste(const PPToken &lhs, const PPToken &rhs) {
+  if (lhs.kind == PPToken::Kind::Placemarker) {
+    PPToken result = rhs;
+    result.space_before = lhs.space_before;
+    return result;
+  }
+  if (rhs.kind == PPToken::Kind::Placemarker) {
+    return lhs;
+  }
+
+  const size_t size = lhs.size + rhs.size;
+  char *text = scratch_.text(size);
+  std::memcpy(text, lhs.text, lhs.size);
+  std::memcpy(text + lhs.size, rhs.text, rhs.size);
+  PPLexer lexer(text, text + size, false);
+  PPToken result;
+  if (!lexer.Next(result) || result.space_before ||
+      result.size != size) {
+    throw PreprocessorException("pasting \"" + std::string(lhs.spelling()) +
+                                "\" and \"" + std::string(rhs.spelling()) +
+                                "\" does not give a valid preprocessing token");
+  }
+  result.space_before = lhs.space_before;
+  result.hide_set = hide_sets_.intersect(lhs.hide_set, rhs.hide_set);
+  result.scratch_text = true;
+  return result;
+}
+
+void MacroExpander::Emit(const PPToken &token, Sink sink) {
+  if (sink.tokens != nullptr) {
+    sink.tokens->push_back(token);
+    return;
+  }
+  std::string &out = *sink.text;
+  if (!out.empty() && out.back() != '\n' &&
+      (token.space_before || would_paste(out.back(), token.text[0]))) {
+    out.push_back(' ');
+  }
+  out.append(token.text, token.size);
+}
+
+void MacroExpander::PushContext(const std::vector<PPToken> &tokens) {
+  // A context read to the end is dropped now, so that a chain of macros
+  //   ending in one another doesn't pile them up.
+  while (contexts_.size() > floor_ &&
+         contexts_.back().next == contexts_.back().end) {
+    contexts_.pop_back();
+  }
+  if (tokens.empty()) {
+    return;
+  }
+  const PPToken *copy = Copy(tokens.data(), tokens.size(), scratch_);
+  contexts_.push_back(Context{copy, copy + tokens.size()});
+}
+
+const PPToken *MacroExpander::Copy(const PPToken *tokens, size_t count,
+                                   TokenArena &arena) {
+  if (count == 0) {
+    return nullptr;
+  }
+  PPToken *copy = arena.tokens(count);
+  std::copy(tokens, tokens + count, copy);
+  return copy;
+}
+
+const char *MacroExpander::ExpandText(const char *pos, const char *end,
+                                      bool in_comment, std::string &out,
+                                      uint32_t &lines) {
+  PPLexer lexer(pos, end, in_comment);
+  base_ = &lexer;
+  ExpandLoop(Sink{&out, nullptr}, false);
+  base_ = nullptr;
+  assert(contexts_.empty() && !has_pushback_);
+  scratch_.clear();
+
+  // The last line may have no newline.
+  lines = lexer.lines() + (lexer.AtEnd() && !lexer.AtLineStart() ? 1 : 0);
+  return lexer.pos();
+}
+
+std::string MacroExpander::ExpandDirective(std::string_view text,
+                                           bool condition) {
+  PPLexer lexer(text.data(), text.data() + text.size(), false);
+  std::vector<PPToken> &tokens = directive_tokens_;
+  tokens.clear();
+  base_ = &lexer;
+  ExpandLoop(Sink{nullptr, &tokens}, condition);
+  base_ = nullptr;
+
+  // A header name is put together from the tokens as they were spaced,
+  //   an expression must not have its operators run together.
+  std::string result;
+  for (const PPToken &token : tokens) {
+    if (!result.empty() &&
+        (token.space_before ||
+         (condition && would_paste(result.back(), token.text[0])))) {
+      result.push_back(' ');
+    }
+    result.append(token.text, token.size);
+  }
+  scratch_.clear();
+  return result;
+}
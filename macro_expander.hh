@@ -0,0 +1,270 @@
+#pragma once
+
+#include "arena.hh"
+#include "symbol_table.hh"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Set of macros a token must not be expanded by, C99 6.10.3.4: the
+//   macros whose replacement it came from. An id in HideSets, 0 is the
+//   empty set.
+using HideSet = uint32_t;
+
+// Preprocessing token, C99 6.4. The text is a view into the source, a
+//   macro body or the arena.
+struct PPToken {
+  enum class Kind : uint8_t {
+    Identifier,
+    Number,
+    CharConst,
+    String,
+    Punctuator,
+    Other,
+    // Stands for an empty argument next to ##, C99 6.10.3.3.
+    Placemarker,
+  };
+
+  static constexpr uint16_t NO_PARAM = UINT16_MAX;
+
+  const char *text = nullptr;
+  uint32_t size = 0;
+  // Set for identifiers that may name a macro, the rest are never
+  //   interned.
+  pas::Symbol symbol;
+  HideSet hide_set = 0;
+  Kind kind = Kind::Other;
+  bool space_before = false;
+  // Made by # or ##, the text is in the scratch arena.
+  bool scratch_text = false;
+  // In a function-like macro's body, the index of the parameter it names.
+  uint16_t param = NO_PARAM;
+
+  std::string_view spelling() const { return std::string_view(text, size); }
+  bool Is(std::string_view punctuator) const {
+    return kind == Kind::Punctuator && spelling() == punctuator;
+  }
+};
+
+struct MacroDefinition {
+  bool function_like = false;
+  bool variadic = false;
+  std::vector<pas::Symbol> params;
+  std::string body;
+
+  // Tokens of the body in the expander's arena, made on the first use.
+  //   Valid for the translation unit.
+  const PPToken *tokens = nullptr;
+  uint32_t token_count = 0;
+  bool tokenized = false;
+};
+
+// Tokens and text, freed all at once by clear().
+class TokenArena : public Arena {
+public:
+  PPToken *tokens(size_t count) {
+    return static_cast<PPToken *>(
+        allocate(count * sizeof(PPToken), alignof(PPToken)));
+  }
+  char *text(size_t size) { return static_cast<char *>(allocate(size, 1)); }
+};
+
+// Interned hide sets. A set is a sparse bitset, a sorted run of 64-bit
+//   words with their indexes, over bits given to macro names; equal
+//   sets get the same id. The operations expansion needs are cached by
+//   their operands, so after warming up they are a hash lookup.
+class HideSets {
+public:
+  HideSets() { clear(); }
+
+  void clear();
+
+  bool contains(HideSet set, uint32_t bit) const;
+  HideSet add(HideSet set, uint32_t bit);
+  HideSet unite(HideSet a, HideSet b);
+  HideSet intersect(HideSet a, HideSet b);
+
+  size_t size() const { return starts_.size() - 1; }
+
+private:
+  struct Word {
+    uint32_t index;
+    uint64_t bits;
+  };
+
+  HideSet intern(const std::vector<Word> &words);
+
+private:
+  // Words of set i are words_[starts_[i], starts_[i + 1]).
+  std::vector<Word> words_;
+  std::vector<uint32_t> starts_;
+  // Bytes of the words -> set.
+  std::unordered_map<std::string, HideSet> ids_;
+  // Operands packed into 64 bits -> result.
+  std::unordered_map<uint64_t, HideSet> add_cache_;
+  std::unordered_map<uint64_t, HideSet> unite_cache_;
+  std::unordered_map<uint64_t, HideSet> intersect_cache_;
+  std::vector<Word> scratch_;
+};
+
+class PPLexer;
+
+// Macro replacement, C99 6.10.3, by the hide set algorithm (Prosser):
+//   every token carries the set of macros it was produced by, a macro
+//   name is not replaced by a macro of its hide set. Replacements are
+//   read back through a stack of contexts instead of being spliced into
+//   a token list, so rescanning costs nothing but the reading.
+// Bodies are tokenized once into the arena of the translation unit.
+//   Token lists made by an expansion go to a scratch arena, cleared
+//   whenever expansion is back in the source text.
+// The full expansion of an object-like macro met in the source text is
+//   memoized until the next #define or #undef, unless it ends with the
+//   name of a function-like macro that could take its arguments from
+//   what follows.
+// Errors are thrown as PreprocessorException without a location, the
+//   preprocessor adds it.
+class MacroExpander {
+public:
+  using MacroTable = std::unordered_map<pas::Symbol, MacroDefinition>;
+
+  explicit MacroExpander(MacroTable &macros);
+  ~MacroExpander();
+
+  MacroExpander(const MacroExpander &other) = delete;
+  MacroExpander &operator=(const MacroExpander &other) = delete;
+
+public:
+  // Drops everything of the last translation unit. Macros already in
+  //   the table are taken as defined.
+  void Reset();
+
+  // Called after a macro is defined or undefined. A new definition is
+  //   tokenized right away, so that its errors are reported at #define.
+  void Defined(pas::Symbol name);
+  void Undefined(pas::Symbol name);
+
+  // Whether a line has an identifier that may be the name of a macro.
+  //   False positives only cost a slower path.
+  bool MayExpand(std::string_view line) const;
+
+  // Expands source text from pos, appending the result to out. Stops at
+  //   the end of a line that is not inside of a comment or a macro
+  //   invocation, so it may take several lines. in_comment tells the
+  //   first one starts inside of a comment. Returns where the next line
+  //   starts, lines is the number of lines consumed.
+  const char *ExpandText(const char *pos, const char *end, bool in_comment,
+                         std::string &out, uint32_t &lines);
+
+  // Expands the text of a directive (#if, #include). In a condition the
+  //   operands of "defined" are left alone.
+  std::string ExpandDirective(std::string_view text, bool condition);
+
+  // Expansions so far in this translation unit, and how many of them
+  //   were served from the memo.
+  size_t expansions() const { return expansions_; }
+  size_t memo_hits() const { return memo_hits_; }
+
+private:
+  struct Context {
+    const PPToken *next;
+    const PPToken *end;
+  };
+
+  struct Memo {
+    uint64_t generation = 0;
+    // The expansion can't be memoized.
+    bool open = false;
+    const PPToken *tokens = nullptr;
+    uint32_t count = 0;
+  };
+
+  // Where expanded tokens go.
+  struct Sink {
+    std::string *text = nullptr;
+    std::vector<PPToken> *tokens = nullptr;
+  };
+
+  // A macro invocation ran past the end of an isolated expansion.
+  struct Incomplete {};
+
+  struct Argument {
+    const PPToken *tokens;
+    uint32_t count;
+  };
+
+  // Buffers of one level of nesting, they keep their capacity.
+  struct Buffers {
+    std::vector<PPToken> collected;
+    // Argument i is collected[bounds[i], bounds[i + 1]).
+    std::vector<uint32_t> bounds;
+    std::vector<Argument> args;
+    std::vector<Argument> expanded;
+    std::vector<PPToken> substituted;
+    std::vector<PPToken> isolated;
+  };
+
+  struct Isolation;
+
+  MacroDefinition *Lookup(PPToken &token);
+  void Tokenize(MacroDefinition &macro);
+  uint32_t HideBit(pas::Symbol name);
+  Buffers &Level(size_t depth);
+
+  bool Next(PPToken &token);
+  // Next token for an invocation, from the following lines if needed.
+  bool NextAcrossLines(PPToken &token);
+
+  void ExpandLoop(Sink sink, bool condition);
+  // Replaces the macro named by token. False if it is not an
+  //   invocation, a function-like name without arguments.
+  bool Invoke(const PPToken &token, MacroDefinition &macro, Sink sink);
+  bool EmitMemoized(const PPToken &token, Sink sink);
+
+  std::vector<PPToken> &Substitute(const PPToken &name, MacroDefinition &macro,
+                                   const std::vector<Argument> &args,
+                                   HideSet hide_set);
+  // Fully expanded tokens of an argument, on their own.
+  Argument ExpandIsolated(const PPToken *tokens, uint32_t count);
+  PPToken Stringize(const Argument &arg, bool space_before);
+  PPToken Paste(const PPToken &lhs, const PPToken &rhs);
+
+  void Emit(const PPToken &token, Sink sink);
+  void PushContext(const std::vector<PPToken> &tokens);
+  const PPToken *Copy(const PPToken *tokens, size_t count, TokenArena &arena);
+
+private:
+  static constexpr size_t FILTER_BITS = 4096;
+  static constexpr size_t MAX_DEPTH = 256;
+
+  MacroTable &macros_;
+  TokenArena arena_;
+  TokenArena scratch_;
+  HideSets hide_sets_;
+  std::unordered_map<pas::Symbol, uint32_t> hide_bits_;
+  std::unordered_map<pas::Symbol, Memo> memo_;
+  uint64_t generation_ = 1;
+  // Hashes of the names of macros defined in this translation unit.
+  std::bitset<FILTER_BITS> filter_;
+
+  std::vector<Context> contexts_;
+  // Contexts below are not read by an isolated expansion.
+  size_t floor_ = 0;
+  PPLexer *base_ = nullptr;
+  PPToken pushback_;
+  bool has_pushback_ = false;
+  bool memoizing_ = false;
+  std::vector<std::unique_ptr<Buffers>> levels_;
+  size_t depth_ = 0;
+  std::vector<PPToken> directive_tokens_;
+  std::string stringized_;
+  pas::Symbol va_args_;
+
+  size_t expansions_ = 0;
+  size_t memo_hits_ = 0;
+};
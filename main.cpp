@@ -1,9 +1,14 @@
 #include "driver.hh"
+#include "parse_session.hh"
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 int main(int argc, char **argv) {
   int result = 0;
   Driver driver;
+  std::string emit_pch;
 
   try {
     for (int i = 1; i < argc; ++i) {
@@ -13,6 +18,77 @@ int main(int argc, char **argv) {
         driver.trace_scanning = true;
       } else if (argv[i] == std::string("-l")) {
         driver.location_debug = true;
+      } else if (argv[i] == std::string("-E")) {
+        driver.stage = Driver::Stage::Preprocess;
+      } else if (argv[i] == std::string("-fsyntax-only")) {
+        driver.stage = Driver::Stage::SyntaxOnly;
+      } else if (argv[i] == std::string("-ast-dump") ||
+                 argv[i] == std::string("-ast-dump=text")) {
+        driver.stage = Driver::Stage::DumpAst;
+        driver.dump_format = pas::flat::DumpFormat::Text;
+      } else if (argv[i] == std::string("-ast-dump=json")) {
+        driver.stage = Driver::Stage::DumpAst;
+        driver.dump_format = pas::flat::DumpFormat::JsonLines;
+      } else if (argv[i] == std::string("-ast-dump=binary")) {
+        driver.stage = Driver::Stage::DumpAst;
+        driver.dump_format = pas::flat::DumpFormat::Binary;
+      } else if (std::string_view(argv[i]).starts_with("-ast-dump-file=")) {
+        driver.dump_to(argv[i] + std::strlen("-ast-dump-file="));
+      } else if (argv[i] == std::string("-run")) {
+        driver.stage = Driver::Stage::Run;
+      } else if (argv[i] == std::string("-fshare-exprs")) {
+        driver.share_exprs = true;
+      } else if (std::string_view(argv[i]).starts_with("-ast-cache=")) {
+        driver.use_ast_cache(argv[i] + std::strlen("-ast-cache="));
+      } else if (argv[i] == std::string("-lexer=flex")) {
+        driver.lexer_kind = Driver::LexerKind::Flex;
+      } else if (argv[i] == std::string("-lexer=hand")) {
+        driver.lexer_kind = Driver::LexerKind::Hand;
+      } else if (argv[i] == std::string("-lexer=diff")) {
+        driver.lexer_kind = Driver::LexerKind::Differential;
+      } else if (argv[i] == std::string("-lexer=pipeline")) {
+        driver.lexer_kind = Driver::LexerKind::Pipeline;
+      } else if (argv[i] == std::string("-lexer=chunked")) {
+        driver.lexer_kind = Driver::LexerKind::Chunked;
+      } else if (std::string_view(argv[i]).starts_with("-lexer-threads=")) {
+        driver.lexer_threads = static_cast<unsigned>(
+            std::stoul(argv[i] + std::strlen("-lexer-threads=")));
+      } else if (std::string_view(argv[i]).starts_with("-sema-threads=")) {
+        driver.sema_threads = static_cast<unsigned>(
+            std::stoul(argv[i] + std::strlen("-sema-threads=")));
+      } else if (std::string_view(argv[i]).starts_with("-emit-pch=")) {
+        // The next file is the header to precompile.
+        emit_pch = argv[i] + std::strlen("-emit-pch=");
+      } else if (std::string_view(argv[i]).starts_with("-include-pch=")) {
+        driver.include_pch(argv[i] + std::strlen("-include-pch="));
+      } else if (argv[i] == std::string("-session")) {
+        // Paths come on stdin, a line each, as an editor saves the file.
+        //   Each parse reuses what it can of the last one.
+        ParseSession session(driver);
+        std::string path;
+        while (std::getline(std::cin, path)) {
+          if (!session.Update(path)) {
+            result = 1;
+          }
+          std::cout << std::endl;
+          std::cerr << "reparsed " << session.reparsed() << ", reused "
+                    << session.reused() << " subprograms" << std::endl;
+        }
+      } else if (std::string_view(argv[i]).starts_with("-I")) {
+        driver.files.add_include_dir(argv[i] + std::strlen("-I"));
+      } else if (std::string_view(argv[i]).starts_with("-D")) {
+        // -DNAME is -DNAME=1.
+        std::string_view definition(argv[i] + std::strlen("-D"));
+        size_t equals = definition.find('=');
+        if (equals == std::string_view::npos) {
+          driver.preprocessor.Predefine(definition, "1");
+        } else {
+          driver.preprocessor.Predefine(definition.substr(0, equals),
+                                        definition.substr(equals + 1));
+        }
+      } else if (!emit_pch.empty()) {
+        driver.emit_pch(argv[i], emit_pch);
+        emit_pch.clear();
       } else if (!driver.parse(argv[i])) {
         std::cout << driver.result << std::endl;
       } else {
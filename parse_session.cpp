@@ -0,0 +1,162 @@
+#include "parse_session.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <string_view>
+
+bool ParseSession::Update(const std::string &path) {
+  if (driver_.stage == Driver::Stage::Preprocess) {
+    valid_ = false;
+    driver_.files.refresh();
+    return driver_.parse(path);
+  }
+
+  driver_.file = path;
+  // Headers may have been edited too. Their text is part of the
+  //   preprocessed source Reparse compares.
+  driver_.files.refresh();
+  if (valid_ && path == path_) {
+    driver_.open_source();
+    if (Reparse()) {
+      return driver_.run_stage();
+    }
+  }
+  if (!FullParse()) {
+    return false;
+  }
+  return driver_.run_stage();
+}
+
+bool ParseSession::FullParse() {
+  path_ = driver_.file;
+  valid_ = driver_.parse_source();
+  if (!valid_) {
+    return false;
+  }
+  Remember();
+  reparsed_ = subprograms_.size();
+  reused_ = 0;
+  return true;
+}
+
+void ParseSession::Remember() {
+  text_.assign(driver_.source_.data(), driver_.source_.size());
+  subprograms_ = driver_.subprograms_;
+  statements_ = driver_.statements_;
+  scope_items_ = driver_.scope_tracker.items_since(0);
+}
+
+bool ParseSession::Reparse() {
+  const std::string_view old_text = text_;
+  std::string_view new_text(driver_.source_.data(), driver_.source_.size());
+
+  // The changed bytes are [begin, old_end) of the old text and
+  //   [begin, new_end) of the new one.
+  const size_t limit = std::min(old_text.size(), new_text.size());
+  const size_t begin = std::mismatch(old_text.begin(),
+                                     old_text.begin() + limit, new_text.begin())
+                           .first -
+                       old_text.begin();
+  if (begin == limit && old_text.size() == new_text.size()) {
+    reparsed_ = 0;
+    reused_ = subprograms_.size();
+    return true;
+  }
+  size_t suffix = 0;
+  while (suffix < limit - begin &&
+         old_text[old_text.size() - 1 - suffix] ==
+             new_text[new_text.size() - 1 - suffix]) {
+    ++suffix;
+  }
+  const size_t old_end = old_text.size() - suffix;
+
+  if (subprograms_.empty() || begin < subprograms_.front().offset ||
+      old_end > statements_.offset) {
+    return false;
+  }
+  // A change right at the start of a subprogram may as well be at the
+  //   end of the one before, both are parsed again.
+  size_t first = 0;
+  while (first + 1 < subprograms_.size() &&
+         subprograms_[first + 1].offset < begin) {
+    ++first;
+  }
+  size_t last = first;
+  while (last + 1 < subprograms_.size() &&
+         subprograms_[last + 1].offset <= old_end) {
+    ++last;
+  }
+  const size_t from = subprograms_[first].offset;
+  const size_t old_to = End(last).offset;
+  const size_t new_to = old_to - old_text.size() + new_text.size();
+
+  // The file scope as a full parse has it at the first subprogram.
+  const size_t mark = subprograms_[first].scope_mark;
+  driver_.scope_tracker.clear();
+  driver_.scope_tracker.start_scope();
+  for (size_t i = 0; i < mark; ++i) {
+    driver_.scope_tracker.add_item(scope_items_[i].first,
+                                   scope_items_[i].second);
+  }
+
+  std::string fragment(new_text.substr(from, new_to - from));
+  SourceFile source = std::move(driver_.source_);
+  const size_t lex_start = driver_.lex_start_;
+  driver_.source_ = SourceFile::from_text(std::move(fragment));
+  const bool parsed = driver_.parse_fragment();
+  driver_.source_ = std::move(source);
+  driver_.lex_start_ = lex_start;
+  driver_.line_table_.reset();
+  if (!parsed) {
+    return false;
+  }
+
+  const size_t old_mark_end = End(last).scope_mark;
+  const ScopeItems declared = driver_.scope_tracker.items_since(mark);
+  if (!std::equal(declared.begin(), declared.end(),
+                  scope_items_.begin() + mark,
+                  scope_items_.begin() + old_mark_end)) {
+    return false;
+  }
+  for (size_t i = old_mark_end; i < scope_items_.size(); ++i) {
+    driver_.scope_tracker.add_item(scope_items_[i].first,
+                                   scope_items_[i].second);
+  }
+
+  pas::ast::List<pas::ast::SubprogDecl> &decls =
+      driver_.ast_->pm_.block_.decls_->subprog_decls_;
+  assert(driver_.fragment_);
+  pas::ast::List<pas::ast::SubprogDecl> &reparsed = *driver_.fragment_;
+  assert(decls.size() == subprograms_.size());
+  assert(reparsed.size() == driver_.subprograms_.size());
+  decls.erase(decls.begin() + first, decls.begin() + last + 1);
+  decls.insert(decls.begin() + first, std::make_move_iterator(reparsed.begin()),
+               std::make_move_iterator(reparsed.end()));
+
+  // Offsets after the change move with it, scope marks stay as the
+  //   declarations are the same.
+  auto moved = [&](uint32_t offset) {
+    return static_cast<uint32_t>(offset + new_text.size() - old_text.size());
+  };
+  std::vector<Driver::SubprogramStart> starts(subprograms_.begin(),
+                                              subprograms_.begin() + first);
+  for (Driver::SubprogramStart start : driver_.subprograms_) {
+    start.offset += static_cast<uint32_t>(from);
+    starts.push_back(start);
+  }
+  for (size_t i = last + 1; i < subprograms_.size(); ++i) {
+    Driver::SubprogramStart start = subprograms_[i];
+    start.offset = moved(start.offset);
+    starts.push_back(start);
+  }
+  statements_.offset = moved(statements_.offset);
+
+  reparsed_ = reparsed.size();
+  reused_ = subprograms_.size() - (last + 1 - first);
+  driver_.fragment_ = {};
+  subprograms_ = std::move(starts);
+  new_text = std::string_view(driver_.source_.data(), driver_.source_.size());
+  text_.assign(new_text);
+  return true;
+}
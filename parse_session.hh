@@ -0,0 +1,73 @@
+#pragma once
+
+#include "driver.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Parses the same file again and again as it is edited, for editors
+//   that check the source on every keystroke. The last parse is kept:
+//   where each top-level subprogram starts and the declarations of the
+//   file scope. After an edit only the subprograms the changed bytes
+//   fall into are lexed and parsed again, on their own, and spliced
+//   into the last AST in place of the old ones.
+// The file scope is replayed up to the first reparsed subprogram, so
+//   identifiers in it are classified as in a full parse. If the
+//   reparsed subprograms declare something else in the file scope, the
+//   rest of the file could be classified differently and the whole file
+//   is parsed again. So it is for edits outside of subprograms (the
+//   program's heading, constants, types, variables and statements) and
+//   for fragments that don't parse on their own.
+// Literals of reparsed subprograms are added to the driver's pool, it
+//   is only cleared by a full parse.
+class ParseSession {
+public:
+  explicit ParseSession(Driver &driver) : driver_(driver) {}
+
+  ParseSession(const ParseSession &other) = delete;
+  ParseSession &operator=(const ParseSession &other) = delete;
+
+public:
+  // Parses path and does the driver's stage with the AST, as
+  //   Driver::parse does. Reuses the last parse if it was of the same
+  //   path. False on a syntax error.
+  bool Update(const std::string &path);
+
+  // Top-level subprograms of the last update parsed again and taken
+  //   from the parse before.
+  size_t reparsed() const { return reparsed_; }
+  size_t reused() const { return reused_; }
+
+private:
+  using ScopeItems =
+      std::vector<std::pair<pas::Symbol, Driver::DeclaredIdentType>>;
+
+  bool FullParse();
+  // Parses the changed subprograms only. False if it can't, nothing is
+  //   reported then and the AST is as it was.
+  bool Reparse();
+  // Takes the layout of the driver's last full parse.
+  void Remember();
+
+  // Where the range of subprogram i ends: the next one or the
+  //   statements start.
+  const Driver::SubprogramStart &End(size_t i) const {
+    return i + 1 < subprograms_.size() ? subprograms_[i + 1] : statements_;
+  }
+
+private:
+  Driver &driver_;
+  bool valid_ = false;
+  std::string path_;
+  // Text the lexers saw in the last parse.
+  std::string text_;
+  std::vector<Driver::SubprogramStart> subprograms_;
+  Driver::SubprogramStart statements_{};
+  ScopeItems scope_items_;
+
+  size_t reparsed_ = 0;
+  size_t reused_ = 0;
+};
@@ -9,7 +9,10 @@
 %code requires {
     #include "ast.hpp"
     #include "get_idx.hpp"
+    #include "literal_pool.hh"
+    #include "source_location.hh"
     #include <string>
+    #include <string_view>
     #include <utility>
 
     /* Forward declaration of classes in order to disable cyclic dependencies */
@@ -24,11 +27,11 @@
 %code {
     #include "ast.hpp"
     #include "driver.hh"
-    #include "location.hh"
 
-    /* Redefine parser to use our function from scanner */
-    static yy::parser::symbol_type yylex(Scanner &scanner) {
-        return scanner.ScanToken();
+    /* Redefine parser to use our function from scanner.
+       The driver picks the lexer, flex or hand-written. */
+    static yy::parser::symbol_type yylex(Driver &driver) {
+        return driver.next_token();
     }
 
 		/* iostream output function for std::pair */
@@ -43,12 +46,14 @@
     }
 }
 
-%lex-param { Scanner &scanner }
+%lex-param { Driver &driver }
 
 %parse-param { Scanner &scanner }
 %parse-param { Driver &driver }
 
 %locations
+// Tokens and stack entries only carry an offset into the source.
+%define api.location.type {SourceLoc}
 
 // TODO: handle dangling else, make a warning that dangling else may happen.
 // %nonassoc THEN
@@ -63,29 +68,43 @@
 
 // Type names, variable names, function names, record names, etc.
 //   There are some predefined identifiers that can't be used.
-%token <std::string> identifier "identifier"
-
-// String constant
-%token <std::string>               string "string"
+// Identifiers are interned by the scanner, payload is the symbol.
+%token <pas::Symbol> identifier "identifier"
+// Identifiers already declared in a visible scope, the scanner
+//   classifies them with Driver::scope_tracker.
+%token <pas::Symbol> var_name type_name func_name struct_name
+
+// String constant, text between the quotes, viewed in the source.
+//   Character constants carry their value.
+%token <std::string_view>          string "string"
+%token <std::string_view>          long_string
+%token <int>                       char_const long_char_const
 %token <int>                       number "number"
 %token <std::pair<char, char>>     CharSubrange   // 'a..z', no multibyte for now (and wide chars).
 %token <char>                      CharacterConst // 'a', no multibyte characters for now.
+// Made by the driver, not the lexers: an expression or a list of them
+//   parsed by the ExpressionParser, see ExpressionStart.
+%token <pas::ast::Expr>                   expression "expression"
+%token <pas::ast::List<pas::ast::Expr>>      expression_list "expression list"
+// Put first by the driver to parse a run of subprograms on their own,
+//   see ParseSession.
+%token                                    subprogram_fragment "subprogram fragment"
 
 %nterm <pas::ast::CompilationUnit>              CompilationUnit
 %nterm <pas::ast::ProgramModule>                ProgramModule
-%nterm <std::vector<std::string>>               IdentList
+%nterm <pas::ast::List<pas::ast::Ident>>           IdentList
 %nterm <pas::ast::Block>                        Block
 %nterm <pas::ast::Declarations>                 Declarations
-%nterm <std::vector<pas::ast::ConstDef>>        ConstantDefBlockOpt
-%nterm <std::vector<pas::ast::TypeDef>>         TypeDefBlockOpt
-%nterm <std::vector<pas::ast::VarDecl>>         VariableDeclBlockOpt
-%nterm <std::vector<pas::ast::SubprogDecl>>     SubprogDeclListOpt
-%nterm <std::vector<pas::ast::ConstDef>>        ConstantDefBlock
-%nterm <std::vector<pas::ast::ConstDef>>        ConstantDefList
-%nterm <std::vector<pas::ast::TypeDef>>         TypeDefBlock
-%nterm <std::vector<pas::ast::TypeDef>>         TypeDefList
-%nterm <std::vector<pas::ast::VarDecl>>         VariableDeclBlock
-%nterm <std::vector<pas::ast::VarDecl>>         VariableDeclList
+%nterm <pas::ast::List<pas::ast::ConstDef>>        ConstantDefBlockOpt
+%nterm <pas::ast::List<pas::ast::TypeDef>>         TypeDefBlockOpt
+%nterm <pas::ast::List<pas::ast::VarDecl>>         VariableDeclBlockOpt
+%nterm <pas::ast::List<pas::ast::SubprogDecl>>     SubprogDeclListOpt
+%nterm <pas::ast::List<pas::ast::ConstDef>>        ConstantDefBlock
+%nterm <pas::ast::List<pas::ast::ConstDef>>        ConstantDefList
+%nterm <pas::ast::List<pas::ast::TypeDef>>         TypeDefBlock
+%nterm <pas::ast::List<pas::ast::TypeDef>>         TypeDefList
+%nterm <pas::ast::List<pas::ast::VarDecl>>         VariableDeclBlock
+%nterm <pas::ast::List<pas::ast::VarDecl>>         VariableDeclList
 %nterm <pas::ast::ConstDef>                     ConstantDef
 %nterm <pas::ast::TypeDef>                      TypeDef
 %nterm <pas::ast::VarDecl>                      VariableDecl
@@ -94,64 +113,49 @@
 %nterm <pas::ast::ConstFactor>                  ConstFactor
 %nterm <pas::ast::Type>                         Type
 %nterm <pas::ast::ArrayType>                    ArrayType
-%nterm <std::vector<pas::ast::Subrange>>        SubrangeList
+%nterm <pas::ast::List<pas::ast::Subrange>>        SubrangeList
 %nterm <pas::ast::Subrange>                     Subrange
 %nterm <pas::ast::RecordType>                   RecordType
 %nterm <pas::ast::SetType>                      SetType
 %nterm <pas::ast::PointerType>                  PointerType
-%nterm <std::vector<pas::ast::FieldList>>       FieldListSequence
+%nterm <pas::ast::List<pas::ast::FieldList>>       FieldListSequence
 %nterm <pas::ast::FieldList>                    FieldList
-%nterm <std::vector<pas::ast::Stmt>>            StatementSequence
-%nterm <std::vector<pas::ast::Stmt>>            StatementList
+%nterm <pas::ast::List<pas::ast::Stmt>>            StatementSequence
+%nterm <pas::ast::List<pas::ast::Stmt>>            StatementList
 %nterm <pas::ast::Stmt>                         Statement
 %nterm <pas::ast::Assignment>                   Assignment
 %nterm <pas::ast::ProcCall>                     ProcedureCall
-%nterm <std::vector<pas::ast::Expr>>            ActualParametersOpt
+%nterm <pas::ast::List<pas::ast::Expr>>            ActualParametersOpt
 %nterm <pas::ast::IfStmt>                       IfStatement
 %nterm <pas::ast::CaseStmt>                     CaseStatement
-%nterm <std::vector<pas::ast::Case>>            CaseList
+%nterm <pas::ast::List<pas::ast::Case>>            CaseList
 %nterm <pas::ast::Case>                         Case
-%nterm <std::vector<pas::ast::ConstExpr>>       CaseLabelList
+%nterm <pas::ast::List<pas::ast::ConstExpr>>       CaseLabelList
 %nterm <pas::ast::WhileStmt>                    WhileStatement
 %nterm <pas::ast::RepeatStmt>                   RepeatStatement
 %nterm <pas::ast::ForStmt>                      ForStatement
 %nterm <pas::ast::WhichWay>                     WhichWay
 %nterm <pas::ast::Designator>                   Designator
-%nterm <std::vector<pas::ast::DesignatorItem>>  DesignatorStuffOpt
-%nterm <std::vector<pas::ast::DesignatorItem>>  DesignatorStuff
+%nterm <pas::ast::List<pas::ast::DesignatorItem>>  DesignatorStuffOpt
+%nterm <pas::ast::List<pas::ast::DesignatorItem>>  DesignatorStuff
 %nterm <pas::ast::DesignatorItem>               DesignatorItem
-%nterm <std::vector<pas::ast::Expr>>            ActualParameters
-%nterm <std::vector<pas::ast::Expr>>            ExpList
-%nterm <std::vector<pas::ast::Expr>>            ExpListOpt
+%nterm <pas::ast::List<pas::ast::Expr>>            ActualParameters
 %nterm <pas::ast::MemoryStmt>                   MemoryStatement
 %nterm <pas::ast::Expr>                         Expression
-%nterm <pas::ast::SimpleExpr>                   SimpleExpression
-// TermList
-%nterm <pas::ast::Term>                         Term
-// FactorList
-%nterm <pas::ast::Factor>                       Factor
-%nterm <std::vector<pas::ast::Element>>         Setvalue
-%nterm <std::vector<pas::ast::Element>>         ElementListOpt
-%nterm <std::vector<pas::ast::Element>>         ElementList
-%nterm <pas::ast::FuncCall>                     FunctionCall
-%nterm <pas::ast::Element>                      Element
-%nterm <std::vector<pas::ast::SubprogDecl>>     SubprogDeclList
+%nterm                                          ExpressionStart
+%nterm                                          ArgumentListStart
+%nterm                                          IndexListStart
+%nterm <pas::ast::List<pas::ast::SubprogDecl>>     SubprogDeclList
 %nterm <pas::ast::SubprogDecl>                  SubprogDecl
 %nterm <pas::ast::ProcDecl>                     ProcedureDecl
 %nterm <pas::ast::FuncDecl>                     FunctionDecl
 %nterm <pas::ast::ProcHeading>                  ProcedureHeading
-%nterm <std::vector<pas::ast::FormalParam>>     FormalParametersOpt
+%nterm <pas::ast::List<pas::ast::FormalParam>>     FormalParametersOpt
 %nterm <pas::ast::ProcHeading>                  FunctionHeading
-%nterm <std::vector<pas::ast::FormalParam>>     FormalParameters
-%nterm <std::vector<pas::ast::FormalParam>>     OneFormalParamList
+%nterm <pas::ast::List<pas::ast::FormalParam>>     FormalParameters
+%nterm <pas::ast::List<pas::ast::FormalParam>>     OneFormalParamList
 %nterm <pas::ast::FormalParam>                  OneFormalParam
 %nterm <pas::ast::UnaryOp>                      UnaryOperator
-%nterm <pas::ast::MultOp>                       MultOperator
-%nterm <pas::ast::AddOp>                        AddOperator
-%nterm <pas::ast::RelOp>                        Relation
-
-%nterm <std::pair<std::vector<pas::ast::Term>,   std::vector<pas::ast::AddOp>>>  TermList
-%nterm <std::pair<std::vector<pas::ast::Factor>, std::vector<pas::ast::MultOp>>> FactorList
 
 
 // Prints output in parsing option for debugging location terminal
@@ -181,23 +185,29 @@
 CompilationUnit:      ProgramModule EOF {
                           $$ = std::move($1);
                           driver.set_ast(std::move($$));
+                      }
+|                     subprogram_fragment SubprogDeclListOpt EOF {
+                          driver.set_fragment(std::move($2));
                       };
 ProgramModule:        PROGRAM identifier ProgramParametersOpt ";" Block "." {
                           $$ = pas::ast::ProgramModule(std::move($2), std::move($5));
                       };
 ProgramParametersOpt: ProgramParameters | %empty;
 ProgramParameters:    "(" IdentList ")";
+// Lists are left-recursive: items are appended as they are reduced,
+//   and the parser stack doesn't grow with the length of the list.
 IdentList:            identifier {
                           // Dunno, why in this case it works and in others it doesn't!
-                          $$ = std::vector<std::string>({std::move($1)});
+                          $$ = pas::ast::List<pas::ast::Ident>({$1});
                       }
-|                     identifier "," IdentList {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     IdentList "," identifier {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($3));
                       };
 
 Block:                Declarations StatementSequence {
-                          $$ = pas::ast::Block(std::make_unique<pas::ast::Declarations>(std::move($1)), std::move($2));
+                          driver.block_statements(@2);
+                          $$ = pas::ast::Block(pas::ast::make<pas::ast::Declarations>(std::move($1)), std::move($2));
                       };
 Declarations:         ConstantDefBlockOpt
                       TypeDefBlockOpt
@@ -210,40 +220,36 @@ ConstantDefBlockOpt:  ConstantDefBlock {
                           $$ = std::move($1);
                       }
 |                     %empty {
-                          $$ = std::vector<pas::ast::ConstDef>();
+                          $$ = pas::ast::List<pas::ast::ConstDef>();
                       };
 TypeDefBlockOpt:      TypeDefBlock {
                           $$ = std::move($1);
                       }
 |                     %empty {
-                          $$ = std::vector<pas::ast::TypeDef>();
+                          $$ = pas::ast::List<pas::ast::TypeDef>();
                       };
 VariableDeclBlockOpt: VariableDeclBlock {
                           $$ = std::move($1);
                       }
 |                     %empty {
-                          $$ = std::vector<pas::ast::VarDecl>();
+                          $$ = pas::ast::List<pas::ast::VarDecl>();
                       };
 SubprogDeclListOpt:   SubprogDeclList {
                           $$ = std::move($1);
                       }
 |                     %empty {
-                          $$ = std::vector<pas::ast::SubprogDecl>();
+                          $$ = pas::ast::List<pas::ast::SubprogDecl>();
                       };
 ConstantDefBlock:     CONST ConstantDefList {
                           $$ = std::move($2);
                       };
 ConstantDefList:      ConstantDef ";" {
-                          $$ = std::vector<pas::ast::ConstDef>();
+                          $$ = pas::ast::List<pas::ast::ConstDef>();
                           $$.emplace_back(std::move($1));
                       }
-|                     ConstantDef ";" ConstantDefList {
-                          // If profiling will show that this takes time,
-                          //   rewrite grammar to insert items to the back
-                          //   of the vector. It should be fairly easy.
-                          //   Same for all similar cases below.
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     ConstantDefList ConstantDef ";" {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($2));
                       };
 TypeDefBlock:         TYPE TypeDefList {
                           $$ = std::move($2);
@@ -258,23 +264,23 @@ TypeDefList:          TypeDef ";" {
                           //   So for C-like objects without user-defined constructors,
                           //   it's just C-like field initialization.
                           // I'll use parenthesis, it's more usual for me..
-                          $$ = std::vector<pas::ast::TypeDef>();
+                          $$ = pas::ast::List<pas::ast::TypeDef>();
                           $$.emplace_back(std::move($1));
                       }
-|                     TypeDef ";" TypeDefList {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     TypeDefList TypeDef ";" {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($2));
                       }
 VariableDeclBlock:    VAR VariableDeclList {
                           $$ = std::move($2);
                       };
 VariableDeclList:     VariableDecl ";" {
-                          $$ = std::vector<pas::ast::VarDecl>();
+                          $$ = pas::ast::List<pas::ast::VarDecl>();
                           $$.emplace_back(std::move($1));
                       }
-|                     VariableDecl ";" VariableDeclList {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     VariableDeclList VariableDecl ";" {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($2));
                       };
 ConstantDef:          identifier "=" ConstExpression {
                           $$ = pas::ast::ConstDef(std::move($1), std::move($3));
@@ -301,7 +307,7 @@ UnaryOperatorOpt:     UnaryOperator {
                           $$ = std::optional<pas::ast::UnaryOp>();
                       };
 ConstFactor:          identifier {
-                          $$ = pas::ast::ConstFactor(std::in_place_type<std::string>, std::move($1));
+                          $$ = pas::ast::ConstFactor(std::in_place_type<pas::ast::Ident>, $1);
                       }
 |                     number {
                           // Allow int32_t, int64_t, uint64_t.
@@ -317,30 +323,30 @@ ConstFactor:          identifier {
                           $$ = pas::ast::ConstFactor(std::in_place_type<std::monostate>);
                       };
 Type:                 identifier {
-                          $$ = std::make_unique<pas::ast::NamedType>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::NamedType>(std::move($1));
                       }
 |                     ArrayType {
-                          $$ = std::make_unique<pas::ast::ArrayType>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::ArrayType>(std::move($1));
                       }
 |                     PointerType {
-                          $$ = std::make_unique<pas::ast::PointerType>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::PointerType>(std::move($1));
                       }
 |                     RecordType {
-                          $$ = std::make_unique<pas::ast::RecordType>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::RecordType>(std::move($1));
                       }
 |                     SetType {
-                          $$ = std::make_unique<pas::ast::SetType>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::SetType>(std::move($1));
                       };
 ArrayType:            ARRAY "[" SubrangeList "]" OF Type {
                           $$ = pas::ast::ArrayType(std::move($3), std::move($6));
                       };
 SubrangeList:         Subrange {
-                          $$ = std::vector<pas::ast::Subrange>();
+                          $$ = pas::ast::List<pas::ast::Subrange>();
                           $$.emplace_back(std::move($1));
                       }
-|                     Subrange "," SubrangeList {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     SubrangeList "," Subrange {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($3));
                       };
 Subrange:             ConstFactor ".." ConstFactor {
                           $$ = pas::ast::Subrange(std::move($1), std::move($3));
@@ -360,12 +366,12 @@ PointerType:          "^" identifier {
                           $$ = pas::ast::PointerType(std::move($2));
                       };
 FieldListSequence:    FieldList {
-                          $$ = std::vector<pas::ast::FieldList>();
+                          $$ = pas::ast::List<pas::ast::FieldList>();
                           $$.emplace_back(std::move($1));
                       }
-|                     FieldList ";" FieldListSequence {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     FieldListSequence ";" FieldList {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($3));
                       };
 FieldList:            IdentList ":" Type {
                           $$ = pas::ast::FieldList(std::move($1), std::move($3));
@@ -375,42 +381,42 @@ StatementSequence:    BEGIN StatementList END {
                           $$ = std::move($2);
                       };
 StatementList:        Statement {
-                          $$ = std::vector<pas::ast::Stmt>();
+                          $$ = pas::ast::List<pas::ast::Stmt>();
                           $$.emplace_back(std::move($1));
                       }
-|                     Statement ";" StatementList {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     StatementList ";" Statement {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($3));
                       };
 Statement:            Assignment {
-                          $$ = std::make_unique<pas::ast::Assignment>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::Assignment>(std::move($1));
                       }
 |                     ProcedureCall {
-                          $$ = std::make_unique<pas::ast::ProcCall>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::ProcCall>(std::move($1));
                       }
 |                     IfStatement {
-                          $$ = std::make_unique<pas::ast::IfStmt>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::IfStmt>(std::move($1));
                       }
 |                     CaseStatement {
-                          $$ = std::make_unique<pas::ast::CaseStmt>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::CaseStmt>(std::move($1));
                       }
 |                     WhileStatement {
-                          $$ = std::make_unique<pas::ast::WhileStmt>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::WhileStmt>(std::move($1));
                       }
 |                     RepeatStatement {
-                          $$ = std::make_unique<pas::ast::RepeatStmt>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::RepeatStmt>(std::move($1));
                       }
 |                     ForStatement {
-                          $$ = std::make_unique<pas::ast::ForStmt>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::ForStmt>(std::move($1));
                       }
 |                     MemoryStatement {
-                          $$ = std::make_unique<pas::ast::MemoryStmt>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::MemoryStmt>(std::move($1));
                       }
 |                     StatementSequence {
-                          $$ = std::make_unique<pas::ast::StmtSeq>(std::move($1));
+                          $$ = pas::ast::make<pas::ast::StmtSeq>(std::move($1));
                       }
 |                     %empty {
-                          $$ = std::make_unique<pas::ast::EmptyStmt>();
+                          $$ = pas::ast::make<pas::ast::EmptyStmt>();
                       };
 Assignment:           Designator ":=" Expression {
                           $$ = pas::ast::Assignment(std::move($1), std::move($3));
@@ -422,7 +428,7 @@ ActualParametersOpt:  ActualParameters {
                           $$ = std::move($1);
                       }
 |                     %empty {
-                          $$ = std::vector<pas::ast::Expr>();
+                          $$ = pas::ast::List<pas::ast::Expr>();
                       };
 IfStatement:          IF Expression THEN Statement {
                           $$ = pas::ast::IfStmt(std::move($2), std::move($4));
@@ -434,23 +440,23 @@ CaseStatement:        CASE Expression OF CaseList END {
                           $$ = pas::ast::CaseStmt(std::move($2), std::move($4));
                       };
 CaseList:             Case {
-                          $$ = std::vector<pas::ast::Case>();
+                          $$ = pas::ast::List<pas::ast::Case>();
                           $$.emplace_back(std::move($1));
                       }
-|                     Case ";" CaseList {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     CaseList ";" Case {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($3));
                       };
 Case:                 CaseLabelList ":" Statement {
                           $$ = pas::ast::Case(std::move($1), std::move($3));
                       };
 CaseLabelList:        ConstExpression {
-                          $$ = std::vector<pas::ast::ConstExpr>();
+                          $$ = pas::ast::List<pas::ast::ConstExpr>();
                           $$.emplace_back(std::move($1));
                       }
-|                     ConstExpression "," CaseLabelList {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     CaseLabelList "," ConstExpression {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($3));
                       };
 WhileStatement:       WHILE Expression DO Statement {
                           $$ = pas::ast::WhileStmt(std::move($2), std::move($4));
@@ -474,30 +480,30 @@ DesignatorStuffOpt:   DesignatorStuff {
                           $$ = std::move($1);
                       }
 |                     %empty {
-                          $$ = std::vector<pas::ast::DesignatorItem>();
+                          $$ = pas::ast::List<pas::ast::DesignatorItem>();
                       };
 DesignatorStuff:      DesignatorItem {
-                          $$ = std::vector<pas::ast::DesignatorItem>();
+                          $$ = pas::ast::List<pas::ast::DesignatorItem>();
                           $$.emplace_back(std::move($1));
                       }
-|                     DesignatorItem DesignatorStuff {
-                          $$ = std::move($2);
-                          $$.insert($$.begin(), std::move($1));
+|                     DesignatorStuff DesignatorItem {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($2));
                       };
 DesignatorItem:       "." identifier {
                           $$ = pas::ast::DesignatorFieldAccess(std::move($2));
                       }
-|                     "[" ExpList "]" {
-                          std::vector<std::unique_ptr<pas::ast::Expr>> exprs;
-                          for (auto& expr: $2) {
-                              exprs.push_back(std::make_unique<pas::ast::Expr>(std::move(expr)));
+|                     "[" IndexListStart expression_list "]" {
+                          pas::ast::List<pas::ast::ExprUP> exprs;
+                          for (auto& expr: $3) {
+                              exprs.push_back(pas::ast::make<pas::ast::Expr>(std::move(expr)));
                           }
                           $$ = pas::ast::DesignatorArrayAccess(std::move(exprs));
                       }
 |                     "^" {
                           $$ = pas::ast::DesignatorPointerAccess();
                       };
-ActualParameters:     "(" ExpListOpt ")" {
+ActualParameters:     "(" ArgumentListStart expression_list ")" {
                           // Actual parameters is always non-empty expression list.
                           //   grammar.pdf has ExpList here, no optionality.
                           // I find it strange we have to always specify a parameter
@@ -505,21 +511,7 @@ ActualParameters:     "(" ExpListOpt ")" {
                           //   I saw pascal in my life, it's not that strange. So I think
                           //   it's a bug or I count it this way, it should be reasonable
                           //   to assume we can have empty parameter list.
-                          $$ = std::move($2);
-                      };
-ExpListOpt:           ExpList {
-                          $$ = std::move($1);
-                      }
-|                     %empty {
-                          $$ = std::vector<pas::ast::Expr>();
-                      }
-ExpList:              Expression {
-                          $$ = std::vector<pas::ast::Expr>();
-                          $$.emplace_back(std::move($1));
-                      }
-|                     Expression "," ExpList {
                           $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
                       };
 MemoryStatement:      NEW "(" identifier ")" {
                           $$ = pas::ast::MemoryStmt(pas::ast::MemoryStmt::Kind::New, std::move($3));
@@ -528,124 +520,30 @@ MemoryStatement:      NEW "(" identifier ")" {
                           $$ = pas::ast::MemoryStmt(pas::ast::MemoryStmt::Kind::Dispose, std::move($3));
                       };
 
-Expression:           SimpleExpression {
-                          // start_expr
-                          $$ = pas::ast::Expr(std::move($1));
-                      }
-|                     SimpleExpression Relation SimpleExpression {
-                          // start_expr; Op: rel, rhs_expr
-                          $$ = pas::ast::Expr(std::move($1), pas::ast::Expr::Op{std::move($2), std::move($3)});
-                      }
-;
-SimpleExpression:     UnaryOperatorOpt TermList {
-                          // unary_operator, start_term; ops: add_operator, term
-                          auto& terms = $2.first;
-                          auto& ops   = $2.second;
-                          pas::ast::Term term = std::move(terms.front());
-                          terms.erase(terms.begin());
-                          std::vector<pas::ast::SimpleExpr::Op> expr_ops;
-                          assert(terms.size() == ops.size());
-                          for (size_t i = 0; i < ops.size(); ++i) {
-                              expr_ops.emplace_back(pas::ast::SimpleExpr::Op{std::move(ops[i]), std::move(terms[i])});
-                          }
-                          $$ = pas::ast::SimpleExpr(std::move($1), std::move(term), std::move(expr_ops));
-                      };
-TermList:             Term {
-                          $$ = std::make_pair(std::vector<pas::ast::Term>(), std::vector<pas::ast::AddOp>());
-                          $$.first.emplace_back(std::move($1));
-                      }
-|                     Term AddOperator TermList {
-                          $$ = std::move($3);
-                          $$.first.insert($$.first.begin(), std::move($1));
-                          $$.second.insert($$.second.begin(), std::move($2));
-                      };
-Term:                 FactorList {
-                          // unary_operator, start_term; ops: add_operator, term
-                          auto& factors = $1.first;
-                          auto& ops   = $1.second;
-                          pas::ast::Factor factor = std::move(factors.front());
-                          factors.erase(factors.begin());
-                          std::vector<pas::ast::Term::Op> term_ops;
-                          assert(factors.size() == ops.size());
-                          for (size_t i = 0; i < ops.size(); ++i) {
-                              term_ops.emplace_back(pas::ast::Term::Op{std::move(ops[i]), std::move(factors[i])});
-                          }
-                          $$ = pas::ast::Term(std::move(factor), std::move(term_ops));
-                      };
-FactorList:           Factor {
-                          $$ = std::make_pair(std::vector<pas::ast::Factor>(), std::vector<pas::ast::MultOp>());
-                          $$.first.emplace_back(std::move($1));
-                      }
-|                     Factor MultOperator FactorList {
-                          $$ = std::move($3);
-                          $$.first.insert($$.first.begin(), std::move($1));
-                          $$.second.insert($$.second.begin(), std::move($2));
-                      };
-Factor:               number {
-                          $$ = std::move($1);
-                      }
-|                     string {
-                          $$ = std::move($1);
-                      }
-|                     TRUE {
-                          $$ = true;
-                      }
-|                     FALSE {
-                          $$ = false;
-                      }
-|                     NIL {
-                          $$ = std::monostate();
-                      }
-|                     Designator {
-                          $$ = std::move($1);
-                      }
-|                     "(" Expression ")" {
-                          $$ = std::make_unique<pas::ast::Expr>(std::move($2));
-                      }
-|                     NOT Factor {
-                          $$ = std::make_unique<pas::ast::Negation>(std::move($2));
-                      }
-|                     Setvalue {
-                          throw "Not implemented!";
-                          // $$ = std::variant<FactorKind::SetValue>(std::move($1));
-                      }
-|                     FunctionCall {
-                          $$ = std::make_unique<pas::ast::FuncCall>(std::move($1));
-                      };
-Setvalue:             "[" ElementListOpt "]" {
+// Expressions are parsed by the driver's ExpressionParser. The empty
+//   rules before them are all their states can reduce, so bison runs
+//   the actions without reading a lookahead first: the driver knows the
+//   next token asked for is the expression.
+Expression:           ExpressionStart expression {
                           $$ = std::move($2);
-                      }
-ElementListOpt:       ElementList {
-                          $$ = std::move($1);
-                      }
-|                     %empty {
-                          $$ = std::vector<pas::ast::Element>();
                       };
-ElementList:          Element {
-                          $$ = std::vector<pas::ast::Element>();
-                          $$.emplace_back(std::move($1));
-                      }
-|                     Element "," ElementList {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+ExpressionStart:      %empty {
+                          driver.expect_expression();
                       };
-FunctionCall:         identifier ActualParameters {
-                          $$ = pas::ast::FuncCall(std::move($1), std::move($2));
+ArgumentListStart:    %empty {
+                          driver.expect_expression_list(true);
                       };
-Element:              ConstExpression {
-                          $$ = pas::ast::ConstExpr(std::move($1));
-                      }
-|                     ConstExpression ".." ConstExpression {
-                          $$ = std::pair<pas::ast::ConstExpr, pas::ast::ConstExpr>(std::move($1), std::move($3));
+IndexListStart:       %empty {
+                          driver.expect_expression_list(false);
                       };
 
 SubprogDeclList:      SubprogDecl {
-                          $$ = std::vector<pas::ast::SubprogDecl>();
+                          $$ = pas::ast::List<pas::ast::SubprogDecl>();
                           $$.emplace_back(std::move($1));
                       }
-|                     SubprogDecl SubprogDeclList {
-                          $$ = std::move($2);
-                          $$.insert($$.begin(), std::move($1));
+|                     SubprogDeclList SubprogDecl {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($2));
                       };
 SubprogDecl:          ProcedureDecl ";" {
                           $$ = pas::ast::ProcDecl(std::move($1));
@@ -654,35 +552,39 @@ SubprogDecl:          ProcedureDecl ";" {
                           $$ = pas::ast::FuncDecl(std::move($1));
                       };
 ProcedureDecl:        ProcedureHeading ";" Block {
+                          driver.subprogram_end();
                           $$ = pas::ast::ProcDecl(std::move($1), std::move($3));
                       };
 FunctionDecl:         FunctionHeading ":" identifier ";" Block {
+                          driver.subprogram_end();
                           // Implementation note: pas::ast::FuncDecl { pas::ast::ProcDecl proc_; ...Type return_type_;
                           pas::ast::ProcDecl proc(std::move($1), std::move($5));
                           $$ = pas::ast::FuncDecl(std::move(proc), std::move($3));
                       };
 ProcedureHeading:     PROCEDURE identifier FormalParametersOpt {
+                          driver.subprogram_begin(@$);
                           $$ = pas::ast::ProcHeading(std::move($2), std::move($3));
                       };
 FormalParametersOpt:  FormalParameters {
                           $$ = std::move($1);
                       }
 |                     %empty {
-                          $$ = std::vector<pas::ast::FormalParam>();
+                          $$ = pas::ast::List<pas::ast::FormalParam>();
                       };
 FunctionHeading:      FUNCTION identifier FormalParametersOpt {
+                          driver.subprogram_begin(@$);
                           $$ = pas::ast::ProcHeading(std::move($2), std::move($3));
                       };
 FormalParameters:     "(" OneFormalParamList ")" {
                           $$ = std::move($2);
                       };
 OneFormalParamList:   OneFormalParam {
-                          $$ = std::vector<pas::ast::FormalParam>();
+                          $$ = pas::ast::List<pas::ast::FormalParam>();
                           $$.emplace_back(std::move($1));
                       }
-|                     OneFormalParam ";" OneFormalParamList {
-                          $$ = std::move($3);
-                          $$.insert($$.begin(), std::move($1));
+|                     OneFormalParamList ";" OneFormalParam {
+                          $$ = std::move($1);
+                          $$.emplace_back(std::move($3));
                       };
 OneFormalParam:       VAR IdentList ":" identifier {
                           $$ = pas::ast::FormalParam(std::move($2), std::move($4));
@@ -694,51 +596,6 @@ UnaryOperator:        "+" {
 |                     "-" {
                           $$ = pas::ast::UnaryOp::Minus;
                       };
-MultOperator:         "*" {
-                          $$ = pas::ast::MultOp::Multiply;
-                      }
-|                     "/" {
-                          $$ = pas::ast::MultOp::RealDiv;
-                      }
-|                     DIV {
-                          $$ = pas::ast::MultOp::IntDiv;
-                      }
-|                     MOD {
-                          $$ = pas::ast::MultOp::Modulo;
-                      }
-|                     AND {
-                          $$ = pas::ast::MultOp::And;
-                      };
-AddOperator:          "+" {
-                          $$ = pas::ast::AddOp::Plus;
-                      }
-|                     "-" {
-                          $$ = pas::ast::AddOp::Minus;
-                      }
-|                     OR {
-                          $$ = pas::ast::AddOp::Or;
-                      };
-Relation:             "=" {
-                          $$ = pas::ast::RelOp::Equal;
-                      }
-|                     "<>" {
-                          $$ = pas::ast::RelOp::NotEqual;
-                      }
-|                     "<" {
-                          $$ = pas::ast::RelOp::Less;
-                      }
-|                     ">" {
-                          $$ = pas::ast::RelOp::Greater;
-                      }
-|                     "<=" {
-                          $$ = pas::ast::RelOp::LessEqual;
-                      }
-|                     ">=" {
-                          $$ = pas::ast::RelOp::GreaterEqual;
-                      }
-|                     IN {
-                          $$ = pas::ast::RelOp::In;
-                      };
 %%
 
 #if 0
@@ -767,5 +624,10 @@ exp:
 void
 yy::parser::error(const location_type& l, const std::string& m)
 {
-  std::cerr << l << ": " << m << '\n';
+  // A fragment that doesn't parse is parsed again with the whole
+  //   source, the error is reported then.
+  if (driver.parsing_fragment()) {
+    return;
+  }
+  std::cerr << driver.describe_location(l) << ": " << m << '\n';
 }
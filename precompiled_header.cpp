@@ -0,0 +1,389 @@
+#include "precompiled_header.hh"
+
+#include "exceptions.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+namespace {
+
+constexpr char MAGIC[8] = {'M', 'C', 'C', 'P', 'C', 'H', '\r', '\n'};
+constexpr uint32_t FORMAT_VERSION = 1;
+constexpr uint32_t NONE = UINT32_MAX;
+
+enum Section : uint32_t {
+  // Bytes of all spellings and paths, Spans cut them into strings.
+  Strings,
+  Spans,
+  // String index of each symbol. Tokens and macros refer to symbols by
+  //   their index here, ids are only valid in the process.
+  Symbols,
+  Text,
+  TokenKinds,
+  TokenOffsets,
+  TokenLengths,
+  TokenPayloads,
+  Files,
+  LineRuns,
+  Macros,
+  MacroParams,
+  SECTION_COUNT
+};
+
+struct SectionRef {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct ImageHeader {
+  char magic[8];
+  uint32_t version;
+  // Token kinds are stored as numbers, they change with the grammar.
+  uint32_t token_kinds;
+  uint32_t line_count;
+  uint32_t reserved;
+  SectionRef sections[SECTION_COUNT];
+};
+
+struct Span {
+  uint32_t offset;
+  uint32_t size;
+};
+
+struct FileRecord {
+  uint32_t path;
+  // Symbol index of the guard macro or NONE.
+  uint32_t guard;
+  uint32_t pragma_once;
+  uint32_t reserved;
+  int64_t mtime_ns;
+  uint64_t size;
+};
+
+struct LineRunRecord {
+  uint32_t output_line;
+  // Index in Files.
+  uint32_t file;
+  uint32_t line;
+};
+
+struct MacroRecord {
+  static constexpr uint32_t FUNCTION_LIKE = 1;
+  static constexpr uint32_t VARIADIC = 2;
+
+  uint32_t name;
+  uint32_t flags;
+  uint32_t first_param;
+  uint32_t param_count;
+  // String index.
+  uint32_t body;
+};
+
+constexpr uint32_t token_kinds() {
+  return static_cast<uint32_t>(yy::parser::YYNTOKENS);
+}
+
+// Size and modification time of a file, false if there is none.
+bool stamp_file(const std::string &path, uint64_t &size, int64_t &mtime_ns) {
+  struct stat file_stat;
+  if (::stat(path.c_str(), &file_stat) != 0) {
+    return false;
+  }
+  size = static_cast<uint64_t>(file_stat.st_size);
+  mtime_ns = static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 +
+             file_stat.st_mtim.tv_nsec;
+  return true;
+}
+
+class ImageWriter {
+public:
+  uint32_t string(std::string_view text) {
+    auto it = string_ids_.find(std::string(text));
+    if (it != string_ids_.end()) {
+      return it->second;
+    }
+    const uint32_t id = static_cast<uint32_t>(spans_.size());
+    spans_.push_back(Span{static_cast<uint32_t>(strings_.size()),
+                          static_cast<uint32_t>(text.size())});
+    strings_.append(text);
+    string_ids_.emplace(std::string(text), id);
+    return id;
+  }
+
+  uint32_t symbol(pas::Symbol symbol) {
+    auto it = symbol_ids_.find(symbol);
+    if (it != symbol_ids_.end()) {
+      return it->second;
+    }
+    const uint32_t id = static_cast<uint32_t>(symbols_.size());
+    symbols_.push_back(string(symbol.spelling()));
+    symbol_ids_.emplace(symbol, id);
+    return id;
+  }
+
+  template <typename T>
+  void section(Section section, const T *data, size_t count) {
+    sections_[section].assign(reinterpret_cast<const char *>(data),
+                              count * sizeof(T));
+  }
+
+  // Header and sections, each section aligned to 8 bytes.
+  std::string finish(uint32_t line_count) {
+    section(Strings, strings_.data(), strings_.size());
+    section(Spans, spans_.data(), spans_.size());
+    section(Symbols, symbols_.data(), symbols_.size());
+
+    ImageHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.token_kinds = token_kinds();
+    header.line_count = line_count;
+
+    std::string image(sizeof(header), '\0');
+    for (uint32_t i = 0; i < SECTION_COUNT; ++i) {
+      image.resize((image.size() + 7) / 8 * 8, '\0');
+      header.sections[i] = SectionRef{image.size(), sections_[i].size()};
+      image.append(sections_[i]);
+    }
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+  }
+
+private:
+  std::string strings_;
+  std::vector<Span> spans_;
+  std::unordered_map<std::string, uint32_t> string_ids_;
+  std::vector<uint32_t> symbols_;
+  std::unordered_map<pas::Symbol, uint32_t> symbol_ids_;
+  std::string sections_[SECTION_COUNT];
+};
+
+class ImageReader {
+public:
+  ImageReader(const std::string &path, const SourceFile &image)
+      : path_(path), image_(image) {
+    if (image.size() < sizeof(ImageHeader)) {
+      Corrupt();
+    }
+    std::memcpy(&header_, image.data(), sizeof(header_));
+    if (std::memcmp(header_.magic, MAGIC, sizeof(MAGIC)) != 0) {
+      throw PrecompiledHeaderException(path + " is not a precompiled header");
+    }
+    if (header_.version != FORMAT_VERSION ||
+        header_.token_kinds != token_kinds()) {
+      throw PrecompiledHeaderException(
+          path + " was made by another version of the compiler");
+    }
+    strings_ = section<char>(Strings);
+    spans_ = section<Span>(Spans);
+  }
+
+  const ImageHeader &header() const { return header_; }
+
+  template <typename T> std::span<const T> section(Section section) const {
+    const SectionRef ref = header_.sections[section];
+    if (ref.offset % alignof(T) != 0 || ref.size % sizeof(T) != 0 ||
+        ref.offset > image_.size() || ref.size > image_.size() - ref.offset) {
+      Corrupt();
+    }
+    return std::span<const T>(
+        reinterpret_cast<const T *>(image_.data() + ref.offset),
+        ref.size / sizeof(T));
+  }
+
+  std::string_view string(uint32_t index) const {
+    if (index >= spans_.size() ||
+        spans_[index].offset > strings_.size() ||
+        spans_[index].size > strings_.size() - spans_[index].offset) {
+      Corrupt();
+    }
+    return std::string_view(strings_.data() + spans_[index].offset,
+                            spans_[index].size);
+  }
+
+  [[noreturn]] void Corrupt() const {
+    throw PrecompiledHeaderException(path_ + " is corrupt");
+  }
+
+private:
+  const std::string &path_;
+  const SourceFile &image_;
+  ImageHeader header_;
+  std::span<const char> strings_;
+  std::span<const Span> spans_;
+};
+
+} // namespace
+
+void PrecompiledHeader::write(const std::string &path, std::string_view text,
+                              const TokenBuffer &tokens,
+                              const Preprocessor &preprocessor) {
+  ImageWriter writer;
+
+  std::unordered_map<const FileCache::Entry *, uint32_t> file_ids;
+  std::vector<FileRecord> files;
+  for (const FileCache::Entry *file : preprocessor.entered_files()) {
+    FileRecord record{};
+    if (!stamp_file(file->path, record.size, record.mtime_ns)) {
+      throw PrecompiledHeaderException("can't make a precompiled header of " +
+                                       file->path + ", it's not a file");
+    }
+    record.path = writer.string(file->path);
+    record.guard =
+        file->guard.has_value() ? writer.symbol(file->guard.value()) : NONE;
+    record.pragma_once = file->pragma_once ? 1 : 0;
+    file_ids.emplace(file, static_cast<uint32_t>(files.size()));
+    files.push_back(record);
+  }
+  writer.section(Files, files.data(), files.size());
+
+  // Runs name the files by path, the entries own them.
+  std::unordered_map<const std::string *, uint32_t> path_ids;
+  for (const auto &[file, id] : file_ids) {
+    path_ids.emplace(&file->path, id);
+  }
+  std::vector<LineRunRecord> runs;
+  for (const LineMap::Run &run : preprocessor.line_map().runs()) {
+    runs.push_back(LineRunRecord{run.output_line,
+                                 path_ids.at(run.origin.path),
+                                 run.origin.line});
+  }
+  writer.section(LineRuns, runs.data(), runs.size());
+
+  std::vector<MacroRecord> macros;
+  std::vector<uint32_t> params;
+  for (const auto &[name, macro] : preprocessor.macros()) {
+    MacroRecord record{};
+    record.name = writer.symbol(name);
+    record.flags = (macro.function_like ? MacroRecord::FUNCTION_LIKE : 0) |
+                   (macro.variadic ? MacroRecord::VARIADIC : 0);
+    record.first_param = static_cast<uint32_t>(params.size());
+    record.param_count = static_cast<uint32_t>(macro.params.size());
+    for (pas::Symbol param : macro.params) {
+      params.push_back(writer.symbol(param));
+    }
+    record.body = writer.string(macro.body);
+    macros.push_back(record);
+  }
+  writer.section(Macros, macros.data(), macros.size());
+  writer.section(MacroParams, params.data(), params.size());
+
+  writer.section(Text, text.data(), text.size());
+  writer.section(TokenKinds, tokens.kinds(), tokens.size());
+  writer.section(TokenOffsets, tokens.offsets(), tokens.size());
+  writer.section(TokenLengths, tokens.lengths(), tokens.size());
+  std::vector<uint32_t> payloads(tokens.payloads(),
+                                 tokens.payloads() + tokens.size());
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    if (tokens.kind(i) == yy::parser::token::TOK_identifier) {
+      payloads[i] = writer.symbol(pas::Symbol(payloads[i]));
+    }
+  }
+  writer.section(TokenPayloads, payloads.data(), payloads.size());
+
+  const std::string image = writer.finish(
+      static_cast<uint32_t>(std::count(text.begin(), text.end(), '\n')));
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(image.data(), static_cast<std::streamsize>(image.size()));
+  out.close();
+  if (!out) {
+    throw IOProblemException("can't write " + path + ": " +
+                             std::strerror(errno));
+  }
+}
+
+std::unique_ptr<PrecompiledHeader>
+PrecompiledHeader::load(const std::string &path, FileCache &files) {
+  std::unique_ptr<PrecompiledHeader> pch(new PrecompiledHeader());
+  pch->image_ = SourceFile::open(path);
+  const ImageReader reader(path, pch->image_);
+
+  std::vector<pas::Symbol> symbols;
+  for (uint32_t string : reader.section<uint32_t>(Symbols)) {
+    symbols.push_back(pas::SymbolTable::global().intern(reader.string(string)));
+  }
+  auto symbol_at = [&](uint32_t index) {
+    if (index >= symbols.size()) {
+      reader.Corrupt();
+    }
+    return symbols[index];
+  };
+
+  for (const FileRecord &record : reader.section<FileRecord>(Files)) {
+    const std::string file_path(reader.string(record.path));
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    if (!stamp_file(file_path, size, mtime_ns) || size != record.size ||
+        mtime_ns != record.mtime_ns) {
+      throw PrecompiledHeaderException("precompiled header " + path +
+                                       " is out of date: " + file_path +
+                                       " has changed");
+    }
+    FileCache::Entry &entry = files.open(file_path);
+    entry.pragma_once = record.pragma_once != 0;
+    if (record.guard != NONE) {
+      entry.guard = symbol_at(record.guard);
+    }
+    pch->files_.push_back(&entry);
+  }
+
+  for (const LineRunRecord &record : reader.section<LineRunRecord>(LineRuns)) {
+    if (record.file >= pch->files_.size()) {
+      reader.Corrupt();
+    }
+    pch->line_runs_.push_back(LineMap::Run{
+        record.output_line,
+        LineMap::Origin{&pch->files_[record.file]->path, record.line}});
+  }
+
+  const std::span<const uint32_t> params = reader.section<uint32_t>(MacroParams);
+  for (const MacroRecord &record : reader.section<MacroRecord>(Macros)) {
+    if (record.first_param > params.size() ||
+        record.param_count > params.size() - record.first_param) {
+      reader.Corrupt();
+    }
+    Preprocessor::Macro macro;
+    macro.function_like = (record.flags & MacroRecord::FUNCTION_LIKE) != 0;
+    macro.variadic = (record.flags & MacroRecord::VARIADIC) != 0;
+    for (uint32_t param :
+         params.subspan(record.first_param, record.param_count)) {
+      macro.params.push_back(symbol_at(param));
+    }
+    macro.body = reader.string(record.body);
+    pch->macros_.emplace_back(symbol_at(record.name), std::move(macro));
+  }
+
+  const std::span<const char> text = reader.section<char>(Text);
+  pch->text_ = std::string_view(text.data(), text.size());
+  pch->line_count_ = reader.header().line_count;
+
+  const std::span<const uint16_t> kinds = reader.section<uint16_t>(TokenKinds);
+  const std::span<const uint32_t> offsets =
+      reader.section<uint32_t>(TokenOffsets);
+  const std::span<const uint32_t> lengths =
+      reader.section<uint32_t>(TokenLengths);
+  const std::span<const uint32_t> payloads =
+      reader.section<uint32_t>(TokenPayloads);
+  if (offsets.size() != kinds.size() || lengths.size() != kinds.size() ||
+      payloads.size() != kinds.size()) {
+    reader.Corrupt();
+  }
+  pch->tokens_.assign(kinds.data(), offsets.data(), lengths.data(),
+                      payloads.data(), kinds.size());
+  for (size_t i = 0; i < kinds.size(); ++i) {
+    if (offsets[i] > text.size() || lengths[i] > text.size() - offsets[i]) {
+      reader.Corrupt();
+    }
+    if (pch->tokens_.kind(i) == yy::parser::token::TOK_identifier) {
+      pch->tokens_.set_payload(i, symbol_at(payloads[i]).id());
+    }
+  }
+
+  return pch;
+}
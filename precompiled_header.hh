@@ -0,0 +1,66 @@
+#pragma once
+
+#include "file_cache.hh"
+#include "preprocessor.hh"
+#include "source_file.hh"
+#include "symbol_table.hh"
+#include "token_buffer.hh"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A header preprocessed and lexed ahead of time (-emit-pch), for the
+//   translation units that all start with it (-include-pch).
+// The image is a file of sections: the preprocessed text of the header,
+//   its tokens as the four arrays of a TokenBuffer, the macros defined
+//   at its end, the files it entered with their include guards, the
+//   line map and the spellings all of these refer to. Loading maps the
+//   file and fixes up only what can't be stored as is: spellings are
+//   interned and the symbol ids of tokens and macros are replaced by
+//   the ids of this process. The text stays in the mapping.
+// An image remembers the size and modification time of every file it
+//   was built from and is rejected once one of them changes.
+class PrecompiledHeader {
+public:
+  PrecompiledHeader(const PrecompiledHeader &other) = delete;
+  PrecompiledHeader &operator=(const PrecompiledHeader &other) = delete;
+
+public:
+  // Writes the image of the header the preprocessor has just run over.
+  //   text is the preprocessor's output, tokens are lexed from it.
+  static void write(const std::string &path, std::string_view text,
+                    const TokenBuffer &tokens, const Preprocessor &preprocessor);
+
+  // Maps an image. The files it entered are opened in files, their
+  //   guards and "#pragma once" are known right away.
+  static std::unique_ptr<PrecompiledHeader> load(const std::string &path,
+                                                 FileCache &files);
+
+  std::string_view text() const { return text_; }
+  uint32_t line_count() const { return line_count_; }
+  const TokenBuffer &tokens() const { return tokens_; }
+
+  // Runs of the header's LineMap, its first output line is 1.
+  const std::vector<LineMap::Run> &line_runs() const { return line_runs_; }
+  const std::vector<std::pair<pas::Symbol, Preprocessor::Macro>> &
+  macros() const {
+    return macros_;
+  }
+  const std::vector<const FileCache::Entry *> &files() const { return files_; }
+
+private:
+  PrecompiledHeader() = default;
+
+private:
+  SourceFile image_;
+  std::string_view text_;
+  uint32_t line_count_ = 0;
+  TokenBuffer tokens_;
+  std::vector<LineMap::Run> line_runs_;
+  std::vector<std::pair<pas::Symbol, Preprocessor::Macro>> macros_;
+  std::vector<const FileCache::Entry *> files_;
+};
@@ -0,0 +1,830 @@
+#include "preprocessor.hh"
+
+#include "exceptions.hh"
+#include "literal_decoder.hh"
+#include "precompiled_header.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <utility>
+
+namespace {
+
+bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+bool is_nondigit(char c) {
+  return c == '_' || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+bool is_ident_char(char c) { return is_nondigit(c) || is_digit(c); }
+
+size_t skip_blanks(std::string_view text, size_t pos) {
+  while (pos < text.size() && is_blank(text[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+// Identifier at pos, empty if there is none. Moves pos past it.
+std::string_view read_identifier(std::string_view text, size_t &pos) {
+  if (pos >= text.size() || !is_nondigit(text[pos])) {
+    return std::string_view();
+  }
+  size_t start = pos;
+  while (pos < text.size() && is_ident_char(text[pos])) {
+    ++pos;
+  }
+  return text.substr(start, pos - start);
+}
+
+std::string_view trim(std::string_view text) {
+  size_t begin = skip_blanks(text, 0);
+  size_t end = text.size();
+  while (end > begin && is_blank(text[end - 1])) {
+    --end;
+  }
+  return text.substr(begin, end - begin);
+}
+
+// Skips a character constant or a string literal starting with the
+//   quote at pos. An unterminated one ends with the line.
+size_t skip_literal(std::string_view line, size_t pos) {
+  const char quote = line[pos];
+  ++pos;
+  while (pos < line.size() && line[pos] != quote) {
+    pos += line[pos] == '\\' ? 2 : 1;
+  }
+  return std::min(pos + 1, line.size());
+}
+
+// Follows comments through a line that is not a directive. Returns
+//   whether there is anything but blanks and comments on it,
+//   in_comment is carried from one line to the next.
+bool scan_line(std::string_view line, bool &in_comment) {
+  bool significant = false;
+  size_t pos = 0;
+  while (pos < line.size()) {
+    if (in_comment) {
+      size_t close = line.find("*/", pos);
+      if (close == std::string_view::npos) {
+        return significant;
+      }
+      in_comment = false;
+      pos = close + 2;
+      continue;
+    }
+    if (significant) {
+      // Only comments matter from now on.
+      pos = line.find_first_of("/\"'", pos);
+      if (pos == std::string_view::npos) {
+        return true;
+      }
+    }
+
+    const char c = line[pos];
+    if (c == '/' && pos + 1 < line.size() && line[pos + 1] == '*') {
+      in_comment = true;
+      pos += 2;
+    } else if (c == '/' && pos + 1 < line.size() && line[pos + 1] == '/') {
+      return significant;
+    } else if (c == '"' || c == '\'') {
+      significant = true;
+      pos = skip_literal(line, pos);
+    } else {
+      significant = significant || !is_blank(c);
+      ++pos;
+    }
+  }
+  return significant;
+}
+
+// Position of the first character of a line outside of blanks and
+//   comments, npos if there is none or a comment goes on to the next line.
+size_t first_token(std::string_view line, bool in_comment) {
+  size_t pos = 0;
+  if (in_comment) {
+    pos = line.find("*/");
+    if (pos == std::string_view::npos) {
+      return pos;
+    }
+    pos += 2;
+  }
+  while (true) {
+    pos = skip_blanks(line, pos);
+    if (line.substr(pos, 2) != "/*") {
+      return pos < line.size() ? pos : std::string_view::npos;
+    }
+    pos = line.find("*/", pos + 2);
+    if (pos == std::string_view::npos) {
+      return pos;
+    }
+    pos += 2;
+  }
+}
+
+// Collects the logical line of a directive, from pos right after the
+//   '#': continuations are joined, comments become spaces. Returns
+//   where the next line starts, lines is the number of lines consumed.
+//   Returns nullptr if a comment is not terminated.
+const char *collect_directive(const char *pos, const char *end,
+                              std::string &text, uint32_t &lines) {
+  text.clear();
+  lines = 1;
+  bool in_comment = false;
+  while (pos != end) {
+    const char c = *pos;
+    if (in_comment) {
+      if (c == '*' && end - pos >= 2 && pos[1] == '/') {
+        in_comment = false;
+        text.push_back(' ');
+        pos += 2;
+        continue;
+      }
+      lines += c == '\n' ? 1 : 0;
+      ++pos;
+      continue;
+    }
+
+    if (c == '\n') {
+      return pos + 1;
+    }
+    if (c == '\\') {
+      const char *next = pos + 1;
+      if (next != end && *next == '\r') {
+        ++next;
+      }
+      if (next != end && *next == '\n') {
+        lines += 1;
+        pos = next + 1;
+        continue;
+      }
+    }
+    if (c == '/' && end - pos >= 2 && pos[1] == '*') {
+      in_comment = true;
+      pos += 2;
+      continue;
+    }
+    if (c == '/' && end - pos >= 2 && pos[1] == '/') {
+      const void *newline = std::memchr(pos, '\n', end - pos);
+      pos = newline != nullptr ? static_cast<const char *>(newline) : end;
+      continue;
+    }
+    if (c == '"' || c == '\'') {
+      const char *literal_end = pos + 1;
+      while (literal_end != end && *literal_end != c && *literal_end != '\n') {
+        literal_end += *literal_end == '\\' && end - literal_end >= 2 ? 2 : 1;
+      }
+      if (literal_end != end && *literal_end == c) {
+        ++literal_end;
+      }
+      text.append(pos, literal_end);
+      pos = literal_end;
+      continue;
+    }
+    text.push_back(c);
+    ++pos;
+  }
+  return in_comment ? nullptr : end;
+}
+
+std::string dir_of(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+} // namespace
+
+void LineMap::add_run(uint32_t output_line, const std::string &path,
+                      uint32_t line) {
+  // A file with nothing in it leaves an empty run behind.
+  if (!runs_.empty() && runs_.back().output_line == output_line) {
+    runs_.pop_back();
+  }
+  runs_.push_back(Run{output_line, Origin{&path, line}});
+}
+
+LineMap::Origin LineMap::find(uint32_t output_line) const {
+  assert(!runs_.empty() && runs_.front().output_line == 1);
+  auto run = std::upper_bound(runs_.begin(), runs_.end(), output_line,
+                              [](uint32_t line, const Run &run) {
+                                return line < run.output_line;
+                              }) -
+             1;
+  return Origin{run->origin.path,
+                run->origin.line + (output_line - run->output_line)};
+}
+
+// Integer constant expression of #if and #elif, over the text with its
+//   macros expanded. Arithmetic is done in intmax_t, C99 asks for
+//   uintmax_t for unsigned operands, that's not told apart yet.
+class Preprocessor::ConditionEvaluator {
+public:
+  ConditionEvaluator(Preprocessor &preprocessor, FileState &state,
+                     std::string_view text)
+      : preprocessor_(preprocessor), state_(state), text_(text) {}
+
+  intmax_t Evaluate() {
+    Next();
+    intmax_t value = Conditional();
+    if (!token_.empty()) {
+      Fail("unexpected '" + std::string(token_) + "' in #if");
+    }
+    return value;
+  }
+
+private:
+  // Lexes the next token into token_, empty at the end.
+  void Next() {
+    pos_ = skip_blanks(text_, pos_);
+    const size_t start = pos_;
+    if (pos_ == text_.size()) {
+      token_ = std::string_view();
+      return;
+    }
+
+    const char c = text_[pos_];
+    if (c == 'L' && pos_ + 1 < text_.size() && text_[pos_ + 1] == '\'') {
+      pos_ = skip_literal(text_, pos_ + 1);
+    } else if (is_nondigit(c)) {
+      read_identifier(text_, pos_);
+    } else if (is_digit(c)) {
+      // pp-number, whatever is not an integer is rejected later.
+      while (pos_ < text_.size() &&
+             (is_ident_char(text_[pos_]) || text_[pos_] == '.')) {
+        ++pos_;
+      }
+    } else if (c == '\'') {
+      pos_ = skip_literal(text_, pos_);
+    } else {
+      static constexpr std::string_view TWO_CHAR[] = {
+          "&&", "||", "==", "!=", "<=", ">=", "<<", ">>"};
+      std::string_view two = text_.substr(pos_, 2);
+      pos_ += std::find(std::begin(TWO_CHAR), std::end(TWO_CHAR), two) !=
+                      std::end(TWO_CHAR)
+                  ? 2
+                  : 1;
+    }
+    token_ = text_.substr(start, pos_ - start);
+  }
+
+  void Expect(std::string_view token) {
+    if (token_ != token) {
+      Fail("expected '" + std::string(token) + "' in #if");
+    }
+    Next();
+  }
+
+  intmax_t Conditional() {
+    intmax_t condition = Binary(0);
+    if (token_ != "?") {
+      return condition;
+    }
+    Next();
+    dead_ += condition == 0 ? 1 : 0;
+    intmax_t if_true = Conditional();
+    dead_ -= condition == 0 ? 1 : 0;
+    Expect(":");
+    dead_ += condition != 0 ? 1 : 0;
+    intmax_t if_false = Conditional();
+    dead_ -= condition != 0 ? 1 : 0;
+    return condition != 0 ? if_true : if_false;
+  }
+
+  // Binding power of a binary operator, 0 if token is not one.
+  static int Precedence(std::string_view op) {
+    static constexpr std::pair<std::string_view, int> OPERATORS[] = {
+        {"||", 1}, {"&&", 2}, {"|", 3},  {"^", 4},  {"&", 5},
+        {"==", 6}, {"!=", 6}, {"<", 7},  {">", 7},  {"<=", 7},
+        {">=", 7}, {"<<", 8}, {">>", 8}, {"+", 9},  {"-", 9},
+        {"*", 10}, {"/", 10}, {"%", 10},
+    };
+    for (const auto &[text, precedence] : OPERATORS) {
+      if (text == op) {
+        return precedence;
+      }
+    }
+    return 0;
+  }
+
+  intmax_t Binary(int min_precedence) {
+    intmax_t lhs = Unary();
+    while (true) {
+      const std::string_view op = token_;
+      const int precedence = Precedence(op);
+      if (precedence == 0 || precedence <= min_precedence) {
+        return lhs;
+      }
+      Next();
+
+      // The right side of && and || is not evaluated when the left
+      //   side decides, errors in it don't count.
+      const bool short_circuit =
+          (op == "&&" && lhs == 0) || (op == "||" && lhs != 0);
+      dead_ += short_circuit ? 1 : 0;
+      intmax_t rhs = Binary(precedence);
+      dead_ -= short_circuit ? 1 : 0;
+      lhs = Apply(op, lhs, rhs);
+    }
+  }
+
+  intmax_t Apply(std::string_view op, intmax_t lhs, intmax_t rhs) {
+    // Wrapping arithmetic, overflow is not an error here.
+    const uintmax_t ulhs = static_cast<uintmax_t>(lhs);
+    const uintmax_t urhs = static_cast<uintmax_t>(rhs);
+    if (op == "||") return lhs != 0 || rhs != 0;
+    if (op == "&&") return lhs != 0 && rhs != 0;
+    if (op == "|") return lhs | rhs;
+    if (op == "^") return lhs ^ rhs;
+    if (op == "&") return lhs & rhs;
+    if (op == "==") return lhs == rhs;
+    if (op == "!=") return lhs != rhs;
+    if (op == "<") return lhs < rhs;
+    if (op == ">") return lhs > rhs;
+    if (op == "<=") return lhs <= rhs;
+    if (op == ">=") return lhs >= rhs;
+    if (op == "<<") return static_cast<intmax_t>(ulhs << (urhs & 63));
+    if (op == ">>") return lhs >> (urhs & 63);
+    if (op == "+") return static_cast<intmax_t>(ulhs + urhs);
+    if (op == "-") return static_cast<intmax_t>(ulhs - urhs);
+    if (op == "*") return static_cast<intmax_t>(ulhs * urhs);
+    // "/" and "%".
+    if (rhs == 0) {
+      if (dead_ != 0) {
+        return 0;
+      }
+      Fail("division by zero in #if");
+    }
+    if (rhs == -1) {
+      return op == "/" ? static_cast<intmax_t>(0 - ulhs) : 0;
+    }
+    return op == "/" ? lhs / rhs : lhs % rhs;
+  }
+
+  intmax_t Unary() {
+    const std::string_view token = token_;
+    if (token.empty()) {
+      Fail("missing expression in #if");
+    }
+    Next();
+
+    if (token == "+") return Unary();
+    if (token == "-") return static_cast<intmax_t>(0 - static_cast<uintmax_t>(Unary()));
+    if (token == "~") return ~Unary();
+    if (token == "!") return Unary() == 0;
+    if (token == "(") {
+      intmax_t value = Conditional();
+      Expect(")");
+      return value;
+    }
+    if (is_digit(token.front())) {
+      return Number(token);
+    }
+    if (token.front() == '\'' ||
+        (token.front() == 'L' && token.size() > 1 && token[1] == '\'')) {
+      return Character(token);
+    }
+    if (is_nondigit(token.front())) {
+      return Identifier(token);
+    }
+    Fail("unexpected '" + std::string(token) + "' in #if");
+  }
+
+  intmax_t Number(std::string_view token) {
+    int base = 10;
+    if (token.size() >= 2 && token[0] == '0' && (token[1] | 0x20) == 'x') {
+      base = 16;
+    } else if (token[0] == '0') {
+      base = 8;
+    }
+    // The scanners matched the constant before decode_integer is
+    //   called on it, here it's up to us.
+    size_t pos = base == 16 ? 2 : 0;
+    auto digit_ok = [base](char c) {
+      return base == 16 ? is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                        : c >= '0' && c < '0' + base;
+    };
+    const size_t digits_start = pos;
+    while (pos < token.size() && digit_ok(token[pos])) {
+      ++pos;
+    }
+    std::string_view suffix = token.substr(pos);
+    size_t longs = std::count_if(suffix.begin(), suffix.end(),
+                                 [](char c) { return (c | 0x20) == 'l'; });
+    size_t unsigneds = std::count_if(suffix.begin(), suffix.end(),
+                                     [](char c) { return (c | 0x20) == 'u'; });
+    if (pos == digits_start || longs + unsigneds != suffix.size() ||
+        longs > 2 || unsigneds > 1) {
+      Fail("invalid integer constant '" + std::string(token) + "' in #if");
+    }
+
+    std::optional<uint64_t> value = decode_integer(token, base);
+    if (!value.has_value()) {
+      Fail("integer constant is too large: " + std::string(token));
+    }
+    return static_cast<intmax_t>(*value);
+  }
+
+  intmax_t Character(std::string_view token) {
+    const bool wide = token.front() == 'L';
+    std::string_view body = token.substr(wide ? 2 : 1);
+    if (body.size() < 2 || body.back() != '\'') {
+      Fail("invalid character constant in #if");
+    }
+    std::optional<int> value =
+        decode_char_const(body.substr(0, body.size() - 1), wide);
+    if (!value.has_value()) {
+      Fail("escape sequence out of range in #if");
+    }
+    return value.value();
+  }
+
+  intmax_t Identifier(std::string_view token) {
+    if (token == "defined") {
+      const bool parenthesized = token_ == "(";
+      if (parenthesized) {
+        Next();
+      }
+      std::string_view name = token_;
+      if (name.empty() || !is_nondigit(name.front())) {
+        Fail("macro name expected after 'defined'");
+      }
+      Next();
+      if (parenthesized) {
+        Expect(")");
+      }
+      return preprocessor_.IsDefined(pas::SymbolTable::global().intern(name));
+    }
+
+    // What is left after expansion is 0, C99 6.10.1.
+    return 0;
+  }
+
+  [[noreturn]] void Fail(const std::string &message) {
+    preprocessor_.Error(state_, message);
+  }
+
+private:
+  Preprocessor &preprocessor_;
+  FileState &state_;
+  std::string_view text_;
+  size_t pos_ = 0;
+  std::string_view token_;
+  // Inside of a branch that doesn't count, see Binary.
+  int dead_ = 0;
+};
+
+Preprocessor::Preprocessor(FileCache &files) : files(files) {
+  Predefine("__STDC__", "1");
+  Predefine("__STDC_HOSTED__", "1");
+  Predefine("__STDC_VERSION__", "199901L");
+}
+
+void Preprocessor::Predefine(std::string_view name, std::string_view body) {
+  predefined_.emplace_back(name, body);
+}
+
+std::string Preprocessor::Run(const std::string &path, SourceFile main) {
+  macros_.clear();
+  for (const auto &[name, body] : predefined_) {
+    macros_[pas::SymbolTable::global().intern(name)].body = body;
+  }
+  conditionals_.clear();
+  once_entered_.clear();
+  entered_files_.clear();
+  entered_.clear();
+  output_.clear();
+  output_line_ = 1;
+  line_map_.clear();
+  skipped_includes_ = 0;
+
+  if (prelude_ != nullptr) {
+    output_.reserve(prelude_->text().size() + main.size());
+    output_.append(prelude_->text());
+    output_line_ += prelude_->line_count();
+    for (const LineMap::Run &run : prelude_->line_runs()) {
+      line_map_.add_run(run.output_line, *run.origin.path, run.origin.line);
+    }
+    for (const auto &[name, macro] : prelude_->macros()) {
+      macros_[name] = macro;
+    }
+    for (const FileCache::Entry *file : prelude_->files()) {
+      if (file->pragma_once) {
+        once_entered_.insert(file);
+      }
+    }
+  } else {
+    output_.reserve(main.size());
+  }
+  expander_.Reset();
+
+  ProcessFile(files.adopt(path, std::move(main)), 0);
+  return std::move(output_);
+}
+
+void Preprocessor::EmitNewlines(size_t count) {
+  output_.append(count, '\n');
+  output_line_ += static_cast<uint32_t>(count);
+}
+
+void Preprocessor::Error(const FileState &state, const std::string &message) {
+  throw PreprocessorException(state.file.path + ":" +
+                              std::to_string(state.line) + ": " + message);
+}
+
+void Preprocessor::ProcessFile(FileCache::Entry &file, size_t depth) {
+  FileState state{.file = file, .dir = dir_of(file.path)};
+  state.base_depth = conditionals_.size();
+  if (file.pragma_once) {
+    once_entered_.insert(&file);
+  }
+  if (entered_.insert(&file).second) {
+    entered_files_.push_back(&file);
+  }
+  line_map_.add_run(output_line_, file.path, 1);
+
+  std::string directive;
+  const char *pos = file.source.data();
+  const char *end = pos + file.source.size();
+  while (pos != end) {
+    const void *newline = std::memchr(pos, '\n', end - pos);
+    const char *line_end =
+        newline != nullptr ? static_cast<const char *>(newline) : end;
+    const std::string_view line(pos, line_end - pos);
+
+    const size_t first = first_token(line, state.in_comment);
+    if (first != std::string_view::npos && line[first] == '#') {
+      uint32_t lines = 0;
+      const char *next =
+          collect_directive(pos + first + 1, end, directive, lines);
+      if (next == nullptr) {
+        Error(state, "unterminated comment");
+      }
+      // The directive's lines are left empty, an included file follows them.
+      EmitNewlines(lines);
+      state.in_comment = false;
+      state.directive_lines = lines;
+      Directive(state, directive, depth);
+      state.line += lines;
+      pos = next;
+      continue;
+    }
+
+    const bool in_comment = state.in_comment;
+    if (scan_line(line, state.in_comment) &&
+        state.guard_state != GuardState::Inside) {
+      state.guard_state = GuardState::None;
+    }
+    if (Active() && expander_.MayExpand(line)) {
+      // An invocation may go on over the next lines, they are all
+      //   replaced by its expansion and left empty.
+      uint32_t lines = 0;
+      const char *next = nullptr;
+      try {
+        next = expander_.ExpandText(pos, end, in_comment, output_, lines);
+      } catch (const PreprocessorException &exc) {
+        Error(state, exc.what());
+      }
+      EmitNewlines(std::max<uint32_t>(lines, 1));
+      state.line += std::max<uint32_t>(lines, 1);
+      state.in_comment = false;
+      pos = next;
+      continue;
+    }
+    if (Active()) {
+      output_.append(line);
+    }
+    EmitNewlines(1);
+    state.line += 1;
+    pos = line_end == end ? end : line_end + 1;
+  }
+
+  if (conditionals_.size() != state.base_depth) {
+    Error(state, "unterminated conditional directive");
+  }
+  if (state.in_comment && depth != 0) {
+    // The main file's is reported by the scanner.
+    Error(state, "unterminated comment");
+  }
+  if (state.guard_state == GuardState::After) {
+    file.guard = state.guard_macro;
+  }
+}
+
+void Preprocessor::Directive(FileState &state, std::string_view text,
+                             size_t depth) {
+  size_t pos = skip_blanks(text, 0);
+  const std::string_view name = read_identifier(text, pos);
+  const std::string_view rest = text.substr(pos);
+  if (name.empty()) {
+    // The null directive or a line marker ("# 12 "file""), nothing to do.
+    if (Active() && pos < text.size() && !is_digit(text[pos])) {
+      Error(state, "invalid preprocessing directive");
+    }
+    return;
+  }
+
+  // Guard detection: the first thing in the file is #ifndef, nothing
+  //   follows its #endif.
+  const bool top_level = conditionals_.size() == state.base_depth;
+  if (state.guard_state == GuardState::Start) {
+    state.guard_state =
+        name == "ifndef" && top_level ? GuardState::Inside : GuardState::None;
+  } else if (state.guard_state == GuardState::After) {
+    state.guard_state = GuardState::None;
+  }
+
+  if (name == "if" || name == "ifdef" || name == "ifndef") {
+    const bool parent_active = Active();
+    bool value = false;
+    if (parent_active && name == "if") {
+      value = EvaluateCondition(state, rest);
+    } else if (parent_active) {
+      size_t name_pos = skip_blanks(rest, 0);
+      std::string_view macro = read_identifier(rest, name_pos);
+      if (macro.empty()) {
+        Error(state, "macro name missing after #" + std::string(name));
+      }
+      pas::Symbol symbol = pas::SymbolTable::global().intern(macro);
+      value = IsDefined(symbol) == (name == "ifdef");
+      if (state.guard_state == GuardState::Inside && top_level) {
+        state.guard_macro = symbol;
+      }
+    }
+    const bool guard = state.guard_state == GuardState::Inside && top_level;
+    conditionals_.push_back(
+        Conditional{parent_active && value, parent_active, value, false, guard});
+    return;
+  }
+
+  if (name == "elif" || name == "else" || name == "endif") {
+    if (conditionals_.size() == state.base_depth) {
+      Error(state, "#" + std::string(name) + " without #if");
+    }
+    Conditional &group = conditionals_.back();
+    if (name == "endif") {
+      if (group.guard && state.guard_state == GuardState::Inside) {
+        state.guard_state = GuardState::After;
+      }
+      conditionals_.pop_back();
+      return;
+    }
+
+    if (group.seen_else) {
+      Error(state, "#" + std::string(name) + " after #else");
+    }
+    if (group.guard) {
+      // Something is kept when the guard macro is defined.
+      state.guard_state = GuardState::None;
+    }
+    group.seen_else = name == "else";
+    const bool value = group.parent_active && !group.taken &&
+                       (name == "else" || EvaluateCondition(state, rest));
+    group.active = value;
+    group.taken = group.taken || value;
+    return;
+  }
+
+  if (!Active()) {
+    return;
+  }
+
+  if (name == "include") {
+    Include(state, rest, depth);
+  } else if (name == "define") {
+    Define(state, rest);
+  } else if (name == "undef") {
+    size_t name_pos = skip_blanks(rest, 0);
+    std::string_view macro = read_identifier(rest, name_pos);
+    if (macro.empty()) {
+      Error(state, "macro name missing after #undef");
+    }
+    pas::Symbol symbol = pas::SymbolTable::global().intern(macro);
+    macros_.erase(symbol);
+    expander_.Undefined(symbol);
+  } else if (name == "error") {
+    Error(state, "#error " + std::string(trim(rest)));
+  } else if (name == "warning") {
+    std::cerr << state.file.path << ':' << state.line << ": warning: "
+              << trim(rest) << '\n';
+  } else if (name == "pragma") {
+    if (trim(rest) == "once") {
+      state.file.pragma_once = true;
+      once_entered_.insert(&state.file);
+    }
+    // Other pragmas are not for us.
+  } else if (name == "line") {
+    // Locations are mapped by the LineMap, #line is not honored yet.
+  } else {
+    Error(state, "invalid preprocessing directive #" + std::string(name));
+  }
+}
+
+void Preprocessor::Include(FileState &state, std::string_view text,
+                           size_t depth) {
+  text = trim(text);
+  std::string expanded;
+  if (!text.empty() && text.front() != '"' && text.front() != '<') {
+    // The header name is made by macros, C99 6.10.2p4.
+    try {
+      expanded = expander_.ExpandDirective(text, false);
+    } catch (const PreprocessorException &exc) {
+      Error(state, exc.what());
+    }
+    text = trim(expanded);
+  }
+  const bool angled = !text.empty() && text.front() == '<';
+  const char close = angled ? '>' : '"';
+  if (text.empty() || (text.front() != '"' && !angled)) {
+    Error(state, "#include expects \"FILENAME\" or <FILENAME>");
+  }
+  size_t name_end = text.find(close, 1);
+  if (name_end == std::string_view::npos) {
+    Error(state, "missing terminating " + std::string(1, close) +
+                     " in #include");
+  }
+  const std::string name(text.substr(1, name_end - 1));
+
+  if (depth + 1 > MAX_INCLUDE_DEPTH) {
+    Error(state, "#include nested too deeply");
+  }
+  FileCache::Entry *file = files.find_include(state.dir, name, angled);
+  if (file == nullptr) {
+    Error(state, "can't find include file " + name);
+  }
+  if (once_entered_.contains(file) ||
+      (file->guard.has_value() && IsDefined(file->guard.value()))) {
+    skipped_includes_ += 1;
+    return;
+  }
+
+  ProcessFile(*file, depth + 1);
+  // The includer goes on after the directive.
+  line_map_.add_run(output_line_, state.file.path,
+                    state.line + state.directive_lines);
+}
+
+void Preprocessor::Define(FileState &state, std::string_view text) {
+  size_t pos = skip_blanks(text, 0);
+  std::string_view name = read_identifier(text, pos);
+  if (name.empty()) {
+    Error(state, "macro name missing after #define");
+  }
+
+  Macro macro;
+  // Function-like only when the parenthesis follows the name right away.
+  if (pos < text.size() && text[pos] == '(') {
+    macro.function_like = true;
+    pos += 1;
+    while (true) {
+      pos = skip_blanks(text, pos);
+      if (pos < text.size() && text[pos] == ')' && macro.params.empty() &&
+          !macro.variadic) {
+        pos += 1;
+        break;
+      }
+      if (text.substr(pos, 3) == "...") {
+        macro.variadic = true;
+        pos = skip_blanks(text, pos + 3);
+      } else {
+        std::string_view param = read_identifier(text, pos);
+        if (param.empty()) {
+          Error(state, "expected parameter name in #define");
+        }
+        macro.params.push_back(pas::SymbolTable::global().intern(param));
+        pos = skip_blanks(text, pos);
+      }
+      if (pos < text.size() && text[pos] == ')') {
+        pos += 1;
+        break;
+      }
+      if (macro.variadic || pos >= text.size() || text[pos] != ',') {
+        Error(state, "expected ',' or ')' in macro parameter list");
+      }
+      pos += 1;
+    }
+  }
+
+  macro.body = trim(text.substr(pos));
+  pas::Symbol symbol = pas::SymbolTable::global().intern(name);
+  macros_[symbol] = std::move(macro);
+  try {
+    expander_.Defined(symbol);
+  } catch (const PreprocessorException &exc) {
+    macros_.erase(symbol);
+    Error(state, exc.what());
+  }
+}
+
+bool Preprocessor::EvaluateCondition(FileState &state, std::string_view text) {
+  std::string expanded;
+  try {
+    expanded = expander_.ExpandDirective(text, true);
+  } catch (const PreprocessorException &exc) {
+    Error(state, exc.what());
+  }
+  return ConditionEvaluator(*this, state, expanded).Evaluate() != 0;
+}
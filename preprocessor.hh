@@ -0,0 +1,161 @@
+#pragma once
+
+#include "file_cache.hh"
+#include "macro_expander.hh"
+#include "source_file.hh"
+#include "symbol_table.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class PrecompiledHeader;
+
+// Where lines of the preprocessed text came from. The text is made of
+//   runs of lines copied from the files (directives and skipped groups
+//   become empty lines), a new run starts whenever an #include enters
+//   or leaves a file.
+class LineMap {
+public:
+  struct Origin {
+    const std::string *path;
+    uint32_t line;
+  };
+
+  struct Run {
+    uint32_t output_line;
+    Origin origin;
+  };
+
+  void clear() { runs_.clear(); }
+
+  // Output line (starting at 1) begins a run of lines of path,
+  //   from line on.
+  void add_run(uint32_t output_line, const std::string &path, uint32_t line);
+
+  Origin find(uint32_t output_line) const;
+
+  const std::vector<Run> &runs() const { return runs_; }
+
+private:
+  std::vector<Run> runs_;
+};
+
+// Directives of the C preprocessor, run over the main file before
+//   scanning: #include, conditional groups, #define and #undef, #error,
+//   #pragma once. Output is the text of the translation unit with the
+//   included files spliced in, for the scanners to lex as one source.
+// Files come from a FileCache shared by all translation units of a run.
+//   Include guards (the whole file in "#ifndef X / #define X ... #endif")
+//   are detected the first time a file is read; a file included again
+//   while its guard macro is defined, or marked "#pragma once", is
+//   skipped without reading it again.
+// Macros are replaced by a MacroExpander in the text, in #if and in
+//   #include. Lines without a possible macro name are copied as is.
+class Preprocessor {
+public:
+  using Macro = MacroDefinition;
+
+  Preprocessor(FileCache &files);
+
+  // Macros defined before every translation unit, as with -D.
+  void Predefine(std::string_view name, std::string_view body);
+
+  // Every translation unit starts where the precompiled header left
+  //   off: its text goes first, its macros are defined and the files it
+  //   entered are not entered again. nullptr for none.
+  void SetPrelude(const PrecompiledHeader *prelude) { prelude_ = prelude; }
+  const PrecompiledHeader *prelude() const { return prelude_; }
+
+  // Preprocesses the translation unit of the main file, already read.
+  std::string Run(const std::string &path, SourceFile main);
+
+  const LineMap &line_map() const { return line_map_; }
+
+  // State after the last run, what a precompiled header saves.
+  const std::unordered_map<pas::Symbol, Macro> &macros() const {
+    return macros_;
+  }
+  const std::vector<const FileCache::Entry *> &entered_files() const {
+    return entered_files_;
+  }
+
+  // Includes skipped thanks to a guard or #pragma once, last run.
+  size_t skipped_includes() const { return skipped_includes_; }
+
+  FileCache &files;
+
+private:
+  // An #if, #ifdef or #ifndef group being processed.
+  struct Conditional {
+    // Lines are kept in the current branch.
+    bool active;
+    // The enclosing group is active.
+    bool parent_active;
+    // One of the branches was taken already.
+    bool taken;
+    bool seen_else;
+    // Opened by the #ifndef of a guard candidate.
+    bool guard;
+  };
+
+  // Include guard detection over one file.
+  enum class GuardState { Start, Inside, After, None };
+
+  struct FileState {
+    FileCache::Entry &file;
+    // Directory of the file with a trailing slash, empty for the
+    //   current one.
+    std::string dir;
+    uint32_t line = 1;
+    // Lines taken by the directive being handled.
+    uint32_t directive_lines = 1;
+    bool in_comment = false;
+    size_t base_depth = 0;
+    GuardState guard_state = GuardState::Start;
+    pas::Symbol guard_macro{};
+  };
+
+  class ConditionEvaluator;
+
+  void ProcessFile(FileCache::Entry &file, size_t depth);
+
+  // Handles a directive, text is the logical line after '#' with
+  //   comments replaced by spaces and continuations joined.
+  void Directive(FileState &state, std::string_view text, size_t depth);
+  void Include(FileState &state, std::string_view text, size_t depth);
+  void Define(FileState &state, std::string_view text);
+  bool EvaluateCondition(FileState &state, std::string_view text);
+
+  bool Active() const {
+    return conditionals_.empty() || conditionals_.back().active;
+  }
+  bool IsDefined(pas::Symbol name) const { return macros_.contains(name); }
+
+  void EmitNewlines(size_t count);
+
+  [[noreturn]] void Error(const FileState &state, const std::string &message);
+
+private:
+  static constexpr size_t MAX_INCLUDE_DEPTH = 200;
+
+  std::unordered_map<pas::Symbol, Macro> macros_;
+  MacroExpander expander_{macros_};
+  std::vector<std::pair<std::string, std::string>> predefined_;
+  std::vector<Conditional> conditionals_;
+  // Files with "#pragma once" entered in this translation unit.
+  std::unordered_set<const FileCache::Entry *> once_entered_;
+  // Every file entered, in order of the first entry.
+  std::vector<const FileCache::Entry *> entered_files_;
+  std::unordered_set<const FileCache::Entry *> entered_;
+  const PrecompiledHeader *prelude_ = nullptr;
+
+  std::string output_;
+  uint32_t output_line_ = 1;
+  LineMap line_map_;
+  size_t skipped_includes_ = 0;
+};
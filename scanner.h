@@ -9,6 +9,9 @@
 
 #include "parser.hh"
 
+#include <cstddef>
+#include <string_view>
+
 class Driver;
 
 class Scanner : public yyFlexLexer {
@@ -17,5 +20,28 @@ public:
   virtual ~Scanner() {}
   virtual yy::parser::symbol_type ScanToken();
   Driver &driver;
+  // Called before every action: the token just matched starts at
+  //   the end of the previous one.
   void UpdateLocation();
+
+  // Location right past the last match, where the end of file is.
+  SourceLoc EndLocation() const;
+
+  // Starts scanning the driver's source from the beginning.
+  void Restart();
+
+  // Text of the token just matched, viewed in the driver's SourceFile.
+  //   Unlike yytext, it stays valid as long as the source does, so
+  //   token payloads don't need a copy.
+  std::string_view TokenText() const;
+
+protected:
+  // Input comes from the driver's SourceFile, not from an std::istream.
+  int LexerInput(char *buf, int max_size) override;
+
+private:
+  // Flex hands the source to us byte by byte in order, so the offset
+  //   of a match in the source is the sum of all previous match lengths.
+  size_t offset_ = 0;
+  size_t token_offset_ = 0;
 };
\ No newline at end of file
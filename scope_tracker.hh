@@ -1,65 +1,101 @@
 #pragma once
 
 #include <exceptions.hh>
+#include <symbol_table.hh>
 
-#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <utility>
 #include <vector>
 
+// Names declared in nested scopes, innermost declaration wins.
+//   The scanner asks it about every identifier (lexer hack), so lookup
+//   must not depend on how many names are declared.
+// Each name has a shadow chain: the head is its innermost declaration,
+//   every declaration remembers the one it shadows. Symbols are dense
+//   ids, so heads are just a vector indexed by symbol id. Ending a scope
+//   pops its declarations and restores the heads they shadowed, that's
+//   O(declarations in the scope).
 template <typename ScopeItemType>
 class ScopeTracker {
 public:
   void start_scope() {
-    scope_sizes_.push_back(0);
+    scope_starts_.push_back(entries_.size());
   }
 
   void end_scope() {
-    if (scope_sizes_.empty()) {
+    if (scope_starts_.empty()) {
       throw NoScopesException("tried to ScopeTracker::end_scope() without an active scope");
     }
-    size_t scope_size = scope_sizes_.back();
-    scope_sizes_.pop_back();
+    size_t scope_start = scope_starts_.back();
+    scope_starts_.pop_back();
 
-    assert(items_.size() >= scope_size);
-    items_.erase(items.end() - scope_size, items.end());
+    assert(entries_.size() >= scope_start);
+    while (entries_.size() > scope_start) {
+      const Entry& entry = entries_.back();
+      heads_[entry.name.id()] = entry.shadowed;
+      entries_.pop_back();
+    }
   }
 
-  // Making copy here, cause we'll make a copy anyway.
-  //   Having a copy here allows to not write
-  //   overload with T& and const T&.
-  // It'll construct anyway, maybe it'll move-construct,
-  //   if user needs that (std::move to first arg).
-  void add_item(std::string name, ScopeItemType item) {
-    if (scope_sizes_.empty()) {
+  void add_item(pas::Symbol name, ScopeItemType item) {
+    if (scope_starts_.empty()) {
       throw NoScopesException("tried to ScopeTracker::add_item() without an active scope");
     }
-    scopes_sizes_.back() += 1;
-    items.push_back(NamedItemType(std::move(name), std::move(item)));
+    if (heads_.size() <= name.id()) {
+      heads_.resize(name.id() + 1, NO_ENTRY);
+    }
+    uint32_t& head = heads_[name.id()];
+    entries_.push_back(Entry{name, std::move(item), head});
+    head = static_cast<uint32_t>(entries_.size() - 1);
   }
 
-  // Here we don't need to store the value, so we don't
-  //   make a just std::string that could be move-constructed,
-  //   copy constructed (for T& or const T&). Just const T& to
-  //   view the object. Also binds to temporary objects, plain
-  //   objects, etc.
-  ScopeItemType* find_item(const std::string& name) {
-    auto start = items_.rbegin();
-    auto end   = items_.rend();
+  // Forgets all scopes and declarations.
+  void clear() {
+    scope_starts_.clear();
+    entries_.clear();
+    heads_.clear();
+  }
 
-    auto it    = std::find_if(start, end, [&](const NamedItemType& item) {
-      return item.first == name;
-    });
+  // Declarations in the active scopes. Taken as a mark, the ones made
+  //   after it in the same scope are items_since(mark).
+  size_t size() const { return entries_.size(); }
 
-    if (it != end) {
-      return &*it;
-    } else {
+  std::vector<std::pair<pas::Symbol, ScopeItemType>> items_since(size_t mark) const {
+    assert(mark <= entries_.size());
+    std::vector<std::pair<pas::Symbol, ScopeItemType>> items;
+    items.reserve(entries_.size() - mark);
+    for (size_t i = mark; i < entries_.size(); ++i) {
+      items.emplace_back(entries_[i].name, entries_[i].item);
+    }
+    return items;
+  }
+
+  // Pointer is valid until the next add_item() or end_scope().
+  ScopeItemType* find_item(pas::Symbol name) {
+    if (name.id() >= heads_.size()) {
+      return nullptr;
+    }
+    uint32_t head = heads_[name.id()];
+    if (head == NO_ENTRY) {
       return nullptr;
     }
+    return &entries_[head].item;
   }
 
 private:
-  using NamedItemType = std::pair<std::string, ScopeItemType>;
+  static constexpr uint32_t NO_ENTRY = UINT32_MAX;
+
+  struct Entry {
+    pas::Symbol name;
+    ScopeItemType item;
+    // Declaration of the same name this one shadows, or NO_ENTRY.
+    uint32_t shadowed;
+  };
 
-  std::string<std::size_t> scope_sizes_;
-  std::vector<NamedItemType> items_;
+  // Index of the first entry of each active scope.
+  std::vector<size_t> scope_starts_;
+  std::vector<Entry> entries_;
+  // Innermost entry for each symbol id, or NO_ENTRY.
+  std::vector<uint32_t> heads_;
 };
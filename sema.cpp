@@ -0,0 +1,860 @@
+#include "sema.hpp"
+
+#include "flat_walk.hh"
+#include "symbol_table.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <span>
+#include <thread>
+#include <unordered_map>
+
+namespace pas {
+namespace sema {
+
+namespace {
+
+using pas::flat::DeclKind;
+using pas::flat::ExprKind;
+using pas::flat::NodeClass;
+using pas::flat::NodeId;
+using pas::flat::StmtKind;
+using pas::flat::Tag;
+using pas::flat::TypeKind;
+
+// A parameter is the types its argument may have, a bit per ExprType.
+//   BY_REFERENCE: the argument must be a variable, it is changed.
+constexpr uint8_t bit(ExprType type) {
+  return static_cast<uint8_t>(1u << static_cast<unsigned>(type));
+}
+constexpr uint8_t ANY_TYPE = bit(ExprType::Integer) | bit(ExprType::Char) |
+                             bit(ExprType::String) | bit(ExprType::Other);
+constexpr uint8_t BY_REFERENCE = 0x80;
+
+std::string describe(ExprType type) {
+  switch (type) {
+  case ExprType::Integer:
+    return "Integer";
+  case ExprType::Char:
+    return "Char";
+  case ExprType::String:
+    return "String";
+  default:
+    return "a value";
+  }
+}
+
+std::string describe(uint8_t parameter) {
+  std::string types;
+  for (ExprType type : {ExprType::Integer, ExprType::Char, ExprType::String}) {
+    if ((parameter & bit(type)) != 0) {
+      types += (types.empty() ? "" : " or ") + describe(type);
+    }
+  }
+  return types;
+}
+
+// Types go with each other unless both are followed and differ.
+bool compatible(ExprType lhs, ExprType rhs) {
+  return lhs == rhs || lhs == ExprType::Other || rhs == ExprType::Other;
+}
+
+// What a name stands for. Result is the name of the function being
+//   checked, its value is assigned to it.
+enum class EntityKind : uint8_t { Const, Type, Var, Proc, Func, Result };
+
+struct Entity {
+  EntityKind kind;
+  // Of a value, of the values of a type, of what a function returns.
+  ExprType type = ExprType::Other;
+  // Parameters of a subprogram, arity of them.
+  uint32_t arity = 0;
+  const uint8_t *parameters = nullptr;
+};
+
+using Names = std::unordered_map<pas::Symbol, Entity>;
+
+struct Builtin {
+  const char *name;
+  EntityKind kind;
+  ExprType result;
+  uint32_t arity;
+  std::array<uint8_t, 2> parameters;
+};
+
+constexpr Builtin BUILTINS[] = {
+    {"read_char", EntityKind::Func, ExprType::Char, 0, {}},
+    {"read_str", EntityKind::Func, ExprType::String, 0, {}},
+    {"read_int", EntityKind::Func, ExprType::Integer, 0, {}},
+    {"strlen", EntityKind::Func, ExprType::Integer, 1,
+     {bit(ExprType::String)}},
+    {"ord", EntityKind::Func, ExprType::Integer, 1,
+     {bit(ExprType::Char) | bit(ExprType::String)}},
+    {"chr", EntityKind::Func, ExprType::Char, 1, {bit(ExprType::Integer)}},
+    {"write_char", EntityKind::Proc, ExprType::Other, 1,
+     {bit(ExprType::Char)}},
+    {"write_str", EntityKind::Proc, ExprType::Other, 1,
+     {bit(ExprType::String)}},
+    {"write_int", EntityKind::Proc, ExprType::Other, 1,
+     {bit(ExprType::Integer)}},
+    {"append", EntityKind::Proc, ExprType::Other, 2,
+     {bit(ExprType::String) | BY_REFERENCE,
+      bit(ExprType::Char) | bit(ExprType::String)}},
+    {"drop", EntityKind::Proc, ExprType::Other, 1,
+     {bit(ExprType::String) | BY_REFERENCE}},
+};
+
+// Names every check sees, under the ones it declares. Filled before the
+//   checks start, only read by them.
+struct Globals {
+  Names builtins;
+  Names program;
+  // Parameters of the program's subprograms, entities point into them.
+  std::vector<std::vector<uint8_t>> parameters;
+};
+
+Globals Builtins() {
+  pas::SymbolTable &symbols = pas::SymbolTable::global();
+  Globals globals;
+  globals.builtins[symbols.intern("Integer")] =
+      Entity{EntityKind::Type, ExprType::Integer};
+  globals.builtins[symbols.intern("Char")] =
+      Entity{EntityKind::Type, ExprType::Char};
+  globals.builtins[symbols.intern("String")] =
+      Entity{EntityKind::Type, ExprType::String};
+  for (const Builtin &builtin : BUILTINS) {
+    globals.builtins[symbols.intern(builtin.name)] =
+        Entity{builtin.kind, builtin.result, builtin.arity,
+               builtin.parameters.data()};
+  }
+  return globals;
+}
+
+// One check: the program's declarations, a subprogram or the program's
+//   statements. Statements, exprs and types are walked, declarations
+//   are gone through in the order names are declared in. Each expr
+//   leaves its type on types_, the node using it takes it from there.
+class Checker {
+public:
+  Checker(const pas::flat::Tree &tree, const Globals &globals,
+          Diagnostics &diagnostics, std::span<ExprType> expr_types,
+          std::atomic<bool> &conflict)
+      : tree_(tree), globals_(globals), diagnostics_(&diagnostics),
+        expr_types_(expr_types), conflict_(conflict), walker_(tree, *this) {}
+
+  // The program's declarations, into a scope published into globals by
+  //   Publish. Its subprograms are only declared, problems with their
+  //   names go to subprograms, one per subprogram.
+  void Program(std::span<Diagnostics> subprograms) {
+    PushScope();
+    Declarations(tree_.block(tree_.program_block()).decls, subprograms);
+  }
+  void Publish(Globals &globals) {
+    globals.program = std::move(scopes_[0]);
+    globals.parameters = std::move(parameters_);
+  }
+
+  void Statements(pas::flat::Range stmts) {
+    for (NodeId stmt : tree_.list(stmts)) {
+      walker_.walk(NodeClass::Stmt, stmt);
+      assert(types_.empty());
+    }
+  }
+
+  // Children: block, [return type name], Param decls.
+  void Subprogram(NodeId id) {
+    const pas::flat::Decl &decl = tree_.decl(id);
+    std::span<const uint32_t> children = tree_.list(decl.children);
+    const bool func = decl.kind == DeclKind::Func;
+    PushScope();
+    for (NodeId param_id : children.subspan(func ? 2 : 1)) {
+      const pas::flat::Decl &param = tree_.decl(param_id);
+      const ExprType type = TypeName(tree_.name(param));
+      for (uint32_t name : tree_.list(param.children)) {
+        Declare(tree_.symbol(name), Entity{EntityKind::Var, type});
+      }
+    }
+    if (func) {
+      Declare(tree_.name(decl),
+              Entity{EntityKind::Result,
+                     TypeName(tree_.symbol(children[1])), Arity(decl),
+                     Parameters(decl)});
+    }
+    const pas::flat::Block &block = tree_.block(children[0]);
+    Declarations(block.decls, {});
+    Statements(block.stmts);
+    PopScope();
+  }
+
+private:
+  friend class pas::flat::Walker<Checker>;
+
+  // Declarations come by kinds: constants, types, variables,
+  //   subprograms. Types may point to the ones after them and
+  //   subprograms may call the ones after them, so all the names of
+  //   these kinds are declared first. Bodies of subprograms are checked
+  //   here unless subprograms has a place for each one's diagnostics,
+  //   then they are checked on their own.
+  void Declarations(pas::flat::Range decls,
+                    std::span<Diagnostics> subprograms) {
+    std::span<const uint32_t> ids = tree_.list(decls);
+    for (size_t i = 0; i < ids.size(); ++i) {
+      const pas::flat::Decl &decl = tree_.decl(ids[i]);
+      switch (decl.kind) {
+      case DeclKind::Const: {
+        ++const_depth_;
+        walker_.walk(NodeClass::Expr, tree_.list(decl.children)[0]);
+        --const_depth_;
+        Declare(tree_.name(decl), Entity{EntityKind::Const, Pop()});
+        break;
+      }
+      case DeclKind::Type: {
+        if (i == 0 || tree_.decl(ids[i - 1]).kind != DeclKind::Type) {
+          for (size_t j = i; j < ids.size(); ++j) {
+            if (tree_.decl(ids[j]).kind == DeclKind::Type) {
+              Declare(tree_.name(tree_.decl(ids[j])),
+                      Entity{EntityKind::Type});
+            }
+          }
+        }
+        const NodeId type = tree_.list(decl.children)[0];
+        walker_.walk(NodeClass::Type, type);
+        // A synonym of a type declared after it is not followed.
+        Entity &entity = scopes_[depth_ - 1][tree_.name(decl)];
+        if (entity.kind == EntityKind::Type) {
+          entity.type = TypeOf(type);
+        }
+        break;
+      }
+      case DeclKind::Var: {
+        const ExprType type = TypeOf(decl.value);
+        for (uint32_t name : tree_.list(decl.children)) {
+          Declare(tree_.symbol(name), Entity{EntityKind::Var, type});
+        }
+        walker_.walk(NodeClass::Type, decl.value);
+        break;
+      }
+      case DeclKind::Proc:
+      case DeclKind::Func: {
+        // Subprograms are last.
+        std::span<const uint32_t> rest = ids.subspan(i);
+        assert(subprograms.empty() || subprograms.size() == rest.size());
+        Diagnostics *diagnostics = diagnostics_;
+        for (size_t j = 0; j < rest.size(); ++j) {
+          const pas::flat::Decl &subprogram = tree_.decl(rest[j]);
+          diagnostics_ = subprograms.empty() ? diagnostics : &subprograms[j];
+          Entity entity{EntityKind::Proc, ExprType::Other, Arity(subprogram),
+                        Parameters(subprogram)};
+          if (subprogram.kind == DeclKind::Func) {
+            entity.kind = EntityKind::Func;
+            entity.type = TypeOf(
+                tree_.symbol(tree_.list(subprogram.children)[1]));
+          }
+          Declare(tree_.name(subprogram), entity);
+        }
+        diagnostics_ = diagnostics;
+        if (subprograms.empty()) {
+          for (NodeId subprogram : rest) {
+            Subprogram(subprogram);
+          }
+        }
+        return;
+      }
+      case DeclKind::Param:
+        assert(false);
+        __builtin_unreachable();
+      }
+    }
+  }
+
+  // Names of the Param decls of a subprogram.
+  uint32_t Arity(const pas::flat::Decl &decl) const {
+    std::span<const uint32_t> children = tree_.list(decl.children);
+    uint32_t arity = 0;
+    for (NodeId param : children.subspan(decl.kind == DeclKind::Func ? 2 : 1)) {
+      arity += tree_.decl(param).children.size;
+    }
+    return arity;
+  }
+
+  // Types of the parameters as seen where the subprogram is declared.
+  const uint8_t *Parameters(const pas::flat::Decl &decl) {
+    std::span<const uint32_t> children = tree_.list(decl.children);
+    std::vector<uint8_t> &parameters = parameters_.emplace_back();
+    const size_t first = decl.kind == DeclKind::Func ? 2 : 1;
+    for (NodeId param_id : children.subspan(first)) {
+      const pas::flat::Decl &param = tree_.decl(param_id);
+      const ExprType type = TypeOf(tree_.name(param));
+      parameters.insert(parameters.end(), param.children.size,
+                        type == ExprType::Other ? ANY_TYPE : bit(type));
+    }
+    return parameters.data();
+  }
+
+  bool enter(Tag<ExprKind::Number>, NodeId id, const pas::flat::Expr &) {
+    Push(id, ExprType::Integer);
+    return false;
+  }
+  bool enter(Tag<ExprKind::Bool>, NodeId id, const pas::flat::Expr &) {
+    Push(id, ExprType::Integer);
+    return false;
+  }
+  bool enter(Tag<ExprKind::String>, NodeId id, const pas::flat::Expr &) {
+    Push(id, ExprType::String);
+    return false;
+  }
+  bool enter(Tag<ExprKind::Nil>, NodeId id, const pas::flat::Expr &) {
+    Push(id, ExprType::Other);
+    return false;
+  }
+
+  // Items work on the type on top.
+  bool enter(Tag<ExprKind::Designator>, NodeId, const pas::flat::Expr &expr) {
+    types_.push_back(Value(tree_.name(expr)));
+    return true;
+  }
+  void leave(Tag<ExprKind::Designator>, NodeId id, const pas::flat::Expr &) {
+    Annotate(id, types_.back());
+  }
+  bool enter(Tag<ExprKind::Field>, NodeId id, const pas::flat::Expr &) {
+    Item(id, "only records have fields");
+    return false;
+  }
+  bool enter(Tag<ExprKind::Deref>, NodeId id, const pas::flat::Expr &) {
+    Item(id, "only pointers can be dereferenced");
+    return false;
+  }
+  void leave(Tag<ExprKind::Index>, NodeId id, const pas::flat::Expr &item) {
+    for (uint32_t i = 0; i < item.children.size; ++i) {
+      if (!compatible(Pop(), ExprType::Integer)) {
+        diagnostics_->push_back("can only do indexing with integer type");
+      }
+    }
+    if (types_.back() == ExprType::String) {
+      if (item.children.size != 1) {
+        diagnostics_->push_back("a string takes one index");
+      }
+      types_.back() = ExprType::Char;
+    } else {
+      Item(id, "only strings and arrays can be indexed");
+    }
+    Annotate(id, types_.back());
+  }
+
+  bool enter(Tag<ExprKind::Call>, NodeId, const pas::flat::Expr &call) {
+    Call(tree_.name(call), call.children.size, EntityKind::Func);
+    return true;
+  }
+  void leave(Tag<ExprKind::Call>, NodeId id, const pas::flat::Expr &call) {
+    Push(id, Arguments(tree_.name(call), call.children, EntityKind::Func));
+  }
+
+  void leave(Tag<ExprKind::Not>, NodeId id, const pas::flat::Expr &) {
+    if (!compatible(Pop(), ExprType::Integer)) {
+      diagnostics_->push_back("negation is only applicable to integer type");
+    }
+    Push(id, ExprType::Integer);
+  }
+  // Operands are between the operators.
+  void leave(Tag<ExprKind::Sum>, NodeId id, const pas::flat::Expr &expr) {
+    Arithmetic(id, (expr.children.size + 1) / 2);
+  }
+  void leave(Tag<ExprKind::Product>, NodeId id, const pas::flat::Expr &expr) {
+    Arithmetic(id, (expr.children.size + 1) / 2);
+  }
+  void leave(Tag<ExprKind::Relation>, NodeId id, const pas::flat::Expr &expr) {
+    const ExprType rhs = Pop();
+    const ExprType lhs = Pop();
+    if (static_cast<pas::ast::RelOp>(expr.op) != pas::ast::RelOp::In &&
+        !compatible(lhs, rhs)) {
+      diagnostics_->push_back("can't compare " + describe(lhs) + " with " +
+                              describe(rhs));
+    }
+    Push(id, ExprType::Integer);
+  }
+
+  // Children: Designator expr, value expr. The designator is assigned
+  //   to, the exprs of its items are walked.
+  bool enter(Tag<StmtKind::Assignment>, NodeId, const pas::flat::Stmt &stmt) {
+    std::span<const uint32_t> children = tree_.list(stmt.children);
+    const pas::flat::Expr &target = tree_.expr(children[0]);
+    types_.push_back(Target(tree_.name(target)));
+    for (NodeId item : tree_.list(target.children)) {
+      walker_.walk(NodeClass::Expr, item);
+    }
+    const ExprType target_type = Pop();
+    Annotate(children[0], target_type);
+    walker_.walk(NodeClass::Expr, children[1]);
+    const ExprType value_type = Pop();
+    if (!compatible(target_type, value_type)) {
+      diagnostics_->push_back("can't assign " + describe(value_type) + " to " +
+                              describe(target_type));
+    }
+    return false;
+  }
+  bool enter(Tag<StmtKind::ProcCall>, NodeId, const pas::flat::Stmt &stmt) {
+    Call(tree_.name(stmt), stmt.children.size, EntityKind::Proc);
+    return true;
+  }
+  void leave(Tag<StmtKind::ProcCall>, NodeId, const pas::flat::Stmt &stmt) {
+    Arguments(tree_.name(stmt), stmt.children, EntityKind::Proc);
+  }
+  // Children: condition expr, then stmt, [else stmt].
+  uint32_t next(Tag<StmtKind::If>, NodeId, const pas::flat::Stmt &,
+                uint32_t done) {
+    if (done == 0) {
+      Condition();
+    }
+    return done == pas::flat::NO_CHILD ? 0 : done + 1;
+  }
+  // Children: condition expr, stmt.
+  uint32_t next(Tag<StmtKind::While>, NodeId, const pas::flat::Stmt &,
+                uint32_t done) {
+    if (done == 0) {
+      Condition();
+    }
+    return done == pas::flat::NO_CHILD ? 0 : done + 1;
+  }
+  // Children: condition expr, stmts. The condition comes last in the
+  //   source.
+  uint32_t next(Tag<StmtKind::Repeat>, NodeId, const pas::flat::Stmt &stmt,
+                uint32_t done) {
+    if (done == 0) {
+      Condition();
+      return pas::flat::NO_CHILD;
+    }
+    const uint32_t after = done == pas::flat::NO_CHILD ? 1 : done + 1;
+    return after < stmt.children.size ? after : 0;
+  }
+  // Children: expr, CaseArm stmts. Labels are of the expr's type.
+  uint32_t next(Tag<StmtKind::Case>, NodeId, const pas::flat::Stmt &,
+                uint32_t done) {
+    if (done == 0) {
+      case_types_.push_back(Pop());
+    }
+    return done == pas::flat::NO_CHILD ? 0 : done + 1;
+  }
+  void leave(Tag<StmtKind::Case>, NodeId, const pas::flat::Stmt &) {
+    case_types_.pop_back();
+  }
+  // Children: stmt, label exprs. Labels come first in the source.
+  bool enter(Tag<StmtKind::CaseArm>, NodeId, const pas::flat::Stmt &) {
+    ++const_depth_;
+    return true;
+  }
+  uint32_t next(Tag<StmtKind::CaseArm>, NodeId, const pas::flat::Stmt &arm,
+                uint32_t done) {
+    if (done == 0) {
+      return pas::flat::NO_CHILD;
+    }
+    if (done != pas::flat::NO_CHILD) {
+      const ExprType label = Pop();
+      if (!compatible(label, case_types_.back())) {
+        diagnostics_->push_back("label of type " + describe(label) +
+                                " in a case over " +
+                                describe(case_types_.back()));
+      }
+    }
+    const uint32_t after = done == pas::flat::NO_CHILD ? 1 : done + 1;
+    if (after < arm.children.size) {
+      return after;
+    }
+    --const_depth_;
+    return 0;
+  }
+  // Children: start, finish, stmt. The counter is declared by the loop
+  //   for its body, as the interpreter does, it must not be in use.
+  uint32_t next(Tag<StmtKind::For>, NodeId, const pas::flat::Stmt &stmt,
+                uint32_t done) {
+    if (done == 1) {
+      const ExprType finish = Pop();
+      const ExprType start = Pop();
+      if (!compatible(start, ExprType::Integer) ||
+          !compatible(finish, ExprType::Integer)) {
+        diagnostics_->push_back("bounds of a for loop must be Integer");
+      }
+      const pas::Symbol counter = tree_.name(stmt);
+      if (Find(counter) != nullptr) {
+        Report("identifier is already in use: ", counter);
+      }
+      PushScope();
+      Declare(counter, Entity{EntityKind::Var, ExprType::Integer});
+    }
+    return done == pas::flat::NO_CHILD ? 0 : done + 1;
+  }
+  void leave(Tag<StmtKind::For>, NodeId, const pas::flat::Stmt &) {
+    PopScope();
+  }
+  bool enter(Tag<StmtKind::Memory>, NodeId, const pas::flat::Stmt &stmt) {
+    const pas::Symbol name = tree_.name(stmt);
+    const Entity *entity = Find(name);
+    if (entity == nullptr) {
+      Report("undeclared identifier: ", name);
+    } else if (entity->kind != EntityKind::Var) {
+      Report("new and dispose need a variable: ", name);
+    }
+    return false;
+  }
+
+  bool enter(Tag<TypeKind::Named>, NodeId, const pas::flat::Type &type) {
+    TypeName(tree_.name(type));
+    return false;
+  }
+  bool enter(Tag<TypeKind::Pointer>, NodeId, const pas::flat::Type &type) {
+    TypeName(tree_.name(type));
+    return false;
+  }
+  // Bounds are constants.
+  bool enter(Tag<TypeKind::Set>, NodeId, const pas::flat::Type &) {
+    ++const_depth_;
+    return true;
+  }
+  void leave(Tag<TypeKind::Set>, NodeId, const pas::flat::Type &set) {
+    types_.resize(types_.size() - set.children.size);
+    --const_depth_;
+  }
+  bool enter(Tag<TypeKind::Array>, NodeId, const pas::flat::Type &) {
+    ++const_depth_;
+    return true;
+  }
+  void leave(Tag<TypeKind::Array>, NodeId, const pas::flat::Type &array) {
+    types_.resize(types_.size() - array.children.size);
+    --const_depth_;
+  }
+  bool enter(Tag<TypeKind::Record>, NodeId, const pas::flat::Type &record) {
+    std::vector<pas::Symbol> names;
+    for (NodeId field : tree_.list(record.children)) {
+      for (uint32_t name : tree_.list(tree_.type(field).children)) {
+        const pas::Symbol symbol = tree_.symbol(name);
+        if (std::find(names.begin(), names.end(), symbol) != names.end()) {
+          Report("duplicate field: ", symbol);
+        }
+        names.push_back(symbol);
+      }
+    }
+    return true;
+  }
+
+  // Type of the values of a type.
+  ExprType TypeOf(NodeId type_id) const {
+    const pas::flat::Type &type = tree_.type(type_id);
+    return type.kind == TypeKind::Named ? TypeOf(tree_.name(type))
+                                        : ExprType::Other;
+  }
+  ExprType TypeOf(pas::Symbol type_name) const {
+    const Entity *entity = Find(type_name);
+    return entity != nullptr && entity->kind == EntityKind::Type
+               ? entity->type
+               : ExprType::Other;
+  }
+
+  // A name used for its value.
+  ExprType Value(pas::Symbol name) {
+    const Entity *entity = Find(name);
+    if (entity == nullptr) {
+      Report("undeclared identifier: ", name);
+      return ExprType::Other;
+    }
+    if (const_depth_ > 0 && entity->kind != EntityKind::Const) {
+      Report("constant expected: ", name);
+      return ExprType::Other;
+    }
+    switch (entity->kind) {
+    case EntityKind::Const:
+    case EntityKind::Var:
+    case EntityKind::Result:
+      return entity->type;
+    case EntityKind::Type:
+      Report("designator must reference a value, not a type: ", name);
+      return ExprType::Other;
+    case EntityKind::Proc:
+      Report("procedure has no value: ", name);
+      return ExprType::Other;
+    case EntityKind::Func:
+      // Called without arguments.
+      if (entity->arity != 0) {
+        Arity("function", name, entity->arity, 0);
+      }
+      return entity->type;
+    }
+    __builtin_unreachable();
+  }
+
+  ExprType Target(pas::Symbol name) {
+    const Entity *entity = Find(name);
+    if (entity == nullptr) {
+      Report("assignment references an undeclared identifier: ", name);
+      return ExprType::Other;
+    }
+    switch (entity->kind) {
+    case EntityKind::Var:
+    case EntityKind::Result:
+      return entity->type;
+    case EntityKind::Const:
+      Report("can't assign to a constant: ", name);
+      break;
+    case EntityKind::Type:
+      Report("assignment must reference a value, not a type: ", name);
+      break;
+    case EntityKind::Proc:
+    case EntityKind::Func:
+      Report("can't assign to a subprogram: ", name);
+      break;
+    }
+    return ExprType::Other;
+  }
+
+  // A Field, Deref or Index item on the type on top, only values not
+  //   followed have them.
+  void Item(NodeId id, const char *problem) {
+    if (types_.back() != ExprType::Other) {
+      diagnostics_->push_back(problem);
+      types_.back() = ExprType::Other;
+    }
+    Annotate(id, ExprType::Other);
+  }
+
+  void Arithmetic(NodeId id, uint32_t operands) {
+    bool integers = true;
+    for (uint32_t i = 0; i < operands; ++i) {
+      integers &= compatible(Pop(), ExprType::Integer);
+    }
+    if (!integers) {
+      diagnostics_->push_back("can only do math with integer type");
+    }
+    Push(id, ExprType::Integer);
+  }
+
+  void Condition() {
+    if (!compatible(Pop(), ExprType::Integer)) {
+      diagnostics_->push_back("condition must evaluate to Integer");
+    }
+  }
+
+  // kind is Func or Proc, the function being checked can be called too.
+  void Call(pas::Symbol name, uint32_t arguments, EntityKind kind) {
+    const std::string what =
+        kind == EntityKind::Func ? "function" : "procedure";
+    const Entity *entity = Find(name);
+    if (entity == nullptr) {
+      Report("undeclared " + what + ": ", name);
+    } else if (!Callable(*entity, kind)) {
+      Report("not a " + what + ": ", name);
+    } else if (entity->arity != arguments) {
+      Arity(what, name, entity->arity, arguments);
+    }
+  }
+
+  // Takes the arguments' types, checks them if Call found no problem.
+  //   Type of the value of a function.
+  ExprType Arguments(pas::Symbol name, pas::flat::Range arguments,
+                     EntityKind kind) {
+    const size_t first = types_.size() - arguments.size;
+    const Entity *entity = Find(name);
+    ExprType result = ExprType::Other;
+    if (entity != nullptr && Callable(*entity, kind) &&
+        entity->arity == arguments.size) {
+      std::span<const uint32_t> ids = tree_.list(arguments);
+      for (uint32_t i = 0; i < arguments.size; ++i) {
+        Argument(name, i, entity->parameters[i], ids[i], types_[first + i]);
+      }
+      result = entity->type;
+    }
+    types_.resize(first);
+    return result;
+  }
+
+  void Argument(pas::Symbol name, uint32_t index, uint8_t parameter,
+                NodeId argument, ExprType type) {
+    const std::string which = "argument " + std::to_string(index + 1) +
+                              " of " + std::string(name.spelling());
+    if (type != ExprType::Other && (parameter & bit(type)) == 0) {
+      diagnostics_->push_back(which + " must be " + describe(parameter));
+    }
+    if ((parameter & BY_REFERENCE) != 0) {
+      const pas::flat::Expr &expr = tree_.expr(argument);
+      const Entity *entity = expr.kind == ExprKind::Designator &&
+                                     expr.children.size == 0
+                                 ? Find(tree_.name(expr))
+                                 : nullptr;
+      if (entity == nullptr || entity->kind != EntityKind::Var) {
+        diagnostics_->push_back(which + " must be a variable");
+      }
+    }
+  }
+
+  static bool Callable(const Entity &entity, EntityKind kind) {
+    return entity.kind == kind ||
+           (kind == EntityKind::Func && entity.kind == EntityKind::Result);
+  }
+
+  void Arity(const std::string &what, pas::Symbol name, uint32_t arity,
+             uint32_t arguments) {
+    diagnostics_->push_back(what + " " + std::string(name.spelling()) +
+                            " takes " + std::to_string(arity) +
+                            " arguments, not " + std::to_string(arguments));
+  }
+
+  ExprType TypeName(pas::Symbol name) {
+    const Entity *entity = Find(name);
+    if (entity == nullptr) {
+      Report("undeclared type: ", name);
+    } else if (entity->kind != EntityKind::Type) {
+      Report("not a type: ", name);
+    } else {
+      return entity->type;
+    }
+    return ExprType::Other;
+  }
+
+  void Report(const std::string &message, pas::Symbol name) {
+    diagnostics_->push_back(message + std::string(name.spelling()));
+  }
+
+  void Push(NodeId id, ExprType type) {
+    Annotate(id, type);
+    types_.push_back(type);
+  }
+  ExprType Pop() {
+    const ExprType type = types_.back();
+    types_.pop_back();
+    return type;
+  }
+
+  // A shared expr is in more than one check, the first one to get to it
+  //   sets its type.
+  void Annotate(NodeId id, ExprType type) {
+    if (!tree_.shares_exprs()) {
+      expr_types_[id] = type;
+      return;
+    }
+    ExprType expected = ExprType::Unknown;
+    if (!std::atomic_ref<ExprType>(expr_types_[id])
+             .compare_exchange_strong(expected, type,
+                                      std::memory_order_relaxed) &&
+        expected != type) {
+      conflict_.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  // Scopes are kept with their memory, a check opens and closes many.
+  void PushScope() {
+    if (depth_ == scopes_.size()) {
+      scopes_.emplace_back();
+    } else {
+      scopes_[depth_].clear();
+    }
+    ++depth_;
+  }
+  void PopScope() { --depth_; }
+
+  void Declare(pas::Symbol name, Entity entity) {
+    if (!scopes_[depth_ - 1].emplace(name, entity).second) {
+      Report("identifier is already in use: ", name);
+    }
+  }
+
+  const Entity *Find(pas::Symbol name) const {
+    for (size_t i = depth_; i-- > 0;) {
+      auto it = scopes_[i].find(name);
+      if (it != scopes_[i].end()) {
+        return &it->second;
+      }
+    }
+    for (const Names *names : {&globals_.program, &globals_.builtins}) {
+      auto it = names->find(name);
+      if (it != names->end()) {
+        return &it->second;
+      }
+    }
+    return nullptr;
+  }
+
+private:
+  const pas::flat::Tree &tree_;
+  const Globals &globals_;
+  Diagnostics *diagnostics_;
+  std::span<ExprType> expr_types_;
+  std::atomic<bool> &conflict_;
+  std::vector<Names> scopes_;
+  size_t depth_ = 0;
+  // Parameters of the subprograms declared by the check, entities point
+  //   into them. Moving the vectors keeps their items in place.
+  std::vector<std::vector<uint8_t>> parameters_;
+  // Types of the exprs walked and not used yet.
+  std::vector<ExprType> types_;
+  // Types of the exprs of the cases being checked.
+  std::vector<ExprType> case_types_;
+  // Inside a constant: a constant's value, bounds, case labels.
+  uint32_t const_depth_ = 0;
+  pas::flat::Walker<Checker> walker_;
+};
+
+} // namespace
+
+Analysis check(const pas::flat::Tree &tree, unsigned thread_count) {
+  const pas::flat::Block &program = tree.block(tree.program_block());
+  std::vector<NodeId> subprograms;
+  for (NodeId id : tree.list(program.decls)) {
+    const DeclKind kind = tree.decl(id).kind;
+    if (kind == DeclKind::Proc || kind == DeclKind::Func) {
+      subprograms.push_back(id);
+    }
+  }
+
+  Analysis analysis;
+  analysis.types.resize(tree.expr_count());
+  std::atomic<bool> conflict = false;
+
+  // found[0] is of the program's declarations, found[1 + i] of
+  //   subprogram i, the last of the program's statements.
+  std::vector<Diagnostics> found(subprograms.size() + 2);
+  Globals globals = Builtins();
+  {
+    Checker checker(tree, globals, found[0], analysis.types, conflict);
+    checker.Program(std::span(found).subspan(1, subprograms.size()));
+    checker.Publish(globals);
+  }
+
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const size_t checks = subprograms.size() + 1;
+  std::atomic<size_t> next_check = 0;
+  auto worker = [&]() {
+    for (size_t check = next_check++; check < checks; check = next_check++) {
+      Checker checker(tree, globals, found[1 + check], analysis.types,
+                      conflict);
+      if (check < subprograms.size()) {
+        checker.Subprogram(subprograms[check]);
+      } else {
+        checker.Statements(program.stmts);
+      }
+    }
+  };
+
+  const size_t worker_count = std::min<size_t>(thread_count, checks) - 1;
+  std::vector<std::thread> workers;
+  workers.reserve(worker_count);
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : workers) {
+    thread.join();
+  }
+
+  for (Diagnostics &part : found) {
+    std::move(part.begin(), part.end(),
+              std::back_inserter(analysis.diagnostics));
+  }
+  if (!analysis.diagnostics.empty() || conflict) {
+    analysis.types.clear();
+  }
+  return analysis;
+}
+
+} // namespace sema
+} // namespace pas
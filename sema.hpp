@@ -1,20 +1,46 @@
 #pragma once
 
-#include "ast.hpp"
+#include "flat_ast.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
 
 namespace pas {
 // Semantic checks.
 namespace sema {
-// Some of operations in grammar are allowed only for specific types.
-//   For example, addition is only allowed for integers (maybe for chars also).
-//   It's possible that we won't allow addition for chars, we have to convert
-//   them to integers first.
-// It also checks that all expressions are evaluatable (this also means that
-//   all functions called must be defined, not only declared). It's not a must
-//   in case we have a linker and functions from other modules. It could be
-//   a problem linker should solve. When we start producing object files
-//   for ld, we should eliminate this check (functions will come at linking
-//   stage and their absence is processed there).
-bool typecheck(pas::AST &ast);
+
+// Messages of the problems a check found, in source order.
+using Diagnostics = std::vector<std::string>;
+
+// Static type of an expr's value. Booleans are Integers, as in the
+//   interpreter. Other is a value the checks don't follow (a record, an
+//   array, a pointer, nil) or one of an expr with a problem, it goes
+//   with any type. Unknown is an expr that was not checked.
+enum class ExprType : uint8_t { Unknown, Integer, Char, String, Other };
+
+struct Analysis {
+  Diagnostics diagnostics;
+  // Type of each expr by id. Empty if there are diagnostics, or if a
+  //   shared expr (see flat_ast.hh) got different types in different
+  //   subprograms.
+  std::vector<ExprType> types;
+};
+
+// Checks that every name the program uses is declared and stands for
+//   what it is used as: a value, a type, a procedure or a function
+//   called with as many arguments as it has parameters. Works out the
+//   type of every expr and checks it against what it is used for:
+//   operands of arithmetic are Integers, conditions are Integers, both
+//   sides of an assignment or a relation are of one type, arguments are
+//   of their parameters' types. A program that passes needs no type
+//   tests when it runs.
+// The program's declarations are checked first. Bodies of its
+//   subprograms only read them, so each subprogram is then checked on
+//   its own, as are the program's statements, on thread_count threads
+//   (0 is one per core). Each check keeps its diagnostics, they are
+//   joined in the order of the checks at the end.
+Analysis check(const pas::flat::Tree &tree, unsigned thread_count = 0);
+
 } // namespace sema
 } // namespace pas
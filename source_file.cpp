@@ -0,0 +1,151 @@
+#include "source_file.hh"
+
+#include "exceptions.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceFile::SourceFile(SourceFile &&other) noexcept { *this = std::move(other); }
+
+SourceFile &SourceFile::operator=(SourceFile &&other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  close();
+
+  // Moving std::string may move its small buffer, data_ must follow it.
+  text_ = std::move(other.text_);
+  data_ = other.owns_text_ ? text_.data() : other.data_;
+  size_ = other.size_;
+  read_pos_ = other.read_pos_;
+  mapped_ = other.mapped_;
+  owns_text_ = other.owns_text_;
+  stdin_eof_ = other.stdin_eof_;
+
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.read_pos_ = 0;
+  other.mapped_ = false;
+  other.owns_text_ = false;
+  other.stdin_eof_ = false;
+  return *this;
+}
+
+SourceFile::~SourceFile() { close(); }
+
+void SourceFile::close() {
+  if (mapped_) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  read_pos_ = 0;
+  mapped_ = false;
+  owns_text_ = false;
+  stdin_eof_ = false;
+  text_.clear();
+}
+
+SourceFile SourceFile::open(const std::string &path) {
+  SourceFile source;
+
+  if (path.empty() || path == "-") {
+    source.owns_text_ = true;
+    while (source.read_stdin_chunk()) {
+    }
+    return source;
+  }
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw IOProblemException("can't open " + path + ": " +
+                             std::strerror(errno));
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    int error = errno;
+    ::close(fd);
+    throw IOProblemException("can't stat " + path + ": " +
+                             std::strerror(error));
+  }
+
+  source.size_ = static_cast<size_t>(file_stat.st_size);
+  if (source.size_ == 0) {
+    // Can't map zero bytes, but there is nothing to read anyway.
+    ::close(fd);
+    source.data_ = "";
+    return source;
+  }
+
+  void *addr = mmap(nullptr, source.size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  int error = errno;
+  // The mapping holds its own reference to the file.
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    throw IOProblemException("can't map " + path + ": " +
+                             std::strerror(error));
+  }
+  // The scanner goes through the file once, front to back.
+  madvise(addr, source.size_, MADV_SEQUENTIAL);
+
+  source.data_ = static_cast<const char *>(addr);
+  source.mapped_ = true;
+  return source;
+}
+
+SourceFile SourceFile::from_text(std::string text) {
+  SourceFile source;
+  source.owns_text_ = true;
+  source.stdin_eof_ = true;
+  source.text_ = std::move(text);
+  source.data_ = source.text_.data();
+  source.size_ = source.text_.size();
+  return source;
+}
+
+bool SourceFile::read_stdin_chunk() {
+  if (stdin_eof_) {
+    return false;
+  }
+
+  size_t old_size = text_.size();
+  text_.resize(old_size + STDIN_CHUNK_SIZE);
+
+  ssize_t bytes_read = 0;
+  do {
+    bytes_read =
+        ::read(STDIN_FILENO, text_.data() + old_size, STDIN_CHUNK_SIZE);
+  } while (bytes_read < 0 && errno == EINTR);
+
+  if (bytes_read < 0) {
+    int error = errno;
+    text_.resize(old_size);
+    throw IOProblemException(std::string("can't read stdin: ") +
+                             std::strerror(error));
+  }
+
+  text_.resize(old_size + static_cast<size_t>(bytes_read));
+  data_ = text_.data();
+  size_ = text_.size();
+
+  if (bytes_read == 0) {
+    stdin_eof_ = true;
+    return false;
+  }
+  return true;
+}
+
+size_t SourceFile::read(char *buf, size_t max_size) {
+  size_t count = std::min(max_size, size_ - read_pos_);
+  std::memcpy(buf, data_ + read_pos_, count);
+  read_pos_ += count;
+  return count;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+// Text of a source file the scanner reads from.
+//   A regular file is mapped read-only into memory, so there is no
+//   iostream buffering in between: the scanner copies bytes right from
+//   the page cache into its own buffer.
+//   Stdin ("-" or an empty name) may be a pipe and can't be mapped,
+//   it's read in chunks up front into one buffer. The preprocessor's
+//   output is a SourceFile too, holding the text it produced.
+// Either way the text stays at the same address until the SourceFile
+//   is destroyed, tokens and the AST keep views into it.
+class SourceFile {
+public:
+  SourceFile() = default;
+  SourceFile(SourceFile &&other) noexcept;
+  SourceFile &operator=(SourceFile &&other) noexcept;
+  ~SourceFile();
+
+  SourceFile(const SourceFile &other) = delete;
+  SourceFile &operator=(const SourceFile &other) = delete;
+
+public:
+  static SourceFile open(const std::string &path);
+  static SourceFile from_text(std::string text);
+
+  // Copies at most max_size next bytes of the file to buf.
+  //   Returns the number of bytes copied, 0 means end of file.
+  size_t read(char *buf, size_t max_size);
+  // Next read starts at pos.
+  void seek(size_t pos) { read_pos_ = std::min(pos, size_); }
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  void close();
+
+  // Reads one more chunk of stdin. Returns false at the end of input.
+  //   Invalidates data_, only called before scanning starts.
+  bool read_stdin_chunk();
+
+private:
+  static constexpr size_t STDIN_CHUNK_SIZE = 64 * 1024;
+
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  size_t read_pos_ = 0;
+
+  bool mapped_ = false;
+  // Read from stdin or made from text, data_ points inside text_.
+  bool owns_text_ = false;
+  bool stdin_eof_ = false;
+  std::string text_;
+};
@@ -0,0 +1,79 @@
+#include "source_location.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+std::ostream &operator<<(std::ostream &stream, SourceLoc loc) {
+  return stream << '@' << loc.offset;
+}
+
+namespace {
+
+// Mask with bit i set when byte i of the block at pos is a newline,
+//   same block sizes as in the hand-written lexer.
+#if defined(__AVX2__)
+constexpr size_t BLOCK_SIZE = 32;
+
+uint32_t newline_mask(const char *pos) {
+  __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos));
+  return static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'))));
+}
+#elif defined(__SSE2__)
+constexpr size_t BLOCK_SIZE = 16;
+
+uint32_t newline_mask(const char *pos) {
+  __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+  return static_cast<uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))));
+}
+#else
+constexpr size_t BLOCK_SIZE = 1;
+
+uint32_t newline_mask(const char *pos) { return *pos == '\n' ? 1 : 0; }
+#endif
+
+} // namespace
+
+void LineTable::build(std::string_view text) {
+  line_starts_.push_back(0);
+
+  const char *begin = text.data();
+  const char *pos = begin;
+  const char *end = begin + text.size();
+  // Blocks never cross the end, the text is not padded.
+  for (; static_cast<size_t>(end - pos) >= BLOCK_SIZE; pos += BLOCK_SIZE) {
+    for (uint32_t mask = newline_mask(pos); mask != 0; mask &= mask - 1) {
+      line_starts_.push_back(
+          static_cast<uint32_t>(pos - begin + std::countr_zero(mask) + 1));
+    }
+  }
+  for (; pos != end; ++pos) {
+    if (*pos == '\n') {
+      line_starts_.push_back(static_cast<uint32_t>(pos - begin + 1));
+    }
+  }
+}
+
+LineTable::Position LineTable::find(std::string_view text, SourceLoc loc) {
+  assert(loc.offset <= text.size());
+
+  if (line_starts_.empty()) {
+    build(text);
+  }
+
+  // The last line starting at or before the offset.
+  auto line = std::upper_bound(line_starts_.begin(), line_starts_.end(),
+                               loc.offset) -
+              1;
+  return Position{static_cast<uint32_t>(line - line_starts_.begin() + 1),
+                  loc.offset - *line + 1};
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// Location of a token or a grammar symbol: offset of its first byte in
+//   the source, so sources are limited to 4 GiB. It is the parser's
+//   location type, carried by every token and parser stack entry.
+//   Line and column are only found when a diagnostic is printed, see
+//   LineTable.
+struct SourceLoc {
+  uint32_t offset = 0;
+
+  bool operator==(const SourceLoc &other) const = default;
+};
+
+// Prints the bare offset, for traces. Diagnostics go through
+//   Driver::describe_location.
+std::ostream &operator<<(std::ostream &stream, SourceLoc loc);
+
+// A rule's location is its first symbol's, an empty rule takes the
+//   location of the symbol before it.
+#define YYLLOC_DEFAULT(Current, Rhs, N)                                        \
+  ((Current) = (N) ? YYRHSLOC(Rhs, 1) : YYRHSLOC(Rhs, 0))
+
+// Starts of lines of a source, to turn offsets into lines and columns.
+//   Built on the first lookup with one pass over the text, 16 or 32
+//   bytes at a time. A source without diagnostics never pays for it.
+class LineTable {
+public:
+  struct Position {
+    // Both start at 1, as in bison's locations. Columns are bytes.
+    uint32_t line;
+    uint32_t column;
+  };
+
+  // Forgets the lines, the next lookup is for another text.
+  void reset() { line_starts_.clear(); }
+
+  Position find(std::string_view text, SourceLoc loc);
+
+private:
+  void build(std::string_view text);
+
+private:
+  // Empty until built, then the first line starts at 0.
+  std::vector<uint32_t> line_starts_;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+// Bounded ring buffer between exactly one producer thread and one
+//   consumer thread. Slots are filled and read in place, an element
+//   is never copied on the way through.
+// Either side may close the ring: the producer when it's done (the
+//   consumer still drains what is published), the consumer when it
+//   doesn't need more (the producer stops at the next slot).
+template <typename T, size_t Capacity> class SpscRing {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "capacity must be a power of two");
+
+public:
+  SpscRing() = default;
+
+  SpscRing(const SpscRing &other) = delete;
+  SpscRing &operator=(const SpscRing &other) = delete;
+
+public:
+  // Producer side. A free slot to fill, waits while the ring is full.
+  //   Returns nullptr if the ring was closed.
+  T *AcquireSlot() {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    while (tail - head_.load(std::memory_order_acquire) == Capacity) {
+      if (closed_.load(std::memory_order_acquire)) {
+        return nullptr;
+      }
+      std::this_thread::yield();
+    }
+    if (closed_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &slots_[tail & (Capacity - 1)];
+  }
+
+  // Makes the slot returned by AcquireSlot visible to the consumer.
+  void Publish() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  // Consumer side. The oldest published slot, waits while the ring is
+  //   empty. Returns nullptr if the ring is empty and closed.
+  T *Front() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    while (tail_.load(std::memory_order_acquire) == head) {
+      if (closed_.load(std::memory_order_acquire)) {
+        // The producer may have published right before closing.
+        if (tail_.load(std::memory_order_acquire) != head) {
+          break;
+        }
+        return nullptr;
+      }
+      std::this_thread::yield();
+    }
+    return &slots_[head & (Capacity - 1)];
+  }
+
+  // Gives the slot returned by Front back to the producer.
+  void Pop() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  void Close() { closed_.store(true, std::memory_order_release); }
+
+  // Only while neither side is running.
+  void Reset() {
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+    closed_.store(false, std::memory_order_relaxed);
+  }
+
+private:
+  // Producer and consumer indices on separate cache lines, so that
+  //   the two cores don't fight over one line on every slot.
+  static constexpr size_t CACHE_LINE = 64;
+
+  alignas(CACHE_LINE) std::atomic<size_t> head_ = 0;
+  alignas(CACHE_LINE) std::atomic<size_t> tail_ = 0;
+  alignas(CACHE_LINE) std::atomic<bool> closed_ = false;
+  std::array<T, Capacity> slots_;
+};
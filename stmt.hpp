@@ -1,13 +1,13 @@
 #pragma once
 
+#include <ast_arena.hpp>
 #include <const_expr.hpp>
 #include <expr.hpp>
+#include <ident.hpp>
 #include <type.hpp>
 
 #include <optional>
-#include <string>
 #include <variant>
-#include <vector>
 
 namespace pas {
 namespace ast {
@@ -36,16 +36,16 @@ class MemoryStmt;
 class StmtSeq;
 class EmptyStmt;
 
-using AssignmentUP = std::unique_ptr<Assignment>;
-using ProcCallUP = std::unique_ptr<ProcCall>;
-using IfStmtUP = std::unique_ptr<IfStmt>;
-using CaseStmtUP = std::unique_ptr<CaseStmt>;
-using WhileStmtUP = std::unique_ptr<WhileStmt>;
-using RepeatStmtUP = std::unique_ptr<RepeatStmt>;
-using ForStmtUP = std::unique_ptr<ForStmt>;
-using MemoryStmtUP = std::unique_ptr<MemoryStmt>;
-using StmtSeqUP = std::unique_ptr<StmtSeq>;
-using EmptyStmtUP = std::unique_ptr<EmptyStmt>;
+using AssignmentUP = NodePtr<Assignment>;
+using ProcCallUP = NodePtr<ProcCall>;
+using IfStmtUP = NodePtr<IfStmt>;
+using CaseStmtUP = NodePtr<CaseStmt>;
+using WhileStmtUP = NodePtr<WhileStmt>;
+using RepeatStmtUP = NodePtr<RepeatStmt>;
+using ForStmtUP = NodePtr<ForStmt>;
+using MemoryStmtUP = NodePtr<MemoryStmt>;
+using StmtSeqUP = NodePtr<StmtSeq>;
+using EmptyStmtUP = NodePtr<EmptyStmt>;
 
 using Stmt =
     std::variant<AssignmentUP, ProcCallUP, IfStmtUP, CaseStmtUP, WhileStmtUP,
@@ -58,10 +58,10 @@ public:
   StmtSeq &operator=(StmtSeq &&other) = default;
 
 public:
-  StmtSeq(std::vector<Stmt> stmts) : stmts_(std::move(stmts)) {}
+  StmtSeq(List<Stmt> stmts) : stmts_(std::move(stmts)) {}
 
 public:
-  std::vector<Stmt> stmts_;
+  List<Stmt> stmts_;
 };
 
 class EmptyStmt {
@@ -96,11 +96,11 @@ public:
   Case &operator=(Case &&other) = default;
 
 public:
-  Case(std::vector<ConstExpr> labels, Stmt then_stmt)
+  Case(List<ConstExpr> labels, Stmt then_stmt)
       : labels_(std::move(labels)), then_stmt_(std::move(then_stmt)) {}
 
 public:
-  std::vector<ConstExpr> labels_;
+  List<ConstExpr> labels_;
   Stmt then_stmt_;
 };
 
@@ -111,12 +111,12 @@ public:
   CaseStmt &operator=(CaseStmt &&other) = default;
 
 public:
-  CaseStmt(Expr cond_expr, std::vector<Case> cases)
+  CaseStmt(Expr cond_expr, List<Case> cases)
       : cond_expr_(std::move(cond_expr)), cases_(std::move(cases)) {}
 
 public:
   Expr cond_expr_;
-  std::vector<Case> cases_;
+  List<Case> cases_;
 };
 
 class WhileStmt {
@@ -141,12 +141,12 @@ public:
   RepeatStmt &operator=(RepeatStmt &&other) = default;
 
 public:
-  RepeatStmt(std::vector<Stmt> inner_stmts, Expr cond_expr)
+  RepeatStmt(List<Stmt> inner_stmts, Expr cond_expr)
       : inner_stmts_(std::move(inner_stmts)), cond_expr_(std::move(cond_expr)) {
   }
 
 public:
-  std::vector<Stmt> inner_stmts_;
+  List<Stmt> inner_stmts_;
   Expr cond_expr_;
 };
 
@@ -159,14 +159,14 @@ public:
   ForStmt &operator=(ForStmt &&other) = default;
 
 public:
-  ForStmt(std::string ident, Expr start_val_expr, WhichWay dir,
+  ForStmt(Ident ident, Expr start_val_expr, WhichWay dir,
           Expr finish_val_expr, Stmt inner_stmt)
-      : ident_(std::move(ident)), start_val_expr_(std::move(start_val_expr)),
+      : ident_(ident), start_val_expr_(std::move(start_val_expr)), dir_(dir),
         finish_val_expr_(std::move(finish_val_expr)),
         inner_stmt_(std::move(inner_stmt)) {}
 
 public:
-  std::string ident_;
+  Ident ident_;
   Expr start_val_expr_;
   WhichWay dir_;
   Expr finish_val_expr_;
@@ -184,12 +184,12 @@ public:
 
   // New or Dispose, identifier of pointer typed variable
   //   allocating memory for.
-  MemoryStmt(Kind kind, std::string ident)
-      : kind_(std::move(kind)), ident_(std::move(ident)) {}
+  MemoryStmt(Kind kind, Ident ident)
+      : kind_(std::move(kind)), ident_(ident) {}
 
 public:
   Kind kind_;
-  std::string ident_;
+  Ident ident_;
 };
 
 class Assignment {
@@ -213,12 +213,12 @@ public:
   ProcCall &operator=(ProcCall &&other) = default;
 
 public:
-  ProcCall(std::string proc_ident, std::vector<Expr> params)
-      : proc_ident_(std::move(proc_ident)), params_(std::move(params)) {}
+  ProcCall(Ident proc_ident, List<Expr> params)
+      : proc_ident_(proc_ident), params_(std::move(params)) {}
 
 public:
-  std::string proc_ident_;
-  std::vector<Expr> params_;
+  Ident proc_ident_;
+  List<Expr> params_;
 };
 
 } // namespace ast
@@ -0,0 +1,113 @@
+#include "symbol_table.hh"
+
+#include "exceptions.hh"
+
+#include <cassert>
+#include <cstring>
+
+namespace pas {
+
+std::string_view Symbol::spelling() const {
+  return SymbolTable::global().spelling(*this);
+}
+
+std::ostream &operator<<(std::ostream &stream, Symbol symbol) {
+  return stream << symbol.spelling();
+}
+
+SymbolTable &SymbolTable::global() {
+  static SymbolTable table;
+  return table;
+}
+
+SymbolTable::SymbolTable()
+    : chunks_(std::make_unique<std::atomic<Entry *>[]>(MAX_CHUNKS)) {
+  // Id 0 is the empty spelling, that's what Symbol() refers to.
+  [[maybe_unused]] Symbol empty = intern(std::string_view());
+  assert(empty == Symbol());
+}
+
+SymbolTable::~SymbolTable() {
+  for (size_t i = 0; i < MAX_CHUNKS; ++i) {
+    delete[] chunks_[i].load(std::memory_order_relaxed);
+  }
+}
+
+const char *SymbolTable::Shard::store(std::string_view spelling) {
+  if (spelling.size() > ARENA_BLOCK_SIZE / 4) {
+    // Don't waste the rest of the current block on a huge identifier,
+    //   give it a block of its own, placed before the current one.
+    auto block = std::make_unique<char[]>(spelling.size());
+    char *data = block.get();
+    std::memcpy(data, spelling.data(), spelling.size());
+    arena.insert(arena.empty() ? arena.end() : arena.end() - 1,
+                 std::move(block));
+    return data;
+  }
+
+  if (spelling.empty()) {
+    return "";
+  }
+  if (arena.empty() || arena_free < spelling.size()) {
+    arena.push_back(std::make_unique<char[]>(ARENA_BLOCK_SIZE));
+    arena_free = ARENA_BLOCK_SIZE;
+  }
+  char *data = arena.back().get() + (ARENA_BLOCK_SIZE - arena_free);
+  std::memcpy(data, spelling.data(), spelling.size());
+  arena_free -= spelling.size();
+  return data;
+}
+
+SymbolTable::Entry *SymbolTable::chunk_for(uint32_t id) {
+  std::atomic<Entry *> &slot = chunks_[id / CHUNK_SIZE];
+  Entry *chunk = slot.load(std::memory_order_acquire);
+  if (chunk != nullptr) {
+    return chunk;
+  }
+
+  // Several shards may need the same new chunk at once, only one wins.
+  Entry *new_chunk = new Entry[CHUNK_SIZE];
+  if (slot.compare_exchange_strong(chunk, new_chunk,
+                                   std::memory_order_acq_rel)) {
+    return new_chunk;
+  }
+  delete[] new_chunk;
+  return chunk;
+}
+
+Symbol SymbolTable::intern(std::string_view spelling) {
+  size_t hash = std::hash<std::string_view>()(spelling);
+  Shard &shard = shards_[hash % SHARD_COUNT];
+
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto it = shard.ids.find(spelling);
+  if (it != shard.ids.end()) {
+    return Symbol(it->second);
+  }
+
+  uint32_t id = next_id_.fetch_add(1, std::memory_order_acq_rel);
+  if (id == UINT32_MAX) {
+    throw RuntimeProblemException("too many distinct identifiers");
+  }
+
+  const char *data = shard.store(spelling);
+  Entry &entry = chunk_for(id)[id % CHUNK_SIZE];
+  entry.data = data;
+  entry.size = static_cast<uint32_t>(spelling.size());
+
+  shard.ids.emplace(std::string_view(data, spelling.size()), id);
+  return Symbol(id);
+}
+
+std::string_view SymbolTable::spelling(Symbol symbol) const {
+  // A symbol is only obtained from intern(), which filled the entry
+  //   before returning it, and handing the symbol to another thread
+  //   already orders that write before our read.
+  const Entry *chunk =
+      chunks_[symbol.id() / CHUNK_SIZE].load(std::memory_order_acquire);
+  assert(chunk != nullptr);
+  const Entry &entry = chunk[symbol.id() % CHUNK_SIZE];
+  return std::string_view(entry.data, entry.size);
+}
+
+} // namespace pas
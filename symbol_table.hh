@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace pas {
+
+// Interned identifier spelling, a dense 32-bit id in the global
+//   SymbolTable. Comparing and hashing symbols is a single integer
+//   operation, the spelling is only looked up for printing.
+// Default constructed symbol is the empty spelling.
+class Symbol {
+public:
+  Symbol() = default;
+  explicit Symbol(uint32_t id) : id_(id) {}
+
+  uint32_t id() const { return id_; }
+  std::string_view spelling() const;
+
+  bool operator==(const Symbol &other) const = default;
+  auto operator<=>(const Symbol &other) const = default;
+
+private:
+  uint32_t id_ = 0;
+};
+
+std::ostream &operator<<(std::ostream &stream, Symbol symbol);
+
+// Maps each spelling to a dense id, shared by all drivers in the process.
+//   Interning locks one of SHARD_COUNT shards picked by the spelling hash,
+//   so drivers on different threads rarely wait for each other. Looking
+//   a spelling up by id takes no locks at all.
+class SymbolTable {
+public:
+  static SymbolTable &global();
+
+  SymbolTable();
+  ~SymbolTable();
+
+  SymbolTable(const SymbolTable &other) = delete;
+  SymbolTable &operator=(const SymbolTable &other) = delete;
+
+public:
+  Symbol intern(std::string_view spelling);
+  std::string_view spelling(Symbol symbol) const;
+
+  // Number of distinct spellings interned so far.
+  size_t size() const { return next_id_.load(std::memory_order_acquire); }
+
+private:
+  static constexpr size_t SHARD_COUNT = 64;
+  static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+  // Id -> spelling is a two-level table: a fixed array of lazily
+  //   allocated chunks. Chunks never move, so readers need no lock.
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+  static constexpr size_t MAX_CHUNKS = (size_t(1) << 32) / CHUNK_SIZE;
+
+  struct Entry {
+    const char *data = nullptr;
+    uint32_t size = 0;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    // Keys view spellings in the shard's arena.
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<std::unique_ptr<char[]>> arena;
+    size_t arena_free = 0;
+
+    const char *store(std::string_view spelling);
+  };
+
+  Entry *chunk_for(uint32_t id);
+
+private:
+  std::array<Shard, SHARD_COUNT> shards_;
+  std::unique_ptr<std::atomic<Entry *>[]> chunks_;
+  std::atomic<uint32_t> next_id_ = 0;
+};
+
+} // namespace pas
+
+template <> struct std::hash<pas::Symbol> {
+  size_t operator()(pas::Symbol symbol) const noexcept {
+    return std::hash<uint32_t>()(symbol.id());
+  }
+};
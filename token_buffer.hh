@@ -0,0 +1,120 @@
+#pragma once
+
+#include "parser.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A run of tokens as the lexer thread hands them over, see
+//   TokenPipeline. Same layout as TokenBuffer, but fixed size, so that
+//   it lives in a slot of a ring and is filled in place.
+struct TokenBatch {
+  static constexpr size_t CAPACITY = 512;
+
+  std::array<uint16_t, CAPACITY> kinds;
+  std::array<uint32_t, CAPACITY> offsets;
+  std::array<uint32_t, CAPACITY> lengths;
+  std::array<uint32_t, CAPACITY> payloads;
+  size_t size = 0;
+  // The final batch: ends with the end of file or lexing stopped
+  //   with an error.
+  bool last = false;
+};
+
+// Tokens of a whole source, structure of arrays: kind, offset in the
+//   source, length and payload are stored in parallel arrays, 14 bytes
+//   a token. Once lexed, the tokens can be walked again (reparse, a
+//   dependency scan) without lexing.
+// Payload is the symbol id for identifiers (never classified, that's
+//   up to the consumer) and the value for numbers and character
+//   constants. Other tokens have none, string literals are recovered
+//   from their text.
+class TokenBuffer {
+public:
+  using Kind = yy::parser::token::token_kind_type;
+
+  void clear() {
+    kinds_.clear();
+    offsets_.clear();
+    lengths_.clear();
+    payloads_.clear();
+  }
+
+  void append(const TokenBatch &batch) {
+    kinds_.insert(kinds_.end(), batch.kinds.begin(),
+                  batch.kinds.begin() + batch.size);
+    offsets_.insert(offsets_.end(), batch.offsets.begin(),
+                    batch.offsets.begin() + batch.size);
+    lengths_.insert(lengths_.end(), batch.lengths.begin(),
+                    batch.lengths.begin() + batch.size);
+    payloads_.insert(payloads_.end(), batch.payloads.begin(),
+                     batch.payloads.begin() + batch.size);
+  }
+
+  void push_back(Kind kind, uint32_t offset, uint32_t length,
+                 uint32_t payload) {
+    kinds_.push_back(static_cast<uint16_t>(kind));
+    offsets_.push_back(offset);
+    lengths_.push_back(length);
+    payloads_.push_back(payload);
+  }
+
+  void append(const TokenBuffer &other) {
+    kinds_.insert(kinds_.end(), other.kinds_.begin(), other.kinds_.end());
+    offsets_.insert(offsets_.end(), other.offsets_.begin(),
+                    other.offsets_.end());
+    lengths_.insert(lengths_.end(), other.lengths_.begin(),
+                    other.lengths_.end());
+    payloads_.insert(payloads_.end(), other.payloads_.begin(),
+                     other.payloads_.end());
+  }
+
+  // Replaces the tokens with count ones from parallel arrays, as a
+  //   precompiled header stores them.
+  void assign(const uint16_t *kinds, const uint32_t *offsets,
+              const uint32_t *lengths, const uint32_t *payloads,
+              size_t count) {
+    kinds_.assign(kinds, kinds + count);
+    offsets_.assign(offsets, offsets + count);
+    lengths_.assign(lengths, lengths + count);
+    payloads_.assign(payloads, payloads + count);
+  }
+
+  void set_payload(size_t index, uint32_t payload) {
+    payloads_[index] = payload;
+  }
+
+  size_t size() const { return kinds_.size(); }
+
+  Kind kind(size_t index) const { return static_cast<Kind>(kinds_[index]); }
+  uint32_t offset(size_t index) const { return offsets_[index]; }
+  uint32_t length(size_t index) const { return lengths_[index]; }
+  uint32_t payload(size_t index) const { return payloads_[index]; }
+
+  const uint16_t *kinds() const { return kinds_.data(); }
+  const uint32_t *offsets() const { return offsets_.data(); }
+  const uint32_t *lengths() const { return lengths_.data(); }
+  const uint32_t *payloads() const { return payloads_.data(); }
+
+  // Payload to store for a token produced by a scanner.
+  static uint32_t payload_of(Kind kind, const yy::parser::symbol_type &token) {
+    switch (kind) {
+    case yy::parser::token::TOK_identifier:
+      return token.value.as<pas::Symbol>().id();
+    case yy::parser::token::TOK_number:
+    case yy::parser::token::TOK_char_const:
+    case yy::parser::token::TOK_long_char_const:
+      return static_cast<uint32_t>(token.value.as<int>());
+    default:
+      return 0;
+    }
+  }
+
+private:
+  std::vector<uint16_t> kinds_;
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> lengths_;
+  std::vector<uint32_t> payloads_;
+};
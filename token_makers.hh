@@ -0,0 +1,31 @@
+#pragma once
+
+#include "parser.hh"
+
+#include <string>
+#include <string_view>
+
+// Tokens with a payload built from the matched text. Shared by the
+//   flex Scanner and the hand-written FastScanner, so both produce
+//   exactly the same symbols. Defined at the end of scanner.l.
+
+// A number symbol corresponding to the constant in S, suffix included.
+//   Decoded in place, throws if the value doesn't fit.
+yy::parser::symbol_type make_number(std::string_view s, int base,
+                                    const yy::parser::location_type &loc);
+
+// Character constants and string literals, STR is the whole literal with
+//   quotes (and L). Character constants carry their value, escapes
+//   decoded. String literals carry a view of the text between the
+//   quotes with escapes kept as is, LiteralPool decodes them through
+//   append_decoded.
+yy::parser::symbol_type make_char_const(std::string_view str,
+                                        const yy::parser::location_type &loc);
+yy::parser::symbol_type
+make_long_char_const(std::string_view str,
+                     const yy::parser::location_type &loc);
+yy::parser::symbol_type make_str_literal(std::string_view str,
+                                         const yy::parser::location_type &loc);
+yy::parser::symbol_type
+make_long_str_literal(std::string_view str,
+                      const yy::parser::location_type &loc);
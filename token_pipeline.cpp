@@ -0,0 +1,88 @@
+#include "token_pipeline.hh"
+#include "driver.hh"
+
+#include <cassert>
+#include <cstdint>
+
+TokenPipeline::TokenPipeline(Driver &driver)
+    : driver(driver), reader_(driver, driver.tokens) {}
+
+void TokenPipeline::Start() {
+  Stop();
+
+  driver.tokens.clear();
+  reader_.Reset();
+  drained_ = false;
+  error_ = nullptr;
+
+  thread_ = std::thread(&TokenPipeline::Produce, this);
+}
+
+void TokenPipeline::Stop() {
+  ring_.Close();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  ring_.Reset();
+}
+
+void TokenPipeline::Produce() {
+  using Token = yy::parser::token;
+  FastScanner &scanner = driver.fast_scanner;
+
+  while (true) {
+    TokenBatch *batch = ring_.AcquireSlot();
+    if (batch == nullptr) {
+      // The consumer doesn't need more tokens.
+      return;
+    }
+
+    batch->size = 0;
+    batch->last = false;
+    while (batch->size < TokenBatch::CAPACITY && !batch->last) {
+      try {
+        yy::parser::symbol_type token = scanner.ScanToken();
+        const size_t index = batch->size++;
+        const Token::token_kind_type kind = scanner.TokenKind();
+
+        batch->kinds[index] = static_cast<uint16_t>(kind);
+        batch->offsets[index] = static_cast<uint32_t>(scanner.TokenOffset());
+        batch->lengths[index] = static_cast<uint32_t>(scanner.TokenLength());
+        batch->payloads[index] = TokenBuffer::payload_of(kind, token);
+
+        batch->last = kind == Token::TOK_EOF;
+      } catch (...) {
+        error_ = std::current_exception();
+        batch->last = true;
+      }
+    }
+
+    const bool last = batch->last;
+    ring_.Publish();
+    if (last) {
+      return;
+    }
+  }
+}
+
+yy::parser::symbol_type TokenPipeline::NextToken() {
+  while (reader_.AtEnd()) {
+    if (drained_) {
+      if (error_ != nullptr) {
+        std::rethrow_exception(error_);
+      }
+      // The parser asked again after the end of file.
+      return yy::parser::make_EOF(reader_.EndLocation());
+    }
+
+    TokenBatch *batch = ring_.Front();
+    // The lexer thread always publishes a last batch, the ring is
+    //   only closed by us.
+    assert(batch != nullptr);
+    driver.tokens.append(*batch);
+    drained_ = batch->last;
+    ring_.Pop();
+  }
+
+  return reader_.Next();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "parser.hh"
+#include "spsc_ring.hh"
+#include "token_buffer.hh"
+#include "token_reader.hh"
+
+#include <cstddef>
+#include <exception>
+#include <thread>
+
+class Driver;
+
+// Lexes on its own thread while the parser consumes. The lexer thread
+//   runs the driver's FastScanner in raw mode and hands tokens over in
+//   batches through a bounded ring; the consumer appends every batch
+//   to the driver's TokenBuffer and builds parser symbols from it.
+// Identifiers are classified by the consumer, when the parser asks
+//   for the token: only then the declarations before it are known.
+class TokenPipeline {
+public:
+  TokenPipeline(Driver &driver);
+  ~TokenPipeline() { Stop(); }
+
+  TokenPipeline(const TokenPipeline &other) = delete;
+  TokenPipeline &operator=(const TokenPipeline &other) = delete;
+
+public:
+  // Starts lexing the driver's source from the beginning. The driver's
+  //   FastScanner belongs to the lexer thread until Stop.
+  void Start();
+
+  // Stops the lexer thread, if it is still running. Tokens lexed so
+  //   far stay in the driver's TokenBuffer.
+  void Stop();
+
+  // Next token for the parser. Errors of the lexer are rethrown here,
+  //   after all tokens before them are handed out.
+  yy::parser::symbol_type NextToken();
+
+  Driver &driver;
+
+private:
+  void Produce();
+
+private:
+  static constexpr size_t RING_SIZE = 16;
+
+  SpscRing<TokenBatch, RING_SIZE> ring_;
+  std::thread thread_;
+  // Set by the lexer thread before it publishes the last batch.
+  std::exception_ptr error_;
+
+  TokenReader reader_;
+  bool drained_ = false;
+};
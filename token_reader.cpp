@@ -0,0 +1,45 @@
+#include "token_reader.hh"
+#include "driver.hh"
+#include "token_makers.hh"
+
+#include <cstdint>
+#include <string_view>
+
+void TokenReader::Reset() { next_ = 0; }
+
+bool TokenReader::AtEnd() const { return next_ == tokens_.size(); }
+
+SourceLoc TokenReader::EndLocation() const {
+  return SourceLoc{static_cast<uint32_t>(driver.source_.size())};
+}
+
+yy::parser::symbol_type TokenReader::Next() {
+  using Token = yy::parser::token;
+  const TokenBuffer &tokens = tokens_;
+  const size_t index = next_++;
+
+  const SourceLoc loc{tokens.offset(index)};
+  const std::string_view text(driver.source_.data() + tokens.offset(index),
+                              tokens.length(index));
+  switch (const Token::token_kind_type kind = tokens.kind(index)) {
+  case Token::TOK_EOF:
+    return yy::parser::make_EOF(loc);
+  case Token::TOK_identifier:
+    return driver.classify_identifier(pas::Symbol(tokens.payload(index)), loc);
+  case Token::TOK_number:
+    return yy::parser::make_number(static_cast<int>(tokens.payload(index)),
+                                   loc);
+  case Token::TOK_string:
+    return make_str_literal(text, loc);
+  case Token::TOK_long_string:
+    return make_long_str_literal(text, loc);
+  case Token::TOK_char_const:
+    return yy::parser::make_char_const(static_cast<int>(tokens.payload(index)),
+                                       loc);
+  case Token::TOK_long_char_const:
+    return yy::parser::make_long_char_const(
+        static_cast<int>(tokens.payload(index)), loc);
+  default:
+    return yy::parser::symbol_type(kind, loc);
+  }
+}
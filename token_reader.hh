@@ -0,0 +1,34 @@
+#pragma once
+
+#include "parser.hh"
+#include "token_buffer.hh"
+
+#include <cstddef>
+
+class Driver;
+
+// Hands out a TokenBuffer of the driver's source to the parser as
+//   symbols, in order. Identifiers are classified as they are read, a
+//   token's location is its offset.
+class TokenReader {
+public:
+  TokenReader(Driver &driver, const TokenBuffer &tokens)
+      : driver(driver), tokens_(tokens) {}
+
+  // Back to the first token.
+  void Reset();
+
+  // All tokens appended to the buffer so far are read.
+  bool AtEnd() const;
+
+  yy::parser::symbol_type Next();
+
+  // Location of the end of the source, where the end of file is.
+  SourceLoc EndLocation() const;
+
+  Driver &driver;
+
+private:
+  const TokenBuffer &tokens_;
+  size_t next_ = 0;
+};
@@ -1,11 +1,10 @@
 #pragma once
 
+#include <ast_arena.hpp>
 #include <const_expr.hpp>
+#include <ident.hpp>
 
-#include <memory>
-#include <string>
 #include <variant>
-#include <vector>
 
 namespace pas {
 namespace ast {
@@ -16,11 +15,11 @@ class PointerType;
 class RecordType;
 class NamedType;
 
-using SetTypeUP = std::unique_ptr<SetType>;
-using ArrayTypeUP = std::unique_ptr<ArrayType>;
-using PointerTypeUP = std::unique_ptr<PointerType>;
-using RecordTypeUP = std::unique_ptr<RecordType>;
-using NamedTypeUP = std::unique_ptr<NamedType>;
+using SetTypeUP = NodePtr<SetType>;
+using ArrayTypeUP = NodePtr<ArrayType>;
+using PointerTypeUP = NodePtr<PointerType>;
+using RecordTypeUP = NodePtr<RecordType>;
+using NamedTypeUP = NodePtr<NamedType>;
 
 enum class TypeKind { Set = 0, Array = 1, Pointer = 2, Record = 3, Named = 4 };
 using Type = std::variant<SetTypeUP, ArrayTypeUP, PointerTypeUP, RecordTypeUP,
@@ -61,12 +60,12 @@ public:
   ArrayType &operator=(ArrayType &&other) = default;
 
 public:
-  ArrayType(std::vector<Subrange> subrange_list, Type item_type)
+  ArrayType(List<Subrange> subrange_list, Type item_type)
       : subrange_list_(std::move(subrange_list)),
         item_type_(std::move(item_type)) {}
 
 public:
-  std::vector<Subrange> subrange_list_;
+  List<Subrange> subrange_list_;
   Type item_type_;
 };
 
@@ -77,11 +76,11 @@ public:
   PointerType &operator=(PointerType &&other) = default;
 
 public:
-  PointerType(std::string ref_type_name)
-      : ref_type_name_(std::move(ref_type_name)) {}
+  PointerType(Ident ref_type_name)
+      : ref_type_name_(ref_type_name) {}
 
 public:
-  std::string ref_type_name_;
+  Ident ref_type_name_;
 };
 
 class FieldList {
@@ -91,11 +90,11 @@ public:
   FieldList &operator=(FieldList &&other) = default;
 
 public:
-  FieldList(std::vector<std::string> idents, Type type)
+  FieldList(List<Ident> idents, Type type)
       : idents_(std::move(idents)), type_(std::move(type)) {}
 
 public:
-  std::vector<std::string> idents_;
+  List<Ident> idents_;
   Type type_;
 };
 
@@ -106,10 +105,10 @@ public:
   RecordType &operator=(RecordType &&other) = default;
 
 public:
-  RecordType(std::vector<FieldList> field) : fields_(std::move(field)) {}
+  RecordType(List<FieldList> field) : fields_(std::move(field)) {}
 
 public:
-  std::vector<FieldList> fields_;
+  List<FieldList> fields_;
 };
 
 // An already defined type, which is referenced
@@ -121,10 +120,10 @@ public:
   NamedType &operator=(NamedType &&other) = default;
 
 public:
-  NamedType(std::string type_name) : type_name_(std::move(type_name)) {}
+  NamedType(Ident type_name) : type_name_(type_name) {}
 
 public:
-  std::string type_name_;
+  Ident type_name_;
 };
 
 } // namespace ast
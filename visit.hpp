@@ -5,6 +5,7 @@
 #include <get_idx.hpp>
 
 #include <cassert>
+#include <iostream>
 
 namespace pas {
 namespace ast {
@@ -1,474 +1,21 @@
 #pragma once
 
 #include <ast.hpp>
+#include <flat_ast.hh>
+#include <flat_walk.hh>
 #include <get_idx.hpp>
-#include <visit.hpp>
-#include <exceptions.hpp>
+#include <exceptions.hh>
+#include <sema.hpp>
 
 #include <iostream>
 #include <limits>
+#include <optional>
+#include <span>
 #include <unordered_map>
 
 namespace pas {
 namespace visitor {
 
-class Printer {
-public:
-  Printer(std::ostream &stream) : stream_(stream) {}
-
-private:
-  MAKE_VISIT_STMT_FRIEND();
-
-  void print_indent() {
-    for (size_t i = 0; i < depth_; ++i) {
-      stream_ << ' ';
-    }
-  }
-
-  void visit(pas::ast::ProgramModule &pm) {
-    print_indent();
-    stream_ << "ProgramModule name=" << pm.program_name_ << '\n';
-    depth_ += 1;
-    visit(pm.block_);
-    depth_ -= 1;
-  }
-  void visit(pas::ast::Block &block) {
-    print_indent();
-    stream_ << "Block" << '\n';
-    depth_ += 1;
-    assert(block.decls_.get() != nullptr);
-    visit(*block.decls_.get());
-    for (auto &stmt : block.stmt_seq_) {
-      visit_stmt(*this, stmt);
-    }
-    depth_ -= 1;
-  }
-  void visit(pas::ast::Declarations &decls) {
-    print_indent();
-    stream_ << "Declarations" << '\n';
-    depth_ += 1;
-    for (auto &const_def : decls.const_defs_) {
-      visit(const_def);
-    }
-    for (auto &type_def : decls.type_defs_) {
-      visit(type_def);
-    }
-    for (auto &var_decl : decls.var_decls_) {
-      visit(var_decl);
-    }
-    for (auto &subprog_decl : decls.subprog_decls_) {
-      visit(subprog_decl);
-    }
-    depth_ -= 1;
-  }
-  void visit(pas::ast::ConstDef &const_def) {
-    print_indent();
-    stream_ << "ConstDef name=" << const_def.ident_ << '\n';
-    depth_ += 1;
-    visit(const_def.const_expr_);
-    depth_ -= 1;
-  }
-  void visit(pas::ast::TypeDef &type_def) {
-    print_indent();
-    stream_ << "TypeDef name=" << type_def.ident_ << '\n';
-    depth_ += 1;
-    visit(type_def.type_);
-    depth_ -= 1;
-  }
-  void visit(pas::ast::VarDecl &var_decl) {
-    print_indent();
-    stream_ << "VarDecl names=";
-    bool first = true;
-    for (auto &name : var_decl.ident_list_) {
-      if (!first) {
-        stream_ << ',';
-      }
-      stream_ << name;
-      first = false;
-    }
-    stream_ << '\n';
-    depth_ += 1;
-    visit(var_decl.type_);
-    depth_ -= 1;
-  }
-  void visit(pas::ast::ConstExpr &const_expr) {
-    print_indent();
-    stream_ << "ConstExpr";
-    depth_ += 1;
-    if (const_expr.unary_op_.has_value()) {
-        switch (const_expr.unary_op_.value()) {
-        case pas::ast::UnaryOp::Plus: {
-          stream_ << " unary_op=plus";
-          break;
-        }
-        case pas::ast::UnaryOp::Minus: {
-          stream_ << " unary_op=minus";
-          break;
-        }
-        default:
-          assert(false);
-          __builtin_unreachable();
-        }
-      }
-    stream_ << '\n';
-    visit(const_expr.factor_);
-    depth_ -= 1;
-  }
-  void visit(pas::ast::ConstFactor &const_factor) {
-    print_indent();
-    stream_ << "ConstFactor ";
-    switch (const_factor.index()) {
-    case get_idx(pas::ast::ConstFactorKind::Identifier): {
-      stream_ << "identifier " << std::get<std::string>(const_factor) << '\n';
-      break;
-    }
-    case get_idx(pas::ast::ConstFactorKind::Number): {
-      stream_ << "number " << std::get<int>(const_factor) << '\n';
-      break;
-    }
-    case get_idx(pas::ast::ConstFactorKind::Bool): {
-      stream_ << "bool " << (std::get<bool>(const_factor) ? "true" : "false")
-              << '\n';
-      break;
-    }
-    case get_idx(pas::ast::ConstFactorKind::Nil): {
-      stream_ << "nil" << '\n';
-      break;
-    }
-    default:
-      assert(false);
-      __builtin_unreachable();
-    }
-  }
-  void visit(pas::ast::Type &node) {}
-  void visit(pas::ast::ArrayType &node) {}
-  void visit(pas::ast::Subrange &node) {}
-  void visit(pas::ast::RecordType &node) {}
-  void visit(pas::ast::SetType &node) {}
-  void visit(pas::ast::PointerType &node) {}
-  void visit(pas::ast::FieldList &node) {}
-  void visit(pas::ast::Assignment &assignment) {
-    print_indent();
-    stream_ << "Assignment" << '\n';
-    depth_ += 1;
-    visit(assignment.designator_);
-    visit(assignment.expr_);
-    depth_ -= 1;
-  }
-  void visit(pas::ast::ProcCall &proc_call) {
-    print_indent();
-    stream_ << "ProcCall name=" << proc_call.proc_ident_ << '\n';
-    depth_ += 1;
-    for (pas::ast::Expr &expr : proc_call.params_) {
-      visit(expr);
-    }
-    depth_ -= 1;
-  }
-  void visit(pas::ast::IfStmt &if_stmt) {
-    print_indent();
-    stream_ << "IfStmt" << '\n';
-    depth_ += 1;
-    visit(if_stmt.cond_expr_);
-    visit_stmt(*this, if_stmt.then_stmt_);
-    if (if_stmt.else_stmt_.has_value()) {
-      visit_stmt(*this, if_stmt.else_stmt_.value());
-    }
-    depth_ -= 1;
-  }
-  void visit(pas::ast::CaseStmt &node) {}
-  void visit(pas::ast::Case &node) {}
-  void visit(pas::ast::WhileStmt &while_stmt) {
-    print_indent();
-    stream_ << "WhileStmt" << '\n';
-    depth_ += 1;
-    visit(while_stmt.cond_expr_);
-    visit_stmt(*this, while_stmt.inner_stmt_);
-    depth_ -= 1;
-  }
-  void visit(pas::ast::RepeatStmt &node) {}
-  void visit(pas::ast::ForStmt &for_stmt) {
-    print_indent();
-    stream_ << "ForStmt ident=" << for_stmt.ident_ << " ";
-    switch (for_stmt.dir_) {
-    case pas::ast::WhichWay::To: {
-      stream_ << "dir=To";
-      break;
-    }
-    case pas::ast::WhichWay::DownTo: {
-      stream_ << "dir=DownTo";
-      break;
-    }
-    default:
-      assert(false);
-      __builtin_unreachable();
-    }
-    stream_ << '\n';
-
-    depth_ += 1;
-    visit(for_stmt.start_val_expr_);
-    visit(for_stmt.finish_val_expr_);
-    visit_stmt(*this, for_stmt.inner_stmt_);
-    depth_ -= 1;
-  }
-  void visit(pas::ast::Designator &designator) {
-    print_indent();
-    stream_ << "Designator ident=" << designator.ident_ << '\n';
-    depth_ += 1;
-    for (pas::ast::DesignatorItem &item : designator.items_) {
-      visit(item);
-    }
-    depth_ -= 1;
-  }
-  void visit(pas::ast::DesignatorItem &designator_item) {
-    switch (designator_item.index()) {
-    case get_idx(pas::ast::DesignatorItemKind::ArrayAccess): {
-      visit(std::get<pas::ast::DesignatorArrayAccess>(designator_item));
-      break;
-    }
-    case get_idx(pas::ast::DesignatorItemKind::FieldAccess): {
-      visit(std::get<pas::ast::DesignatorFieldAccess>(designator_item));
-      break;
-    }
-    case get_idx(pas::ast::DesignatorItemKind::PointerAccess): {
-      visit(std::get<pas::ast::DesignatorPointerAccess>(designator_item));
-      break;
-    }
-    }
-  }
-  void visit(pas::ast::DesignatorArrayAccess &array_access) {
-    print_indent();
-    stream_ << "DesignatorArrayAccess" << '\n';
-    depth_ += 1;
-    for (std::unique_ptr<pas::ast::Expr> &expr_ptr : array_access.expr_list_) {
-      visit(*expr_ptr);
-    }
-    depth_ -= 1;
-  }
-  void visit(pas::ast::DesignatorFieldAccess &field_access) {}
-  void visit(pas::ast::DesignatorPointerAccess &pointer_access) {}
-  void visit(pas::ast::MemoryStmt &node) {}
-  void visit(pas::ast::EmptyStmt &empty_stmt) {}
-  void visit(pas::ast::Expr &expr) {
-    if (!expr.op_.has_value()) {
-      visit(expr.start_expr_);
-    } else {
-      print_indent();
-      stream_ << "Expr op=";
-      switch (expr.op_.value().rel) {
-      case pas::ast::RelOp::Equal: {
-        stream_ << "equal";
-        break;
-      }
-      case pas::ast::RelOp::Greater: {
-        stream_ << "greater";
-        break;
-      }
-      case pas::ast::RelOp::GreaterEqual: {
-        stream_ << "greater_equal";
-        break;
-      }
-      case pas::ast::RelOp::In: {
-        stream_ << "in";
-        break;
-      }
-      case pas::ast::RelOp::Less: {
-        stream_ << "less";
-        break;
-      }
-      case pas::ast::RelOp::LessEqual: {
-        stream_ << "less_equal";
-        break;
-      }
-      case pas::ast::RelOp::NotEqual: {
-        stream_ << "not_equal";
-        break;
-      }
-      default:
-        assert(false);
-        __builtin_unreachable();
-      }
-
-      stream_ << '\n';
-      depth_ += 1;
-      visit(expr.start_expr_);
-      visit(expr.op_.value().expr);
-      depth_ -= 1;
-    }
-  }
-  void visit(pas::ast::SimpleExpr &simple_expr) {
-    if (simple_expr.ops_.empty() && !simple_expr.unary_op_.has_value()) {
-      visit(simple_expr.start_term_);
-    } else {
-      print_indent();
-      stream_ << "SimpleExpr";
-      if (simple_expr.unary_op_.has_value()) {
-        stream_ << " ";
-        switch (simple_expr.unary_op_.value()) {
-        case pas::ast::UnaryOp::Plus: {
-          stream_ << "unary_op=plus";
-          break;
-        }
-        case pas::ast::UnaryOp::Minus: {
-          stream_ << "unary_op=minus";
-          break;
-        }
-        default:
-          assert(false);
-          __builtin_unreachable();
-        }
-      }
-      stream_ << '\n';
-
-      depth_ += 1;
-      visit(simple_expr.start_term_);
-      for (pas::ast::SimpleExpr::Op &op : simple_expr.ops_) {
-        switch (op.op) {
-        case pas::ast::AddOp::Minus: {
-          print_indent();
-          stream_ << "Minus" << '\n';
-          break;
-        }
-        case pas::ast::AddOp::Plus: {
-          print_indent();
-          stream_ << "Plus" << '\n';
-          break;
-        }
-        case pas::ast::AddOp::Or: {
-          print_indent();
-          stream_ << "Or" << '\n';
-          break;
-        }
-        default:
-          assert(false);
-          __builtin_unreachable();
-        }
-
-        visit(op.term);
-      }
-      depth_ -= 1;
-    }
-  }
-  void visit(pas::ast::Term &term) {
-    if (term.ops_.empty()) {
-      visit(term.start_factor_);
-    } else {
-      print_indent();
-      stream_ << "Term" << '\n';
-      depth_ += 1;
-      visit(term.start_factor_);
-      for (pas::ast::Term::Op &op : term.ops_) {
-        switch (op.op) {
-        case pas::ast::MultOp::And: {
-          print_indent();
-          stream_ << "And" << '\n';
-          break;
-        }
-        case pas::ast::MultOp::IntDiv: {
-          print_indent();
-          stream_ << "IntDiv" << '\n';
-          break;
-        }
-        case pas::ast::MultOp::Modulo: {
-          print_indent();
-          stream_ << "Modulo" << '\n';
-          break;
-        }
-        case pas::ast::MultOp::Multiply: {
-          print_indent();
-          stream_ << "Multiply" << '\n';
-          break;
-        }
-        case pas::ast::MultOp::RealDiv: {
-          print_indent();
-          stream_ << "RealDiv" << '\n';
-          break;
-        }
-        default:
-          assert(false);
-          __builtin_unreachable();
-        }
-        visit(op.factor);
-        depth_ -= 1;
-      }
-    }
-  }
-  void visit(pas::ast::Factor &factor) {
-      switch (factor.index()) {
-      case get_idx(pas::ast::FactorKind::Bool): {
-          print_indent();
-          bool value = std::get<bool>(factor);
-          stream_ << "Factor Bool" << (value ? "true" : "false") << '\n';
-          break;
-      }
-      case get_idx(pas::ast::FactorKind::Designator): {
-          visit(std::get<pas::ast::Designator>(factor));
-          break;
-      }
-      case get_idx(pas::ast::FactorKind::Expr): {
-          visit(*std::get<pas::ast::ExprUP>(factor));
-          break;
-      }
-      case get_idx(pas::ast::FactorKind::Negation): {
-          print_indent();
-          stream_ << "Factor Not" << '\n';
-          visit(std::get<pas::ast::NegationUP>(factor)->factor_);
-          break;
-      }
-      case get_idx(pas::ast::FactorKind::Nil): {
-          print_indent();
-          stream_ << "Factor Nil" << '\n';
-          break;
-      }
-      case get_idx(pas::ast::FactorKind::Number): {
-          print_indent();
-          stream_ << "Factor number=" << std::get<int>(factor) << '\n';
-          break;
-      }
-      case get_idx(pas::ast::FactorKind::String): {
-          print_indent();
-          stream_ << "Factor string=\"" << std::get<std::string>(factor) << "\"" << '\n';
-          break;
-      }
-      case get_idx(pas::ast::FactorKind::FuncCall): {
-          visit(*std::get<pas::ast::FuncCallUP>(factor));
-          break;
-      }
-      default: assert(false); __builtin_unreachable();
-      }
-  }
-  void visit(pas::ast::FuncCall &func_call) {
-      print_indent();
-      stream_ << "FuncCall ident=" << func_call.func_ident_ << '\n';
-      depth_ += 1;
-      for (pas::ast::Expr& expr: func_call.params_) {
-          visit(expr);
-      }
-      depth_ -= 1;
-  }
-  void visit(pas::ast::Element &node) {}
-  void visit(pas::ast::SubprogDecl &node) {}
-  void visit(pas::ast::ProcDecl &node) {}
-  void visit(pas::ast::FuncDecl &node) {}
-  void visit(pas::ast::ProcHeading &node) {}
-  void visit(pas::ast::FormalParam &node) {}
-  void visit(pas::ast::StmtSeq &stmt_seq) {
-    print_indent();
-    stream_ << "StmtSeq" << '\n';
-    depth_ += 1;
-    for (pas::ast::Stmt &stmt : stmt_seq.stmts_) {
-      visit_stmt(*this, stmt);
-    }
-    depth_ -= 1;
-  }
-
-public:
-  void visit(pas::ast::CompilationUnit &cu) { visit(cu.pm_); }
-
-private:
-  std::ostream &stream_;
-  size_t depth_ = 0;
-};
-
 // https://stackoverflow.com/a/25066044
 //   Won't work if I have any other functions
 //   with name "visit" in child class.
@@ -483,47 +30,77 @@ private:
 // #undef FOR_EACH_STMT
 //};
 
+// Given the types of a program that passed the checks (sema.hpp),
+//   Integer exprs leave their values on ints_, not on values_, and
+//   operators work on them without looking at a variant: the checks
+//   proved what they are. Without them every operation tests its
+//   operands' types.
 class Interpreter /* : public NotImplementedVisitor */ {
 public:
-  Interpreter() {
+  Interpreter(const pas::flat::Tree &tree, const pas::LiteralPool &literals,
+              std::span<const pas::sema::ExprType> types = {})
+      : tree_(tree), literals_(literals), types_(types),
+        walker_(tree, *this) {
+    pas::SymbolTable &symbols = pas::SymbolTable::global();
+
     // Add unique original names for basic types.
-    ident_to_item_["Integer"] =
+    ident_to_item_[symbols.intern("Integer")] =
         std::make_shared<Type>(std::in_place_index<get_idx(TypeKind::Integer)>);
-    ident_to_item_["Char"] =
+    ident_to_item_[symbols.intern("Char")] =
         std::make_shared<Type>(std::in_place_index<get_idx(TypeKind::Char)>);
-    ident_to_item_["String"] =
+    ident_to_item_[symbols.intern("String")] =
         std::make_shared<Type>(std::in_place_index<get_idx(TypeKind::String)>);
-  }
-
-  void interpret(pas::ast::CompilationUnit &cu) { interpret(cu.pm_); }
-
-private:
-  MAKE_VISIT_STMT_FRIEND();
-
-  void interpret(pas::ast::ProgramModule &pm) { interpret(pm.block_); }
 
-  void interpret(pas::ast::Block &block) {
-    // Decl field should always be there, it can just have
-    //   no actual decls inside.
-    assert(block.decls_.get() != nullptr);
-    process_decls(*block.decls_);
-    for (pas::ast::Stmt &stmt : block.stmt_seq_) {
-      visit_stmt(*this, stmt);
+    // Built-in subprograms are looked up by symbol, not by comparing
+    //   the name against each of them.
+    builtin_funcs_[symbols.intern("read_char")] = &Interpreter::eval_read_char;
+    builtin_funcs_[symbols.intern("read_str")] = &Interpreter::eval_read_str;
+    builtin_funcs_[symbols.intern("read_int")] = &Interpreter::eval_read_int;
+    builtin_funcs_[symbols.intern("strlen")] = &Interpreter::eval_strlen;
+    builtin_funcs_[symbols.intern("ord")] = &Interpreter::eval_ord;
+    builtin_funcs_[symbols.intern("chr")] = &Interpreter::eval_chr;
+
+    builtin_procs_[symbols.intern("write_char")] =
+        &Interpreter::visit_write_char;
+    builtin_procs_[symbols.intern("write_str")] = &Interpreter::visit_write_str;
+    builtin_procs_[symbols.intern("write_int")] = &Interpreter::visit_write_int;
+    builtin_procs_[symbols.intern("append")] = &Interpreter::visit_append;
+    builtin_procs_[symbols.intern("drop")] = &Interpreter::visit_drop;
+
+    if (tree_.shares_exprs()) {
+      constant_values_.resize(tree_.expr_count());
     }
   }
 
-  void process_decls(pas::ast::Declarations &decls) {
-    if (!decls.subprog_decls_.empty()) {
+  void interpret() { walker_.walk(NodeClass::Block, tree_.program_block()); }
+
+private:
+  friend class pas::flat::Walker<Interpreter>;
+
+  using NodeId = pas::flat::NodeId;
+  using NodeClass = pas::flat::NodeClass;
+  using ExprKind = pas::flat::ExprKind;
+  using StmtKind = pas::flat::StmtKind;
+  using DeclKind = pas::flat::DeclKind;
+  template <auto Kind> using Tag = pas::flat::Tag<Kind>;
+
+  void process_decls(pas::flat::Range decls) {
+    // Constants come first, subprograms last.
+    std::span<const uint32_t> ids = tree_.list(decls);
+    if (!ids.empty() && (tree_.decl(ids.back()).kind == DeclKind::Proc ||
+                         tree_.decl(ids.back()).kind == DeclKind::Func)) {
       throw NotImplementedException("function decls are not implemented yet");
     }
-    if (!decls.const_defs_.empty()) {
+    if (!ids.empty() && tree_.decl(ids.front()).kind == DeclKind::Const) {
       throw NotImplementedException("const defs are not implemented yet");
     }
-    for (auto &type_def : decls.type_defs_) {
-      process_type_def(type_def);
-    }
-    for (auto &var_decl : decls.var_decls_) {
-      process_var_decl(var_decl);
+    for (NodeId id : ids) {
+      const pas::flat::Decl &decl = tree_.decl(id);
+      if (decl.kind == DeclKind::Type) {
+        process_type_def(decl);
+      } else if (decl.kind == DeclKind::Var) {
+        process_var_decl(decl);
+      }
     }
   }
 
@@ -580,338 +157,508 @@ private:
   //    };
 
 private:
-  Value eval(pas::ast::Factor &factor) {
-    switch (factor.index()) {
-    case get_idx(pas::ast::FactorKind::Bool): {
-      // No dedicated bool type for now for simplicity
-      //   (I don't have much time, too many things to do).
-      return Value(static_cast<int>(std::get<bool>(factor)));
+  // Expressions are evaluated by a walk: each node's hooks leave its
+  //   value on values_, operators take their operands' values from it.
+  Value eval(NodeId id) {
+    walker_.walk(NodeClass::Expr, id);
+    if (integer(id)) {
+      return Value(std::in_place_type<int>, pop_int());
+    }
+    Value value = std::move(values_.back());
+    values_.pop_back();
+    return value;
+  }
+
+  // Value of an Integer expr, message is thrown if it's not one.
+  int eval_int(NodeId id, const char *message) {
+    if (integer(id)) {
+      walker_.walk(NodeClass::Expr, id);
+      return pop_int();
+    }
+    Value value = eval(id);
+    if (value.index() != get_idx(ValueKind::Integer)) {
+      throw SemanticProblemException(message);
+    }
+    return std::get<int>(value);
+  }
+
+  bool typed() const { return !types_.empty(); }
+  bool integer(NodeId id) const {
+    return typed() && types_[id] == pas::sema::ExprType::Integer;
+  }
+  int pop_int() {
+    const int value = ints_.back();
+    ints_.pop_back();
+    return value;
+  }
+  void push_int(NodeId id, int value) {
+    if (integer(id)) {
+      ints_.push_back(value);
+    } else {
+      values_.emplace_back(std::in_place_type<int>, value);
     }
-    case get_idx(pas::ast::FactorKind::Number): {
-      return Value(std::get<int>(factor));
+  }
+  void push(NodeId id, Value value) {
+    if (integer(id)) {
+      ints_.push_back(*std::get_if<int>(&value));
+    } else {
+      values_.push_back(std::move(value));
     }
-    case get_idx(pas::ast::FactorKind::String): {
-      return Value(std::get<std::string>(factor));
+  }
+
+  // Copies of a shared expression are one node, its value is worked
+  //   out once. Pushes the value if it's known.
+  bool push_known(NodeId id, const pas::flat::Expr &expr) {
+    if (constant_values_.empty() || !expr.constant()) {
+      return false;
     }
-    case get_idx(pas::ast::FactorKind::Nil): {
-      throw NotImplementedException("Nil is not supported yet");
+    const std::optional<Value> &value = constant_values_[id];
+    if (!value.has_value()) {
+      return false;
     }
-    case get_idx(pas::ast::FactorKind::FuncCall): {
-      return eval(*std::get<pas::ast::FuncCallUP>(factor));
-      break;
+    push(id, *value);
+    return true;
+  }
+  void remember(NodeId id, const pas::flat::Expr &expr) {
+    if (!constant_values_.empty() && expr.constant()) {
+      constant_values_[id] =
+          integer(id) ? Value(std::in_place_type<int>, ints_.back())
+                      : values_.back();
     }
+  }
 
-    case get_idx(pas::ast::FactorKind::Negation): {
-      Value inner_value = eval(std::get<pas::ast::NegationUP>(factor)->factor_);
-      if (inner_value.index() != 0) {
-        throw SemanticProblemException(
-            "Negation is only applicable to integer type");
-      }
-      return ~std::get<int>(inner_value);
+  bool enter(Tag<ExprKind::Bool>, NodeId id, const pas::flat::Expr &expr) {
+    // No dedicated bool type for now for simplicity
+    //   (I don't have much time, too many things to do).
+    push_int(id, static_cast<int>(expr.value));
+    return false;
+  }
+  bool enter(Tag<ExprKind::Number>, NodeId id, const pas::flat::Expr &expr) {
+    push_int(id, expr.number());
+    return false;
+  }
+  bool enter(Tag<ExprKind::String>, NodeId, const pas::flat::Expr &expr) {
+    values_.emplace_back(std::in_place_type<std::string>,
+                         literals_.bytes(pas::StringLiteral(expr.value)));
+    return false;
+  }
+  bool enter(Tag<ExprKind::Nil>, NodeId, const pas::flat::Expr &) {
+    throw NotImplementedException("Nil is not supported yet");
+  }
+
+  bool enter(Tag<ExprKind::Call>, NodeId id,
+             const pas::flat::Expr &func_call) {
+    auto it = builtin_funcs_.find(tree_.name(func_call));
+    if (it == builtin_funcs_.end()) {
+      throw NotImplementedException(
+          "function calls are not supported yet, except read_char, read_str, "
+          "read_int, strlen, ord, chr");
     }
-    case get_idx(pas::ast::FactorKind::Expr): {
-      Value inner_value = eval(*std::get<pas::ast::ExprUP>(factor));
-      return inner_value;
+    if (!typed()) {
+      return true;
     }
-    case get_idx(pas::ast::FactorKind::Designator): {
-      auto &designator = std::get<pas::ast::Designator>(factor);
-      // TODO: check if item with identifier exists in the first place!!
-      // IMPORTANT!
-      std::variant<std::shared_ptr<Type>, std::shared_ptr<Value>> item =
-          ident_to_item_[designator.ident_];
-      if (item.index() != 1) {
-        throw SemanticProblemException(
-            "designator must reference a value, not a type: " +
-            designator.ident_);
+    // Arguments go to the function as values, of any type.
+    const size_t first = values_.size();
+    for (NodeId argument : tree_.list(func_call.children)) {
+      Value value = eval(argument);
+      values_.push_back(std::move(value));
+    }
+    Value value =
+        (this->*(it->second))(std::span<Value>(values_).subspan(first));
+    values_.resize(first);
+    push(id, std::move(value));
+    return false;
+  }
+  void leave(Tag<ExprKind::Call>, NodeId, const pas::flat::Expr &func_call) {
+    const size_t first = values_.size() - func_call.children.size;
+    Value value = (this->*builtin_funcs_[tree_.name(func_call)])(
+        std::span<Value>(values_).subspan(first));
+    values_.resize(first);
+    values_.push_back(std::move(value));
+  }
+
+  void leave(Tag<ExprKind::Not>, NodeId, const pas::flat::Expr &) {
+    if (typed()) {
+      ints_.back() = ~ints_.back();
+      return;
+    }
+    Value &inner_value = values_.back();
+    if (inner_value.index() != 0) {
+      throw SemanticProblemException(
+          "Negation is only applicable to integer type");
+    }
+    inner_value = ~std::get<int>(inner_value);
+  }
+
+  bool enter(Tag<ExprKind::Designator>, NodeId id,
+             const pas::flat::Expr &expr) {
+    const pas::Symbol name = tree_.name(expr);
+    // A function without parameters is called by its name alone, as
+    //   sema takes it.
+    auto function = ident_to_item_.contains(name) ? builtin_funcs_.end()
+                                                  : builtin_funcs_.find(name);
+    if (function != builtin_funcs_.end()) {
+      Value value = (this->*(function->second))({});
+      if (integer(id)) {
+        ints_.push_back(*std::get_if<int>(&value));
+        return false;
       }
-      Value base_value = *std::get<std::shared_ptr<Value>>(item);
-
-      for (pas::ast::DesignatorItem &item : designator.items_) {
-        switch (item.index()) {
-        case get_idx(pas::ast::DesignatorItemKind::FieldAccess): {
-          throw NotImplementedException("field access is not implemented");
-        }
-        case get_idx(pas::ast::DesignatorItemKind::PointerAccess): {
-          throw NotImplementedException("pointer access is not implemented");
-        }
-        case get_idx(pas::ast::DesignatorItemKind::ArrayAccess): {
-          //          if (base_value.index() != get_idx(ValueKind::Pointer)) {
-          //            throw NotImplementedException(
-          //                "value must be a pointer for array access");
-          //          }
-          if (base_value.index() != get_idx(ValueKind::String)) {
-            throw NotImplementedException(
-                "value must be a string for array access");
-          }
-          pas::ast::DesignatorArrayAccess &array_access =
-              std::get<pas::ast::DesignatorArrayAccess>(item);
-          if (array_access.expr_list_.size() != 1) {
-            throw NotImplementedException(
-                "array access for more than one index is not supported");
-          }
-          Value value_index = eval(*array_access.expr_list_[0]);
-          if (value_index.index() != get_idx(ValueKind::Integer)) {
-            throw SemanticProblemException(
-                "can only do indexing with integer type");
-          }
-          int index = std::get<int>(value_index);
-          auto &value = std::get<std::string>(base_value);
-          if (index < 0 || index >= value.size()) {
-            // Won't be reported if it's a compiler, not an interpreter.
-            //   Only a thing like valgrind or memory sanitizer.
-            throw RuntimeProblemException("index is out of bounds: " +
-                                          std::to_string(index));
-          }
-          base_value = Value(std::in_place_type<char>, value[index]);
-          break;
-        }
-        }
+      values_.push_back(std::move(value));
+      return true;
+    }
+    const Value &value =
+        variable(name, "designator must reference a value, not a type: ");
+    // An Integer designator has no items.
+    if (integer(id)) {
+      ints_.push_back(*std::get_if<int>(&value));
+      return false;
+    }
+    // Items work on the value on top.
+    values_.push_back(value);
+    return true;
+  }
+  bool enter(Tag<ExprKind::Field>, NodeId, const pas::flat::Expr &) {
+    throw NotImplementedException("field access is not implemented");
+  }
+  bool enter(Tag<ExprKind::Deref>, NodeId, const pas::flat::Expr &) {
+    throw NotImplementedException("pointer access is not implemented");
+  }
+  bool enter(Tag<ExprKind::Index>, NodeId, const pas::flat::Expr &item) {
+    //          if (base_value.index() != get_idx(ValueKind::Pointer)) {
+    //            throw NotImplementedException(
+    //                "value must be a pointer for array access");
+    //          }
+    if (typed()) {
+      return true;
+    }
+    if (values_.back().index() != get_idx(ValueKind::String)) {
+      throw NotImplementedException("value must be a string for array access");
+    }
+    if (item.children.size != 1) {
+      throw NotImplementedException(
+          "array access for more than one index is not supported");
+    }
+    return true;
+  }
+  void leave(Tag<ExprKind::Index>, NodeId, const pas::flat::Expr &) {
+    int index = 0;
+    if (typed()) {
+      index = pop_int();
+    } else {
+      Value value_index = std::move(values_.back());
+      values_.pop_back();
+      if (value_index.index() != get_idx(ValueKind::Integer)) {
+        throw SemanticProblemException(
+            "can only do indexing with integer type");
       }
-      return base_value;
+      index = std::get<int>(value_index);
     }
-    default:
-      assert(false);
-      __builtin_unreachable();
+    Value &base_value = values_.back();
+    auto &value = *std::get_if<std::string>(&base_value);
+    if (index < 0 || index >= value.size()) {
+      // Won't be reported if it's a compiler, not an interpreter.
+      //   Only a thing like valgrind or memory sanitizer.
+      throw RuntimeProblemException("index is out of bounds: " +
+                                    std::to_string(index));
     }
+    base_value = Value(std::in_place_type<char>, value[index]);
   }
 
-  Value eval(pas::ast::Term &term) {
-    Value value = eval(term.start_factor_);
-    for (pas::ast::Term::Op &op : term.ops_) {
+  bool enter(Tag<ExprKind::Product>, NodeId id, const pas::flat::Expr &term) {
+    return !push_known(id, term);
+  }
+  void leave(Tag<ExprKind::Product>, NodeId id, const pas::flat::Expr &term) {
+    std::span<const uint32_t> children = tree_.list(term.children);
+    if (typed()) {
+      const size_t first = ints_.size() - (children.size() + 1) / 2;
+      int value = ints_[first];
+      for (size_t i = 1; i < children.size(); i += 2) {
+        value = apply(static_cast<pas::ast::MultOp>(children[i]), value,
+                      ints_[first + (i + 1) / 2]);
+      }
+      ints_.resize(first);
+      ints_.push_back(value);
+      remember(id, term);
+      return;
+    }
+    const size_t first = values_.size() - (children.size() + 1) / 2;
+    Value value = std::move(values_[first]);
+    for (size_t i = 1; i < children.size(); i += 2) {
       if (value.index() != 0) {
         throw SemanticProblemException("can only do math with integer type");
       }
-      Value rhs_value = eval(op.factor);
+      const Value &rhs_value = values_[first + (i + 1) / 2];
       if (rhs_value.index() != 0) {
         throw SemanticProblemException("can only do math with integer type");
       }
-      switch (op.op) {
-      case pas::ast::MultOp::And: {
-        value = std::get<int>(value) & std::get<int>(rhs_value);
-        break;
-      }
-      case pas::ast::MultOp::IntDiv: {
-        value = std::get<int>(value) / std::get<int>(rhs_value);
-        break;
-      }
-      case pas::ast::MultOp::Modulo: {
-        value = std::get<int>(value) % std::get<int>(rhs_value);
-        break;
-      }
-      case pas::ast::MultOp::Multiply: {
-        value = std::get<int>(value) * std::get<int>(rhs_value);
-        break;
-      }
-      case pas::ast::MultOp::RealDiv: {
-        throw NotImplementedException("real numbers are not supported");
-      }
-      default:
-        assert(false);
-        __builtin_unreachable();
-      }
+      value = apply(static_cast<pas::ast::MultOp>(children[i]),
+                    std::get<int>(value), std::get<int>(rhs_value));
+    }
+    values_.resize(first);
+    values_.push_back(std::move(value));
+    remember(id, term);
+  }
+
+  static int apply(pas::ast::MultOp op, int lhs, int rhs) {
+    switch (op) {
+    case pas::ast::MultOp::And:
+      return lhs & rhs;
+    case pas::ast::MultOp::IntDiv:
+      return lhs / rhs;
+    case pas::ast::MultOp::Modulo:
+      return lhs % rhs;
+    case pas::ast::MultOp::Multiply:
+      return lhs * rhs;
+    case pas::ast::MultOp::RealDiv:
+      throw NotImplementedException("real numbers are not supported");
+    default:
+      assert(false);
+      __builtin_unreachable();
     }
-    return value;
   }
 
-  Value eval(pas::ast::SimpleExpr &simple_expr) {
+  bool enter(Tag<ExprKind::Sum>, NodeId id,
+             const pas::flat::Expr &simple_expr) {
+    return !push_known(id, simple_expr);
+  }
+  void leave(Tag<ExprKind::Sum>, NodeId id,
+             const pas::flat::Expr &simple_expr) {
     // NOTE: unary op is ignored for now.
-    Value value = eval(simple_expr.start_term_);
-    for (pas::ast::SimpleExpr::Op &op : simple_expr.ops_) {
+    std::span<const uint32_t> children = tree_.list(simple_expr.children);
+    if (typed()) {
+      const size_t first = ints_.size() - (children.size() + 1) / 2;
+      int value = ints_[first];
+      for (size_t i = 1; i < children.size(); i += 2) {
+        value = apply(static_cast<pas::ast::AddOp>(children[i]), value,
+                      ints_[first + (i + 1) / 2]);
+      }
+      ints_.resize(first);
+      ints_.push_back(value);
+      remember(id, simple_expr);
+      return;
+    }
+    const size_t first = values_.size() - (children.size() + 1) / 2;
+    Value value = std::move(values_[first]);
+    for (size_t i = 1; i < children.size(); i += 2) {
       if (value.index() != 0) {
         throw SemanticProblemException("can only do math with integer type");
       }
-      Value rhs_value = eval(op.term);
+      const Value &rhs_value = values_[first + (i + 1) / 2];
       if (rhs_value.index() != 0) {
         throw SemanticProblemException("can only do math with integer type");
       }
-      switch (op.op) {
-      case pas::ast::AddOp::Plus: {
-        value = std::get<int>(value) + std::get<int>(rhs_value);
-        break;
-      }
-      case pas::ast::AddOp::Minus: {
-        value = std::get<int>(value) - std::get<int>(rhs_value);
-        break;
-      }
-      case pas::ast::AddOp::Or: {
-        value = std::get<int>(value) | std::get<int>(rhs_value);
-        break;
-      }
-      default:
-        assert(false);
-        __builtin_unreachable();
-      }
+      value = apply(static_cast<pas::ast::AddOp>(children[i]),
+                    std::get<int>(value), std::get<int>(rhs_value));
     }
-    return value;
+    values_.resize(first);
+    values_.push_back(std::move(value));
+    remember(id, simple_expr);
   }
 
-  Value eval(pas::ast::Expr &expr) {
-    Value value = eval(expr.start_expr_);
-    if (expr.op_.has_value()) {
-      pas::ast::Expr::Op &op = expr.op_.value();
-      switch (op.rel) {
-      case pas::ast::RelOp::Equal: {
-        Value rhs_value = eval(op.expr);
-        return Value(std::in_place_type<int>, value == rhs_value);
-      }
-      case pas::ast::RelOp::GreaterEqual: {
-        Value rhs_value = eval(op.expr);
-        return Value(std::in_place_type<int>, value >= rhs_value);
-      }
-      case pas::ast::RelOp::Greater: {
-        Value rhs_value = eval(op.expr);
-        return Value(std::in_place_type<int>, value > rhs_value);
-      }
-      case pas::ast::RelOp::LessEqual: {
-        Value rhs_value = eval(op.expr);
-        return Value(std::in_place_type<int>, value <= rhs_value);
-      }
-      case pas::ast::RelOp::Less: {
-        Value rhs_value = eval(op.expr);
-        return Value(std::in_place_type<int>, value < rhs_value);
-      }
-      case pas::ast::RelOp::NotEqual: {
-        Value rhs_value = eval(op.expr);
-        return Value(std::in_place_type<int>, value != rhs_value);
-      }
-      case pas::ast::RelOp::In: {
-        throw NotImplementedException("relation \"in\" is not supported");
-      }
-      default:
-        assert(false);
-        __builtin_unreachable();
-      }
+  static int apply(pas::ast::AddOp op, int lhs, int rhs) {
+    switch (op) {
+    case pas::ast::AddOp::Plus:
+      return lhs + rhs;
+    case pas::ast::AddOp::Minus:
+      return lhs - rhs;
+    case pas::ast::AddOp::Or:
+      return lhs | rhs;
+    default:
+      assert(false);
+      __builtin_unreachable();
     }
-    return value;
   }
 
-  void visit(pas::ast::MemoryStmt &memory_stmt) {}
-  void visit(pas::ast::RepeatStmt &repeat_stmt) {}
-  void visit(pas::ast::CaseStmt &case_stmt) {}
-
-  void visit(pas::ast::StmtSeq &stmt_seq) {
-    for (pas::ast::Stmt &stmt : stmt_seq.stmts_) {
-      visit_stmt(*this, stmt);
+  bool enter(Tag<ExprKind::Relation>, NodeId id, const pas::flat::Expr &expr) {
+    return !push_known(id, expr);
+  }
+  void leave(Tag<ExprKind::Relation>, NodeId id, const pas::flat::Expr &expr) {
+    const auto op = static_cast<pas::ast::RelOp>(expr.op);
+    if (integer(tree_.list(expr.children)[0])) {
+      const int rhs = pop_int();
+      ints_.back() = compare(op, ints_.back(), rhs);
+      remember(id, expr);
+      return;
     }
+    Value rhs_value = std::move(values_.back());
+    values_.pop_back();
+    if (typed()) {
+      Value value = std::move(values_.back());
+      values_.pop_back();
+      ints_.push_back(compare(op, value, rhs_value));
+    } else {
+      Value &value = values_.back();
+      value = Value(std::in_place_type<int>, compare(op, value, rhs_value));
+    }
+    remember(id, expr);
   }
 
-  void visit(pas::ast::IfStmt &if_stmt) {
-    Value value = eval(if_stmt.cond_expr_);
-    if (value.index() != get_idx(ValueKind::Integer)) {
-      throw SemanticProblemException("condition must evaluate to Integer");
-    }
-    if (std::get<int>(value) != 0) {
-      visit_stmt(*this, if_stmt.then_stmt_);
-    } else if (if_stmt.else_stmt_.has_value()) {
-      visit_stmt(*this, if_stmt.else_stmt_.value());
+  template <typename T>
+  static int compare(pas::ast::RelOp op, const T &lhs, const T &rhs) {
+    switch (op) {
+    case pas::ast::RelOp::Equal:
+      return lhs == rhs;
+    case pas::ast::RelOp::GreaterEqual:
+      return lhs >= rhs;
+    case pas::ast::RelOp::Greater:
+      return lhs > rhs;
+    case pas::ast::RelOp::LessEqual:
+      return lhs <= rhs;
+    case pas::ast::RelOp::Less:
+      return lhs < rhs;
+    case pas::ast::RelOp::NotEqual:
+      return lhs != rhs;
+    case pas::ast::RelOp::In:
+      throw NotImplementedException("relation \"in\" is not supported");
+    default:
+      assert(false);
+      __builtin_unreachable();
     }
   }
 
-  void visit(pas::ast::EmptyStmt &empty_stmt) {}
+  // Statements are run by a walk too. Their exprs are not walked as
+  //   children, the hooks evaluate them; next picks the branch of an
+  //   if and walks loop bodies again.
+  bool enter(Tag<NodeClass::Declarations>, NodeId,
+             const pas::flat::Block &block) {
+    process_decls(block.decls);
+    return false;
+  }
 
-  void visit(pas::ast::ForStmt &for_stmt) {
-    Value start_value = eval(for_stmt.start_val_expr_);
-    Value end_value = eval(for_stmt.finish_val_expr_);
+  bool enter(Tag<StmtKind::Assignment>, NodeId, const pas::flat::Stmt &stmt) {
+    std::span<const uint32_t> children = tree_.list(stmt.children);
+    visit_assignment(children[0], children[1]);
+    return false;
+  }
+  bool enter(Tag<StmtKind::ProcCall>, NodeId, const pas::flat::Stmt &stmt) {
+    visit_proc_call(stmt);
+    return false;
+  }
+  bool enter(Tag<StmtKind::Case>, NodeId, const pas::flat::Stmt &) {
+    return false;
+  }
+  bool enter(Tag<StmtKind::Repeat>, NodeId, const pas::flat::Stmt &) {
+    return false;
+  }
 
-    if (start_value.index() != get_idx(ValueKind::Integer) ||
-        end_value.index() != get_idx(ValueKind::Integer)) {
-      throw SemanticProblemException(
-          "expressions in for statement must evaluate to int");
+  // Children: condition, then, [else].
+  uint32_t next(Tag<StmtKind::If>, NodeId, const pas::flat::Stmt &stmt,
+                uint32_t done) {
+    if (done != pas::flat::NO_CHILD) {
+      return pas::flat::NO_CHILD;
+    }
+    if (eval_int(tree_.list(stmt.children)[0],
+                 "condition must evaluate to Integer") != 0) {
+      return 1;
     }
+    return stmt.children.size > 2 ? 2 : pas::flat::NO_CHILD;
+  }
+
+  // Children: condition, body.
+  uint32_t next(Tag<StmtKind::While>, NodeId, const pas::flat::Stmt &stmt,
+                uint32_t) {
+    return eval_int(tree_.list(stmt.children)[0],
+                    "condition expression in while statement must evaluate "
+                    "to int") != 0
+               ? 1
+               : pas::flat::NO_CHILD;
+  }
 
-    int start_index = std::get<int>(start_value);
-    int end_index = std::get<int>(end_value);
+  // Children: start, finish, body. The counter of each for being run is
+  //   on for_loops_.
+  bool enter(Tag<StmtKind::For>, NodeId, const pas::flat::Stmt &for_stmt) {
+    std::span<const uint32_t> children = tree_.list(for_stmt.children);
+    const char *message = "expressions in for statement must evaluate to int";
+    int start_index = eval_int(children[0], message);
+    int end_index = eval_int(children[1], message);
 
-    if (ident_to_item_.contains(for_stmt.ident_)) {
+    const pas::Symbol ident = tree_.name(for_stmt);
+    if (ident_to_item_.contains(ident)) {
       throw SemanticProblemException("identifier is already in use: " +
-                                     for_stmt.ident_);
+                                     std::string(ident.spelling()));
     }
     std::shared_ptr<Value> counter =
         std::make_shared<Value>(std::in_place_type<int>, start_index);
-    ident_to_item_[for_stmt.ident_] = counter;
-
-    switch (for_stmt.dir_) {
-    case pas::ast::WhichWay::To: {
-      for (int i = start_index; i <= end_index; ++i) {
-        visit_stmt(*this, for_stmt.inner_stmt_);
-        std::get<int>(*counter) += 1;
-      }
-      break;
-    }
-    case pas::ast::WhichWay::DownTo: {
-      for (int i = start_index; i >= end_index; --i) {
-        visit_stmt(*this, for_stmt.inner_stmt_);
-        std::get<int>(*counter) -= 1;
-      }
-      break;
-    }
-    }
-
-    ident_to_item_.erase(for_stmt.ident_);
+    ident_to_item_[ident] = counter;
+    for_loops_.push_back(ForLoop{std::move(counter), start_index, end_index});
+    return true;
+  }
+  uint32_t next(Tag<StmtKind::For>, NodeId, const pas::flat::Stmt &for_stmt,
+                uint32_t done) {
+    ForLoop &loop = for_loops_.back();
+    const int step =
+        static_cast<pas::ast::WhichWay>(for_stmt.op) == pas::ast::WhichWay::To
+            ? 1
+            : -1;
+    if (done != pas::flat::NO_CHILD) {
+      loop.index += step;
+      *std::get_if<int>(loop.counter.get()) += step;
+    }
+    const bool more =
+        step > 0 ? loop.index <= loop.end : loop.index >= loop.end;
+    return more ? 2 : pas::flat::NO_CHILD;
+  }
+  void leave(Tag<StmtKind::For>, NodeId, const pas::flat::Stmt &for_stmt) {
+    for_loops_.pop_back();
+    ident_to_item_.erase(tree_.name(for_stmt));
   }
 
-  void visit(pas::ast::WhileStmt &while_stmt) {
-    Value value = eval(while_stmt.cond_expr_);
-    if (value.index() != get_idx(ValueKind::Integer)) {
-      throw SemanticProblemException(
-          "condition expression in while statement must evaluate to int");
-    }
-
-    if (std::get<int>(value) == 0) {
+  void visit_assignment(NodeId designator_id, NodeId expr) {
+    if (integer(designator_id)) {
+      const int new_value = eval_int(
+          expr, "incompatible types, must be of the same type for assignment");
+      Value &value =
+          variable(tree_.name(tree_.expr(designator_id)),
+                   "assignment must reference a value, not a type: ");
+      *std::get_if<int>(&value) = new_value;
       return;
     }
 
-    do {
-      visit_stmt(*this, while_stmt.inner_stmt_);
-    } while (std::get<int>(eval(while_stmt.cond_expr_)) != 0);
-  }
-
-  void visit(pas::ast::Assignment &assignment) {
-    Value new_value = eval(assignment.expr_);
-    pas::ast::Designator &designator = assignment.designator_;
+    Value new_value = eval(expr);
+    const pas::flat::Expr &designator = tree_.expr(designator_id);
+    const pas::Symbol ident = tree_.name(designator);
 
-    if (!ident_to_item_.contains(designator.ident_)) {
+    if (!ident_to_item_.contains(ident)) {
       throw SemanticProblemException(
           "assignment references an undeclared identifier: " +
-          designator.ident_);
+          std::string(ident.spelling()));
     }
 
     std::variant<std::shared_ptr<Type>, std::shared_ptr<Value>> item =
-        ident_to_item_[designator.ident_];
+        ident_to_item_[ident];
     if (item.index() != 1) {
       throw SemanticProblemException(
           "assignment must reference a value, not a type: " +
-          designator.ident_);
+          std::string(ident.spelling()));
     }
     auto value = std::get<std::shared_ptr<Value>>(item);
 
-    if (!designator.items_.empty()) {
+    std::span<const uint32_t> items = tree_.list(designator.children);
+    if (!items.empty()) {
 
       if (value->index() != get_idx(ValueKind::String)) {
         throw SemanticProblemException(
             "pointer and array access are only allowed for strings");
       }
 
-      if (designator.items_.size() >= 2) {
+      if (items.size() >= 2) {
         throw SemanticProblemException(
             "a string may have only one array access in assignment");
       }
 
-      if (designator.items_[0].index() !=
-          get_idx(pas::ast::DesignatorItemKind::ArrayAccess)) {
+      const pas::flat::Expr &array_access = tree_.expr(items[0]);
+      if (array_access.kind != ExprKind::Index) {
         throw SemanticProblemException(
             "only direct and array accesses are supported in assignment");
       }
 
-      auto &array_access =
-          std::get<pas::ast::DesignatorArrayAccess>(designator.items_[0]);
-
-      if (array_access.expr_list_.size() >= 2) {
+      std::span<const uint32_t> indices = tree_.list(array_access.children);
+      if (indices.size() >= 2) {
         throw NotImplementedException(
             "array access for more than one index is not supported");
       }
 
-      Value value_index = eval(*array_access.expr_list_[0]);
+      Value value_index = eval(indices[0]);
       if (value_index.index() != get_idx(ValueKind::Integer)) {
         throw SemanticProblemException(
             "can only do indexing with integer type");
@@ -935,8 +682,18 @@ private:
     *value = new_value; // Copy assign a new value.
   }
 
-  Value eval_read_char(pas::ast::FuncCall &func_call) {
-    if (!func_call.params_.empty()) {
+  // Value of a variable, message and the name are thrown if there's none.
+  Value &variable(pas::Symbol ident, const char *message) {
+    auto it = ident_to_item_.find(ident);
+    if (it == ident_to_item_.end() || it->second.index() != 1) {
+      throw SemanticProblemException(message +
+                                     std::string(ident.spelling()));
+    }
+    return **std::get_if<std::shared_ptr<Value>>(&it->second);
+  }
+
+  Value eval_read_char(std::span<Value> args) {
+    if (!args.empty()) {
       throw SemanticProblemException(
           "function read_char doesn't accept parameters");
     }
@@ -945,8 +702,8 @@ private:
     return Value(std::in_place_type<char>, chr);
   }
 
-  Value eval_read_str(pas::ast::FuncCall &func_call) {
-    if (!func_call.params_.empty()) {
+  Value eval_read_str(std::span<Value> args) {
+    if (!args.empty()) {
       throw SemanticProblemException(
           "function read_str doesn't accept parameters");
     }
@@ -955,8 +712,8 @@ private:
     return Value(std::in_place_type<std::string>, str);
   }
 
-  Value eval_read_int(pas::ast::FuncCall &func_call) {
-    if (!func_call.params_.empty()) {
+  Value eval_read_int(std::span<Value> args) {
+    if (!args.empty()) {
       throw SemanticProblemException(
           "function read_int doesn't accept parameters");
     }
@@ -965,13 +722,13 @@ private:
     return Value(std::in_place_type<int>, value);
   }
 
-  Value eval_strlen(pas::ast::FuncCall &func_call) {
-    if (func_call.params_.size() != 1) {
+  Value eval_strlen(std::span<Value> args) {
+    if (args.size() != 1) {
       throw SemanticProblemException(
           "function strlen accepts only one parameter of type String");
     }
 
-    Value arg = eval(func_call.params_[0]);
+    Value &arg = args[0];
 
     if (arg.index() != get_idx(ValueKind::String)) {
       throw SemanticProblemException(
@@ -988,13 +745,13 @@ private:
     return Value(std::in_place_type<int>, static_cast<int>(str.size()));
   }
 
-  Value eval_ord(pas::ast::FuncCall &func_call) {
-    if (func_call.params_.size() != 1) {
+  Value eval_ord(std::span<Value> args) {
+    if (args.size() != 1) {
       throw SemanticProblemException("function ord accepts only one parameter "
                                      "of type Char or String (of length 1)");
     }
 
-    Value arg = eval(func_call.params_[0]);
+    Value &arg = args[0];
 
     if (arg.index() != get_idx(ValueKind::Char) &&
         arg.index() != get_idx(ValueKind::String)) {
@@ -1018,13 +775,13 @@ private:
     return Value(std::in_place_type<int>, static_cast<int>(chr));
   }
 
-  Value eval_chr(pas::ast::FuncCall &func_call) {
-    if (func_call.params_.size() != 1) {
+  Value eval_chr(std::span<Value> args) {
+    if (args.size() != 1) {
       throw SemanticProblemException(
           "function chr accepts only one parameter of type Int");
     }
 
-    Value arg = eval(func_call.params_[0]);
+    Value &arg = args[0];
 
     if (arg.index() != get_idx(ValueKind::Integer)) {
       throw SemanticProblemException(
@@ -1041,35 +798,13 @@ private:
     return Value(std::in_place_type<char>, static_cast<char>(chr_code));
   }
 
-  Value eval(pas::ast::FuncCall &func_call) {
-    const std::string &func_name = func_call.func_ident_;
-
-    if (func_name == "read_char") {
-      return eval_read_char(func_call);
-    } else if (func_name == "read_str") {
-      return eval_read_str(func_call);
-    } else if (func_name == "read_int") {
-      return eval_read_int(func_call);
-    } else if (func_name == "strlen") {
-      return eval_strlen(func_call);
-    } else if (func_name == "ord") {
-      return eval_ord(func_call);
-    } else if (func_name == "chr") {
-      return eval_chr(func_call);
-    } else {
-      throw NotImplementedException(
-          "function calls are not supported yet, except read_char, read_str, "
-          "read_int, strlen, ord, chr");
-    }
-  }
-
-  void visit_write_char(pas::ast::ProcCall &proc_call) {
-    if (proc_call.params_.size() != 1) {
+  void visit_write_char(const pas::flat::Stmt &proc_call) {
+    if (tree_.list(proc_call.children).size() != 1) {
       throw SemanticProblemException(
           "procedure write_char accepts only one parameter of type Char");
     }
 
-    Value arg = eval(proc_call.params_[0]);
+    Value arg = eval(tree_.list(proc_call.children)[0]);
 
     if (arg.index() != get_idx(ValueKind::Char)) {
       throw SemanticProblemException(
@@ -1079,13 +814,13 @@ private:
     std::cout << std::get<char>(arg);
   }
 
-  void visit_write_str(pas::ast::ProcCall &proc_call) {
-    if (proc_call.params_.size() != 1) {
+  void visit_write_str(const pas::flat::Stmt &proc_call) {
+    if (tree_.list(proc_call.children).size() != 1) {
       throw SemanticProblemException(
           "procedure write_str accepts only one parameter of type String");
     }
 
-    Value arg = eval(proc_call.params_[0]);
+    Value arg = eval(tree_.list(proc_call.children)[0]);
 
     if (arg.index() != get_idx(ValueKind::String)) {
       throw SemanticProblemException(
@@ -1095,13 +830,13 @@ private:
     std::cout << std::get<std::string>(arg);
   }
 
-  void visit_write_int(pas::ast::ProcCall &proc_call) {
-    if (proc_call.params_.size() != 1) {
+  void visit_write_int(const pas::flat::Stmt &proc_call) {
+    if (tree_.list(proc_call.children).size() != 1) {
       throw SemanticProblemException(
           "procedure write_int accepts only one parameter of type Integer");
     }
 
-    Value arg = eval(proc_call.params_[0]);
+    Value arg = eval(tree_.list(proc_call.children)[0]);
 
     if (arg.index() != get_idx(ValueKind::Integer)) {
       throw SemanticProblemException(
@@ -1111,33 +846,27 @@ private:
     std::cout << std::get<int>(arg);
   }
 
-  Value &eval_ref(pas::ast::Expr &expr) {
-    if (expr.op_.has_value()) {
-      throw SemanticProblemException("expected identifier, not an operation");
-    }
-    pas::ast::SimpleExpr &simple_expr = expr.start_expr_;
-    if (!simple_expr.ops_.empty() || simple_expr.unary_op_.has_value()) {
-      throw SemanticProblemException("expected identifier, not an operation");
-    }
-    pas::ast::Term &term = simple_expr.start_term_;
-    if (!term.ops_.empty()) {
+  Value &eval_ref(NodeId id) {
+    const pas::flat::Expr &designator = tree_.expr(id);
+    if (designator.kind == ExprKind::Relation ||
+        designator.kind == ExprKind::Sum ||
+        designator.kind == ExprKind::Product) {
       throw SemanticProblemException("expected identifier, not an operation");
     }
-    pas::ast::Factor &factor = term.start_factor_;
-    if (factor.index() != get_idx(pas::ast::FactorKind::Designator)) {
+    if (designator.kind != ExprKind::Designator) {
       throw SemanticProblemException("expected identifier, not an expression");
     }
 
-    pas::ast::Designator &designator = std::get<pas::ast::Designator>(factor);
-    if (!designator.items_.empty()) {
+    if (!tree_.list(designator.children).empty()) {
       // Array access is not supported for now in value reference evaluation.
       throw SemanticProblemException(
           "unexpected array access, expected an identifier");
     }
 
-    std::string &ident = designator.ident_;
+    pas::ast::Ident ident = tree_.name(designator);
     if (!ident_to_item_.contains(ident)) {
-      throw SemanticProblemException("reference to undeclared " + ident);
+      throw SemanticProblemException("reference to undeclared " +
+                                     std::string(ident.spelling()));
     }
     std::variant<std::shared_ptr<Type>, std::shared_ptr<Value>> item =
         ident_to_item_[ident];
@@ -1148,14 +877,14 @@ private:
     return *std::get<std::shared_ptr<Value>>(item);
   }
 
-  void visit_append(pas::ast::ProcCall &proc_call) {
-    if (proc_call.params_.size() != 2) {
+  void visit_append(const pas::flat::Stmt &proc_call) {
+    if (tree_.list(proc_call.children).size() != 2) {
       throw SemanticProblemException(
           "procedure append accepts only two parameters: String, Ch`ar");
     }
 
-    Value &dst_arg = eval_ref(proc_call.params_[0]);
-    Value src_arg = eval(proc_call.params_[1]);
+    Value &dst_arg = eval_ref(tree_.list(proc_call.children)[0]);
+    Value src_arg = eval(tree_.list(proc_call.children)[1]);
 
     if (dst_arg.index() != get_idx(ValueKind::String)) {
       throw SemanticProblemException(
@@ -1176,13 +905,13 @@ private:
     }
   }
 
-  void visit_drop(pas::ast::ProcCall &proc_call) {
-    if (proc_call.params_.size() != 1) {
+  void visit_drop(const pas::flat::Stmt &proc_call) {
+    if (tree_.list(proc_call.children).size() != 1) {
       throw SemanticProblemException(
           "procedure drop accepts only one parameter: String");
     }
 
-    Value &str_arg = eval_ref(proc_call.params_[0]);
+    Value &str_arg = eval_ref(tree_.list(proc_call.children)[0]);
 
     if (str_arg.index() != get_idx(ValueKind::String)) {
       throw SemanticProblemException(
@@ -1192,26 +921,17 @@ private:
     std::get<std::string>(str_arg).pop_back();
   }
 
-  void visit(pas::ast::ProcCall &proc_call) {
-    const std::string &proc_name = proc_call.proc_ident_;
-
-    //      std::cerr << "ProcCall proc_name = " << proc_name << std::endl;
-
-    if (proc_name == "write_char") {
-      visit_write_char(proc_call);
-    } else if (proc_name == "write_str") {
-      visit_write_str(proc_call);
-    } else if (proc_name == "write_int") {
-      visit_write_int(proc_call);
-    } else if (proc_name == "append") {
-      visit_append(proc_call);
-    } else if (proc_name == "drop") {
-      visit_drop(proc_call);
-    } else {
+  void visit_proc_call(const pas::flat::Stmt &proc_call) {
+    //      std::cerr << "ProcCall proc_name = " << proc_call.proc_ident_ <<
+    //      std::endl;
+
+    auto it = builtin_procs_.find(tree_.name(proc_call));
+    if (it == builtin_procs_.end()) {
       throw NotImplementedException(
           "procedure calls are not supported yet, except write_char, "
           "write_str, write_int, append, drop");
     }
+    (this->*(it->second))(proc_call);
   }
 
   // ProcCall для scanf, printf.
@@ -1219,21 +939,22 @@ private:
   // FuncCall разрешить только для scanf, printf. У scanf всегда два аргумента,
   // у printf -- один или два.
 
-  void process_type_def(const pas::ast::TypeDef &type_def) {
-    size_t type_index = type_def.type_.index();
-    switch (type_index) {
-    case get_idx(pas::ast::TypeKind::Array):
-    case get_idx(pas::ast::TypeKind::Record):
-    case get_idx(pas::ast::TypeKind::Set): {
+  void process_type_def(const pas::flat::Decl &type_def) {
+    const pas::flat::Type &type =
+        tree_.type(tree_.list(type_def.children)[0]);
+    switch (type.kind) {
+    case pas::flat::TypeKind::Array:
+    case pas::flat::TypeKind::Record:
+    case pas::flat::TypeKind::Set: {
       throw NotImplementedException(
           "only pointer types, basic types (Integer, Char) and their synonims "
           "are supported for now");
     }
       //    case get_idx(pas::ast::TypeKind::Pointer): {
-      //      if (ident_to_item_.contains(type_def.ident_)) {
+      //      if (ident_to_item_.contains(type_def.name())) {
       //        throw SemanticProblemException("identifier is already in use: "
       //        +
-      //                                       type_def.ident_);
+      //                                       type_def.name());
       //      }
       //      const auto &ptr_type_up =
       //          std::get<pas::ast::PointerTypeUP>(type_def.type_);
@@ -1257,38 +978,36 @@ private:
       //      new_item =
       //          std::variant<std::shared_ptr<Type>, std::shared_ptr<Value>>(
       //              std::move(new_type_item));
-      //      ident_to_item_[type_def.ident_] = new_item;
+      //      ident_to_item_[type_def.name()] = new_item;
       //      break;
       //    }
-    case get_idx(pas::ast::TypeKind::Pointer): {
+    case pas::flat::TypeKind::Pointer: {
       throw NotImplementedException("pointer types are not supported now");
     }
-    case get_idx(pas::ast::TypeKind::Named): {
-      if (ident_to_item_.contains(type_def.ident_)) {
-        throw SemanticProblemException("identifier is already in use: " +
-                                       type_def.ident_);
+    case pas::flat::TypeKind::Named: {
+      if (ident_to_item_.contains(tree_.name(type_def))) {
+        throw SemanticProblemException(
+            "identifier is already in use: " +
+            std::string(tree_.name(type_def).spelling()));
       }
-      const auto &named_type_up =
-          std::get<pas::ast::NamedTypeUP>(type_def.type_);
-      const pas::ast::NamedType &named_type = *named_type_up;
-      if (!ident_to_item_.contains(named_type.type_name_)) {
+      if (!ident_to_item_.contains(tree_.name(type))) {
         throw SemanticProblemException(
             "named type references an undeclared identifier: " +
-            named_type.type_name_);
+            std::string(tree_.name(type).spelling()));
       }
       std::variant<std::shared_ptr<Type>, std::shared_ptr<Value>> item =
-          ident_to_item_[named_type.type_name_];
+          ident_to_item_[tree_.name(type)];
       if (item.index() != 0) {
         throw SemanticProblemException(
             "named type must reference a type, not a value: " +
-            named_type.type_name_);
+            std::string(tree_.name(type).spelling()));
       }
       auto type_item = std::get<std::shared_ptr<Type>>(item);
       auto new_type_item = type_item;
       auto new_item =
           std::variant<std::shared_ptr<Type>, std::shared_ptr<Value>>(
               std::move(new_type_item));
-      ident_to_item_[type_def.ident_] = new_item;
+      ident_to_item_[tree_.name(type_def)] = new_item;
       break;
     }
     default:
@@ -1301,19 +1020,18 @@ private:
   //   this function is before Type declaration (using in private section).
   //   Inside of this function, all declarations are already processed
   //   and the body is already a definition.
-  std::shared_ptr<Type> make_var_decl_type(const pas::ast::Type &type) {
-    size_t type_index = type.index();
-    switch (type_index) {
-    case get_idx(pas::ast::TypeKind::Array):
-    case get_idx(pas::ast::TypeKind::Record):
-    case get_idx(pas::ast::TypeKind::Set): {
+  std::shared_ptr<Type> make_var_decl_type(const pas::flat::Type &type) {
+    switch (type.kind) {
+    case pas::flat::TypeKind::Array:
+    case pas::flat::TypeKind::Record:
+    case pas::flat::TypeKind::Set: {
       //      throw NotImplementedException(
       //          "only pointer types, basic types (Integer, Char) and their
       //          synonims " "are supported for now");
       throw NotImplementedException(
           "only basic types (Integer, Char) and strings are supported for now");
     }
-    case get_idx(pas::ast::TypeKind::Pointer): {
+    case pas::flat::TypeKind::Pointer: {
       throw NotImplementedException("pointer types are not supported now");
     }
 
@@ -1338,20 +1056,18 @@ private:
       //      new_type_item = std::make_shared<Type>(pointer_type); return
       //      new_type_item; break;
       //    }
-    case get_idx(pas::ast::TypeKind::Named): {
-      const auto &named_type_up = std::get<pas::ast::NamedTypeUP>(type);
-      const pas::ast::NamedType &named_type = *named_type_up;
-      if (!ident_to_item_.contains(named_type.type_name_)) {
+    case pas::flat::TypeKind::Named: {
+      if (!ident_to_item_.contains(tree_.name(type))) {
         throw SemanticProblemException(
             "named type references an undeclared identifier: " +
-            named_type.type_name_);
+            std::string(tree_.name(type).spelling()));
       }
       std::variant<std::shared_ptr<Type>, std::shared_ptr<Value>> item =
-          ident_to_item_[named_type.type_name_];
+          ident_to_item_[tree_.name(type)];
       if (item.index() != 0) {
         throw SemanticProblemException(
             "named type must reference a type, not a value: " +
-            named_type.type_name_);
+            std::string(tree_.name(type).spelling()));
       }
       auto type_item = std::get<std::shared_ptr<Type>>(item);
       return type_item;
@@ -1393,12 +1109,14 @@ private:
     }
   }
 
-  void process_var_decl(const pas::ast::VarDecl &var_decl) {
-    std::shared_ptr<Type> var_type = make_var_decl_type(var_decl.type_);
-    for (const std::string &ident : var_decl.ident_list_) {
+  void process_var_decl(const pas::flat::Decl &var_decl) {
+    std::shared_ptr<Type> var_type =
+        make_var_decl_type(tree_.type(var_decl.value));
+    for (uint32_t name : tree_.list(var_decl.children)) {
+      const pas::ast::Ident ident = tree_.symbol(name);
       if (ident_to_item_.contains(ident)) {
         throw SemanticProblemException("identifier is already in use: " +
-                                       ident);
+                                       std::string(ident.spelling()));
       }
       std::shared_ptr<Value> value = make_uninit_value_of_type(var_type);
       ident_to_item_[ident] = value;
@@ -1406,9 +1124,34 @@ private:
   }
 
 private:
+  const pas::flat::Tree &tree_;
+  const pas::LiteralPool &literals_;
+  // Types of the exprs by id, empty if the program was not checked.
+  std::span<const pas::sema::ExprType> types_;
   std::unordered_map<
-      std::string, std::variant<std::shared_ptr<Type>, std::shared_ptr<Value>>>
+      pas::ast::Ident,
+      std::variant<std::shared_ptr<Type>, std::shared_ptr<Value>>>
       ident_to_item_;
+  // Built-in functions get the values of their arguments.
+  std::unordered_map<pas::ast::Ident, Value (Interpreter::*)(std::span<Value>)>
+      builtin_funcs_;
+  std::unordered_map<pas::ast::Ident,
+                     void (Interpreter::*)(const pas::flat::Stmt &)>
+      builtin_procs_;
+  // Values of constant operator exprs by id, kept if exprs are shared.
+  std::vector<std::optional<Value>> constant_values_;
+
+  // Values of the exprs being evaluated, operands before operators.
+  std::vector<Value> values_;
+  // Values of the Integer exprs being evaluated, if there are types.
+  std::vector<int> ints_;
+  struct ForLoop {
+    std::shared_ptr<Value> counter;
+    int index;
+    int end;
+  };
+  std::vector<ForLoop> for_loops_;
+  pas::flat::Walker<Interpreter> walker_;
 };
 
 } // namespace visitor